@@ -0,0 +1,61 @@
+//===--- aho_corasick_benchmark.cc - AhoCorasick benchmarks -----*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/aho_corasick_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/aho_corasick.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(AhoCorasickBenchmark, Scan) {
+  constexpr static int kKeywords = 100000;
+  constexpr static std::size_t kMaxKeyword = 12;
+  std::mt19937 random(7);
+  auto randomWord = [&random](std::size_t length) {
+    std::string word(length, 'a');
+    for (auto &letter : word) {
+      letter = static_cast<char>('a' + random() % 26);
+    }
+    return word;
+  };
+  Trie<int> trie;
+  for (int i = 0; i < kKeywords; ++i) {
+    (void)trie.Insert(randomWord(4 + random() % (kMaxKeyword - 3)), i);
+  }
+  std::string text;
+  while (text.size() < (1 << 22)) {
+    text += randomWord(1 + random() % 10);
+    text += ' ';
+  }
+  auto automaton = AhoCorasick<int>::Compile(trie);
+
+  // what we do today: one walk per starting offset.
+  long probed = 0;
+  auto probeTime = TestWithTimeMileS([&]() {
+    for (std::size_t begin = 0; begin < text.size(); ++begin) {
+      auto window = std::string_view(text).substr(begin, kMaxKeyword);
+      probed += trie.VisitPrefixes(window, [](std::string_view, int) {});
+    }
+  });
+  long scanned = 0;
+  auto scanTime = TestWithTimeMileS([&]() {
+    scanned = automaton.Scan(text, [](std::string_view, const int &) {});
+  });
+  std::cout << "per offset " << probeTime.count() << "ms, automaton "
+            << scanTime.count() << "ms, " << scanned << " matches"
+            << std::endl;
+  EXPECT_EQ(scanned, probed);
+}
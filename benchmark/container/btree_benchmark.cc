@@ -0,0 +1,111 @@
+//===--- btree_benchmark.cc - btree_set benchmarks --------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/btree_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/set.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+/// bytes handed out by CountingAllocator, of any type.
+std::size_t allocated = 0;
+
+/// std::allocator that adds up the bytes it hands out.
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U> &) {} // NOLINT
+
+  auto
+  allocate(std::size_t count) -> T * {
+    allocated += count * sizeof(T);
+    return std::allocator<T>().allocate(count);
+  }
+
+  void
+  deallocate(T *ptr, std::size_t count) {
+    allocated -= count * sizeof(T);
+    std::allocator<T>().deallocate(ptr, count);
+  }
+
+  friend auto
+  operator==(const CountingAllocator &, const CountingAllocator &) -> bool {
+    return true;
+  }
+
+  friend auto
+  operator!=(const CountingAllocator &, const CountingAllocator &) -> bool {
+    return false;
+  }
+};
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(BTreeBenchmark, SetAgainstStdSet) {
+  constexpr static int kKeys = 1 << 21;
+  constexpr static int kScans = 1 << 16;
+  constexpr static int kScanLength = 100;
+  std::mt19937 random(3);
+  std::vector<int> keys(kKeys);
+  for (auto &key : keys) {
+    key = static_cast<int>(random());
+  }
+
+  auto run = [&](auto &set, const char *name) {
+    allocated = 0;
+    auto insertTime = TestWithTimeMileS([&]() {
+      for (auto key : keys) {
+        set.insert(key);
+      }
+    });
+    auto bytes = allocated;
+    std::uint64_t sum = 0;
+    auto findTime = TestWithTimeMileS([&]() {
+      for (auto key : keys) {
+        sum += *set.find(key);
+      }
+    });
+    // range queries: the 100 keys from a random one on.
+    auto scanTime = TestWithTimeMileS([&]() {
+      for (int scan = 0; scan < kScans; ++scan) {
+        auto iter = set.lower_bound(keys[scan]);
+        for (int i = 0; i < kScanLength && iter != set.end(); ++i, ++iter) {
+          sum += *iter;
+        }
+      }
+      for (auto key : set) {
+        sum += key;
+      }
+    });
+    std::cout << name << ": " << bytes / set.size() << " bytes a key, insert "
+              << insertTime.count() << "ms, find " << findTime.count()
+              << "ms, scan " << scanTime.count() << "ms (" << sum << ")"
+              << std::endl;
+    return bytes;
+  };
+  std::set<int, std::less<int>, CountingAllocator<int>> rbtree;
+  auto rbBytes = run(rbtree, "std::set");
+  set<int, std::less<int>, CountingAllocator<int>> btree;
+  auto bBytes = run(btree, "btree_set");
+  EXPECT_LT(bBytes, rbBytes);
+}
@@ -0,0 +1,85 @@
+//===--- concurrent_hash_map_benchmark.cc - concurrent_hash_map benchmarks ===//
+// cdi 2023
+//
+// Identification: benchmark/container/concurrent_hash_map_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/concurrent_hash_map.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(ConcurrentHashMapBenchmark, Scaling) {
+  constexpr static int kKeys = 1 << 16;
+  constexpr static int kOpsPerThread = 1 << 19;
+  auto cores = std::max(1U, std::thread::hardware_concurrency());
+
+  // 90% lookups, 10% insert_or_assign over a warm key set.
+  auto run = [](unsigned threads, auto &&find, auto &&assign) {
+    return TestWithTimeMileS([&]() {
+      std::vector<std::thread> workers;
+      for (unsigned thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([&find, &assign, thread]() {
+          std::mt19937 random(thread);
+          for (int op = 0; op < kOpsPerThread; ++op) {
+            auto key = static_cast<int>(random() % kKeys);
+            if (op % 10 == 0) {
+              assign(key, op);
+            } else {
+              find(key);
+            }
+          }
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    });
+  };
+
+  // 1, 2, 4, ... threads up to one per core.
+  for (unsigned threads = 1;; threads = std::min(threads * 2, cores)) {
+    concurrent_hash_map<int, int> sharded;
+    std::unordered_map<int, int> locked;
+    std::mutex latch;
+    for (int key = 0; key < kKeys; ++key) {
+      (void)sharded.insert(key, key);
+      locked.emplace(key, key);
+    }
+    auto shardedTime = run(
+        threads,
+        [&sharded](int key) { (void)sharded.find(key); },
+        [&sharded](int key, int value) {
+          (void)sharded.insert_or_assign(key, value);
+        });
+    auto lockedTime = run(
+        threads,
+        [&locked, &latch](int key) {
+          std::lock_guard lock(latch);
+          (void)locked.find(key);
+        },
+        [&locked, &latch](int key, int value) {
+          std::lock_guard lock(latch);
+          locked[key] = value;
+        });
+    std::cout << threads << " threads: sharded " << shardedTime.count()
+              << "ms, one mutex " << lockedTime.count() << "ms" << std::endl;
+    if (threads == cores) {
+      break;
+    }
+  }
+}
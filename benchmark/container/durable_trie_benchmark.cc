@@ -0,0 +1,88 @@
+//===--- durable_trie_benchmark.cc - DurableTrie benchmarks -----*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/durable_trie_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/durable_trie.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+auto
+FreshDir(const std::string &name) -> std::string {
+  auto dir = testing::TempDir() + "durable_trie_benchmark." + name;
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+template <typename Trie>
+auto
+Contents(const Trie &trie) -> std::map<std::string, int> {
+  std::map<std::string, int> contents;
+  (void)trie.ScanPrefix("", [&contents](std::string_view key, int value) {
+    contents.emplace(key, value);
+  });
+  return contents;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(DurableTrieBenchmark, Logging) {
+  constexpr static int kThreads = 8;
+  constexpr static int kKeys = 20000;
+  constexpr static int kSyncedKeys = 1000;
+  auto run = [](int keys, auto &&insert) {
+    return TestWithTimeMileS([&]() {
+      std::vector<std::thread> writers;
+      for (int thread = 0; thread < kThreads; ++thread) {
+        writers.emplace_back([&insert, thread, keys]() {
+          for (int i = 0; i < keys; ++i) {
+            insert(std::to_string(i) + "/" + std::to_string(thread), i);
+          }
+        });
+      }
+      for (auto &writer : writers) {
+        writer.join();
+      }
+    });
+  };
+
+  Trie<int> plain;
+  auto plainTime = run(kKeys, [&plain](const std::string &key, int value) {
+    (void)plain.Insert(key, value);
+  });
+  DurableTrie<int> unsynced(FreshDir("unsynced"), {false});
+  auto unsyncedTime =
+      run(kKeys, [&unsynced](const std::string &key, int value) {
+        (void)unsynced.Insert(key, value);
+      });
+  DurableTrie<int> synced(FreshDir("synced"));
+  auto syncedTime =
+      run(kSyncedKeys, [&synced](const std::string &key, int value) {
+        (void)synced.Insert(key, value);
+      });
+  std::cout << kThreads * kKeys << " inserts on " << kThreads
+            << " threads: trie " << plainTime.count() << "ms, logged "
+            << unsyncedTime.count() << "ms; " << kThreads * kSyncedKeys
+            << " synced " << syncedTime.count() << "ms with " << synced.Syncs()
+            << " syncs" << std::endl;
+  EXPECT_LT(synced.Syncs(), static_cast<std::size_t>(kThreads * kSyncedKeys));
+  EXPECT_EQ(Contents(unsynced.Get()), Contents(plain));
+}
@@ -0,0 +1,64 @@
+//===--- flat_hash_map_benchmark.cc - flat_hash_map benchmarks --*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/flat_hash_map_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/unordered_map.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapBenchmark, InsertAndLookup) {
+  constexpr static std::size_t kKeys = 1 << 20;
+  std::mt19937_64 random(7);
+  std::vector<std::uint64_t> keys(kKeys);
+  std::vector<std::uint64_t> missing(kKeys);
+  for (auto &key : keys) {
+    key = random();
+  }
+  for (auto &key : missing) {
+    key = random();
+  }
+
+  auto run = [&](auto &map, const char *name) {
+    auto insertTime = TestWithTimeMileS([&]() {
+      for (std::size_t i = 0; i < kKeys; ++i) {
+        map[keys[i]] = static_cast<int>(i);
+      }
+    });
+    std::uint64_t sum = 0;
+    auto hitTime = TestWithTimeMileS([&]() {
+      for (auto key : keys) {
+        sum += map.find(key)->second;
+      }
+    });
+    std::size_t misses = 0;
+    auto missTime = TestWithTimeMileS([&]() {
+      for (auto key : missing) {
+        misses += map.count(key) == 0 ? 1 : 0;
+      }
+    });
+    std::cout << name << ": insert " << insertTime.count() << "ms, hit "
+              << hitTime.count() << "ms, miss " << missTime.count() << "ms"
+              << std::endl;
+    EXPECT_EQ(sum, std::uint64_t{kKeys} * (kKeys - 1) / 2);
+    EXPECT_EQ(misses, kKeys);
+  };
+  std::unordered_map<std::uint64_t, int> chained;
+  run(chained, "std::unordered_map");
+  unordered_map<std::uint64_t, int> flat;
+  run(flat, "flat_hash_map");
+}
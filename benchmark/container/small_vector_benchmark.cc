@@ -0,0 +1,45 @@
+//===--- small_vector_benchmark.cc - small_vector benchmarks ----*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/small_vector_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/small_vector.hh"
+#include "../../test/common/test_with_time.hh"
+#include "container/vector.hh"
+
+#include "gtest/gtest.h"
+#include <iostream>
+#include <numeric>
+#include <utility>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(SmallVectorBenchmark, AgainstVector) {
+  constexpr static int kRounds = 1 << 21;
+  constexpr static int kElements = 6;
+  // build, sum and drop a handful of ints, as a hot path would.
+  auto run = [](auto make) {
+    long sum = 0;
+    auto time = TestWithTimeMileS([&]() {
+      for (int round = 0; round < kRounds; ++round) {
+        auto values = make();
+        for (int i = 0; i < kElements; ++i) {
+          values.push_back(round + i);
+        }
+        sum += std::accumulate(values.begin(), values.end(), 0L);
+      }
+    });
+    return std::make_pair(time, sum);
+  };
+  auto [heapTime, heapSum] = run([]() { return vector<int>(); });
+  auto [inlineTime, inlineSum] = run([]() { return small_vector<int, 8>(); });
+  std::cout << "vector " << heapTime.count() << "ms, small_vector "
+            << inlineTime.count() << "ms" << std::endl;
+  EXPECT_EQ(heapSum, inlineSum);
+}
@@ -0,0 +1,288 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: benchmark/container/trie_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/trie.hh"
+#include "../../test/common/test_with_time.hh"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, ArenaTeardown) {
+  constexpr static int kKeys = 200000;
+  std::vector<std::string> keys;
+  keys.reserve(kKeys);
+  std::mt19937 random(42);
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back(std::to_string(random()));
+  }
+
+  auto heap = std::make_unique<Trie<int>>();
+  auto arena = std::make_unique<Trie<int, cdi::memory::ArenaAllocator>>();
+  auto heapInsert = TestWithTimeMileS([&]() {
+    for (int i = 0; i < kKeys; ++i) {
+      (void)heap->Insert(keys[i], i);
+    }
+  });
+  auto arenaInsert = TestWithTimeMileS([&]() {
+    for (int i = 0; i < kKeys; ++i) {
+      (void)arena->Insert(keys[i], i);
+    }
+  });
+  auto heapTeardown = TestWithTimeMileS([&]() { heap.reset(); });
+  auto arenaTeardown = TestWithTimeMileS([&]() { arena.reset(); });
+  std::cout << "insert heap " << heapInsert.count() << "ms, arena "
+            << arenaInsert.count() << "ms; teardown heap "
+            << heapTeardown.count() << "ms, arena " << arenaTeardown.count()
+            << "ms" << std::endl;
+}
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, BulkLoad) {
+  constexpr static int kKeys = 300000;
+  std::mt19937 random(42);
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < kKeys; ++i) {
+    entries.emplace_back("/route/" + std::to_string(random()), i);
+  }
+  std::sort(entries.begin(), entries.end());
+
+  Trie<int> inserted;
+  auto insertTime = TestWithTimeMileS([&]() {
+    for (auto &[key, value] : entries) {
+      (void)inserted.Insert(key, value);
+    }
+  });
+  Trie<int> loaded;
+  auto batch = entries;
+  auto loadTime = TestWithTimeMileS(
+      [&]() { (void)loaded.BulkLoad(std::move(batch)); });
+  std::cout << "insert " << insertTime.count() << "ms, bulk load "
+            << loadTime.count() << "ms on "
+            << std::thread::hardware_concurrency() << " threads" << std::endl;
+  for (int i = 0; i < kKeys; i += 1000) {
+    EXPECT_EQ(loaded.LookupMaybe(entries[i].first).value_or(-1),
+              inserted.LookupMaybe(entries[i].first).value_or(-2));
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, LookupBatch) {
+  constexpr static int kKeys = 500000;
+  constexpr static std::size_t kBatch = 256;
+  std::mt19937 random(42);
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < kKeys; ++i) {
+    entries.emplace_back(std::to_string(random()) + std::to_string(random()),
+                         i);
+  }
+  Trie<int> trie(TrieReadMode::kOptimistic);
+  (void)trie.BulkLoad(entries);
+  // lookups in random order, so that every descent misses the cache.
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back(entries[random() % kKeys].first);
+  }
+
+  long single = 0;
+  auto singleTime = TestWithTimeMileS([&]() {
+    for (auto &key : keys) {
+      single += trie.LookupMaybe(key).value_or(0);
+    }
+  });
+  long batched = 0;
+  std::vector<cdi::constructor::Maybe<int>> out(kBatch);
+  auto batchTime = TestWithTimeMileS([&]() {
+    for (std::size_t begin = 0; begin < keys.size(); begin += kBatch) {
+      auto end = std::min(keys.size(), begin + kBatch);
+      (void)trie.LookupBatch(
+          keys.begin() + begin, keys.begin() + end, out.begin());
+      for (std::size_t i = 0; i < end - begin; ++i) {
+        batched += out[i].value_or(0);
+      }
+    }
+  });
+  std::cout << "one by one " << singleTime.count() << "ms, batched "
+            << batchTime.count() << "ms" << std::endl;
+  EXPECT_EQ(batched, single);
+}
+
+namespace {
+
+using Ranked = std::vector<std::pair<std::string, double>>;
+
+auto
+TopKOf(const ScoredTrie<int> &trie, const std::string &prefix, std::size_t k)
+    -> Ranked {
+  Ranked found;
+  (void)trie.TopK(prefix,
+                  k,
+                  [&found](std::string_view key, const Scored<int> &value) {
+                    found.emplace_back(std::string(key), value.score);
+                  });
+  return found;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, TopK) {
+  constexpr static int kKeys = 500000;
+  constexpr static std::size_t kK = 10;
+  std::mt19937 random(7);
+  std::vector<std::pair<std::string, Scored<int>>> entries;
+  for (int i = 0; i < kKeys; ++i) {
+    entries.push_back({std::to_string(random()),
+                       {static_cast<double>(random() % 1000000), i}});
+  }
+  ScoredTrie<int> trie;
+  (void)trie.BulkLoad(entries);
+
+  constexpr static const char *kPrefixes[] = {"", "1", "2", "3", "42"};
+  std::vector<Ranked> scanned;
+  auto scanTime = TestWithTimeMileS([&]() {
+    for (auto *prefix : kPrefixes) {
+      Ranked all;
+      (void)trie.ScanPrefix(
+          prefix, [&all](std::string_view key, const Scored<int> &value) {
+            all.emplace_back(std::string(key), value.score);
+          });
+      std::stable_sort(all.begin(), all.end(), [](auto &lhs, auto &rhs) {
+        return lhs.second > rhs.second;
+      });
+      all.resize(std::min(kK, all.size()));
+      scanned.push_back(std::move(all));
+    }
+  });
+  std::vector<Ranked> best;
+  auto topKTime = TestWithTimeMileS([&]() {
+    for (auto *prefix : kPrefixes) {
+      best.push_back(TopKOf(trie, prefix, kK));
+    }
+  });
+  std::cout << "scan and sort " << scanTime.count() << "ms, top-k "
+            << topKTime.count() << "ms" << std::endl;
+  EXPECT_EQ(best, scanned);
+}
+
+namespace {
+
+auto
+Levenshtein(const std::string &lhs, const std::string &rhs) -> std::size_t {
+  std::vector<std::size_t> row(rhs.size() + 1);
+  for (std::size_t j = 0; j <= rhs.size(); ++j) {
+    row[j] = j;
+  }
+  for (std::size_t i = 1; i <= lhs.size(); ++i) {
+    auto diagonal = row[0];
+    row[0] = i;
+    for (std::size_t j = 1; j <= rhs.size(); ++j) {
+      auto above = row[j];
+      row[j] = std::min({row[j] + 1,
+                         row[j - 1] + 1,
+                         diagonal + (lhs[i - 1] == rhs[j - 1] ? 0 : 1)});
+      diagonal = above;
+    }
+  }
+  return row[rhs.size()];
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, Fuzzy) {
+  constexpr static int kKeys = 200000;
+  std::mt19937 random(3);
+  auto randomWord = [&random]() {
+    std::string word(5 + random() % 8, 'a');
+    for (auto &letter : word) {
+      letter = static_cast<char>('a' + random() % 26);
+    }
+    return word;
+  };
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < kKeys; ++i) {
+    entries.emplace_back(randomWord(), i);
+  }
+  Trie<int> trie;
+  (void)trie.BulkLoad(entries);
+  std::vector<std::string> queries;
+  for (int i = 0; i < 20; ++i) {
+    // a known key, misspelled once.
+    auto query = entries[random() % kKeys].first;
+    query[random() % query.size()] = 'z';
+    queries.push_back(query);
+  }
+
+  std::size_t scanned = 0;
+  auto scanTime = TestWithTimeMileS([&]() {
+    for (auto &query : queries) {
+      for (auto &[key, value] : entries) {
+        scanned += Levenshtein(key, query) <= 2 ? 1 : 0;
+      }
+    }
+  });
+  std::size_t walked = 0;
+  auto walkTime = TestWithTimeMileS([&]() {
+    for (auto &query : queries) {
+      walked += trie.VisitFuzzy(query, 2, [](std::string_view, std::size_t,
+                                             int) {});
+    }
+  });
+  std::cout << "brute force " << scanTime.count() << "ms, trie walk "
+            << walkTime.count() << "ms" << std::endl;
+  EXPECT_EQ(walked, scanned);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieBenchmark, Update) {
+  constexpr static int kKeys = 100000;
+  constexpr static int kRounds = 5;
+  std::mt19937 random(18);
+  std::vector<std::string> keys;
+  std::vector<std::pair<std::string, long>> entries;
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back("/counters/" + std::to_string(random()));
+    entries.emplace_back(keys.back(), 0);
+  }
+  Trie<long> replaced;
+  Trie<long> updated;
+  (void)replaced.BulkLoad(entries);
+  (void)updated.BulkLoad(entries);
+
+  auto replaceTime = TestWithTimeMileS([&]() {
+    for (int round = 0; round < kRounds; ++round) {
+      for (auto &key : keys) {
+        auto value = replaced.LookupMaybe(key).value_or(0);
+        (void)replaced.Remove(key);
+        (void)replaced.Insert(key, value + 1);
+      }
+    }
+  });
+  auto updateTime = TestWithTimeMileS([&]() {
+    for (int round = 0; round < kRounds; ++round) {
+      for (auto &key : keys) {
+        (void)updated.Update(key, [](long &value) { ++value; });
+      }
+    }
+  });
+  std::cout << "lookup, remove and insert " << replaceTime.count()
+            << "ms, update " << updateTime.count() << "ms" << std::endl;
+  EXPECT_EQ(updated.LookupMaybe(keys[0]).value_or(0), kRounds);
+  EXPECT_EQ(replaced.LookupMaybe(keys[0]).value_or(0), kRounds);
+}
@@ -0,0 +1,77 @@
+//===--- vector_benchmark.cc - vector bounds-check benchmarks ---*- C++ -*-===//
+// cdi 2023
+//
+// Identification: benchmark/container/vector_benchmark.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/vector.hh"
+#include "../../test/common/test_with_time.hh"
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+/// sum of values[i] for i read from indices, over and over: a loop bound
+/// would let the compiler prove i in range and drop the checks.
+template <typename Vector>
+[[gnu::noinline]] auto
+IndexedSum(const Vector &values,
+           const std::vector<std::uint32_t> &indices,
+           int rounds) -> std::uint64_t {
+  std::uint64_t sum = 0;
+  for (int round = 0; round < rounds; ++round) {
+    for (auto index : indices) {
+      sum += values[index];
+    }
+  }
+  return sum;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(VectorBenchmark, BoundsChecks) {
+  constexpr static int kElements = 1 << 16;
+  constexpr static int kRounds = 1 << 10;
+  constexpr static int kRuns = 5;
+  std::vector<int> raw(kElements);
+  std::vector<std::uint32_t> indices(kElements);
+  for (int i = 0; i < kElements; ++i) {
+    raw[i] = i;
+    // strided, to defeat vectorized loads without missing the cache.
+    indices[i] = (i * 17) % kElements;
+  }
+  vector<int, BoundsCheck::kUnchecked> unchecked(raw.begin(), raw.end());
+  vector<int, BoundsCheck::kChecked> checked(raw.begin(), raw.end());
+  vector<int, BoundsCheck::kHardened> hardened(raw.begin(), raw.end());
+
+  // the best of a few runs, to keep noise from deciding.
+  auto run = [&indices](const auto &values, const char *name) {
+    std::uint64_t sum = 0;
+    auto best = std::chrono::milliseconds::max();
+    for (int run = 0; run < kRuns; ++run) {
+      best = std::min(best, TestWithTimeMileS([&]() {
+                        sum = IndexedSum(values, indices, kRounds);
+                      }));
+    }
+    std::cout << name << ": " << best.count() << "ms" << std::endl;
+    EXPECT_EQ(sum, std::uint64_t{kRounds} * kElements * (kElements - 1) / 2);
+  };
+  // unchecked is meant to compile to the same loop as std::vector; that is a
+  // question for the generated code, the timings only show the check cost.
+  run(raw, "std::vector");
+  run(unchecked, "unchecked");
+  run(checked, "checked");
+  run(hardened, "hardened");
+}
@@ -0,0 +1,273 @@
+//===--- epoch.hh - Epoch based reclamation ---------------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/concurrency/epoch.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Epoch based reclamation (EBR), in the style of Fraser's thesis and crossbeam.
+//
+// Readers wrap their traversal in an EpochGuard. Pinning is a store to a slot
+// owned by the current thread plus a fence, no lock and no read-modify-write
+// on shared cache lines.
+//
+// Writers unlink an object first, then hand it to a RetireList. It is freed
+// once the global epoch advanced twice past the retirement, i.e. every reader
+// that could still see it has left its critical section.
+//
+// Classes: EpochGuard, RetireList
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONCURRENCY_EPOCH_HH
+#define CDI_CONCURRENCY_EPOCH_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cdi::concurrency {
+
+constexpr static std::size_t kCacheLineSize = 64;
+
+namespace detail {
+
+/// slot epoch of a participant outside any critical section.
+constexpr static std::uint64_t kQuiescent = 0;
+
+struct alignas(kCacheLineSize) EpochSlot {
+  std::atomic<std::uint64_t> epoch{kQuiescent};
+  std::atomic<bool> inUse{false};
+  EpochSlot *next = nullptr;
+};
+
+/// Process wide epoch. Slots are never freed but recycled, so a thread exiting
+/// after static destruction never touches freed memory.
+class EpochManager {
+public:
+  static auto
+  Instance() -> EpochManager & {
+    static auto *manager = new EpochManager();
+    return *manager;
+  }
+
+  auto
+  AcquireSlot() -> EpochSlot * {
+    for (auto *slot = slots_.load(std::memory_order_acquire); slot != nullptr;
+         slot = slot->next) {
+      bool expected = false;
+      if (!slot->inUse.load(std::memory_order_relaxed) &&
+          slot->inUse.compare_exchange_strong(expected,
+                                              true,
+                                              std::memory_order_acquire)) {
+        return slot;
+      }
+    }
+    auto *slot = new EpochSlot();
+    slot->inUse.store(true, std::memory_order_relaxed);
+    slot->next = slots_.load(std::memory_order_relaxed);
+    while (!slots_.compare_exchange_weak(slot->next,
+                                         slot,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+    }
+    return slot;
+  }
+
+  void
+  ReleaseSlot(EpochSlot *slot) {
+    slot->epoch.store(kQuiescent, std::memory_order_release);
+    slot->inUse.store(false, std::memory_order_release);
+  }
+
+  void
+  Enter(EpochSlot *slot) {
+    slot->epoch.store(global_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void
+  Exit(EpochSlot *slot) {
+    slot->epoch.store(kQuiescent, std::memory_order_release);
+  }
+
+  /// Epoch a retired object is tagged with. Call after unlinking it.
+  auto
+  RetireEpoch() -> std::uint64_t {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return global_.load(std::memory_order_relaxed);
+  }
+
+  /// Advance the global epoch if every pinned slot has observed it.
+  /// \return the global epoch after the attempt.
+  auto
+  TryAdvance() -> std::uint64_t {
+    auto current = global_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto *slot = slots_.load(std::memory_order_acquire); slot != nullptr;
+         slot = slot->next) {
+      // acquire pairs with Exit, reads of the leaving reader happen before.
+      auto pinned = slot->epoch.load(std::memory_order_acquire);
+      if (pinned != kQuiescent && pinned != current) {
+        return current;
+      }
+    }
+    global_.compare_exchange_strong(current,
+                                    current + 1,
+                                    std::memory_order_release,
+                                    std::memory_order_relaxed);
+    return global_.load(std::memory_order_relaxed);
+  }
+
+private:
+  EpochManager() = default;
+
+  alignas(kCacheLineSize) std::atomic<std::uint64_t> global_{1};
+  alignas(kCacheLineSize) std::atomic<EpochSlot *> slots_{nullptr};
+};
+
+/// Each thread owns one slot; nested guards only count.
+struct ThreadEpochHandle {
+  ThreadEpochHandle() : slot(EpochManager::Instance().AcquireSlot()) {}
+  ~ThreadEpochHandle() { EpochManager::Instance().ReleaseSlot(slot); }
+
+  ThreadEpochHandle(const ThreadEpochHandle &) = delete;
+  auto
+  operator=(const ThreadEpochHandle &) -> ThreadEpochHandle & = delete;
+
+  EpochSlot *slot;
+  int nesting = 0;
+};
+
+inline auto
+LocalEpochHandle() -> ThreadEpochHandle & {
+  thread_local ThreadEpochHandle handle;
+  return handle;
+}
+
+} // namespace detail
+
+/// Read-side critical section. Everything loaded from a shared structure while
+/// the guard is alive stays valid until the guard dies.
+class EpochGuard {
+public:
+  EpochGuard() : handle_(detail::LocalEpochHandle()) {
+    if (handle_.nesting++ == 0) {
+      detail::EpochManager::Instance().Enter(handle_.slot);
+    }
+  }
+
+  ~EpochGuard() {
+    if (--handle_.nesting == 0) {
+      detail::EpochManager::Instance().Exit(handle_.slot);
+    }
+  }
+
+  EpochGuard(const EpochGuard &) = delete;
+  auto
+  operator=(const EpochGuard &) -> EpochGuard & = delete;
+
+private:
+  detail::ThreadEpochHandle &handle_;
+};
+
+/// Objects unlinked from a shared structure, waiting for readers to drain.
+/// Owned by the structure; whatever is left is freed when the list dies, at
+/// which point no reader may be using the structure anyway.
+class RetireList {
+public:
+  RetireList() = default;
+  ~RetireList() {
+    for (auto &retired : retired_) {
+      retired.deleter(retired.object);
+    }
+  }
+
+  RetireList(const RetireList &) = delete;
+  auto
+  operator=(const RetireList &) -> RetireList & = delete;
+
+  template <typename T>
+  void
+  Retire(T *object) {
+    Retire(object, [](void *erased) { delete static_cast<T *>(erased); });
+  }
+
+  void
+  Retire(void *object, void (*deleter)(void *)) {
+    auto epoch = detail::EpochManager::Instance().RetireEpoch();
+    std::scoped_lock<std::mutex> lock(latch_);
+    retired_.push_back({object, deleter, epoch});
+    pending_.store(retired_.size(), std::memory_order_relaxed);
+  }
+
+  /// Free every object no reader can reach any more.
+  /// \return number of objects freed.
+  auto
+  Collect() -> std::size_t {
+    // two advances make everything retired before this call reclaimable when
+    // no reader is in the way.
+    auto &manager = detail::EpochManager::Instance();
+    (void)manager.TryAdvance();
+    auto global = manager.TryAdvance();
+    std::vector<Retired> reclaimable;
+    {
+      std::scoped_lock<std::mutex> lock(latch_);
+      auto keep = retired_.begin();
+      for (auto &retired : retired_) {
+        if (retired.epoch + 2 <= global) {
+          reclaimable.push_back(retired);
+        } else {
+          *keep++ = retired;
+        }
+      }
+      retired_.erase(keep, retired_.end());
+      pending_.store(retired_.size(), std::memory_order_relaxed);
+    }
+    for (auto &retired : reclaimable) {
+      retired.deleter(retired.object);
+    }
+    return reclaimable.size();
+  }
+
+  /// Free everything at once. Only when no reader can be left.
+  void
+  Drain() {
+    std::vector<Retired> reclaimable;
+    {
+      std::scoped_lock<std::mutex> lock(latch_);
+      reclaimable.swap(retired_);
+      pending_.store(0, std::memory_order_relaxed);
+    }
+    for (auto &retired : reclaimable) {
+      retired.deleter(retired.object);
+    }
+  }
+
+  /// cheap, may lag behind concurrent Retire and Collect calls.
+  [[nodiscard]] auto
+  Pending() const -> std::size_t {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Retired {
+    void *object;
+    void (*deleter)(void *);
+    std::uint64_t epoch;
+  };
+
+  mutable std::mutex latch_;
+  std::vector<Retired> retired_;
+  std::atomic<std::size_t> pending_{0};
+};
+
+} // namespace cdi::concurrency
+
+#endif // CDI_CONCURRENCY_EPOCH_HH
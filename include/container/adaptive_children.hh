@@ -0,0 +1,577 @@
+//===--- adaptive_children.hh - ART style child arrays ----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/adaptive_children.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Children of a trie node, laid out as in the Adaptive Radix Tree (Leis et al.,
+// ICDE 2013). The layout follows the fanout:
+//
+//   Node4    sorted keys, linear search.
+//   Node16   sorted keys, one SSE2 compare finds the slot.
+//   Node48   256 byte index into 48 slots.
+//   Node256  direct array.
+//
+// A childless node costs one word. Keys are compared as unsigned bytes, so
+// iteration is in the same order as std::string comparison.
+//
+// Ptr is the owning child pointer, e.g. std::unique_ptr<Node>. Children never
+// move in memory when the layout grows or shrinks, only their pointers do.
+// Alloc is the allocation policy of the layouts, see memory/slab_arena.hh; the
+// calls that may reallocate take an instance of it. A layout replaced by one
+// of them goes through Alloc::Retire, so readers racing with the change under
+// a version check still read valid memory.
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_ADAPTIVE_CHILDREN_HH
+#define CDI_CONTAINER_ADAPTIVE_CHILDREN_HH
+
+#include "container/visitor.hh"
+#include "memory/slab_arena.hh"
+#include "port/bit.hh"
+#include "port/port.hh"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if CDI_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cdi::container {
+
+enum class AdaptiveKind : std::uint8_t {
+  kEmpty = 0,
+  kNode4 = 1,
+  kNode16 = 2,
+  kNode48 = 3,
+  kNode256 = 4,
+};
+
+template <typename Ptr, typename Alloc = cdi::memory::HeapAllocator>
+class AdaptiveChildren {
+  constexpr static std::uintptr_t kKindMask = 0x7;
+
+  // shrink a little below the capacity of the smaller kind, so a node that
+  // oscillates around a boundary does not reallocate on every operation.
+  constexpr static std::size_t kShrink16 = 3;
+  constexpr static std::size_t kShrink48 = 12;
+  constexpr static std::size_t kShrink256 = 37;
+
+  struct alignas(8) Node4 {
+    std::uint8_t count = 0;
+    std::uint8_t keys[4] = {};
+    Ptr children[4];
+  };
+
+  struct alignas(16) Node16 {
+    std::uint8_t count = 0;
+    alignas(16) std::uint8_t keys[16] = {};
+    Ptr children[16];
+  };
+
+  struct alignas(8) Node48 {
+    constexpr static std::uint8_t kEmptySlot = 0;
+    std::uint8_t count = 0;
+    std::uint8_t index[256] = {}; // slot + 1
+    Ptr children[48];
+  };
+
+  struct alignas(8) Node256 {
+    std::uint16_t count = 0;
+    Ptr children[256];
+  };
+
+public:
+  AdaptiveChildren() = default;
+  ~AdaptiveChildren() { Reset(); }
+
+  AdaptiveChildren(const AdaptiveChildren &) = delete;
+  auto
+  operator=(const AdaptiveChildren &) -> AdaptiveChildren & = delete;
+
+  AdaptiveChildren(AdaptiveChildren &&other) noexcept
+      : inner_(std::exchange(other.inner_, 0)) {}
+
+  auto
+  operator=(AdaptiveChildren &&other) noexcept -> AdaptiveChildren & {
+    if (this != &other) {
+      Reset();
+      inner_ = std::exchange(other.inner_, 0);
+    }
+    return *this;
+  }
+
+  [[nodiscard]] auto
+  Kind() const -> AdaptiveKind {
+    return static_cast<AdaptiveKind>(inner_ & kKindMask);
+  }
+
+  [[nodiscard]] auto
+  Empty() const -> bool {
+    return inner_ == 0;
+  }
+
+  [[nodiscard]] auto
+  Size() const -> std::size_t {
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return 0;
+    case AdaptiveKind::kNode4:
+      return As<Node4>()->count;
+    case AdaptiveKind::kNode16:
+      return As<Node16>()->count;
+    case AdaptiveKind::kNode48:
+      return As<Node48>()->count;
+    case AdaptiveKind::kNode256:
+      return As<Node256>()->count;
+    }
+    return 0;
+  }
+
+  /// bytes held besides the AdaptiveChildren itself.
+  [[nodiscard]] auto
+  MemoryUsage() const -> std::size_t {
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return 0;
+    case AdaptiveKind::kNode4:
+      return sizeof(Node4);
+    case AdaptiveKind::kNode16:
+      return sizeof(Node16);
+    case AdaptiveKind::kNode48:
+      return sizeof(Node48);
+    case AdaptiveKind::kNode256:
+      return sizeof(Node256);
+    }
+    return 0;
+  }
+
+  /// \return the slot of `key`, nullptr if absent. Valid until the next
+  /// Insert or Erase.
+  [[nodiscard]] auto
+  Find(char key) -> Ptr * {
+    auto byte = static_cast<std::uint8_t>(key);
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return nullptr;
+    case AdaptiveKind::kNode4: {
+      auto *node = As<Node4>();
+      for (std::uint8_t i = 0; i < node->count; ++i) {
+        if (node->keys[i] == byte) {
+          return &node->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case AdaptiveKind::kNode16: {
+      auto *node = As<Node16>();
+      auto slot = SearchNode16(node, byte);
+      return slot < node->count ? &node->children[slot] : nullptr;
+    }
+    case AdaptiveKind::kNode48: {
+      auto *node = As<Node48>();
+      auto slot = node->index[byte];
+      return slot != Node48::kEmptySlot ? &node->children[slot - 1] : nullptr;
+    }
+    case AdaptiveKind::kNode256: {
+      auto *node = As<Node256>();
+      return node->children[byte] ? &node->children[byte] : nullptr;
+    }
+    }
+    return nullptr;
+  }
+
+  [[nodiscard]] auto
+  Find(char key) const -> const Ptr * {
+    return const_cast<AdaptiveChildren *>(this)->Find(key);
+  }
+
+  /// Start loading what Find(key) reads first, so that a caller with other
+  /// work to do meanwhile does not stall on it.
+  void
+  Prefetch(char key) const {
+    auto byte = static_cast<std::uint8_t>(key);
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return;
+    case AdaptiveKind::kNode4:
+      CDI_PREFETCH(As<Node4>());
+      return;
+    case AdaptiveKind::kNode16:
+      CDI_PREFETCH(As<Node16>()->keys);
+      return;
+    case AdaptiveKind::kNode48:
+      CDI_PREFETCH(&As<Node48>()->index[byte]);
+      return;
+    case AdaptiveKind::kNode256:
+      CDI_PREFETCH(&As<Node256>()->children[byte]);
+      return;
+    }
+  }
+
+  /// Add a child, growing the layout when it is full.
+  /// \return the new slot, nullptr if `key` is already present.
+  auto
+  Insert(char key, Ptr &&child, const Alloc &alloc = Alloc()) -> Ptr * {
+    if (Find(key) != nullptr) {
+      return nullptr;
+    }
+    auto byte = static_cast<std::uint8_t>(key);
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      inner_ = Tag(alloc.template New<Node4>(), AdaptiveKind::kNode4);
+      return InsertSorted(As<Node4>(), byte, std::move(child));
+    case AdaptiveKind::kNode4:
+      if (As<Node4>()->count == 4) {
+        Grow<Node4, Node16>(AdaptiveKind::kNode16, alloc);
+        return InsertSorted(As<Node16>(), byte, std::move(child));
+      }
+      return InsertSorted(As<Node4>(), byte, std::move(child));
+    case AdaptiveKind::kNode16:
+      if (As<Node16>()->count == 16) {
+        GrowTo48(alloc);
+        return InsertNode48(As<Node48>(), byte, std::move(child));
+      }
+      return InsertSorted(As<Node16>(), byte, std::move(child));
+    case AdaptiveKind::kNode48:
+      if (As<Node48>()->count == 48) {
+        GrowTo256(alloc);
+        return InsertNode256(As<Node256>(), byte, std::move(child));
+      }
+      return InsertNode48(As<Node48>(), byte, std::move(child));
+    case AdaptiveKind::kNode256:
+      return InsertNode256(As<Node256>(), byte, std::move(child));
+    }
+    return nullptr;
+  }
+
+  /// Drop a child, shrinking the layout when it gets sparse.
+  /// \param[out] erased if not nullptr, receives the child instead of it
+  /// being destroyed.
+  /// \return false if `key` is absent.
+  auto
+  Erase(char key, const Alloc &alloc = Alloc(), Ptr *erased = nullptr)
+      -> bool {
+    auto byte = static_cast<std::uint8_t>(key);
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return false;
+    case AdaptiveKind::kNode4: {
+      auto *node = As<Node4>();
+      if (!EraseSorted(node, byte, erased)) {
+        return false;
+      }
+      if (node->count == 0) {
+        alloc.Retire(node);
+        inner_ = 0;
+      }
+      return true;
+    }
+    case AdaptiveKind::kNode16: {
+      auto *node = As<Node16>();
+      if (!EraseSorted(node, byte, erased)) {
+        return false;
+      }
+      if (node->count <= kShrink16) {
+        Shrink<Node16, Node4>(AdaptiveKind::kNode4, alloc);
+      }
+      return true;
+    }
+    case AdaptiveKind::kNode48: {
+      auto *node = As<Node48>();
+      auto slot = node->index[byte];
+      if (slot == Node48::kEmptySlot) {
+        return false;
+      }
+      TakeChild(node->children[slot - 1], erased);
+      node->index[byte] = Node48::kEmptySlot;
+      if (--node->count <= kShrink48) {
+        ShrinkTo16(alloc);
+      }
+      return true;
+    }
+    case AdaptiveKind::kNode256: {
+      auto *node = As<Node256>();
+      if (!node->children[byte]) {
+        return false;
+      }
+      TakeChild(node->children[byte], erased);
+      if (--node->count <= kShrink256) {
+        ShrinkTo48(alloc);
+      }
+      return true;
+    }
+    }
+    return false;
+  }
+
+  /// Visit children in ascending (unsigned) key order.
+  /// `func(char key, Ptr &child)` returns void, or bool where false stops.
+  /// \return false if stopped early.
+  template <typename Func>
+  auto
+  ForEach(Func &&func) -> bool {
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      return true;
+    case AdaptiveKind::kNode4:
+      return ForEachSorted(As<Node4>(), func);
+    case AdaptiveKind::kNode16:
+      return ForEachSorted(As<Node16>(), func);
+    case AdaptiveKind::kNode48: {
+      auto *node = As<Node48>();
+      for (int byte = 0; byte < 256; ++byte) {
+        auto slot = node->index[byte];
+        if (slot != Node48::kEmptySlot &&
+            !detail::CallVisitor(
+                func, static_cast<char>(byte), node->children[slot - 1])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case AdaptiveKind::kNode256: {
+      auto *node = As<Node256>();
+      for (int byte = 0; byte < 256; ++byte) {
+        if (node->children[byte] &&
+            !detail::CallVisitor(
+                func, static_cast<char>(byte), node->children[byte])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    }
+    return true;
+  }
+
+  template <typename Func>
+  auto
+  ForEach(Func &&func) const -> bool {
+    return const_cast<AdaptiveChildren *>(this)->ForEach(
+        [&func](char key, Ptr &child) {
+          return detail::CallVisitor(
+              func, key, static_cast<const Ptr &>(child));
+        });
+  }
+
+private:
+  template <typename Node>
+  [[nodiscard]] auto
+  As() const -> Node * {
+    return reinterpret_cast<Node *>(inner_ & ~kKindMask);
+  }
+
+  template <typename Node>
+  static auto
+  Tag(Node *node, AdaptiveKind kind) -> std::uintptr_t {
+    return reinterpret_cast<std::uintptr_t>(node) |
+           static_cast<std::uintptr_t>(kind);
+  }
+
+  static auto
+  SearchNode16(const Node16 *node, std::uint8_t byte) -> std::uint8_t {
+#if CDI_HAVE_SSE2
+    auto keys = _mm_load_si128(reinterpret_cast<const __m128i *>(node->keys));
+    auto hits = _mm_cmpeq_epi8(keys, _mm_set1_epi8(static_cast<char>(byte)));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits)) &
+                ((1U << node->count) - 1);
+    return mask != 0 ? static_cast<std::uint8_t>(port::LowestBit(mask))
+                     : node->count;
+#else
+    for (std::uint8_t i = 0; i < node->count; ++i) {
+      if (node->keys[i] == byte) {
+        return i;
+      }
+    }
+    return node->count;
+#endif
+  }
+
+  template <typename Node>
+  static auto
+  InsertSorted(Node *node, std::uint8_t byte, Ptr &&child) -> Ptr * {
+    std::uint8_t pos = 0;
+    while (pos < node->count && node->keys[pos] < byte) {
+      ++pos;
+    }
+    for (auto i = node->count; i > pos; --i) {
+      node->keys[i] = node->keys[i - 1];
+      node->children[i] = std::move(node->children[i - 1]);
+    }
+    node->keys[pos] = byte;
+    node->children[pos] = std::move(child);
+    ++node->count;
+    return &node->children[pos];
+  }
+
+  /// empty `child`, into `erased` if given.
+  static void
+  TakeChild(Ptr &child, Ptr *erased) {
+    if (erased != nullptr) {
+      *erased = std::move(child);
+    }
+    child = Ptr();
+  }
+
+  template <typename Node>
+  static auto
+  EraseSorted(Node *node, std::uint8_t byte, Ptr *erased) -> bool {
+    std::uint8_t pos = 0;
+    while (pos < node->count && node->keys[pos] != byte) {
+      ++pos;
+    }
+    if (pos == node->count) {
+      return false;
+    }
+    TakeChild(node->children[pos], erased);
+    for (auto i = pos; i + 1 < node->count; ++i) {
+      node->keys[i] = node->keys[i + 1];
+      node->children[i] = std::move(node->children[i + 1]);
+    }
+    --node->count;
+    node->keys[node->count] = 0;
+    node->children[node->count] = Ptr();
+    return true;
+  }
+
+  template <typename Node, typename Func>
+  static auto
+  ForEachSorted(Node *node, Func &func) -> bool {
+    for (std::uint8_t i = 0; i < node->count; ++i) {
+      if (!detail::CallVisitor(
+              func, static_cast<char>(node->keys[i]), node->children[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static auto
+  InsertNode48(Node48 *node, std::uint8_t byte, Ptr &&child) -> Ptr * {
+    std::uint8_t slot = 0;
+    while (node->children[slot]) {
+      ++slot;
+    }
+    node->children[slot] = std::move(child);
+    node->index[byte] = slot + 1;
+    ++node->count;
+    return &node->children[slot];
+  }
+
+  static auto
+  InsertNode256(Node256 *node, std::uint8_t byte, Ptr &&child) -> Ptr * {
+    node->children[byte] = std::move(child);
+    ++node->count;
+    return &node->children[byte];
+  }
+
+  /// between the two sorted kinds.
+  template <typename From, typename To>
+  void
+  Grow(AdaptiveKind kind, const Alloc &alloc) {
+    auto *from = As<From>();
+    auto *to = alloc.template New<To>();
+    for (std::uint8_t i = 0; i < from->count; ++i) {
+      to->keys[i] = from->keys[i];
+      to->children[i] = std::move(from->children[i]);
+    }
+    to->count = from->count;
+    alloc.Retire(from);
+    inner_ = Tag(to, kind);
+  }
+
+  template <typename From, typename To>
+  void
+  Shrink(AdaptiveKind kind, const Alloc &alloc) {
+    Grow<From, To>(kind, alloc);
+  }
+
+  void
+  GrowTo48(const Alloc &alloc) {
+    auto *from = As<Node16>();
+    auto *to = alloc.template New<Node48>();
+    for (std::uint8_t i = 0; i < from->count; ++i) {
+      to->children[i] = std::move(from->children[i]);
+      to->index[from->keys[i]] = i + 1;
+    }
+    to->count = from->count;
+    alloc.Retire(from);
+    inner_ = Tag(to, AdaptiveKind::kNode48);
+  }
+
+  void
+  GrowTo256(const Alloc &alloc) {
+    auto *from = As<Node48>();
+    auto *to = alloc.template New<Node256>();
+    for (int byte = 0; byte < 256; ++byte) {
+      if (auto slot = from->index[byte]; slot != Node48::kEmptySlot) {
+        to->children[byte] = std::move(from->children[slot - 1]);
+      }
+    }
+    to->count = from->count;
+    alloc.Retire(from);
+    inner_ = Tag(to, AdaptiveKind::kNode256);
+  }
+
+  void
+  ShrinkTo16(const Alloc &alloc) {
+    auto *from = As<Node48>();
+    auto *to = alloc.template New<Node16>();
+    for (int byte = 0; byte < 256; ++byte) {
+      if (auto slot = from->index[byte]; slot != Node48::kEmptySlot) {
+        to->keys[to->count] = static_cast<std::uint8_t>(byte);
+        to->children[to->count++] = std::move(from->children[slot - 1]);
+      }
+    }
+    alloc.Retire(from);
+    inner_ = Tag(to, AdaptiveKind::kNode16);
+  }
+
+  void
+  ShrinkTo48(const Alloc &alloc) {
+    auto *from = As<Node256>();
+    auto *to = alloc.template New<Node48>();
+    for (int byte = 0; byte < 256; ++byte) {
+      if (from->children[byte]) {
+        to->children[to->count] = std::move(from->children[byte]);
+        to->index[byte] = ++to->count;
+      }
+    }
+    alloc.Retire(from);
+    inner_ = Tag(to, AdaptiveKind::kNode48);
+  }
+
+  void
+  Reset() {
+    switch (Kind()) {
+    case AdaptiveKind::kEmpty:
+      break;
+    case AdaptiveKind::kNode4:
+      Alloc::Delete(As<Node4>());
+      break;
+    case AdaptiveKind::kNode16:
+      Alloc::Delete(As<Node16>());
+      break;
+    case AdaptiveKind::kNode48:
+      Alloc::Delete(As<Node48>());
+      break;
+    case AdaptiveKind::kNode256:
+      Alloc::Delete(As<Node256>());
+      break;
+    }
+    inner_ = 0;
+  }
+
+  std::uintptr_t inner_ = 0;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_ADAPTIVE_CHILDREN_HH
@@ -0,0 +1,376 @@
+//===--- aho_corasick.hh - Multi-pattern matcher ----------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/aho_corasick.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// The keys of a Trie compiled into an Aho-Corasick automaton (Aho and
+// Corasick, CACM 1975): one pass over a buffer finds every occurrence of every
+// key, overlapping ones included, however many keys there are.
+//
+// States are the prefixes of the keys, one per byte, numbered breadth first
+// as in container/frozen_trie.hh, so the children of a state are consecutive
+// and their labels sorted. A missing transition follows the failure link, the
+// state of the longest proper suffix that is a prefix of some key, and the
+// output link chains the states of the keys ending at a position.
+//
+// Shallow states are where a scan spends its time, and breadth first puts
+// them first: the first kDenseStates states get a full row of 256 resolved
+// transitions, no failure link is followed from them. Deeper states search
+// their labels and fall back along failure links, which soon lead into the
+// dense rows.
+//
+// In the root state, bytes that start no key are skipped in bulk. With SSSE3,
+// 16 at a time whatever bytes keys start with: the first bytes form a 256 bit
+// map, indexed with pshufb by the low nibble of each byte for a row and by the
+// high one for a bit of it (Hyperscan's "truffle"). With SSE2 only, 16 at a
+// time just for tiny dictionaries, whose keys start with kSimdFirstBytes
+// distinct bytes at most, each compared on its own; others, such as 100k
+// keywords, skip byte by byte through a 256 entry table.
+//
+// Classes: AhoCorasick
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_AHO_CORASICK_HH
+#define CDI_CONTAINER_AHO_CORASICK_HH
+
+#include "container/trie.hh"
+#include "container/visitor.hh"
+#include "port/bit.hh"
+#include "port/port.hh"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if CDI_HAVE_SSSE3
+#include <tmmintrin.h>
+#elif CDI_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cdi::container {
+
+template <typename T>
+class AhoCorasick {
+  using StateId = std::uint32_t;
+
+  constexpr static StateId kRoot = 0;
+  constexpr static StateId kNone = ~StateId{0};
+
+  struct State {
+    StateId firstChild; // children are [firstChild, next state's firstChild).
+    StateId fail;
+    StateId output; // next state down the failure chain ending a key.
+    StateId match;  // index of the value, kNone if no key ends here.
+    std::uint32_t depth;
+  };
+
+public:
+  /// states with a dense row of transitions, 1KiB each.
+  constexpr static std::size_t kDenseStates = 256;
+  /// up to this many distinct first bytes are searched for with SSE2 alone.
+  constexpr static std::size_t kSimdFirstBytes = 4;
+
+  /// Compile the keys of `trie`. The trie is scanned once, writers may go on
+  /// concurrently but their changes may or may not make it.
+  template <typename Alloc>
+  static auto
+  Compile(const Trie<T, Alloc> &trie) -> AhoCorasick {
+    std::vector<std::pair<std::string, T>> entries;
+    (void)trie.ScanPrefix("", [&entries](std::string_view key, const T &value) {
+      entries.emplace_back(key, value);
+    });
+    return Compile(std::move(entries));
+  }
+
+  /// Compile the given keys; of duplicate keys the first wins, empty keys
+  /// are ignored.
+  static auto
+  Compile(std::vector<std::pair<std::string, T>> entries) -> AhoCorasick {
+    auto byKey = [](const auto &lhs, const auto &rhs) {
+      return lhs.first < rhs.first;
+    };
+    if (!std::is_sorted(entries.begin(), entries.end(), byKey)) {
+      std::stable_sort(entries.begin(), entries.end(), byKey);
+    }
+    entries.erase(std::unique(entries.begin(),
+                              entries.end(),
+                              [](const auto &lhs, const auto &rhs) {
+                                return lhs.first == rhs.first;
+                              }),
+                  entries.end());
+    auto begin = entries.begin();
+    while (begin != entries.end() && begin->first.empty()) {
+      ++begin;
+    }
+
+    AhoCorasick automaton;
+    automaton.BuildGoto(entries, begin - entries.begin());
+    automaton.BuildFailure();
+    automaton.BuildDense();
+    automaton.BuildPrefilter();
+    return automaton;
+  }
+
+  /// Report every occurrence of every key in `text`, in order of their end,
+  /// longer keys first at the same end. `visitor(std::string_view match,
+  /// const T &value)` gets a view of text, match.data() - text.data() is the
+  /// offset; it returns void, or bool where false stops the scan. Nothing is
+  /// allocated.
+  /// \return the number of matches reported.
+  template <typename Visitor>
+  auto
+  Scan(std::string_view text, Visitor &&visitor) const -> std::size_t {
+    std::size_t matches = 0;
+    auto state = kRoot;
+    const auto *bytes = reinterpret_cast<const std::uint8_t *>(text.data());
+    for (std::size_t pos = 0; pos < text.size(); ++pos) {
+      if (state == kRoot) {
+        pos = SkipToFirstByte(bytes, pos, text.size());
+        if (pos == text.size()) {
+          break;
+        }
+      }
+      state = Next(state, bytes[pos]);
+      const auto &reached = states_[state];
+      auto found = reached.match != kNone ? state : reached.output;
+      for (; found != kNone; found = states_[found].output) {
+        const auto &hit = states_[found];
+        ++matches;
+        if (!detail::CallVisitor(visitor,
+                                 text.substr(pos + 1 - hit.depth, hit.depth),
+                                 values_[hit.match])) {
+          return matches;
+        }
+      }
+    }
+    return matches;
+  }
+
+  /// whether any key occurs in text.
+  [[nodiscard]] auto
+  Contains(std::string_view text) const -> bool {
+    return Scan(text, [](std::string_view, const T &) { return false; }) > 0;
+  }
+
+  /// number of keys.
+  [[nodiscard]] auto
+  Size() const -> std::size_t {
+    return values_.size();
+  }
+
+  /// number of states, the root included.
+  [[nodiscard]] auto
+  StateCount() const -> std::size_t {
+    return states_.size();
+  }
+
+private:
+  AhoCorasick() = default;
+
+  /// The trie of the sorted, distinct keys in entries[begin, ...), breadth
+  /// first over ranges of keys sharing their first depth bytes.
+  void
+  BuildGoto(std::vector<std::pair<std::string, T>> &entries,
+            std::size_t begin) {
+    struct Pending {
+      std::size_t begin;
+      std::size_t end;
+      std::uint32_t depth;
+    };
+    std::vector<Pending> queue{{begin, entries.size(), 0}};
+    labels_.push_back('\0');
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+      auto [first, end, depth] = queue[head];
+      State state{static_cast<StateId>(queue.size()), kRoot, kNone, kNone,
+                  depth};
+      if (first < end && entries[first].first.size() == depth) {
+        state.match = static_cast<StateId>(values_.size());
+        values_.push_back(std::move(entries[first].second));
+        ++first;
+      }
+      while (first < end) {
+        auto keychar = entries[first].first[depth];
+        auto groupEnd = first + 1;
+        while (groupEnd < end && entries[groupEnd].first[depth] == keychar) {
+          ++groupEnd;
+        }
+        queue.push_back({first, groupEnd, depth + 1});
+        labels_.push_back(keychar);
+        first = groupEnd;
+      }
+      states_.push_back(state);
+    }
+  }
+
+  /// Failure and output links, in breadth first order: a state's failure
+  /// target is shallower, so it is done already.
+  void
+  BuildFailure() {
+    for (StateId parent = 0; parent < states_.size(); ++parent) {
+      for (auto child = states_[parent].firstChild; child < ChildEnd(parent);
+           ++child) {
+        auto byte = static_cast<std::uint8_t>(labels_[child]);
+        auto fail = kRoot;
+        if (parent != kRoot) {
+          auto state = states_[parent].fail;
+          auto next = Goto(state, byte);
+          while (next == kNone && state != kRoot) {
+            state = states_[state].fail;
+            next = Goto(state, byte);
+          }
+          fail = next != kNone ? next : kRoot;
+        }
+        auto &node = states_[child];
+        node.fail = fail;
+        node.output =
+            states_[fail].match != kNone ? fail : states_[fail].output;
+      }
+    }
+  }
+
+  /// Resolved rows for the first kDenseStates states. A failure target is
+  /// shallower, hence numbered lower, hence has its row already.
+  void
+  BuildDense() {
+    dense_.resize(std::min(states_.size(), kDenseStates));
+    for (StateId state = 0; state < dense_.size(); ++state) {
+      for (int byte = 0; byte < 256; ++byte) {
+        auto next = Goto(state, static_cast<std::uint8_t>(byte));
+        if (next == kNone) {
+          next = state == kRoot ? kRoot : dense_[states_[state].fail][byte];
+        }
+        dense_[state][byte] = next;
+      }
+    }
+  }
+
+  void
+  BuildPrefilter() {
+    for (auto child = states_[kRoot].firstChild; child < ChildEnd(kRoot);
+         ++child) {
+      auto byte = static_cast<std::uint8_t>(labels_[child]);
+      first_[byte] = true;
+      firstBytes_.push_back(byte);
+      // row: the low nibble; bit: the high one, of the rows of 0-7 or 8-15.
+      auto &rows = byte < 0x80 ? firstRowsLow_ : firstRowsHigh_;
+      rows[byte & 0x0F] |= static_cast<std::uint8_t>(1U << ((byte >> 4) & 7));
+    }
+  }
+
+  [[nodiscard]] auto
+  ChildEnd(StateId state) const -> StateId {
+    return state + 1 < states_.size()
+               ? states_[state + 1].firstChild
+               : static_cast<StateId>(states_.size());
+  }
+
+  /// the child of state labelled byte, kNone if there is none.
+  [[nodiscard]] auto
+  Goto(StateId state, std::uint8_t byte) const -> StateId {
+    const auto *begin = labels_.data() + states_[state].firstChild;
+    const auto *end = labels_.data() + ChildEnd(state);
+    const auto *found = std::lower_bound(
+        begin, end, byte, [](char label, std::uint8_t wanted) {
+          return static_cast<std::uint8_t>(label) < wanted;
+        });
+    if (found == end || static_cast<std::uint8_t>(*found) != byte) {
+      return kNone;
+    }
+    return static_cast<StateId>(found - labels_.data());
+  }
+
+  /// the transition from state on byte, failure links resolved.
+  [[nodiscard]] auto
+  Next(StateId state, std::uint8_t byte) const -> StateId {
+    while (state >= dense_.size()) {
+      auto next = Goto(state, byte);
+      if (next != kNone) {
+        return next;
+      }
+      state = states_[state].fail;
+    }
+    return dense_[state][byte];
+  }
+
+  /// first position at or after pos whose byte starts a key, or size.
+  [[nodiscard]] auto
+  SkipToFirstByte(const std::uint8_t *bytes,
+                  std::size_t pos,
+                  std::size_t size) const -> std::size_t {
+#if CDI_HAVE_SSSE3
+    const auto rowsLow = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(firstRowsLow_.data()));
+    const auto rowsHigh = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(firstRowsHigh_.data()));
+    const auto bitOf = _mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const auto lowNibble = _mm_set1_epi8(0x0F);
+    const auto topBit = _mm_set1_epi8(static_cast<char>(0x80));
+    for (; pos + 16 <= size; pos += 16) {
+      auto block =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+      // pshufb gives 0 for lanes with the top bit set: those bytes find
+      // their row in the second table, the others in the first.
+      auto rows = _mm_or_si128(
+          _mm_shuffle_epi8(rowsLow, block),
+          _mm_shuffle_epi8(rowsHigh, _mm_xor_si128(block, topBit)));
+      auto bits = _mm_shuffle_epi8(
+          bitOf, _mm_and_si128(_mm_srli_epi16(block, 4), lowNibble));
+      auto misses =
+          _mm_cmpeq_epi8(_mm_and_si128(rows, bits), _mm_setzero_si128());
+      auto mask =
+          static_cast<std::uint32_t>(_mm_movemask_epi8(misses)) ^ 0xFFFFU;
+      if (mask != 0) {
+        return pos + port::LowestBit(mask);
+      }
+    }
+#elif CDI_HAVE_SSE2
+    if (firstBytes_.size() <= kSimdFirstBytes) {
+      for (; pos + 16 <= size; pos += 16) {
+        auto block =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + pos));
+        auto hits = _mm_setzero_si128();
+        for (auto byte : firstBytes_) {
+          hits = _mm_or_si128(
+              hits,
+              _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(byte))));
+        }
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) {
+          return pos + port::LowestBit(mask);
+        }
+      }
+    }
+#endif
+    while (pos < size && !first_[bytes[pos]]) {
+      ++pos;
+    }
+    return pos;
+  }
+
+  std::vector<State> states_;
+  std::vector<char> labels_; // of each state, by id.
+  std::vector<std::array<StateId, 256>> dense_;
+  std::array<bool, 256> first_{};
+  std::vector<std::uint8_t> firstBytes_;
+  // the first bytes by nibbles, see SkipToFirstByte: bytes below 0x80, then
+  // the others.
+  std::array<std::uint8_t, 16> firstRowsLow_{};
+  std::array<std::uint8_t, 16> firstRowsHigh_{};
+  std::vector<T> values_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_AHO_CORASICK_HH
@@ -0,0 +1,88 @@
+//===--- bounds_check.hh - Index checks of cdi containers -------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/bounds_check.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// How vector and small_vector check an index, picked per build or per type:
+//
+//   kUnchecked  no check at all: indexing is std::vector's operator[].
+//   kChecked    one compare and a branch predicted not taken; a bad index
+//               calls ReportOutOfBounds, kept out of line and cold, which
+//               prints the index and a stack trace and aborts.
+//   kHardened   the same branch to a trap instruction: no report, next to no
+//               code, for release builds that must not read out of bounds.
+//
+// The build picks the default with CDI_BOUNDS_CHECK, 0, 1 or 2 for the modes
+// in that order, which the CMake cache variable CDI_BOUNDS_CHECK (unchecked,
+// checked or hardened) defines; else it is unchecked under NDEBUG, and
+// checked otherwise. The mode is a template
+// argument of the containers, so a type can pick its own, and translation
+// units built with different defaults do not share a vector type.
+//
+// Classes: BoundsCheck
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_BOUNDS_CHECK_HH
+#define CDI_CONTAINER_BOUNDS_CHECK_HH
+
+#include "port/port.hh"
+#include <cstddef>
+
+#ifndef CDI_BOUNDS_CHECK
+#ifdef NDEBUG
+#define CDI_BOUNDS_CHECK 0
+#else
+#define CDI_BOUNDS_CHECK 1
+#endif
+#endif
+
+namespace cdi::container {
+
+enum class BoundsCheck { kUnchecked = 0, kChecked = 1, kHardened = 2 };
+
+static_assert(CDI_BOUNDS_CHECK >= 0 && CDI_BOUNDS_CHECK <= 2,
+              "CDI_BOUNDS_CHECK is 0, 1 or 2");
+
+constexpr BoundsCheck kDefaultBoundsCheck =
+    static_cast<BoundsCheck>(CDI_BOUNDS_CHECK);
+
+namespace detail {
+
+/// Print "<container> index out of bounds: index >= size" and the stack to
+/// stderr, and abort.
+[[noreturn, gnu::cold, gnu::noinline]] void
+ReportOutOfBounds(const char *container,
+                  std::size_t index,
+                  std::size_t size) noexcept;
+
+} // namespace detail
+
+/// Check index < size as kCheck says; container names the caller in the
+/// report.
+template <BoundsCheck kCheck>
+[[gnu::always_inline]] inline void
+CheckIndex(std::size_t index, std::size_t size, const char *container) {
+  if constexpr (kCheck == BoundsCheck::kChecked) {
+    if (CDI_UNLIKELY(index >= size)) {
+      detail::ReportOutOfBounds(container, index, size);
+    }
+  } else if constexpr (kCheck == BoundsCheck::kHardened) {
+    if (CDI_UNLIKELY(index >= size)) {
+      CDI_TRAP();
+    }
+  } else {
+    (void)index;
+    (void)size;
+    (void)container;
+  }
+}
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_BOUNDS_CHECK_HH
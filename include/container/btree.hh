@@ -0,0 +1,1178 @@
+//===--- btree.hh - Cache friendly ordered set and map ----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/btree.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Ordered set and map as a B+ tree: values are kept sorted in leaves of
+// kNodeBytes, four cache lines, and inner nodes of the same size hold
+// separator keys and child pointers only. A red-black tree pays a cache miss
+// per level and per element scanned; here a lookup misses about once per
+// level of a much shallower tree, and a scan walks whole leaves, which are
+// linked to their neighbours.
+//
+// A separator is the smallest key of the child to its right when it was
+// made: keys below it are on its left, the others on its right. Erasing a
+// key leaves separators alone, which stay valid bounds.
+//
+// Within a node, arithmetic keys ordered by std::less are not binary
+// searched: the rank of a key is the number of keys below it, counted with
+// SSE2 compares, 4 at a time for 32 bit integers and floats and 2 for
+// doubles. The count is branchless, and for other widths left to the
+// compiler to vectorize. Other keys are binary searched.
+//
+// Nodes split in half, but a leaf or inner node overflowing at its end
+// keeps its keys and starts a new node for the rest: appending keys in order
+// fills the nodes. Nodes below half full after an erasure borrow from a
+// sibling, or are merged with it.
+//
+// Unlike std::set and std::map, values move between nodes: an insertion or
+// erasure invalidates every iterator. Values must be nothrow move
+// constructible.
+//
+// Classes: btree_set, btree_map
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_BTREE_HH
+#define CDI_CONTAINER_BTREE_HH
+
+#include "port/bit.hh"
+#include "port/port.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if CDI_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cdi::container {
+
+namespace detail {
+
+/// whether keys compare by the built-in <, so that a node is searched by
+/// counting the keys below the target.
+template <typename K, typename Compare>
+constexpr bool kCountedSearch =
+    std::is_arithmetic_v<K> && (std::is_same_v<Compare, std::less<K>> ||
+                                std::is_same_v<Compare, std::less<>>);
+
+/// The rank of key among the sorted keys[0, count): the number of keys less
+/// than it, with kUpper the number not greater.
+template <bool kUpper, typename K, typename Compare>
+auto
+SearchNode(const K *keys, std::size_t count, const K &key, const Compare &comp)
+    -> std::size_t {
+  if constexpr (kCountedSearch<K, Compare>) {
+    std::size_t rank = 0;
+    std::size_t i = 0;
+#if CDI_HAVE_SSE2
+    if constexpr (std::is_integral_v<K> && sizeof(K) == 4) {
+      // SSE2 compares signed lanes: unsigned ones flip their sign bit.
+      const auto bias = _mm_set1_epi32(std::is_signed_v<K> ? 0 : INT32_MIN);
+      const auto target =
+          _mm_xor_si128(_mm_set1_epi32(static_cast<std::int32_t>(key)), bias);
+      for (; i + 4 <= count; i += 4) {
+        auto block = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)),
+            bias);
+        if constexpr (kUpper) {
+          auto above = _mm_cmpgt_epi32(block, target);
+          auto mask = _mm_movemask_ps(_mm_castsi128_ps(above));
+          rank += 4 - port::PopCount(static_cast<std::uint32_t>(mask));
+        } else {
+          auto below = _mm_cmplt_epi32(block, target);
+          auto mask = _mm_movemask_ps(_mm_castsi128_ps(below));
+          rank += port::PopCount(static_cast<std::uint32_t>(mask));
+        }
+      }
+    } else if constexpr (std::is_same_v<K, float>) {
+      const auto target = _mm_set1_ps(key);
+      for (; i + 4 <= count; i += 4) {
+        auto block = _mm_loadu_ps(keys + i);
+        auto hits = kUpper ? _mm_cmple_ps(block, target)
+                           : _mm_cmplt_ps(block, target);
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_ps(hits));
+        rank += port::PopCount(mask);
+      }
+    } else if constexpr (std::is_same_v<K, double>) {
+      const auto target = _mm_set1_pd(key);
+      for (; i + 2 <= count; i += 2) {
+        auto block = _mm_loadu_pd(keys + i);
+        auto hits = kUpper ? _mm_cmple_pd(block, target)
+                           : _mm_cmplt_pd(block, target);
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_pd(hits));
+        rank += port::PopCount(mask);
+      }
+    }
+#endif
+    for (; i < count; ++i) {
+      rank += kUpper ? !(key < keys[i]) : keys[i] < key;
+    }
+    return rank;
+  } else if constexpr (kUpper) {
+    return std::upper_bound(keys, keys + count, key, comp) - keys;
+  } else {
+    return std::lower_bound(keys, keys + count, key, comp) - keys;
+  }
+}
+
+/// The B+ tree under btree_set (Value is K) and btree_map (Value is
+/// std::pair<const K, V>).
+template <typename K, typename Value, typename Compare, typename Alloc>
+class BTree {
+protected:
+  constexpr static bool kIsSet = std::is_same_v<Value, K>;
+
+  struct Node {
+    std::uint16_t count; // values of a leaf, keys of an inner node.
+    bool leaf;
+  };
+
+  constexpr static std::size_t kNodeBytes = 256;
+  constexpr static std::size_t kLeafHeader = 2 * sizeof(void *) + sizeof(Node);
+  constexpr static std::size_t kLeafSlots = std::max<std::size_t>(
+      4, (kNodeBytes - kLeafHeader) / sizeof(Value));
+  constexpr static std::size_t kInnerSlots = std::max<std::size_t>(
+      4,
+      (kNodeBytes - sizeof(Node) - sizeof(void *)) /
+          (sizeof(K) + sizeof(void *)));
+  constexpr static std::size_t kMinLeaf = kLeafSlots / 2;
+  constexpr static std::size_t kMinInner = kInnerSlots / 2;
+  constexpr static std::size_t kMaxHeight = 64;
+
+  struct Leaf : Node {
+    auto
+    Slots() -> Value * {
+      return std::launder(reinterpret_cast<Value *>(slots));
+    }
+
+    Leaf *prev;
+    Leaf *next;
+    alignas(Value) unsigned char slots[kLeafSlots * sizeof(Value)];
+  };
+
+  struct Inner : Node {
+    auto
+    Keys() -> K * {
+      return std::launder(reinterpret_cast<K *>(keys));
+    }
+
+    alignas(K) unsigned char keys[kInnerSlots * sizeof(K)];
+    Node *children[kInnerSlots + 1];
+  };
+
+  using LeafAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Leaf>;
+  using InnerAlloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Inner>;
+
+  template <bool kConst>
+  class Iterator {
+    friend class BTree;
+    template <bool>
+    friend class Iterator;
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::conditional_t<kConst, const Value &, Value &>;
+    using pointer = std::conditional_t<kConst, const Value *, Value *>;
+
+    Iterator() = default;
+
+    /// iterator to const_iterator.
+    template <bool kOther, typename = std::enable_if_t<kConst && !kOther>>
+    Iterator(const Iterator<kOther> &other) // NOLINT
+        : leaf_(other.leaf_), index_(other.index_) {}
+
+    auto
+    operator*() const -> reference {
+      return leaf_->Slots()[index_];
+    }
+
+    auto
+    operator->() const -> pointer {
+      return &leaf_->Slots()[index_];
+    }
+
+    auto
+    operator++() -> Iterator & {
+      if (++index_ == leaf_->count && leaf_->next != nullptr) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+      }
+      return *this;
+    }
+
+    auto
+    operator++(int) -> Iterator {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    auto
+    operator--() -> Iterator & {
+      if (index_ == 0) {
+        leaf_ = leaf_->prev;
+        index_ = leaf_->count;
+      }
+      --index_;
+      return *this;
+    }
+
+    auto
+    operator--(int) -> Iterator {
+      auto old = *this;
+      --*this;
+      return old;
+    }
+
+    friend auto
+    operator==(const Iterator &lhs, const Iterator &rhs) -> bool {
+      return lhs.leaf_ == rhs.leaf_ && lhs.index_ == rhs.index_;
+    }
+
+    friend auto
+    operator!=(const Iterator &lhs, const Iterator &rhs) -> bool {
+      return !(lhs == rhs);
+    }
+
+  private:
+    Iterator(Leaf *leaf, std::size_t index) : leaf_(leaf), index_(index) {}
+
+    Leaf *leaf_ = nullptr;
+    std::size_t index_ = 0;
+  };
+
+public:
+  using key_type = K;
+  using value_type = Value;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using key_compare = Compare;
+  using allocator_type = Alloc;
+  using reference = Value &;
+  using const_reference = const Value &;
+  using iterator = Iterator<kIsSet>;
+  using const_iterator = Iterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  BTree() = default;
+
+  explicit BTree(const Compare &comp, const Alloc &alloc = Alloc())
+      : comp_(comp), alloc_(alloc) {}
+
+  BTree(const BTree &other)
+      : comp_(other.comp_),
+        alloc_(std::allocator_traits<Alloc>::
+                   select_on_container_copy_construction(other.alloc_)) {
+    for (const auto &value : other) {
+      (void)InsertUnique(KeyOf(value), value);
+    }
+  }
+
+  BTree(BTree &&other) noexcept
+      : root_(std::exchange(other.root_, nullptr)),
+        leftmost_(std::exchange(other.leftmost_, nullptr)),
+        rightmost_(std::exchange(other.rightmost_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        height_(std::exchange(other.height_, 0)),
+        leaves_(std::exchange(other.leaves_, 0)),
+        inners_(std::exchange(other.inners_, 0)), comp_(other.comp_),
+        alloc_(std::move(other.alloc_)) {}
+
+  auto
+  operator=(const BTree &other) -> BTree & {
+    if (this != &other) {
+      BTree copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  auto
+  operator=(BTree &&other) noexcept -> BTree & {
+    if (this != &other) {
+      BTree moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+
+  ~BTree() { clear(); }
+
+  //===--------------------------------------------------------------------===
+  // iteration and capacity
+  //===--------------------------------------------------------------------===
+
+  auto
+  begin() -> iterator {
+    return iterator(leftmost_, 0);
+  }
+
+  auto
+  end() -> iterator {
+    return iterator(rightmost_, rightmost_ == nullptr ? 0 : rightmost_->count);
+  }
+
+  auto
+  begin() const -> const_iterator {
+    return const_cast<BTree *>(this)->begin();
+  }
+
+  auto
+  end() const -> const_iterator {
+    return const_cast<BTree *>(this)->end();
+  }
+
+  auto
+  cbegin() const -> const_iterator {
+    return begin();
+  }
+
+  auto
+  cend() const -> const_iterator {
+    return end();
+  }
+
+  auto
+  rbegin() -> reverse_iterator {
+    return reverse_iterator(end());
+  }
+
+  auto
+  rend() -> reverse_iterator {
+    return reverse_iterator(begin());
+  }
+
+  auto
+  rbegin() const -> const_reverse_iterator {
+    return const_reverse_iterator(end());
+  }
+
+  auto
+  rend() const -> const_reverse_iterator {
+    return const_reverse_iterator(begin());
+  }
+
+  [[nodiscard]] auto
+  empty() const -> bool {
+    return size_ == 0;
+  }
+
+  [[nodiscard]] auto
+  size() const -> size_type {
+    return size_;
+  }
+
+  /// levels of nodes, 0 when nothing was ever inserted.
+  [[nodiscard]] auto
+  height() const -> std::size_t {
+    return height_;
+  }
+
+  /// bytes of nodes allocated.
+  [[nodiscard]] auto
+  bytes_used() const -> std::size_t {
+    return leaves_ * sizeof(Leaf) + inners_ * sizeof(Inner);
+  }
+
+  void
+  clear() {
+    if (root_ != nullptr) {
+      Destroy(root_);
+    }
+    root_ = nullptr;
+    leftmost_ = nullptr;
+    rightmost_ = nullptr;
+    size_ = 0;
+    height_ = 0;
+  }
+
+  void
+  swap(BTree &other) noexcept {
+    using std::swap;
+    swap(root_, other.root_);
+    swap(leftmost_, other.leftmost_);
+    swap(rightmost_, other.rightmost_);
+    swap(size_, other.size_);
+    swap(height_, other.height_);
+    swap(leaves_, other.leaves_);
+    swap(inners_, other.inners_);
+    swap(comp_, other.comp_);
+    swap(alloc_, other.alloc_);
+  }
+
+  //===--------------------------------------------------------------------===
+  // lookup
+  //===--------------------------------------------------------------------===
+
+  auto
+  lower_bound(const K &key) -> iterator {
+    return Bound<false>(key);
+  }
+
+  auto
+  lower_bound(const K &key) const -> const_iterator {
+    return const_cast<BTree *>(this)->lower_bound(key);
+  }
+
+  auto
+  upper_bound(const K &key) -> iterator {
+    return Bound<true>(key);
+  }
+
+  auto
+  upper_bound(const K &key) const -> const_iterator {
+    return const_cast<BTree *>(this)->upper_bound(key);
+  }
+
+  auto
+  equal_range(const K &key) -> std::pair<iterator, iterator> {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  auto
+  equal_range(const K &key) const -> std::pair<const_iterator, const_iterator> {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  auto
+  find(const K &key) -> iterator {
+    auto found = lower_bound(key);
+    if (found == end() || comp_(key, KeyOf(*found))) {
+      return end();
+    }
+    return found;
+  }
+
+  auto
+  find(const K &key) const -> const_iterator {
+    return const_cast<BTree *>(this)->find(key);
+  }
+
+  [[nodiscard]] auto
+  contains(const K &key) const -> bool {
+    return find(key) != end();
+  }
+
+  [[nodiscard]] auto
+  count(const K &key) const -> size_type {
+    return contains(key) ? 1 : 0;
+  }
+
+  auto
+  key_comp() const -> key_compare {
+    return comp_;
+  }
+
+  auto
+  get_allocator() const -> allocator_type {
+    return alloc_;
+  }
+
+  //===--------------------------------------------------------------------===
+  // modification
+  //===--------------------------------------------------------------------===
+
+  auto
+  insert(const Value &value) -> std::pair<iterator, bool> {
+    return InsertUnique(KeyOf(value), value);
+  }
+
+  auto
+  insert(Value &&value) -> std::pair<iterator, bool> {
+    return InsertUnique(KeyOf(value), std::move(value));
+  }
+
+  template <typename InputIt>
+  void
+  insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      (void)emplace(*first);
+    }
+  }
+
+  void
+  insert(std::initializer_list<Value> values) {
+    insert(values.begin(), values.end());
+  }
+
+  /// Builds the value first, to find its key.
+  template <typename... Args>
+  auto
+  emplace(Args &&...args) -> std::pair<iterator, bool> {
+    Value value(std::forward<Args>(args)...);
+    return insert(std::move(value));
+  }
+
+  auto
+  erase(const K &key) -> size_type {
+    auto found = find(key);
+    if (found == end()) {
+      return 0;
+    }
+    (void)erase(found);
+    return 1;
+  }
+
+  /// \return the iterator after pos.
+  auto
+  erase(const_iterator pos) -> iterator {
+    return EraseAt(KeyOf(*pos));
+  }
+
+  template <bool kMutable = !kIsSet, typename = std::enable_if_t<kMutable>>
+  auto
+  erase(iterator pos) -> iterator {
+    return erase(const_iterator(pos));
+  }
+
+  auto
+  erase(const_iterator first, const_iterator last) -> iterator {
+    if (first == begin() && last == end()) {
+      clear();
+      return end();
+    }
+    // iterators do not survive an erasure: count, then erase that many.
+    auto erased = std::distance(first, last);
+    auto next = iterator(first.leaf_, first.index_);
+    for (; erased > 0; --erased) {
+      next = erase(const_iterator(next));
+    }
+    return next;
+  }
+
+  friend auto
+  operator==(const BTree &lhs, const BTree &rhs) -> bool {
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin());
+  }
+
+  friend auto
+  operator!=(const BTree &lhs, const BTree &rhs) -> bool {
+    return !(lhs == rhs);
+  }
+
+  friend auto
+  operator<(const BTree &lhs, const BTree &rhs) -> bool {
+    return std::lexicographical_compare(
+        lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+protected:
+  static auto
+  KeyOf(const Value &value) -> const K & {
+    if constexpr (kIsSet) {
+      return value;
+    } else {
+      return value.first;
+    }
+  }
+
+  /// Insert Value(args...) unless key, its key, is there.
+  template <typename... Args>
+  auto
+  InsertUnique(const K &key, Args &&...args) -> std::pair<iterator, bool> {
+    if (root_ == nullptr) {
+      root_ = leftmost_ = rightmost_ = NewLeaf();
+      height_ = 1;
+    }
+    Inner *path[kMaxHeight];
+    std::size_t branch[kMaxHeight];
+    std::size_t depth = 0;
+    auto *leaf = Descend(key, path, branch, depth);
+    auto pos = LeafRank<false>(leaf, key);
+    if (pos < leaf->count && !comp_(key, KeyOf(leaf->Slots()[pos]))) {
+      return {iterator(leaf, pos), false};
+    }
+    Value value(std::forward<Args>(args)...);
+    ++size_;
+    if (leaf->count < kLeafSlots) {
+      Emplace(leaf, pos, std::move(value));
+      return {iterator(leaf, pos), true};
+    }
+
+    // split, keeping a leaf full when appending past the last key.
+    auto *right = NewLeaf();
+    std::size_t split = pos == leaf->count && leaf->next == nullptr
+                            ? leaf->count
+                            : leaf->count / 2;
+    Relocate(right->Slots(), leaf->Slots() + split, leaf->count - split);
+    right->count = static_cast<std::uint16_t>(leaf->count - split);
+    leaf->count = static_cast<std::uint16_t>(split);
+    right->prev = leaf;
+    right->next = leaf->next;
+    (right->next != nullptr ? right->next->prev : rightmost_) = right;
+    leaf->next = right;
+    auto inserted =
+        pos < split ? iterator(leaf, pos) : iterator(right, pos - split);
+    if (pos < split) {
+      Emplace(leaf, pos, std::move(value));
+    } else {
+      Emplace(right, pos - split, std::move(value));
+    }
+    InsertSeparator(path, branch, depth, KeyOf(right->Slots()[0]), right);
+    return {inserted, true};
+  }
+
+  /// Rank of key in a leaf, see SearchNode.
+  template <bool kUpper>
+  auto
+  LeafRank(Leaf *leaf, const K &key) const -> std::size_t {
+    auto *slots = leaf->Slots();
+    if constexpr (kIsSet) {
+      return SearchNode<kUpper>(slots, leaf->count, key, comp_);
+    } else if constexpr (kUpper) {
+      return std::upper_bound(slots,
+                              slots + leaf->count,
+                              key,
+                              [this](const K &lhs, const Value &rhs) {
+                                return comp_(lhs, rhs.first);
+                              }) -
+             slots;
+    } else {
+      return std::lower_bound(slots,
+                              slots + leaf->count,
+                              key,
+                              [this](const Value &lhs, const K &rhs) {
+                                return comp_(lhs.first, rhs);
+                              }) -
+             slots;
+    }
+  }
+
+  /// The leaf where key is or would be, with the inner nodes on the way and
+  /// the branch taken in each when path is given.
+  auto
+  Descend(const K &key, Inner **path, std::size_t *branch, std::size_t &depth)
+      const -> Leaf * {
+    auto *node = root_;
+    while (!node->leaf) {
+      auto *inner = static_cast<Inner *>(node);
+      // a key equal to a separator is on its right.
+      auto index = SearchNode<true>(inner->Keys(), inner->count, key, comp_);
+      if (path != nullptr) {
+        path[depth] = inner;
+        branch[depth] = index;
+        ++depth;
+      }
+      node = inner->children[index];
+    }
+    return static_cast<Leaf *>(node);
+  }
+
+  template <bool kUpper>
+  auto
+  Bound(const K &key) -> iterator {
+    if (root_ == nullptr) {
+      return end();
+    }
+    std::size_t depth = 0;
+    auto *leaf = Descend(key, nullptr, nullptr, depth);
+    auto pos = LeafRank<kUpper>(leaf, key);
+    if (pos == leaf->count && leaf->next != nullptr) {
+      return iterator(leaf->next, 0);
+    }
+    return iterator(leaf, pos);
+  }
+
+  /// Add separator and the node right of it after branch[depth - 1] of
+  /// path[depth - 1], splitting inner nodes up the path as need be.
+  void
+  InsertSeparator(Inner **path,
+                  const std::size_t *branch,
+                  std::size_t depth,
+                  const K &separator,
+                  Node *right) {
+    K key(separator);
+    while (depth > 0) {
+      --depth;
+      auto *inner = path[depth];
+      auto index = branch[depth];
+      if (inner->count < kInnerSlots) {
+        InsertKey(inner, index, std::move(key), right);
+        return;
+      }
+      // split around the key at middle, which goes up; keep the node full
+      // when appending past its last key.
+      std::size_t count = inner->count;
+      std::size_t middle = index == count ? count - 1 : count / 2;
+      auto *sibling = NewInner();
+      auto *keys = inner->Keys();
+      RelocateKeys(sibling->Keys(), keys + middle + 1, count - middle - 1);
+      std::copy(inner->children + middle + 1,
+                inner->children + count + 1,
+                sibling->children);
+      sibling->count = static_cast<std::uint16_t>(count - middle - 1);
+      K up(std::move(keys[middle]));
+      keys[middle].~K();
+      inner->count = static_cast<std::uint16_t>(middle);
+      if (index <= middle) {
+        InsertKey(inner, index, std::move(key), right);
+      } else {
+        InsertKey(sibling, index - middle - 1, std::move(key), right);
+      }
+      key = std::move(up);
+      right = sibling;
+    }
+    // the root split.
+    auto *root = NewInner();
+    new (root->Keys()) K(std::move(key));
+    root->children[0] = root_;
+    root->children[1] = right;
+    root->count = 1;
+    root_ = root;
+    ++height_;
+  }
+
+  /// Erase the value of key, which is there.
+  /// \return the iterator to the value after it.
+  auto
+  EraseAt(const K &key) -> iterator {
+    Inner *path[kMaxHeight];
+    std::size_t branch[kMaxHeight];
+    std::size_t depth = 0;
+    auto *leaf = Descend(key, path, branch, depth);
+    auto pos = LeafRank<false>(leaf, key);
+    auto *slots = leaf->Slots();
+    slots[pos].~Value();
+    Relocate(slots + pos, slots + pos + 1, leaf->count - pos - 1);
+    --leaf->count;
+    --size_;
+    auto next = RebalanceLeaf(leaf, pos, path, branch, depth);
+    if (next.index_ == next.leaf_->count && next.leaf_->next != nullptr) {
+      next = iterator(next.leaf_->next, 0);
+    }
+    return next;
+  }
+
+  /// Restore the occupancy of leaf after an erasure at pos.
+  /// \return where the value at pos went.
+  auto
+  RebalanceLeaf(Leaf *leaf,
+                std::size_t pos,
+                Inner **path,
+                const std::size_t *branch,
+                std::size_t depth) -> iterator {
+    if (depth == 0 || leaf->count >= kMinLeaf) {
+      return iterator(leaf, pos);
+    }
+    auto *parent = path[depth - 1];
+    auto index = branch[depth - 1];
+    auto *left = index > 0 ? static_cast<Leaf *>(parent->children[index - 1])
+                           : nullptr;
+    auto *right = index < parent->count
+                      ? static_cast<Leaf *>(parent->children[index + 1])
+                      : nullptr;
+    if (left != nullptr && left->count > kMinLeaf) {
+      RelocateBackward(leaf->Slots() + 1, leaf->Slots(), leaf->count);
+      Relocate(leaf->Slots(), left->Slots() + left->count - 1, 1);
+      --left->count;
+      ++leaf->count;
+      parent->Keys()[index - 1] = KeyOf(leaf->Slots()[0]);
+      return iterator(leaf, pos + 1);
+    }
+    if (right != nullptr && right->count > kMinLeaf) {
+      Relocate(leaf->Slots() + leaf->count, right->Slots(), 1);
+      Relocate(right->Slots(), right->Slots() + 1, right->count - 1);
+      --right->count;
+      ++leaf->count;
+      parent->Keys()[index] = KeyOf(right->Slots()[0]);
+      return iterator(leaf, pos);
+    }
+    iterator next;
+    if (left != nullptr) {
+      next = iterator(left, left->count + pos);
+      MergeLeaves(left, leaf);
+      EraseKey(parent, index - 1);
+    } else if (right != nullptr) {
+      next = iterator(leaf, pos);
+      MergeLeaves(leaf, right);
+      EraseKey(parent, index);
+    } else {
+      return iterator(leaf, pos);
+    }
+    RebalanceInner(path, branch, depth - 1);
+    return next;
+  }
+
+  /// Move the values of right to the end of left, and free right.
+  void
+  MergeLeaves(Leaf *left, Leaf *right) {
+    Relocate(left->Slots() + left->count, right->Slots(), right->count);
+    left->count = static_cast<std::uint16_t>(left->count + right->count);
+    left->next = right->next;
+    (left->next != nullptr ? left->next->prev : rightmost_) = left;
+    right->count = 0;
+    FreeLeaf(right);
+  }
+
+  /// Restore the occupancy of path[depth] after it lost a key, on up.
+  void
+  RebalanceInner(Inner **path, const std::size_t *branch, std::size_t depth) {
+    for (;; --depth) {
+      auto *inner = path[depth];
+      if (depth == 0) {
+        if (inner->count == 0) {
+          // the root is down to one child, which takes its place.
+          root_ = inner->children[0];
+          FreeInner(inner);
+          --height_;
+        }
+        return;
+      }
+      if (inner->count >= kMinInner) {
+        return;
+      }
+      auto *parent = path[depth - 1];
+      auto index = branch[depth - 1];
+      auto *keys = parent->Keys();
+      auto *left = index > 0 ? static_cast<Inner *>(parent->children[index - 1])
+                             : nullptr;
+      auto *right = index < parent->count
+                        ? static_cast<Inner *>(parent->children[index + 1])
+                        : nullptr;
+      if (left != nullptr && left->count > kMinInner) {
+        // rotate right through the parent.
+        RelocateKeysBackward(inner->Keys() + 1, inner->Keys(), inner->count);
+        std::copy_backward(inner->children,
+                           inner->children + inner->count + 1,
+                           inner->children + inner->count + 2);
+        new (inner->Keys()) K(std::move(keys[index - 1]));
+        inner->children[0] = left->children[left->count];
+        ++inner->count;
+        auto *last = left->Keys() + left->count - 1;
+        keys[index - 1] = std::move(*last);
+        last->~K();
+        --left->count;
+        return;
+      }
+      if (right != nullptr && right->count > kMinInner) {
+        // rotate left through the parent.
+        new (inner->Keys() + inner->count) K(std::move(keys[index]));
+        inner->children[inner->count + 1] = right->children[0];
+        ++inner->count;
+        keys[index] = std::move(right->Keys()[0]);
+        right->Keys()[0].~K();
+        RelocateKeys(right->Keys(), right->Keys() + 1, right->count - 1);
+        std::copy(right->children + 1,
+                  right->children + right->count + 1,
+                  right->children);
+        --right->count;
+        return;
+      }
+      if (left != nullptr) {
+        MergeInners(left, inner, parent, index - 1);
+      } else {
+        MergeInners(inner, right, parent, index);
+      }
+    }
+  }
+
+  /// Pull separator `index` of parent down between left and right, move
+  /// right into left, and free right.
+  void
+  MergeInners(Inner *left, Inner *right, Inner *parent, std::size_t index) {
+    new (left->Keys() + left->count) K(std::move(parent->Keys()[index]));
+    RelocateKeys(
+        left->Keys() + left->count + 1, right->Keys(), right->count);
+    std::copy(right->children,
+              right->children + right->count + 1,
+              left->children + left->count + 1);
+    left->count = static_cast<std::uint16_t>(left->count + right->count + 1);
+    right->count = 0;
+    FreeInner(right);
+    EraseKey(parent, index);
+  }
+
+  /// Insert key at index and child right of it.
+  void
+  InsertKey(Inner *inner, std::size_t index, K &&key, Node *child) {
+    auto *keys = inner->Keys();
+    RelocateKeysBackward(keys + index + 1, keys + index, inner->count - index);
+    new (keys + index) K(std::move(key));
+    std::copy_backward(inner->children + index + 1,
+                       inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->children[index + 1] = child;
+    ++inner->count;
+  }
+
+  /// Erase key index and the child right of it, which is gone.
+  void
+  EraseKey(Inner *inner, std::size_t index) {
+    auto *keys = inner->Keys();
+    keys[index].~K();
+    RelocateKeys(keys + index, keys + index + 1, inner->count - index - 1);
+    std::copy(inner->children + index + 2,
+              inner->children + inner->count + 1,
+              inner->children + index + 1);
+    --inner->count;
+  }
+
+  /// Construct value at pos of a leaf with room, moving the ones after.
+  void
+  Emplace(Leaf *leaf, std::size_t pos, Value &&value) {
+    auto *slots = leaf->Slots();
+    RelocateBackward(slots + pos + 1, slots + pos, leaf->count - pos);
+    new (slots + pos) Value(MoveOut(value));
+    ++leaf->count;
+  }
+
+  /// value as an rvalue, the key of a map's pair included.
+  static auto
+  MoveOut(Value &value) -> decltype(auto) {
+    if constexpr (kIsSet) {
+      return std::move(value);
+    } else {
+      return std::pair<K &&, typename Value::second_type &&>(
+          std::move(const_cast<K &>(value.first)), std::move(value.second));
+    }
+  }
+
+  /// move count values from src to the lower dst, forward.
+  static void
+  Relocate(Value *dst, Value *src, std::size_t count) {
+    if constexpr (std::is_trivially_copyable_v<Value>) {
+      std::memmove(static_cast<void *>(dst), src, count * sizeof(Value));
+    } else {
+      for (std::size_t i = 0; i < count; ++i) {
+        new (dst + i) Value(MoveOut(src[i]));
+        src[i].~Value();
+      }
+    }
+  }
+
+  /// move count values from src to the higher dst, backward.
+  static void
+  RelocateBackward(Value *dst, Value *src, std::size_t count) {
+    if constexpr (std::is_trivially_copyable_v<Value>) {
+      std::memmove(static_cast<void *>(dst), src, count * sizeof(Value));
+    } else {
+      for (auto i = count; i > 0; --i) {
+        new (dst + i - 1) Value(MoveOut(src[i - 1]));
+        src[i - 1].~Value();
+      }
+    }
+  }
+
+  static void
+  RelocateKeys(K *dst, K *src, std::size_t count) {
+    if constexpr (std::is_trivially_copyable_v<K>) {
+      std::memmove(static_cast<void *>(dst), src, count * sizeof(K));
+    } else {
+      for (std::size_t i = 0; i < count; ++i) {
+        new (dst + i) K(std::move(src[i]));
+        src[i].~K();
+      }
+    }
+  }
+
+  static void
+  RelocateKeysBackward(K *dst, K *src, std::size_t count) {
+    if constexpr (std::is_trivially_copyable_v<K>) {
+      std::memmove(static_cast<void *>(dst), src, count * sizeof(K));
+    } else {
+      for (auto i = count; i > 0; --i) {
+        new (dst + i - 1) K(std::move(src[i - 1]));
+        src[i - 1].~K();
+      }
+    }
+  }
+
+  auto
+  NewLeaf() -> Leaf * {
+    LeafAlloc alloc(alloc_);
+    auto *leaf = std::allocator_traits<LeafAlloc>::allocate(alloc, 1);
+    leaf->count = 0;
+    leaf->leaf = true;
+    leaf->prev = nullptr;
+    leaf->next = nullptr;
+    ++leaves_;
+    return leaf;
+  }
+
+  auto
+  NewInner() -> Inner * {
+    InnerAlloc alloc(alloc_);
+    auto *inner = std::allocator_traits<InnerAlloc>::allocate(alloc, 1);
+    inner->count = 0;
+    inner->leaf = false;
+    ++inners_;
+    return inner;
+  }
+
+  void
+  FreeLeaf(Leaf *leaf) {
+    LeafAlloc alloc(alloc_);
+    std::allocator_traits<LeafAlloc>::deallocate(alloc, leaf, 1);
+    --leaves_;
+  }
+
+  void
+  FreeInner(Inner *inner) {
+    InnerAlloc alloc(alloc_);
+    std::allocator_traits<InnerAlloc>::deallocate(alloc, inner, 1);
+    --inners_;
+  }
+
+  void
+  Destroy(Node *node) {
+    if (node->leaf) {
+      auto *leaf = static_cast<Leaf *>(node);
+      std::destroy_n(leaf->Slots(), leaf->count);
+      FreeLeaf(leaf);
+      return;
+    }
+    auto *inner = static_cast<Inner *>(node);
+    for (std::size_t child = 0; child <= inner->count; ++child) {
+      Destroy(inner->children[child]);
+    }
+    std::destroy_n(inner->Keys(), inner->count);
+    FreeInner(inner);
+  }
+
+  Node *root_ = nullptr;
+  Leaf *leftmost_ = nullptr;
+  Leaf *rightmost_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t height_ = 0;
+  std::size_t leaves_ = 0;
+  std::size_t inners_ = 0;
+  Compare comp_;
+  Alloc alloc_;
+};
+
+} // namespace detail
+
+template <typename K,
+          typename Compare = std::less<K>,
+          typename Alloc = std::allocator<K>>
+class btree_set : public detail::BTree<K, K, Compare, Alloc> {
+  using Base = detail::BTree<K, K, Compare, Alloc>;
+
+public:
+  using value_compare = Compare;
+
+  btree_set() = default;
+  using Base::Base;
+
+  template <typename InputIt>
+  btree_set(InputIt first, InputIt last, const Compare &comp = Compare())
+      : Base(comp) {
+    this->insert(first, last);
+  }
+
+  btree_set(std::initializer_list<K> values, const Compare &comp = Compare())
+      : btree_set(values.begin(), values.end(), comp) {}
+
+  auto
+  value_comp() const -> value_compare {
+    return this->comp_;
+  }
+};
+
+template <typename K,
+          typename V,
+          typename Compare = std::less<K>,
+          typename Alloc = std::allocator<std::pair<const K, V>>>
+class btree_map
+    : public detail::BTree<K, std::pair<const K, V>, Compare, Alloc> {
+  using Base = detail::BTree<K, std::pair<const K, V>, Compare, Alloc>;
+
+public:
+  using mapped_type = V;
+  using typename Base::iterator;
+
+  btree_map() = default;
+  using Base::Base;
+
+  template <typename InputIt>
+  btree_map(InputIt first, InputIt last, const Compare &comp = Compare())
+      : Base(comp) {
+    this->insert(first, last);
+  }
+
+  btree_map(std::initializer_list<std::pair<const K, V>> values,
+            const Compare &comp = Compare())
+      : btree_map(values.begin(), values.end(), comp) {}
+
+  /// Insert V(args...) if key is missing; args are left alone otherwise.
+  template <typename... Args>
+  auto
+  try_emplace(const K &key, Args &&...args) -> std::pair<iterator, bool> {
+    return this->InsertUnique(
+        key,
+        std::piecewise_construct,
+        std::forward_as_tuple(key),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  auto
+  try_emplace(K &&key, Args &&...args) -> std::pair<iterator, bool> {
+    return this->InsertUnique(
+        key,
+        std::piecewise_construct,
+        std::forward_as_tuple(std::move(key)),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename Value>
+  auto
+  insert_or_assign(const K &key, Value &&value) -> std::pair<iterator, bool> {
+    auto result = try_emplace(key, std::forward<Value>(value));
+    if (!result.second) {
+      result.first->second = std::forward<Value>(value);
+    }
+    return result;
+  }
+
+  auto
+  operator[](const K &key) -> V & {
+    return try_emplace(key).first->second;
+  }
+
+  auto
+  operator[](K &&key) -> V & {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  auto
+  at(const K &key) -> V & {
+    auto found = this->find(key);
+    if (found == this->end()) {
+      throw std::out_of_range("btree_map::at: no such key");
+    }
+    return found->second;
+  }
+
+  auto
+  at(const K &key) const -> const V & {
+    return const_cast<btree_map *>(this)->at(key);
+  }
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_BTREE_HH
@@ -0,0 +1,287 @@
+//===--- concurrent_hash_map.hh - Thread safe hash map ----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/concurrent_hash_map.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// A hash map for many threads, split into shards as ShardedTrie is: a key
+// lives in the flat_hash_map of one shard, picked by the top bits of its
+// hash, behind a reader-writer latch of that shard only. Readers of a shard
+// share its latch, writers to different shards never meet, and each shard
+// sits on cache lines of its own, so neither do their latches.
+//
+// A shard grows on its own, under its own latch, when its table is full:
+// there is no stop-the-world rehash. A resize moves 1/shards of the values,
+// and only the threads using that shard wait for it.
+//
+// References cannot outlive a latch, so lookups copy the value out, or hand
+// it to a visitor that runs under the shard's latch. Visitors and predicates
+// must be short, and must not touch the map.
+//
+// Classes: concurrent_hash_map
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_CONCURRENT_HASH_MAP_HH
+#define CDI_CONTAINER_CONCURRENT_HASH_MAP_HH
+
+#include "constructor/maybe.hh"
+#include "container/flat_hash_map.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace cdi::container {
+
+template <typename K,
+          typename V,
+          typename Hash = std::hash<K>,
+          typename Eq = std::equal_to<K>>
+class concurrent_hash_map {
+  constexpr static std::size_t kCacheLineSize = 64;
+
+  using Map = flat_hash_map<K, V, Hash, Eq>;
+
+  struct alignas(kCacheLineSize) Shard {
+    mutable std::shared_mutex latch;
+    Map map;
+  };
+
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using size_type = std::size_t;
+
+  constexpr static std::size_t kMaxShards = 1024;
+
+  /// \param shards rounded up to a power of two; 0 for four per core, so
+  /// that two threads rarely pick the same shard.
+  explicit concurrent_hash_map(std::size_t shards = 0,
+                               const Hash &hash = Hash(),
+                               const Eq &eq = Eq())
+      : hash_(hash) {
+    if (shards == 0) {
+      shards =
+          4 * std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    shards = std::clamp<std::size_t>(shards, 1, kMaxShards);
+    while ((std::size_t{1} << shardBits_) < shards) {
+      ++shardBits_;
+    }
+    shards_ = std::make_unique<Shard[]>(ShardCount());
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      shards_[shard].map = Map(0, hash, eq);
+    }
+  }
+
+  concurrent_hash_map(const concurrent_hash_map &) = delete;
+  auto
+  operator=(const concurrent_hash_map &) -> concurrent_hash_map & = delete;
+
+  [[nodiscard]] auto
+  ShardCount() const -> std::size_t {
+    return std::size_t{1} << shardBits_;
+  }
+
+  /// Make room for count values in all, spread evenly over the shards.
+  void
+  reserve(size_type count) {
+    auto perShard = (count + ShardCount() - 1) / ShardCount();
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      std::unique_lock latch(shards_[shard].latch);
+      shards_[shard].map.reserve(perShard);
+    }
+  }
+
+  //===--------------------------------------------------------------------===
+  // lookup
+  //===--------------------------------------------------------------------===
+
+  /// a copy of the value of key.
+  auto
+  find(const K &key) const -> cdi::constructor::Maybe<V> {
+    cdi::constructor::Maybe<V> found;
+    (void)visit(key, [&found](const V &value) { found = value; });
+    return found;
+  }
+
+  [[nodiscard]] auto
+  contains(const K &key) const -> bool {
+    const auto &shard = At(key);
+    std::shared_lock latch(shard.latch);
+    return shard.map.contains(key);
+  }
+
+  /// Call visitor(const V &) on the value of key, under the shared latch of
+  /// its shard: to read part of a large value without copying all of it.
+  /// \return false if key has no value.
+  template <typename Visitor>
+  auto
+  visit(const K &key, Visitor &&visitor) const -> bool {
+    const auto &shard = At(key);
+    std::shared_lock latch(shard.latch);
+    auto found = shard.map.find(key);
+    if (found == shard.map.end()) {
+      return false;
+    }
+    visitor(static_cast<const V &>(found->second));
+    return true;
+  }
+
+  /// Call visitor(const K &, const V &) on every entry, one shard at a time
+  /// under its shared latch: entries changed meanwhile may or may not be
+  /// seen, those that stay are seen once.
+  template <typename Visitor>
+  void
+  for_each(Visitor &&visitor) const {
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      std::shared_lock latch(shards_[shard].latch);
+      for (const auto &[key, value] : shards_[shard].map) {
+        visitor(key, value);
+      }
+    }
+  }
+
+  /// number of entries; only a snapshot while writers go on.
+  [[nodiscard]] auto
+  size() const -> size_type {
+    size_type size = 0;
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      std::shared_lock latch(shards_[shard].latch);
+      size += shards_[shard].map.size();
+    }
+    return size;
+  }
+
+  [[nodiscard]] auto
+  empty() const -> bool {
+    return size() == 0;
+  }
+
+  //===--------------------------------------------------------------------===
+  // modification
+  //===--------------------------------------------------------------------===
+
+  /// \return false if key already has a value, which is kept.
+  template <typename... Args>
+  auto
+  try_emplace(const K &key, Args &&...args) -> bool {
+    auto &shard = At(key);
+    std::unique_lock latch(shard.latch);
+    return shard.map.try_emplace(key, std::forward<Args>(args)...).second;
+  }
+
+  auto
+  insert(const K &key, V value) -> bool {
+    return try_emplace(key, std::move(value));
+  }
+
+  /// \return true if key had no value.
+  auto
+  insert_or_assign(const K &key, V value) -> bool {
+    auto &shard = At(key);
+    std::unique_lock latch(shard.latch);
+    return shard.map.insert_or_assign(key, std::move(value)).second;
+  }
+
+  /// Call fn(V &) on the value of key in place, under the exclusive latch
+  /// of its shard, e.g. to bump a counter.
+  /// \return false if key has no value.
+  template <typename Fn>
+  auto
+  update(const K &key, Fn &&fn) -> bool {
+    auto &shard = At(key);
+    std::unique_lock latch(shard.latch);
+    auto found = shard.map.find(key);
+    if (found == shard.map.end()) {
+      return false;
+    }
+    fn(found->second);
+    return true;
+  }
+
+  auto
+  erase(const K &key) -> bool {
+    auto &shard = At(key);
+    std::unique_lock latch(shard.latch);
+    return shard.map.erase(key) == 1;
+  }
+
+  /// Erase key if pred(const V &) holds for its value, atomically: e.g. to
+  /// drop a cache entry only if nobody refreshed it meanwhile.
+  template <typename Pred>
+  auto
+  erase_if(const K &key, Pred &&pred) -> bool {
+    auto &shard = At(key);
+    std::unique_lock latch(shard.latch);
+    auto found = shard.map.find(key);
+    if (found == shard.map.end() ||
+        !pred(static_cast<const V &>(found->second))) {
+      return false;
+    }
+    shard.map.erase(found);
+    return true;
+  }
+
+  /// Erase every entry for which pred(const K &, const V &) holds, one
+  /// shard at a time under its exclusive latch.
+  /// \return the number of entries erased.
+  template <typename Pred>
+  auto
+  erase_if(Pred &&pred) -> size_type {
+    size_type erased = 0;
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      std::unique_lock latch(shards_[shard].latch);
+      auto &map = shards_[shard].map;
+      for (auto iter = map.begin(); iter != map.end();) {
+        if (pred(static_cast<const K &>(iter->first),
+                 static_cast<const V &>(iter->second))) {
+          iter = map.erase(iter);
+          ++erased;
+        } else {
+          ++iter;
+        }
+      }
+    }
+    return erased;
+  }
+
+  void
+  clear() {
+    for (std::size_t shard = 0; shard < ShardCount(); ++shard) {
+      std::unique_lock latch(shards_[shard].latch);
+      shards_[shard].map.clear();
+    }
+  }
+
+private:
+  /// the shard of key, by the top bits of its hash: the shard's map probes
+  /// by the low ones.
+  auto
+  At(const K &key) const -> Shard & {
+    if (shardBits_ == 0) {
+      return shards_[0];
+    }
+    auto hash = detail::MixHash(hash_(key));
+    return shards_[hash >> (sizeof(std::size_t) * 8 - shardBits_)];
+  }
+
+  Hash hash_;
+  std::size_t shardBits_ = 0;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_CONCURRENT_HASH_MAP_HH
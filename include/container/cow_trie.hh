@@ -0,0 +1,258 @@
+//===--- cow_trie.hh - Persistent copy on write trie ------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/cow_trie.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// The RCU flavour of the trie, for read mostly workloads.
+//
+// Nodes are immutable once published. A writer copies the root-to-leaf path it
+// changes, shares every untouched subtree with the old version and swings the
+// root pointer. Readers load the root and walk down with plain loads, without
+// any lock; they only announce themselves to the epoch reclaimer, so the
+// replaced path is freed after the last reader that could see it is gone.
+//
+// Writers are serialized among themselves, they never block readers.
+//
+// Classes: CowTrie
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_COW_TRIE_HH
+#define CDI_CONTAINER_COW_TRIE_HH
+
+#include "concurrency/epoch.hh"
+#include "constructor/maybe.hh"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cdi::container {
+
+template <typename T>
+class CowTrie {
+  struct Node {
+    using Edge = std::pair<char, const Node *>;
+
+    [[nodiscard]] auto
+    GetChild(char key) const -> const Node * {
+      auto iter = LowerBound(key);
+      if (iter == children_.end() || iter->first != key) {
+        return nullptr;
+      }
+      return iter->second;
+    }
+
+    [[nodiscard]] auto
+    LowerBound(char key) const -> typename std::vector<Edge>::const_iterator {
+      return std::lower_bound(
+          children_.begin(),
+          children_.end(),
+          key,
+          [](const Edge &edge, char target) { return edge.first < target; });
+    }
+
+    /// copy of this node, sharing the children.
+    [[nodiscard]] auto
+    Clone() const -> Node * {
+      return new Node(*this);
+    }
+
+    /// point `key` at `child`, nullptr unlinks it.
+    void
+    SetChild(char key, const Node *child) {
+      auto iter = children_.begin() + (LowerBound(key) - children_.cbegin());
+      bool found = iter != children_.end() && iter->first == key;
+      if (child == nullptr) {
+        if (found) {
+          children_.erase(iter);
+        }
+      } else if (found) {
+        iter->second = child;
+      } else {
+        children_.emplace(iter, key, child);
+      }
+    }
+
+    [[nodiscard]] auto
+    Empty() const -> bool {
+      return !value_ && children_.empty();
+    }
+
+    cdi::constructor::Maybe<T> value_;
+    std::vector<Edge> children_; // sorted by key
+  };
+
+public:
+  CowTrie() : root_(new Node()) {}
+
+  ~CowTrie() { Destroy(root_.load(std::memory_order_relaxed)); }
+
+  CowTrie(const CowTrie &) = delete;
+  auto
+  operator=(const CowTrie &) -> CowTrie & = delete;
+
+  /// Insert a key, keep the old value if there is one.
+  /// \return true if the key was absent.
+  auto
+  Insert(std::string_view key, T value) -> bool {
+    if (key.empty()) {
+      return false;
+    }
+    std::scoped_lock<std::mutex> writerLock(writeLatch_);
+    auto path = CollectPath(key);
+    if (path.back() != nullptr && path.back()->value_) {
+      return false;
+    }
+
+    auto *leaf = path.back() != nullptr ? path.back()->Clone() : new Node();
+    leaf->value_ = std::move(value);
+    Publish(key, path, leaf);
+    return true;
+  }
+
+  /// \return true if the key had a value.
+  auto
+  Remove(std::string_view key) -> bool {
+    if (key.empty()) {
+      return false;
+    }
+    std::scoped_lock<std::mutex> writerLock(writeLatch_);
+    auto path = CollectPath(key);
+    if (path.back() == nullptr || !path.back()->value_) {
+      return false;
+    }
+
+    Node *leaf = nullptr;
+    if (!path.back()->children_.empty()) {
+      leaf = path.back()->Clone();
+      leaf->value_.reset();
+    }
+    Publish(key, path, leaf);
+    return true;
+  }
+
+  /// cdi-style api.
+  [[nodiscard]] auto
+  LookupMaybe(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    cdi::concurrency::EpochGuard guard;
+    const auto *node = TraverseDown(key);
+    if (node == nullptr) {
+      return cdi::constructor::none;
+    }
+    return node->value_;
+  }
+
+  /// Call `visitor` with a reference to the value, no copy is made. The
+  /// reference must not escape the visitor.
+  /// \return true if the key has a value.
+  template <typename Visitor>
+  auto
+  Visit(std::string_view key, Visitor &&visitor) const -> bool {
+    cdi::concurrency::EpochGuard guard;
+    const auto *node = TraverseDown(key);
+    if (node == nullptr || !node->value_) {
+      return false;
+    }
+    std::forward<Visitor>(visitor)(*node->value_);
+    return true;
+  }
+
+  /// Free replaced versions no reader holds any more. Writers call it for
+  /// you, it is exposed for callers that want to drain eagerly.
+  auto
+  Collect() -> std::size_t {
+    return retired_.Collect();
+  }
+
+  /// replaced nodes waiting for readers to drain.
+  [[nodiscard]] auto
+  PendingReclaim() const -> std::size_t {
+    return retired_.Pending();
+  }
+
+private:
+  /// path[i] is the node reached after i characters, nullptr once the key
+  /// leaves the trie. Writers only, the write latch keeps it stable.
+  auto
+  CollectPath(std::string_view key) const -> std::vector<const Node *> {
+    std::vector<const Node *> path;
+    path.reserve(key.size() + 1);
+    const auto *node = root_.load(std::memory_order_relaxed);
+    path.push_back(node);
+    for (char keychar : key) {
+      node = node != nullptr ? node->GetChild(keychar) : nullptr;
+      path.push_back(node);
+    }
+    return path;
+  }
+
+  /// Copy the path above `leaf` (nullptr drops the leaf), publish the new
+  /// root, then retire the replaced nodes.
+  void
+  Publish(std::string_view key,
+          const std::vector<const Node *> &path,
+          const Node *leaf) {
+    const Node *child = leaf;
+    for (auto depth = key.size(); depth-- > 0;) {
+      const auto *old = path[depth];
+      // drop the empty chain a removal leaves behind, but keep the root.
+      if (child == nullptr && depth > 0 && old->children_.size() == 1 &&
+          !old->value_) {
+        continue;
+      }
+      auto *copy = old != nullptr ? old->Clone() : new Node();
+      copy->SetChild(key[depth], child);
+      child = copy;
+    }
+    root_.store(child, std::memory_order_release);
+
+    for (const auto *old : path) {
+      if (old != nullptr) {
+        retired_.Retire(const_cast<Node *>(old));
+      }
+    }
+    (void)retired_.Collect();
+  }
+
+  /// readers only, inside an EpochGuard.
+  auto
+  TraverseDown(std::string_view key) const -> const Node * {
+    const auto *node = root_.load(std::memory_order_acquire);
+    for (char keychar : key) {
+      node = node->GetChild(keychar);
+      if (node == nullptr) {
+        return nullptr;
+      }
+    }
+    return node;
+  }
+
+  static void
+  Destroy(const Node *node) {
+    std::vector<const Node *> stack{node};
+    while (!stack.empty()) {
+      const auto *top = stack.back();
+      stack.pop_back();
+      for (const auto &edge : top->children_) {
+        stack.push_back(edge.second);
+      }
+      delete top;
+    }
+  }
+
+  std::atomic<const Node *> root_;
+  std::mutex writeLatch_;
+  cdi::concurrency::RetireList retired_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_COW_TRIE_HH
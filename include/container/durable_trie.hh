@@ -0,0 +1,307 @@
+//===--- durable_trie.hh - Trie that survives a crash -----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/durable_trie.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// A Trie backed by a directory, see storage/write_ahead_log.hh: every change is
+// logged before it is acknowledged, and the trie is checkpointed now and then
+// so that recovery need not replay all of history.
+//
+// The log holds after-images, "key now has value v" or "key has no value",
+// never the operation itself: replaying a record twice, or over a checkpoint
+// that already has it, does no harm. A writer changes the trie and appends
+// its record under one of kStripes mutexes picked by the key, so the records
+// of a key are logged in the order its changes were made. The mutex is
+// released before the commit waits for the disk, which is where group commit
+// gathers writers; a reader may see a change before it is durable, as with
+// any early lock release.
+//
+// A checkpoint takes every stripe for as long as it takes to open a snapshot
+// of the trie and read the last LSN: no change is then between the two, the
+// snapshot holds exactly the records up to that LSN. The snapshot is streamed
+// into the checkpoint file while writers go on, then the log segments it made
+// obsolete are deleted.
+//
+// Recovery, in the constructor, bulk loads the checkpoint and replays the log
+// records after it.
+//
+// Values are written as their bytes, so T must be trivially copyable, as for
+// FrozenTrie.
+//
+// Classes: DurableTrie
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_DURABLE_TRIE_HH
+#define CDI_CONTAINER_DURABLE_TRIE_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include "storage/write_ahead_log.hh"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cdi::container {
+
+struct DurableTrieOptions {
+  /// whether a change waits for fdatasync, see WriteAheadLog.
+  bool sync = true;
+  /// checkpoint on a background thread this often, 0 for never: call
+  /// DurableTrie::Checkpoint instead.
+  std::chrono::milliseconds checkpointEvery{0};
+  TrieReadMode mode = TrieReadMode::kPessimistic;
+};
+
+template <typename T, typename Alloc = cdi::memory::HeapAllocator>
+class DurableTrie {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "values are logged as their bytes");
+
+  enum Op : char {
+    kPut = 'P',
+    kDelete = 'D',
+  };
+
+public:
+  using value_type = T;
+
+  constexpr static std::size_t kStripes = 32;
+
+  /// Recover the trie kept in dir, created if missing, and log to it.
+  explicit DurableTrie(std::string dir, DurableTrieOptions options = {})
+      : dir_(std::move(dir)), options_(options), trie_(options.mode),
+        log_(dir_, Recover() + 1, options.sync) {
+    if (options_.checkpointEvery.count() > 0) {
+      checkpointer_ = std::thread([this] { CheckpointPeriodically(); });
+    }
+  }
+
+  ~DurableTrie() {
+    if (checkpointer_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(stopLatch_);
+        stopped_ = true;
+      }
+      stop_.notify_all();
+      checkpointer_.join();
+    }
+  }
+
+  DurableTrie(const DurableTrie &) = delete;
+  auto operator=(const DurableTrie &) -> DurableTrie & = delete;
+
+  /// Trie::Insert, durable when it returns true.
+  auto Insert(std::string_view key, T value) -> bool {
+    std::unique_lock<std::mutex> stripe(StripeOf(key));
+    if (!trie_.Insert(key, value)) {
+      return false;
+    }
+    auto lsn = log_.Append(Encode(kPut, key, &value));
+    stripe.unlock();
+    log_.Commit(lsn);
+    return true;
+  }
+
+  /// Trie::Upsert, durable when it returns.
+  auto Upsert(std::string_view key, T value) -> bool {
+    if (key.empty()) {
+      return false;
+    }
+    std::unique_lock<std::mutex> stripe(StripeOf(key));
+    auto inserted = trie_.Upsert(key, value);
+    auto lsn = log_.Append(Encode(kPut, key, &value));
+    stripe.unlock();
+    log_.Commit(lsn);
+    return inserted;
+  }
+
+  /// Trie::Update, durable when it returns true. fn runs under the key's
+  /// stripe as well, keep it short.
+  template <typename Fn> auto Update(std::string_view key, Fn &&fn) -> bool {
+    std::unique_lock<std::mutex> stripe(StripeOf(key));
+    if (!trie_.Update(key, std::forward<Fn>(fn))) {
+      return false;
+    }
+    T value;
+    (void)trie_.Lookup(key, &value);
+    auto lsn = log_.Append(Encode(kPut, key, &value));
+    stripe.unlock();
+    log_.Commit(lsn);
+    return true;
+  }
+
+  /// Unlike Trie::Remove, true only if key had a value, which is removed
+  /// durably.
+  auto Remove(std::string_view key) -> bool {
+    std::unique_lock<std::mutex> stripe(StripeOf(key));
+    if (!trie_.Lookup(key)) {
+      return false;
+    }
+    (void)trie_.Remove(key);
+    auto lsn = log_.Append(Encode(kDelete, key, nullptr));
+    stripe.unlock();
+    log_.Commit(lsn);
+    return true;
+  }
+
+  [[nodiscard("you must check whether the lookup succeed.")]] auto
+  Lookup(std::string_view key, T *value = nullptr) const -> bool {
+    return trie_.Lookup(key, value);
+  }
+
+  auto LookupMaybe(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    return trie_.LookupMaybe(key);
+  }
+
+  /// The trie, for every other read. Changing it behind the log's back would
+  /// lose the change at the next restart, hence const.
+  [[nodiscard]] auto Get() const -> const Trie<T, Alloc> & { return trie_; }
+
+  /// see Trie::Snapshot.
+  auto Snapshot() -> TrieSnapshot<T, Alloc> { return trie_.Snapshot(); }
+
+  /// Write a checkpoint and delete the log it replaces; writers are held up
+  /// only while the snapshot is opened. Runs one at a time.
+  /// \return the LSN the checkpoint was taken after.
+  auto Checkpoint() -> storage::Lsn {
+    std::lock_guard<std::mutex> lock(checkpointLatch_);
+    auto [snapshot, last] = Freeze();
+    if (last == checkpointed_) {
+      return last;
+    }
+    (void)log_.Rotate();
+    storage::CheckpointWriter writer(dir_, last);
+    std::string payload;
+    (void)snapshot.ScanPrefix(
+        "", [&writer, &payload](std::string_view key, const T &value) {
+          payload.assign(reinterpret_cast<const char *>(&value), sizeof(T));
+          payload.append(key);
+          writer.Add(payload);
+        });
+    writer.Finish();
+    checkpointed_ = last;
+    log_.Truncate(last);
+    return last;
+  }
+
+  /// the LSN of the last change logged, 0 if none.
+  [[nodiscard]] auto LastLsn() const -> storage::Lsn { return log_.Last(); }
+
+  /// see WriteAheadLog::Syncs.
+  [[nodiscard]] auto Syncs() const -> std::uint64_t { return log_.Syncs(); }
+
+private:
+  static auto Encode(Op op, std::string_view key, const T *value)
+      -> std::string {
+    std::string payload(1, op);
+    if (value != nullptr) {
+      payload.append(reinterpret_cast<const char *>(value), sizeof(T));
+    }
+    payload.append(key);
+    return payload;
+  }
+
+  static auto Decode(std::string_view bytes, T &value) -> std::string_view {
+    if (bytes.size() < sizeof(T)) {
+      throw std::runtime_error("durable trie: short record");
+    }
+    std::memcpy(&value, bytes.data(), sizeof(T));
+    return bytes.substr(sizeof(T));
+  }
+
+  /// Load the checkpoint and replay the log after it.
+  /// \return the last LSN found.
+  auto Recover() -> storage::Lsn {
+    std::filesystem::create_directories(dir_);
+    std::vector<std::pair<std::string, T>> entries;
+    checkpointed_ = storage::CheckpointWriter::Load(
+        dir_, [&entries](std::string_view payload) {
+          T value;
+          auto key = Decode(payload, value);
+          entries.emplace_back(key, value);
+        });
+    (void)trie_.BulkLoad(std::move(entries));
+    return storage::WriteAheadLog::Replay(
+        dir_, checkpointed_, [this](storage::Lsn, std::string_view payload) {
+          if (payload.empty()) {
+            throw std::runtime_error("durable trie: empty record");
+          }
+          if (payload[0] == kDelete) {
+            (void)trie_.Remove(payload.substr(1));
+            return;
+          }
+          T value;
+          auto key = Decode(payload.substr(1), value);
+          (void)trie_.Upsert(key, value);
+        });
+  }
+
+  auto StripeOf(std::string_view key) -> std::mutex & {
+    return stripes_[std::hash<std::string_view>()(key) % kStripes];
+  }
+
+  /// A snapshot and the LSN of the last record it has, with no writer in
+  /// between.
+  auto Freeze() -> std::pair<TrieSnapshot<T, Alloc>, storage::Lsn> {
+    for (auto &stripe : stripes_) {
+      stripe.lock();
+    }
+    auto snapshot = trie_.Snapshot();
+    auto last = log_.Last();
+    for (auto &stripe : stripes_) {
+      stripe.unlock();
+    }
+    return {std::move(snapshot), last};
+  }
+
+  /// A failed checkpoint leaves the previous one and the log in place, so
+  /// nothing is lost: it is tried again next period.
+  void CheckpointPeriodically() {
+    std::unique_lock<std::mutex> lock(stopLatch_);
+    while (!stop_.wait_for(lock, options_.checkpointEvery,
+                           [this] { return stopped_; })) {
+      lock.unlock();
+      try {
+        (void)Checkpoint();
+      } catch (const std::exception &) {
+      }
+      lock.lock();
+    }
+  }
+
+  std::string dir_;
+  DurableTrieOptions options_;
+  Trie<T, Alloc> trie_;
+  storage::Lsn checkpointed_ = 0;
+  storage::WriteAheadLog log_;
+  std::array<std::mutex, kStripes> stripes_;
+  std::mutex checkpointLatch_;
+  std::mutex stopLatch_;
+  std::condition_variable stop_;
+  bool stopped_ = false;
+  std::thread checkpointer_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_DURABLE_TRIE_HH
@@ -0,0 +1,929 @@
+//===--- flat_hash_map.hh - Open addressing hash map ------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/flat_hash_map.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// A hash map storing its values in one flat array, laid out as the "Swiss
+// table" of Abseil: next to the slots is an array of control bytes, one per
+// slot, that is either
+//
+//   empty      never used since the last rehash, ends a probe.
+//   deleted    a tombstone: erased, but a probe must go on past it.
+//   sentinel   the end of the array, where iteration stops.
+//   0..127     full, with the 7 low bits of the key's hash (H2).
+//
+// The rest of the hash (H1) picks where a probe starts. A probe loads 16
+// control bytes at a time and compares them all with H2 at once, with SSE2
+// where the target has it: only slots whose byte matches are compared by
+// key, about one in 128 of the others. Groups are visited in triangular
+// steps, which reach every group of the power of two sized table. The first
+// 15 control bytes are cloned past the sentinel so that a group may start
+// at any slot.
+//
+// The table grows by doubling once 7/8 of it is full or tombstones. An
+// erased slot only becomes a tombstone if some probe may have passed it,
+// i.e. if every 16 byte window around it was full; otherwise it is empty
+// again at once.
+//
+// Unlike std::unordered_map, values move when the table grows: an insertion
+// may invalidate every iterator, pointer and reference. Erasure invalidates
+// only those to the erased element. Values must be nothrow move constructible
+// for an insertion that grows the table to be exception safe.
+//
+// With Hash::is_transparent and Eq::is_transparent, find, contains, count and
+// erase take any key type the two accept, e.g. a std::string_view for a map
+// keyed by std::string, without building a key.
+//
+// Classes: flat_hash_map
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_FLAT_HASH_MAP_HH
+#define CDI_CONTAINER_FLAT_HASH_MAP_HH
+
+#include "port/bit.hh"
+#include "port/port.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if CDI_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cdi::container {
+
+namespace detail {
+
+using CtrlByte = std::int8_t;
+
+constexpr CtrlByte kCtrlEmpty = -128;
+constexpr CtrlByte kCtrlDeleted = -2;
+constexpr CtrlByte kCtrlSentinel = -1;
+
+/// 16 control bytes, matched at once. A match is a mask with bit i set for
+/// byte i.
+class ControlGroup {
+public:
+  constexpr static std::size_t kWidth = 16;
+
+  explicit ControlGroup(const CtrlByte *ctrl) {
+#if CDI_HAVE_SSE2
+    ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#else
+    std::memcpy(ctrl_, ctrl, kWidth);
+#endif
+  }
+
+  [[nodiscard]] auto
+  Match(CtrlByte h2) const -> std::uint32_t {
+#if CDI_HAVE_SSE2
+    return static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+#else
+    return MatchIf([h2](CtrlByte byte) { return byte == h2; });
+#endif
+  }
+
+  [[nodiscard]] auto
+  MatchEmpty() const -> std::uint32_t {
+    return Match(kCtrlEmpty);
+  }
+
+  [[nodiscard]] auto
+  MatchEmptyOrDeleted() const -> std::uint32_t {
+#if CDI_HAVE_SSE2
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(
+        _mm_cmpgt_epi8(_mm_set1_epi8(kCtrlSentinel), ctrl_)));
+#else
+    return MatchIf([](CtrlByte byte) { return byte < kCtrlSentinel; });
+#endif
+  }
+
+private:
+#if CDI_HAVE_SSE2
+  __m128i ctrl_;
+#else
+  template <typename Predicate>
+  auto
+  MatchIf(Predicate predicate) const -> std::uint32_t {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < kWidth; ++i) {
+      mask |= static_cast<std::uint32_t>(predicate(ctrl_[i])) << i;
+    }
+    return mask;
+  }
+
+  CtrlByte ctrl_[kWidth];
+#endif
+};
+
+/// zero bits above the highest set one of a non-zero group mask.
+inline auto
+HighZeros(std::uint32_t mask) -> std::size_t {
+  std::size_t zeros = 0;
+  for (auto bit = std::uint32_t{1} << (ControlGroup::kWidth - 1);
+       (mask & bit) == 0;
+       bit >>= 1) {
+    ++zeros;
+  }
+  return zeros;
+}
+
+/// Spread the entropy of a hash over all its bits: std::hash of an integer
+/// is the integer itself, whose low bits would all go to H2.
+inline auto
+MixHash(std::size_t hash) -> std::size_t {
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 Wide;
+  auto product = static_cast<Wide>(hash) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<std::size_t>(product) ^
+         static_cast<std::size_t>(product >> 64);
+#else
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  return hash ^ (hash >> 33);
+#endif
+}
+
+template <typename Fn, typename = void>
+struct IsTransparent : std::false_type {};
+
+template <typename Fn>
+struct IsTransparent<Fn, std::void_t<typename Fn::is_transparent>>
+    : std::true_type {};
+
+/// The key type of a lookup: Key where heterogeneous lookup is on, which
+/// is then deduced, the map's key type otherwise.
+template <bool kTransparent>
+struct KeyArg {
+  template <typename Key, typename KeyType>
+  using Type = Key;
+};
+
+template <>
+struct KeyArg<false> {
+  template <typename Key, typename KeyType>
+  using Type = KeyType;
+};
+
+} // namespace detail
+
+template <typename K,
+          typename V,
+          typename Hash = std::hash<K>,
+          typename Eq = std::equal_to<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>>
+class flat_hash_map {
+  using CtrlByte = detail::CtrlByte;
+  using Group = detail::ControlGroup;
+  using SlotTraits = std::allocator_traits<Allocator>;
+  using CtrlAllocator = typename SlotTraits::template rebind_alloc<CtrlByte>;
+  using CtrlTraits = std::allocator_traits<CtrlAllocator>;
+
+  constexpr static std::size_t kWidth = Group::kWidth;
+  constexpr static std::size_t kMinCapacity = kWidth - 1;
+  constexpr static std::size_t kNotFound = ~std::size_t{0};
+
+  template <typename Key>
+  using KeyArg = typename detail::KeyArg<
+      detail::IsTransparent<Hash>::value &&
+      detail::IsTransparent<Eq>::value>::template Type<Key, K>;
+
+  template <bool kConst>
+  class Iterator {
+    friend class flat_hash_map;
+    template <bool> friend class Iterator;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const K, V>;
+    using difference_type = std::ptrdiff_t;
+    using reference =
+        std::conditional_t<kConst, const value_type &, value_type &>;
+    using pointer =
+        std::conditional_t<kConst, const value_type *, value_type *>;
+
+    Iterator() = default;
+
+    /// iterator to const_iterator.
+    template <bool kOther, typename = std::enable_if_t<kConst && !kOther>>
+    Iterator(const Iterator<kOther> &other) // NOLINT
+        : ctrl_(other.ctrl_), slot_(other.slot_) {}
+
+    auto
+    operator*() const -> reference {
+      return *slot_;
+    }
+
+    auto
+    operator->() const -> pointer {
+      return slot_;
+    }
+
+    auto
+    operator++() -> Iterator & {
+      ++ctrl_;
+      ++slot_;
+      SkipFree();
+      return *this;
+    }
+
+    auto
+    operator++(int) -> Iterator {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    friend auto
+    operator==(const Iterator &lhs, const Iterator &rhs) -> bool {
+      return lhs.ctrl_ == rhs.ctrl_;
+    }
+
+    friend auto
+    operator!=(const Iterator &lhs, const Iterator &rhs) -> bool {
+      return lhs.ctrl_ != rhs.ctrl_;
+    }
+
+  private:
+    Iterator(const CtrlByte *ctrl, pointer slot) : ctrl_(ctrl), slot_(slot) {}
+
+    /// on to the next full slot, or the sentinel.
+    void
+    SkipFree() {
+      while (*ctrl_ < detail::kCtrlSentinel) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+
+    const CtrlByte *ctrl_ = nullptr;
+    pointer slot_ = nullptr;
+  };
+
+public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<const K, V>;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = Eq;
+  using allocator_type = Allocator;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+  using pointer = typename SlotTraits::pointer;
+  using const_pointer = typename SlotTraits::const_pointer;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  flat_hash_map() = default;
+
+  explicit flat_hash_map(size_type capacity,
+                         const Hash &hash = Hash(),
+                         const Eq &eq = Eq(),
+                         const Allocator &alloc = Allocator())
+      : hash_(hash), eq_(eq), alloc_(alloc) {
+    reserve(capacity);
+  }
+
+  template <typename InputIt>
+  flat_hash_map(InputIt first, InputIt last, size_type capacity = 0)
+      : flat_hash_map(capacity) {
+    insert(first, last);
+  }
+
+  flat_hash_map(std::initializer_list<value_type> values,
+                size_type capacity = 0)
+      : flat_hash_map(values.begin(), values.end(), capacity) {}
+
+  flat_hash_map(const flat_hash_map &other)
+      : hash_(other.hash_), eq_(other.eq_),
+        alloc_(SlotTraits::select_on_container_copy_construction(
+            other.alloc_)) {
+    reserve(other.size_);
+    for (const auto &value : other) {
+      auto index = PrepareInsert(HashOf(value.first));
+      ConstructAt(index, value);
+    }
+  }
+
+  flat_hash_map(flat_hash_map &&other) noexcept
+      : ctrl_(std::exchange(other.ctrl_, nullptr)),
+        slots_(std::exchange(other.slots_, nullptr)),
+        capacity_(std::exchange(other.capacity_, 0)),
+        size_(std::exchange(other.size_, 0)),
+        growthLeft_(std::exchange(other.growthLeft_, 0)),
+        hash_(std::move(other.hash_)), eq_(std::move(other.eq_)),
+        alloc_(std::move(other.alloc_)) {}
+
+  auto
+  operator=(const flat_hash_map &other) -> flat_hash_map & {
+    if (this != &other) {
+      flat_hash_map copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  auto
+  operator=(flat_hash_map &&other) noexcept -> flat_hash_map & {
+    if (this != &other) {
+      flat_hash_map moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+
+  ~flat_hash_map() { Release(); }
+
+  //===--------------------------------------------------------------------===
+  // iteration and capacity
+  //===--------------------------------------------------------------------===
+
+  auto
+  begin() -> iterator {
+    if (size_ == 0) {
+      return end();
+    }
+    iterator iter(ctrl_, slots_);
+    iter.SkipFree();
+    return iter;
+  }
+
+  auto
+  end() -> iterator {
+    return iterator(ctrl_ + capacity_, slots_ + capacity_);
+  }
+
+  auto
+  begin() const -> const_iterator {
+    return const_cast<flat_hash_map *>(this)->begin();
+  }
+
+  auto
+  end() const -> const_iterator {
+    return const_cast<flat_hash_map *>(this)->end();
+  }
+
+  auto
+  cbegin() const -> const_iterator {
+    return begin();
+  }
+
+  auto
+  cend() const -> const_iterator {
+    return end();
+  }
+
+  [[nodiscard]] auto
+  empty() const -> bool {
+    return size_ == 0;
+  }
+
+  [[nodiscard]] auto
+  size() const -> size_type {
+    return size_;
+  }
+
+  /// number of slots.
+  [[nodiscard]] auto
+  bucket_count() const -> size_type {
+    return capacity_;
+  }
+
+  [[nodiscard]] auto
+  load_factor() const -> float {
+    return capacity_ == 0 ? 0.0F : static_cast<float>(size_) / capacity_;
+  }
+
+  [[nodiscard]] auto
+  max_load_factor() const -> float {
+    return 7.0F / 8;
+  }
+
+  /// Make room for `count` values in all, without growing on the way.
+  void
+  reserve(size_type count) {
+    if (count > size_ + growthLeft_) {
+      Resize(CapacityFor(count));
+    }
+  }
+
+  /// Rebuild the table with at least `count` slots, or as few as the values
+  /// need: also drops every tombstone.
+  void
+  rehash(size_type count) {
+    auto capacity = CapacityFor(size_);
+    while (capacity < count) {
+      capacity = capacity * 2 + 1;
+    }
+    if (size_ == 0 && count == 0) {
+      Release();
+      return;
+    }
+    Resize(capacity);
+  }
+
+  void
+  clear() {
+    if (capacity_ == 0) {
+      return;
+    }
+    DestroyAll();
+    std::memset(ctrl_, detail::kCtrlEmpty, capacity_ + kWidth);
+    ctrl_[capacity_] = detail::kCtrlSentinel;
+    size_ = 0;
+    growthLeft_ = MaxLoad(capacity_);
+  }
+
+  void
+  swap(flat_hash_map &other) noexcept {
+    using std::swap;
+    swap(ctrl_, other.ctrl_);
+    swap(slots_, other.slots_);
+    swap(capacity_, other.capacity_);
+    swap(size_, other.size_);
+    swap(growthLeft_, other.growthLeft_);
+    swap(hash_, other.hash_);
+    swap(eq_, other.eq_);
+    swap(alloc_, other.alloc_);
+  }
+
+  //===--------------------------------------------------------------------===
+  // insertion
+  //===--------------------------------------------------------------------===
+
+  auto
+  insert(const value_type &value) -> std::pair<iterator, bool> {
+    return EmplaceWithKey(value.first, value);
+  }
+
+  auto
+  insert(value_type &&value) -> std::pair<iterator, bool> {
+    auto [index, inserted] = FindOrPrepareInsert(value.first);
+    if (inserted) {
+      ConstructAt(index,
+                  std::move(const_cast<K &>(value.first)),
+                  std::move(value.second));
+    }
+    return {IteratorAt(index), inserted};
+  }
+
+  template <typename InputIt>
+  void
+  insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      (void)emplace(*first);
+    }
+  }
+
+  void
+  insert(std::initializer_list<value_type> values) {
+    insert(values.begin(), values.end());
+  }
+
+  /// Builds the value first, to find its key: prefer try_emplace when the key
+  /// is at hand.
+  template <typename... Args>
+  auto
+  emplace(Args &&...args) -> std::pair<iterator, bool> {
+    value_type value(std::forward<Args>(args)...);
+    return insert(std::move(value));
+  }
+
+  /// Insert V(args...) if key is missing; args are left alone otherwise.
+  template <typename... Args>
+  auto
+  try_emplace(const K &key, Args &&...args) -> std::pair<iterator, bool> {
+    return EmplaceWithKey(key,
+                          std::piecewise_construct,
+                          std::forward_as_tuple(key),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  auto
+  try_emplace(K &&key, Args &&...args) -> std::pair<iterator, bool> {
+    return EmplaceWithKey(key,
+                          std::piecewise_construct,
+                          std::forward_as_tuple(std::move(key)),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  template <typename Value>
+  auto
+  insert_or_assign(const K &key, Value &&value) -> std::pair<iterator, bool> {
+    auto result = try_emplace(key, std::forward<Value>(value));
+    if (!result.second) {
+      result.first->second = std::forward<Value>(value);
+    }
+    return result;
+  }
+
+  template <typename Value>
+  auto
+  insert_or_assign(K &&key, Value &&value) -> std::pair<iterator, bool> {
+    auto [index, inserted] = FindOrPrepareInsert(key);
+    if (inserted) {
+      ConstructAt(index, std::move(key), std::forward<Value>(value));
+    } else {
+      slots_[index].second = std::forward<Value>(value);
+    }
+    return {IteratorAt(index), inserted};
+  }
+
+  auto
+  operator[](const K &key) -> V & {
+    return try_emplace(key).first->second;
+  }
+
+  auto
+  operator[](K &&key) -> V & {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  //===--------------------------------------------------------------------===
+  // lookup
+  //===--------------------------------------------------------------------===
+
+  template <typename Key = K>
+  auto
+  find(const KeyArg<Key> &key) -> iterator {
+    auto index = FindIndex(key, HashOf(key));
+    return index == kNotFound ? end() : IteratorAt(index);
+  }
+
+  template <typename Key = K>
+  auto
+  find(const KeyArg<Key> &key) const -> const_iterator {
+    return const_cast<flat_hash_map *>(this)->find(key);
+  }
+
+  template <typename Key = K>
+  [[nodiscard]] auto
+  contains(const KeyArg<Key> &key) const -> bool {
+    return FindIndex(key, HashOf(key)) != kNotFound;
+  }
+
+  template <typename Key = K>
+  [[nodiscard]] auto
+  count(const KeyArg<Key> &key) const -> size_type {
+    return contains(key) ? 1 : 0;
+  }
+
+  template <typename Key = K>
+  auto
+  at(const KeyArg<Key> &key) -> V & {
+    auto index = FindIndex(key, HashOf(key));
+    if (index == kNotFound) {
+      throw std::out_of_range("flat_hash_map::at: no such key");
+    }
+    return slots_[index].second;
+  }
+
+  template <typename Key = K>
+  auto
+  at(const KeyArg<Key> &key) const -> const V & {
+    return const_cast<flat_hash_map *>(this)->at(key);
+  }
+
+  //===--------------------------------------------------------------------===
+  // erasure
+  //===--------------------------------------------------------------------===
+
+  /// \return the iterator after pos.
+  auto
+  erase(const_iterator pos) -> iterator {
+    auto index = static_cast<size_type>(pos.ctrl_ - ctrl_);
+    EraseAt(index);
+    iterator next(ctrl_ + index, slots_ + index);
+    ++next;
+    return next;
+  }
+
+  auto
+  erase(iterator pos) -> iterator {
+    return erase(const_iterator(pos));
+  }
+
+  auto
+  erase(const_iterator first, const_iterator last) -> iterator {
+    while (first != last) {
+      first = erase(first);
+    }
+    return iterator(last.ctrl_, const_cast<value_type *>(last.slot_));
+  }
+
+  template <typename Key = K,
+            typename = std::enable_if_t<
+                !std::is_convertible_v<const KeyArg<Key> &, const_iterator>>>
+  auto
+  erase(const KeyArg<Key> &key) -> size_type {
+    auto index = FindIndex(key, HashOf(key));
+    if (index == kNotFound) {
+      return 0;
+    }
+    EraseAt(index);
+    return 1;
+  }
+
+  //===--------------------------------------------------------------------===
+  // observers
+  //===--------------------------------------------------------------------===
+
+  auto
+  hash_function() const -> hasher {
+    return hash_;
+  }
+
+  auto
+  key_eq() const -> key_equal {
+    return eq_;
+  }
+
+  auto
+  get_allocator() const -> allocator_type {
+    return alloc_;
+  }
+
+  friend auto
+  operator==(const flat_hash_map &lhs, const flat_hash_map &rhs) -> bool {
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    for (const auto &[key, value] : lhs) {
+      auto found = rhs.find(key);
+      if (found == rhs.end() || !(found->second == value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend auto
+  operator!=(const flat_hash_map &lhs, const flat_hash_map &rhs) -> bool {
+    return !(lhs == rhs);
+  }
+
+private:
+  template <typename Key>
+  [[nodiscard]] auto
+  HashOf(const Key &key) const -> std::size_t {
+    return detail::MixHash(hash_(key));
+  }
+
+  static auto
+  H1(std::size_t hash) -> std::size_t {
+    return hash >> 7;
+  }
+
+  static auto
+  H2(std::size_t hash) -> CtrlByte {
+    return static_cast<CtrlByte>(hash & 0x7F);
+  }
+
+  /// most values a table of capacity slots holds before it grows.
+  static auto
+  MaxLoad(std::size_t capacity) -> std::size_t {
+    return capacity - capacity / 8;
+  }
+
+  /// the smallest capacity, one less than a power of two, for count values.
+  static auto
+  CapacityFor(std::size_t count) -> std::size_t {
+    auto capacity = kMinCapacity;
+    while (MaxLoad(capacity) < count) {
+      capacity = capacity * 2 + 1;
+    }
+    return capacity;
+  }
+
+  auto
+  IteratorAt(std::size_t index) -> iterator {
+    return iterator(ctrl_ + index, slots_ + index);
+  }
+
+  /// the slot of key, kNotFound if it has none.
+  template <typename Key>
+  auto
+  FindIndex(const Key &key, std::size_t hash) const -> std::size_t {
+    if (capacity_ == 0) {
+      return kNotFound;
+    }
+    auto h2 = H2(hash);
+    auto offset = H1(hash) & capacity_;
+    for (std::size_t step = kWidth;; step += kWidth) {
+      Group group(ctrl_ + offset);
+      for (auto mask = group.Match(h2); mask != 0; mask &= mask - 1) {
+        auto index = (offset + port::LowestBit(mask)) & capacity_;
+        if (eq_(slots_[index].first, key)) {
+          return index;
+        }
+      }
+      // at least one slot is empty at any time, so probes end.
+      if (group.MatchEmpty() != 0) {
+        return kNotFound;
+      }
+      offset = (offset + step) & capacity_;
+    }
+  }
+
+  /// first empty or deleted slot on the probe sequence of hash.
+  auto
+  FindFirstNonFull(std::size_t hash) const -> std::size_t {
+    auto offset = H1(hash) & capacity_;
+    for (std::size_t step = kWidth;; step += kWidth) {
+      auto mask = Group(ctrl_ + offset).MatchEmptyOrDeleted();
+      if (mask != 0) {
+        return (offset + port::LowestBit(mask)) & capacity_;
+      }
+      offset = (offset + step) & capacity_;
+    }
+  }
+
+  template <typename Key>
+  auto
+  FindOrPrepareInsert(const Key &key) -> std::pair<std::size_t, bool> {
+    auto hash = HashOf(key);
+    auto index = FindIndex(key, hash);
+    if (index != kNotFound) {
+      return {index, false};
+    }
+    return {PrepareInsert(hash), true};
+  }
+
+  /// Claim a slot for a key that is not in the table, growing it if need
+  /// be. The slot is marked full, its value is for the caller to construct.
+  auto
+  PrepareInsert(std::size_t hash) -> std::size_t {
+    if (capacity_ == 0) {
+      Resize(kMinCapacity);
+    }
+    auto index = FindFirstNonFull(hash);
+    if (growthLeft_ == 0 && ctrl_[index] != detail::kCtrlDeleted) {
+      // rehashing in place would do if tombstones are most of the load.
+      Resize(size_ * 2 < MaxLoad(capacity_) ? capacity_ : capacity_ * 2 + 1);
+      index = FindFirstNonFull(hash);
+    }
+    growthLeft_ -= ctrl_[index] == detail::kCtrlEmpty ? 1 : 0;
+    ++size_;
+    SetCtrl(index, H2(hash));
+    return index;
+  }
+
+  template <typename Key, typename... Args>
+  auto
+  EmplaceWithKey(const Key &key, Args &&...args) -> std::pair<iterator, bool> {
+    auto [index, inserted] = FindOrPrepareInsert(key);
+    if (inserted) {
+      ConstructAt(index, std::forward<Args>(args)...);
+    }
+    return {IteratorAt(index), inserted};
+  }
+
+  /// Construct the value of a slot PrepareInsert claimed, which is given
+  /// back if that throws.
+  template <typename... Args>
+  void
+  ConstructAt(std::size_t index, Args &&...args) {
+    try {
+      SlotTraits::construct(
+          alloc_, slots_ + index, std::forward<Args>(args)...);
+    } catch (...) {
+      --size_;
+      SetCtrl(index, detail::kCtrlDeleted);
+      throw;
+    }
+  }
+
+  /// Set a control byte, and its clone past the sentinel if it has one.
+  void
+  SetCtrl(std::size_t index, CtrlByte ctrl) {
+    ctrl_[index] = ctrl;
+    ctrl_[((index - (kWidth - 1)) & capacity_) + (kWidth - 1)] = ctrl;
+  }
+
+  void
+  EraseAt(std::size_t index) {
+    SlotTraits::destroy(alloc_, slots_ + index);
+    --size_;
+    // a probe never passed the slot if some window of 16 bytes holding it
+    // has an empty one: that probe would have stopped there.
+    auto before = (index - kWidth) & capacity_;
+    auto emptyAfter = Group(ctrl_ + index).MatchEmpty();
+    auto emptyBefore = Group(ctrl_ + before).MatchEmpty();
+    auto neverPassed =
+        emptyAfter != 0 && emptyBefore != 0 &&
+        port::LowestBit(emptyAfter) + detail::HighZeros(emptyBefore) < kWidth;
+    SetCtrl(index, neverPassed ? detail::kCtrlEmpty : detail::kCtrlDeleted);
+    growthLeft_ += neverPassed ? 1 : 0;
+  }
+
+  /// Move every value into a new table of capacity slots.
+  void
+  Resize(std::size_t capacity) {
+    auto *oldCtrl = ctrl_;
+    auto *oldSlots = slots_;
+    auto oldCapacity = capacity_;
+
+    CtrlAllocator ctrlAlloc(alloc_);
+    ctrl_ = CtrlTraits::allocate(ctrlAlloc, capacity + kWidth);
+    try {
+      slots_ = SlotTraits::allocate(alloc_, capacity);
+    } catch (...) {
+      CtrlTraits::deallocate(ctrlAlloc, ctrl_, capacity + kWidth);
+      ctrl_ = oldCtrl;
+      throw;
+    }
+    std::memset(ctrl_, detail::kCtrlEmpty, capacity + kWidth);
+    ctrl_[capacity] = detail::kCtrlSentinel;
+    capacity_ = capacity;
+    growthLeft_ = MaxLoad(capacity) - size_;
+
+    for (std::size_t old = 0; old < oldCapacity; ++old) {
+      if (oldCtrl[old] < 0) {
+        continue;
+      }
+      auto &value = oldSlots[old];
+      auto hash = HashOf(value.first);
+      auto index = FindFirstNonFull(hash);
+      SetCtrl(index, H2(hash));
+      SlotTraits::construct(alloc_,
+                            slots_ + index,
+                            std::move(const_cast<K &>(value.first)),
+                            std::move(value.second));
+      SlotTraits::destroy(alloc_, &value);
+    }
+    if (oldCapacity != 0) {
+      CtrlTraits::deallocate(ctrlAlloc, oldCtrl, oldCapacity + kWidth);
+      SlotTraits::deallocate(alloc_, oldSlots, oldCapacity);
+    }
+  }
+
+  void
+  DestroyAll() {
+    if constexpr (!std::is_trivially_destructible_v<value_type>) {
+      for (std::size_t index = 0; index < capacity_; ++index) {
+        if (ctrl_[index] >= 0) {
+          SlotTraits::destroy(alloc_, slots_ + index);
+        }
+      }
+    }
+  }
+
+  void
+  Release() {
+    if (capacity_ == 0) {
+      return;
+    }
+    DestroyAll();
+    CtrlAllocator ctrlAlloc(alloc_);
+    CtrlTraits::deallocate(ctrlAlloc, ctrl_, capacity_ + kWidth);
+    SlotTraits::deallocate(alloc_, slots_, capacity_);
+    ctrl_ = nullptr;
+    slots_ = nullptr;
+    capacity_ = 0;
+    size_ = 0;
+    growthLeft_ = 0;
+  }
+
+  CtrlByte *ctrl_ = nullptr; // capacity_ + kWidth bytes, see the file comment.
+  value_type *slots_ = nullptr;
+  std::size_t capacity_ = 0; // 0, or a power of two minus one.
+  std::size_t size_ = 0;
+  std::size_t growthLeft_ = 0; // empty slots that may still be filled.
+  Hash hash_;
+  Eq eq_;
+  Allocator alloc_;
+};
+
+template <typename K,
+          typename V,
+          typename Hash,
+          typename Eq,
+          typename Allocator>
+void
+swap(flat_hash_map<K, V, Hash, Eq, Allocator> &lhs,
+     flat_hash_map<K, V, Hash, Eq, Allocator> &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_FLAT_HASH_MAP_HH
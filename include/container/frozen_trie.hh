@@ -0,0 +1,377 @@
+//===--- frozen_trie.hh - Immutable succinct trie ---------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/frozen_trie.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// A read only trie in the LOUDS layout (Jacobson 1989, Delpratt et al. 2006),
+// to be written once and queried straight from the bytes, e.g. a file mapped
+// with memory/mapped_file.hh. Nothing is deserialized: opening costs one
+// header check, and processes mapping the same file share its pages.
+//
+// Nodes are numbered in breadth first order, one per character of the keys.
+// The tree shape is a bit vector: "10" for a super root, then for each node
+// as many 1s as it has children and a 0. With rank and select on it, the
+// children of node v are the consecutive nodes
+//   [select0(v) - v, select0(v + 1) - v - 1)
+// so a lookup does one select, a scan to the next 0 and a binary search over
+// the edge labels per character. A second bit vector marks the nodes holding
+// a value, its rank is the index into the value array.
+//
+// Space is about 10 bits per node plus the values, against a few dozen bytes
+// per node for Trie.
+//
+// The image is in the byte order of the machine that wrote it. Values are
+// copied bit for bit, so T must be trivially copyable; store an offset into
+// a blob of your own for anything else.
+//
+// Classes: FrozenTrie
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_FROZEN_TRIE_HH
+#define CDI_CONTAINER_FROZEN_TRIE_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include "port/bit.hh"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cdi::container {
+
+namespace detail {
+
+/// Rank / select over a bit vector that lives elsewhere. A cumulative count
+/// per block of 8 words makes rank two loads and a popcount.
+class RankSelectView {
+public:
+  constexpr static std::size_t kBlockWords = 8;
+  constexpr static std::size_t kBlockBits = kBlockWords * 64;
+
+  RankSelectView() = default;
+  RankSelectView(const std::uint64_t *words,
+                 const std::uint64_t *blockRanks,
+                 std::uint64_t bits)
+      : words_(words), blockRanks_(blockRanks), bits_(bits) {}
+
+  static auto
+  WordCount(std::uint64_t bits) -> std::size_t {
+    return (bits + 63) / 64;
+  }
+
+  static auto
+  BlockCount(std::uint64_t bits) -> std::size_t {
+    return (WordCount(bits) + kBlockWords - 1) / kBlockWords + 1;
+  }
+
+  /// cumulative ones before each block, the last entry is the total.
+  static auto
+  BuildRanks(const std::vector<std::uint64_t> &words, std::uint64_t bits)
+      -> std::vector<std::uint64_t> {
+    std::vector<std::uint64_t> ranks(BlockCount(bits), 0);
+    std::uint64_t ones = 0;
+    for (std::size_t word = 0; word < words.size(); ++word) {
+      if (word % kBlockWords == 0) {
+        ranks[word / kBlockWords] = ones;
+      }
+      ones += port::PopCount(words[word]);
+    }
+    ranks.back() = ones;
+    return ranks;
+  }
+
+  [[nodiscard]] auto
+  Get(std::uint64_t pos) const -> bool {
+    return (words_[pos / 64] >> (pos % 64)) & 1U;
+  }
+
+  /// ones in [0, pos).
+  [[nodiscard]] auto
+  Rank1(std::uint64_t pos) const -> std::uint64_t {
+    auto word = pos / 64;
+    auto rank = blockRanks_[word / kBlockWords];
+    for (auto scan = word - word % kBlockWords; scan < word; ++scan) {
+      rank += port::PopCount(words_[scan]);
+    }
+    if (pos % 64 != 0) {
+      rank += port::PopCount(words_[word] << (64 - pos % 64));
+    }
+    return rank;
+  }
+
+  /// position of the first zero at or after `pos`, which must exist.
+  [[nodiscard]] auto
+  NextZero(std::uint64_t pos) const -> std::uint64_t {
+    auto word = pos / 64;
+    auto zeros = ~words_[word] >> (pos % 64) << (pos % 64);
+    while (zeros == 0) {
+      zeros = ~words_[++word];
+    }
+    return word * 64 + port::LowestBit(zeros);
+  }
+
+  /// position of the zero with 0 based index `nth`.
+  [[nodiscard]] auto
+  Select0(std::uint64_t nth) const -> std::uint64_t {
+    // the last block with fewer zeros before it than nth + 1.
+    std::size_t low = 0;
+    std::size_t high = BlockCount(bits_) - 1;
+    while (high - low > 1) {
+      auto mid = (low + high) / 2;
+      if (mid * kBlockBits - blockRanks_[mid] <= nth) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    auto remaining = nth - (low * kBlockBits - blockRanks_[low]);
+    for (auto word = low * kBlockWords;; ++word) {
+      auto zeros = ~words_[word];
+      auto count = static_cast<std::uint64_t>(port::PopCount(zeros));
+      if (remaining < count) {
+        for (; remaining > 0; --remaining) {
+          zeros &= zeros - 1;
+        }
+        return word * 64 + port::LowestBit(zeros);
+      }
+      remaining -= count;
+    }
+  }
+
+private:
+  const std::uint64_t *words_ = nullptr;
+  const std::uint64_t *blockRanks_ = nullptr;
+  std::uint64_t bits_ = 0;
+};
+
+} // namespace detail
+
+template <typename T>
+class FrozenTrie {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "frozen values are copied bit for bit");
+  static_assert(alignof(T) <= alignof(std::uint64_t),
+                "sections are 8 byte aligned");
+
+  constexpr static char kMagic[8] = {'C', 'D', 'I', 'L', 'O', 'U', 'D', 'S'};
+  constexpr static std::uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t valueSize;
+    std::uint64_t nodes;
+    std::uint64_t values;
+  };
+
+public:
+  /// Write the frozen image of `trie`. The trie is scanned once, writers may
+  /// go on concurrently but their changes may or may not make it.
+  template <typename Alloc>
+  static void
+  Freeze(const Trie<T, Alloc> &trie, std::ostream &out) {
+    std::vector<std::pair<std::string, T>> entries;
+    (void)trie.ScanPrefix("", [&entries](std::string_view key, const T &value) {
+      entries.emplace_back(key, value);
+    });
+    Freeze(entries, out);
+  }
+
+  /// Write the frozen image of sorted, distinct, non empty keys.
+  static void
+  Freeze(const std::vector<std::pair<std::string, T>> &entries,
+         std::ostream &out) {
+    std::vector<std::uint64_t> louds;
+    std::uint64_t loudsBits = 0;
+    auto pushBit = [&louds, &loudsBits](bool bit) {
+      if (loudsBits % 64 == 0) {
+        louds.push_back(0);
+      }
+      louds.back() |= static_cast<std::uint64_t>(bit) << (loudsBits % 64);
+      ++loudsBits;
+    };
+    std::vector<std::uint64_t> terminals;
+    std::vector<char> labels;
+    std::vector<T> values;
+
+    // breadth first over ranges of entries sharing their first depth chars.
+    struct Pending {
+      std::size_t begin;
+      std::size_t end;
+      std::size_t depth;
+    };
+    std::vector<Pending> queue{{0, entries.size(), 0}};
+    labels.push_back('\0');
+    pushBit(true);
+    pushBit(false);
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+      auto [begin, end, depth] = queue[head];
+      if (head % 64 == 0) {
+        terminals.push_back(0);
+      }
+      if (begin < end && entries[begin].first.size() == depth) {
+        terminals.back() |= std::uint64_t{1} << (head % 64);
+        values.push_back(entries[begin].second);
+        ++begin;
+      }
+      while (begin < end) {
+        auto keychar = entries[begin].first[depth];
+        auto groupEnd = begin + 1;
+        while (groupEnd < end && entries[groupEnd].first[depth] == keychar) {
+          ++groupEnd;
+        }
+        queue.push_back({begin, groupEnd, depth + 1});
+        labels.push_back(keychar);
+        pushBit(true);
+        begin = groupEnd;
+      }
+      pushBit(false);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.valueSize = sizeof(T);
+    header.nodes = queue.size();
+    header.values = values.size();
+    Write(out, &header, sizeof(header));
+    Write(out, louds.data(), louds.size() * sizeof(std::uint64_t));
+    auto loudsRanks = detail::RankSelectView::BuildRanks(louds, loudsBits);
+    Write(out, loudsRanks.data(), loudsRanks.size() * sizeof(std::uint64_t));
+    auto terminalRanks =
+        detail::RankSelectView::BuildRanks(terminals, header.nodes);
+    Write(out, terminals.data(), terminals.size() * sizeof(std::uint64_t));
+    Write(out,
+          terminalRanks.data(),
+          terminalRanks.size() * sizeof(std::uint64_t));
+    Write(out, labels.data(), labels.size());
+    Write(out, values.data(), values.size() * sizeof(T));
+  }
+
+  /// View a frozen image in place, e.g. MappedFile::Data(). The bytes must
+  /// stay alive and unchanged as long as the view is used, and be aligned
+  /// for both uint64_t and T.
+  /// \return none if the bytes are not a frozen image of this T.
+  static auto
+  View(const void *data, std::size_t size)
+      -> cdi::constructor::Maybe<FrozenTrie> {
+    Header header{};
+    if (size < sizeof(header) ||
+        reinterpret_cast<std::uintptr_t>(data) % alignof(std::uint64_t) != 0) {
+      return cdi::constructor::none;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.valueSize != sizeof(T) ||
+        header.nodes == 0) {
+      return cdi::constructor::none;
+    }
+
+    using detail::RankSelectView;
+    auto loudsBits = 2 * header.nodes + 1;
+    const auto *bytes = static_cast<const char *>(data);
+    std::size_t offset = sizeof(header);
+    // every section is padded to 8 bytes.
+    auto take = [&offset](std::size_t length) {
+      return std::exchange(offset, offset + (length + 7) / 8 * 8);
+    };
+    auto words = take(RankSelectView::WordCount(loudsBits) * 8);
+    auto wordRanks = take(RankSelectView::BlockCount(loudsBits) * 8);
+    auto terminals = take(RankSelectView::WordCount(header.nodes) * 8);
+    auto terminalRanks = take(RankSelectView::BlockCount(header.nodes) * 8);
+    auto labels = take(header.nodes);
+    auto values = take(header.values * sizeof(T));
+    if (offset != size) {
+      return cdi::constructor::none;
+    }
+
+    FrozenTrie trie;
+    auto words64 = [bytes](std::size_t at) {
+      return reinterpret_cast<const std::uint64_t *>(bytes + at);
+    };
+    trie.louds_ =
+        RankSelectView(words64(words), words64(wordRanks), loudsBits);
+    trie.terminals_ = RankSelectView(
+        words64(terminals), words64(terminalRanks), header.nodes);
+    trie.labels_ = bytes + labels;
+    trie.values_ = reinterpret_cast<const T *>(bytes + values);
+    trie.size_ = header.values;
+    return trie;
+  }
+
+  /// \return the value in the image, none if key is absent.
+  [[nodiscard]] auto
+  Find(std::string_view key) const -> const T * {
+    std::uint64_t node = 0;
+    for (char keychar : key) {
+      // children of node are [first, first + degree).
+      auto start = louds_.Select0(node);
+      auto stop = louds_.NextZero(start + 1);
+      const auto *begin = labels_ + (start - node);
+      const auto *end = labels_ + (stop - node - 1);
+      const auto *found =
+          std::lower_bound(begin, end, keychar, [](char lhs, char rhs) {
+            return static_cast<unsigned char>(lhs) <
+                   static_cast<unsigned char>(rhs);
+          });
+      if (found == end || *found != keychar) {
+        return nullptr;
+      }
+      node = static_cast<std::uint64_t>(found - labels_);
+    }
+    if (!terminals_.Get(node)) {
+      return nullptr;
+    }
+    return values_ + terminals_.Rank1(node);
+  }
+
+  /// cdi-style api.
+  [[nodiscard]] auto
+  LookupMaybe(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    const auto *value = Find(key);
+    if (value == nullptr) {
+      return cdi::constructor::none;
+    }
+    return *value;
+  }
+
+  /// number of keys.
+  [[nodiscard]] auto
+  Size() const -> std::size_t {
+    return size_;
+  }
+
+private:
+  FrozenTrie() = default;
+
+  static void
+  Write(std::ostream &out, const void *data, std::size_t size) {
+    out.write(static_cast<const char *>(data),
+              static_cast<std::streamsize>(size));
+    // keep every section 8 byte aligned.
+    static constexpr char kPadding[8] = {};
+    out.write(kPadding, static_cast<std::streamsize>((8 - size % 8) % 8));
+  }
+
+  detail::RankSelectView louds_;
+  detail::RankSelectView terminals_;
+  const char *labels_ = nullptr;
+  const T *values_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_FROZEN_TRIE_HH
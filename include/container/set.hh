@@ -7,13 +7,27 @@
 //
 //===------------------------------------------===
 
+//===------------------------------------------------------------------------===
+// The ordered set of cdi is a B+ tree, see container/btree.hh: values sit
+// side by side in nodes of a few cache lines instead of one allocation each.
+// Mind that unlike with std::set, an insertion or erasure invalidates every
+// iterator.
+//===------------------------------------------------------------------------===
+
 #ifndef CDI_CONTAINER_SET_HH
 #define CDI_CONTAINER_SET_HH
 
-#include <set>
+#include "container/btree.hh"
+#include <functional>
+#include <memory>
 
 namespace cdi::container {
-using std::set;
+
+template <typename K,
+          typename Compare = std::less<K>,
+          typename Allocator = std::allocator<K>>
+using set = btree_set<K, Compare, Allocator>;
+
 } // namespace cdi::container
 
 #endif // CDI_CONTAINER_SET_HH
@@ -0,0 +1,386 @@
+//===--- sharded_trie.hh - Trie split into independent shards ---*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/sharded_trie.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// N independent Tries behind one front. A key lives in exactly one shard, so
+// single key operations touch one trie only, and writers to different shards
+// never meet, not even at a root latch. Each shard sits on cache lines of its
+// own, so neither do their latches and retire lists.
+//
+// Keys are partitioned by
+//   kLeadingByte  ranges of the first byte. Shards are ordered, and every
+//                 prefix of a key is in the key's shard: a prefix scan or a
+//                 longest prefix match stays in one shard. Skewed when keys
+//                 share their first byte, e.g. URL paths.
+//   kHash         a hash of the whole key. Even whatever the keys look like;
+//                 ordered scans merge the shards, and a longest prefix match
+//                 looks up every prefix.
+//
+// Scans and bulk loads that involve several shards fan out, one thread per
+// shard. Scans then collect copies of the values, which are handed to the
+// visitor in key order from the calling thread, no latch held.
+//
+// Classes: ShardedTrie
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_SHARDED_TRIE_HH
+#define CDI_CONTAINER_SHARDED_TRIE_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include "container/visitor.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cdi::container {
+
+enum class TrieSharding : std::uint8_t {
+  kLeadingByte,
+  kHash,
+};
+
+template <typename T, typename Alloc = cdi::memory::HeapAllocator>
+class ShardedTrie {
+  constexpr static std::size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) Shard {
+    explicit Shard(TrieReadMode mode) : trie(mode) {}
+
+    Trie<T, Alloc> trie;
+  };
+
+public:
+  using value_type = T;
+
+  constexpr static std::size_t kNoLimit = Trie<T, Alloc>::kNoLimit;
+  constexpr static std::size_t kMaxShards = 256;
+
+  /// \param shards 0 for one per core; at most kMaxShards.
+  explicit ShardedTrie(std::size_t shards = 0,
+                       TrieSharding sharding = TrieSharding::kLeadingByte,
+                       TrieReadMode mode = TrieReadMode::kPessimistic)
+      : sharding_(sharding) {
+    if (shards == 0) {
+      shards = std::thread::hardware_concurrency();
+    }
+    shards = std::clamp<std::size_t>(shards, 1, kMaxShards);
+    shards_.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i) {
+      shards_.push_back(std::make_unique<Shard>(mode));
+    }
+  }
+
+  [[nodiscard]] auto ShardCount() const -> std::size_t {
+    return shards_.size();
+  }
+
+  [[nodiscard]] auto GetSharding() const -> TrieSharding { return sharding_; }
+
+  /// index of the shard holding key.
+  [[nodiscard]] auto ShardOf(std::string_view key) const -> std::size_t {
+    if (sharding_ == TrieSharding::kHash) {
+      return std::hash<std::string_view>()(key) % shards_.size();
+    }
+    return key.empty() ? 0 : ShardOfByte(static_cast<std::uint8_t>(key[0]));
+  }
+
+  /// Like Trie::Clear, must not race with any other operation.
+  void Clear() {
+    for (auto &shard : shards_) {
+      shard->trie.Clear();
+    }
+  }
+
+  auto Insert(std::string_view key, T value) -> bool {
+    return At(key).Insert(key, std::move(value));
+  }
+
+  auto Upsert(std::string_view key, T value) -> bool {
+    return At(key).Upsert(key, std::move(value));
+  }
+
+  template <typename Merge>
+  auto Upsert(std::string_view key, T value, Merge &&merge) -> bool {
+    return At(key).Upsert(key, std::move(value), std::forward<Merge>(merge));
+  }
+
+  template <typename Fn> auto Update(std::string_view key, Fn &&fn) -> bool {
+    return At(key).Update(key, std::forward<Fn>(fn));
+  }
+
+  auto CompareAndSwap(std::string_view key, const T &expected, T desired)
+      -> bool {
+    return At(key).CompareAndSwap(key, expected, std::move(desired));
+  }
+
+  auto Remove(std::string_view key) -> bool { return At(key).Remove(key); }
+
+  [[nodiscard("you must check whether the lookup succeed.")]] auto
+  Lookup(std::string_view key, T *value = nullptr) const -> bool {
+    return At(key).Lookup(key, value);
+  }
+
+  auto LookupMaybe(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    return At(key).LookupMaybe(key);
+  }
+
+  template <typename Visitor>
+  auto Visit(std::string_view key, Visitor &&visitor) const -> bool {
+    return At(key).Visit(key, std::forward<Visitor>(visitor));
+  }
+
+  auto LookupRef(std::string_view key) const
+      -> cdi::constructor::Maybe<TrieValueRef<T, Alloc>> {
+    return At(key).LookupRef(key);
+  }
+
+  /// Trie::LongestPrefix. One walk with kLeadingByte; with kHash every
+  /// prefix is looked up in its own shard, longest first.
+  auto LongestPrefix(std::string_view key) const
+      -> cdi::constructor::Maybe<std::pair<std::string_view, T>> {
+    if (sharding_ == TrieSharding::kLeadingByte) {
+      return At(key).LongestPrefix(key);
+    }
+    for (auto length = key.size(); length > 0; --length) {
+      auto prefix = key.substr(0, length);
+      if (auto found = At(prefix).LookupMaybe(prefix)) {
+        return std::make_pair(prefix, std::move(*found));
+      }
+    }
+    return cdi::constructor::none;
+  }
+
+  /// Trie::BulkLoad, every shard loading its part of the batch on a thread
+  /// of its own.
+  auto BulkLoad(std::vector<std::pair<std::string, T>> entries,
+                std::size_t threads = 0) -> std::size_t {
+    std::vector<Entries> parts(shards_.size());
+    for (auto &entry : entries) {
+      parts[ShardOf(entry.first)].push_back(std::move(entry));
+    }
+    if (threads == 0) {
+      threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    auto perShard = std::max<std::size_t>(1, threads / shards_.size());
+    std::vector<std::size_t> added(shards_.size());
+    FanOut(AllShards(), [&](std::size_t shard) {
+      added[shard] =
+          shards_[shard]->trie.BulkLoad(std::move(parts[shard]), perShard);
+    });
+    return std::accumulate(added.begin(), added.end(), std::size_t{0});
+  }
+
+  /// Trie::ScanPrefix over all shards, in key order. Streams from the trie
+  /// when a single shard is involved, see the file comment otherwise.
+  template <typename Visitor>
+  auto ScanPrefix(std::string_view prefix,
+                  Visitor &&visitor,
+                  std::size_t limit = kNoLimit) const -> std::size_t {
+    if (sharding_ == TrieSharding::kLeadingByte && !prefix.empty()) {
+      return At(prefix).ScanPrefix(prefix, visitor, limit);
+    }
+    return Gather(
+        AllShards(),
+        [prefix, limit](const Trie<T, Alloc> &trie, auto &&collect) {
+          (void)trie.ScanPrefix(prefix, collect, limit);
+        },
+        visitor,
+        limit);
+  }
+
+  /// Trie::ScanRange over all shards, in key order.
+  template <typename Visitor>
+  auto ScanRange(std::string_view lo,
+                 std::string_view hi,
+                 Visitor &&visitor,
+                 std::size_t limit = kNoLimit) const -> std::size_t {
+    auto shards = AllShards();
+    if (sharding_ == TrieSharding::kLeadingByte) {
+      shards.erase(std::remove_if(shards.begin(),
+                                  shards.end(),
+                                  [this, lo, hi](std::size_t shard) {
+                                    return !Overlaps(shard, lo, hi);
+                                  }),
+                   shards.end());
+      if (shards.size() == 1) {
+        return shards_[shards[0]]->trie.ScanRange(lo, hi, visitor, limit);
+      }
+    }
+    return Gather(
+        shards,
+        [lo, hi, limit](const Trie<T, Alloc> &trie, auto &&collect) {
+          (void)trie.ScanRange(lo, hi, collect, limit);
+        },
+        visitor,
+        limit);
+  }
+
+  /// Trie::TopK over all shards: the k best of every shard involved, merged.
+  template <typename Visitor>
+  auto TopK(std::string_view prefix, std::size_t k, Visitor &&visitor) const
+      -> std::size_t {
+    if (sharding_ == TrieSharding::kLeadingByte && !prefix.empty()) {
+      return At(prefix).TopK(prefix, k, visitor);
+    }
+    std::vector<Entries> parts(shards_.size());
+    FanOut(AllShards(), [&](std::size_t shard) {
+      auto &part = parts[shard];
+      (void)shards_[shard]->trie.TopK(
+          prefix, k, [&part](std::string_view key, const T &value) {
+            part.emplace_back(std::string(key), value);
+          });
+    });
+    Entries best;
+    for (auto &part : parts) {
+      std::move(part.begin(), part.end(), std::back_inserter(best));
+    }
+    auto size = std::min(k, best.size());
+    std::partial_sort(best.begin(),
+                      best.begin() + size,
+                      best.end(),
+                      [](auto &lhs, auto &rhs) {
+                        return lhs.second.score > rhs.second.score ||
+                               (lhs.second.score == rhs.second.score &&
+                                lhs.first.compare(rhs.first) < 0);
+                      });
+    std::size_t visited = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      ++visited;
+      if (!detail::CallVisitor(
+              visitor, std::string_view(best[i].first), best[i].second)) {
+        break;
+      }
+    }
+    return visited;
+  }
+
+private:
+  using Entries = std::vector<std::pair<std::string, T>>;
+
+  [[nodiscard]] auto ShardOfByte(std::uint8_t byte) const -> std::size_t {
+    return byte * shards_.size() / 256;
+  }
+
+  auto At(std::string_view key) -> Trie<T, Alloc> & {
+    return shards_[ShardOf(key)]->trie;
+  }
+
+  auto At(std::string_view key) const -> const Trie<T, Alloc> & {
+    return shards_[ShardOf(key)]->trie;
+  }
+
+  [[nodiscard]] auto AllShards() const -> std::vector<std::size_t> {
+    std::vector<std::size_t> shards(shards_.size());
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+      shards[i] = i;
+    }
+    return shards;
+  }
+
+  /// whether kLeadingByte `shard` may hold keys in [lo, hi).
+  [[nodiscard]] auto Overlaps(std::size_t shard,
+                              std::string_view lo,
+                              std::string_view hi) const -> bool {
+    if (!lo.empty() && shard < ShardOfByte(static_cast<std::uint8_t>(lo[0]))) {
+      return false;
+    }
+    if (hi.empty()) {
+      return false;
+    }
+    auto hiByte = static_cast<std::uint8_t>(hi[0]);
+    auto last = ShardOfByte(hiByte);
+    if (shard != last) {
+      return shard < last;
+    }
+    // a key starting with hi's byte is below hi only if hi goes on.
+    return hi.size() > 1 || (hiByte > 0 && ShardOfByte(hiByte - 1) == shard);
+  }
+
+  /// Run `task(shard)` for every shard, the first on this thread.
+  template <typename Task>
+  static void FanOut(const std::vector<std::size_t> &shards, Task &&task) {
+    std::vector<std::future<void>> spawned;
+    for (std::size_t i = 1; i < shards.size(); ++i) {
+      spawned.push_back(
+          std::async(std::launch::async, [&task, shard = shards[i]]() {
+            task(shard);
+          }));
+    }
+    if (!shards.empty()) {
+      task(shards[0]);
+    }
+    for (auto &done : spawned) {
+      done.get();
+    }
+  }
+
+  /// Scan the shards in parallel into copies, then visit them in key order.
+  template <typename Scan, typename Visitor>
+  auto Gather(const std::vector<std::size_t> &shards,
+              Scan &&scan,
+              Visitor &visitor,
+              std::size_t limit) const -> std::size_t {
+    std::vector<Entries> parts(shards.size());
+    std::vector<std::size_t> slot(shards_.size());
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+      slot[shards[i]] = i;
+    }
+    FanOut(shards, [&](std::size_t shard) {
+      auto &part = parts[slot[shard]];
+      scan(shards_[shard]->trie, [&part](std::string_view key, const T &value) {
+        part.emplace_back(std::string(key), value);
+      });
+    });
+
+    // each part is sorted; a linear pick of the least head is plenty for a
+    // few dozen shards.
+    std::vector<std::size_t> heads(parts.size());
+    std::size_t visited = 0;
+    while (visited < limit) {
+      const std::pair<std::string, T> *least = nullptr;
+      std::size_t from = 0;
+      for (std::size_t i = 0; i < parts.size(); ++i) {
+        if (heads[i] < parts[i].size() &&
+            (least == nullptr || parts[i][heads[i]].first < least->first)) {
+          least = &parts[i][heads[i]];
+          from = i;
+        }
+      }
+      if (least == nullptr) {
+        break;
+      }
+      ++heads[from];
+      ++visited;
+      if (!detail::CallVisitor(
+              visitor, std::string_view(least->first), least->second)) {
+        break;
+      }
+    }
+    return visited;
+  }
+
+  TrieSharding sharding_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_SHARDED_TRIE_HH
@@ -0,0 +1,511 @@
+//===--- small_vector.hh - Vector with inline storage -----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/small_vector.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// A vector whose first N elements live inside it: a small_vector of up to N
+// elements never touches the heap, so building one on the stack, returning
+// it or dropping it costs no allocation. Past N it spills to the heap and
+// grows as std::vector does.
+//
+// The price is its size, N elements more than a vector, and moves: moving
+// a small_vector whose elements are inline moves them one by one, and
+// iterators to them do not survive it.
+//
+// get, operator[], front, back and pop_back are checked as cdi::vector's
+// are, by kCheck.
+//
+// Classes: small_vector
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_SMALL_VECTOR_HH
+#define CDI_CONTAINER_SMALL_VECTOR_HH
+
+#include "container/bounds_check.hh"
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace cdi::container {
+
+template <typename T,
+          std::size_t N,
+          BoundsCheck kCheck = kDefaultBoundsCheck>
+class small_vector {
+  static_assert(N > 0, "small_vector needs room for an element inline");
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T &;
+  using const_reference = const T &;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using iterator = T *;
+  using const_iterator = const T *;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  constexpr static size_type kInlineCapacity = N;
+
+  small_vector() noexcept = default;
+
+  explicit small_vector(size_type count) { resize(count); }
+
+  small_vector(size_type count, const T &value) { resize(count, value); }
+
+  template <typename InputIt,
+            typename Category =
+                typename std::iterator_traits<InputIt>::iterator_category>
+  small_vector(InputIt first, InputIt last) {
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+      reserve(static_cast<size_type>(std::distance(first, last)));
+    }
+    for (; first != last; ++first) {
+      emplace_back(*first);
+    }
+  }
+
+  small_vector(std::initializer_list<T> values)
+      : small_vector(values.begin(), values.end()) {}
+
+  small_vector(const small_vector &other)
+      : small_vector(other.begin(), other.end()) {}
+
+  small_vector(small_vector &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T>) {
+    TakeFrom(other);
+  }
+
+  auto
+  operator=(const small_vector &other) -> small_vector & {
+    if (this != &other) {
+      clear();
+      reserve(other.size());
+      std::uninitialized_copy(other.begin(), other.end(), data_);
+      size_ = other.size();
+    }
+    return *this;
+  }
+
+  auto
+  operator=(small_vector &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T>) -> small_vector & {
+    if (this != &other) {
+      clear();
+      Release();
+      TakeFrom(other);
+    }
+    return *this;
+  }
+
+  auto
+  operator=(std::initializer_list<T> values) -> small_vector & {
+    return *this = small_vector(values);
+  }
+
+  ~small_vector() {
+    clear();
+    Release();
+  }
+
+  //===--------------------------------------------------------------------===
+  // element access
+  //===--------------------------------------------------------------------===
+
+  [[gnu::always_inline]] auto
+  get(size_type index) -> reference {
+    AssertIndexInBounds(index);
+    return data_[index];
+  }
+
+  [[gnu::always_inline]] auto
+  get(size_type index) const -> const_reference {
+    AssertIndexInBounds(index);
+    return data_[index];
+  }
+
+  [[gnu::always_inline]] auto
+  operator[](size_type index) -> reference {
+    return get(index);
+  }
+
+  [[gnu::always_inline]] auto
+  operator[](size_type index) const -> const_reference {
+    return get(index);
+  }
+
+  auto
+  at(size_type index) -> reference {
+    if (index >= size_) {
+      throw std::out_of_range("small_vector::at: index out of range");
+    }
+    return data_[index];
+  }
+
+  auto
+  at(size_type index) const -> const_reference {
+    return const_cast<small_vector *>(this)->at(index);
+  }
+
+  auto
+  front() -> reference {
+    return get(0);
+  }
+
+  auto
+  front() const -> const_reference {
+    return get(0);
+  }
+
+  auto
+  back() -> reference {
+    return get(size_ - 1);
+  }
+
+  auto
+  back() const -> const_reference {
+    return get(size_ - 1);
+  }
+
+  auto
+  data() noexcept -> pointer {
+    return data_;
+  }
+
+  auto
+  data() const noexcept -> const_pointer {
+    return data_;
+  }
+
+  //===--------------------------------------------------------------------===
+  // iteration and capacity
+  //===--------------------------------------------------------------------===
+
+  auto
+  begin() noexcept -> iterator {
+    return data_;
+  }
+
+  auto
+  end() noexcept -> iterator {
+    return data_ + size_;
+  }
+
+  auto
+  begin() const noexcept -> const_iterator {
+    return data_;
+  }
+
+  auto
+  end() const noexcept -> const_iterator {
+    return data_ + size_;
+  }
+
+  auto
+  cbegin() const noexcept -> const_iterator {
+    return begin();
+  }
+
+  auto
+  cend() const noexcept -> const_iterator {
+    return end();
+  }
+
+  auto
+  rbegin() noexcept -> reverse_iterator {
+    return reverse_iterator(end());
+  }
+
+  auto
+  rend() noexcept -> reverse_iterator {
+    return reverse_iterator(begin());
+  }
+
+  auto
+  rbegin() const noexcept -> const_reverse_iterator {
+    return const_reverse_iterator(end());
+  }
+
+  auto
+  rend() const noexcept -> const_reverse_iterator {
+    return const_reverse_iterator(begin());
+  }
+
+  [[nodiscard]] auto
+  empty() const noexcept -> bool {
+    return size_ == 0;
+  }
+
+  [[nodiscard]] auto
+  size() const noexcept -> size_type {
+    return size_;
+  }
+
+  [[nodiscard]] auto
+  capacity() const noexcept -> size_type {
+    return capacity_;
+  }
+
+  /// whether the elements are still inside the small_vector.
+  [[nodiscard]] auto
+  is_inline() const noexcept -> bool {
+    return data_ == InlineData();
+  }
+
+  void
+  reserve(size_type count) {
+    if (count > capacity_) {
+      Reallocate(count);
+    }
+  }
+
+  /// Move the elements back inline if they fit, or else to a heap block of
+  /// their size.
+  void
+  shrink_to_fit() {
+    if (!is_inline() && size_ < capacity_) {
+      Reallocate(size_);
+    }
+  }
+
+  //===--------------------------------------------------------------------===
+  // modification
+  //===--------------------------------------------------------------------===
+
+  template <typename... Args>
+  auto
+  emplace_back(Args &&...args) -> reference {
+    if (size_ == capacity_) {
+      return EmplaceBackGrowing(std::forward<Args>(args)...);
+    }
+    auto *element = new (data_ + size_) T(std::forward<Args>(args)...);
+    ++size_;
+    return *element;
+  }
+
+  void
+  push_back(const T &value) {
+    (void)emplace_back(value);
+  }
+
+  void
+  push_back(T &&value) {
+    (void)emplace_back(std::move(value));
+  }
+
+  void
+  pop_back() {
+    AssertIndexInBounds(size_ - 1);
+    data_[--size_].~T();
+  }
+
+  template <typename... Args>
+  auto
+  emplace(const_iterator pos, Args &&...args) -> iterator {
+    auto index = pos - begin();
+    (void)emplace_back(std::forward<Args>(args)...);
+    std::rotate(begin() + index, end() - 1, end());
+    return begin() + index;
+  }
+
+  auto
+  insert(const_iterator pos, const T &value) -> iterator {
+    return emplace(pos, value);
+  }
+
+  auto
+  insert(const_iterator pos, T &&value) -> iterator {
+    return emplace(pos, std::move(value));
+  }
+
+  auto
+  erase(const_iterator pos) -> iterator {
+    return erase(pos, pos + 1);
+  }
+
+  auto
+  erase(const_iterator first, const_iterator last) -> iterator {
+    auto *from = begin() + (first - cbegin());
+    auto *to = begin() + (last - cbegin());
+    auto *newEnd = std::move(to, end(), from);
+    std::destroy(newEnd, end());
+    size_ = static_cast<size_type>(newEnd - data_);
+    return from;
+  }
+
+  void
+  resize(size_type count) {
+    Resize(count);
+  }
+
+  void
+  resize(size_type count, const T &value) {
+    Resize(count, value);
+  }
+
+  void
+  clear() noexcept {
+    std::destroy_n(data_, size_);
+    size_ = 0;
+  }
+
+  void
+  swap(small_vector &other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    small_vector moved(std::move(other));
+    other = std::move(*this);
+    *this = std::move(moved);
+  }
+
+  friend auto
+  operator==(const small_vector &lhs, const small_vector &rhs) -> bool {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+  friend auto
+  operator!=(const small_vector &lhs, const small_vector &rhs) -> bool {
+    return !(lhs == rhs);
+  }
+
+  friend auto
+  operator<(const small_vector &lhs, const small_vector &rhs) -> bool {
+    return std::lexicographical_compare(
+        lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+  }
+
+private:
+  auto
+  InlineData() const noexcept -> T * {
+    return std::launder(
+        reinterpret_cast<T *>(const_cast<unsigned char *>(inline_)));
+  }
+
+  /// Construct the element past the end in a larger block first: args may
+  /// refer to an element.
+  template <typename... Args>
+  auto
+  EmplaceBackGrowing(Args &&...args) -> reference {
+    auto capacity = std::max<size_type>(2 * capacity_, size_ + 1);
+    auto *block = std::allocator<T>().allocate(capacity);
+    try {
+      new (block + size_) T(std::forward<Args>(args)...);
+    } catch (...) {
+      std::allocator<T>().deallocate(block, capacity);
+      throw;
+    }
+    Adopt(block, capacity);
+    return data_[size_++];
+  }
+
+  /// Move the elements to a block of capacity, inline if it fits.
+  void
+  Reallocate(size_type capacity) {
+    if (capacity <= N) {
+      if (!is_inline()) {
+        auto *block = data_;
+        auto oldCapacity = capacity_;
+        Relocate(block, size_, InlineData());
+        std::allocator<T>().deallocate(block, oldCapacity);
+        data_ = InlineData();
+        capacity_ = N;
+      }
+      return;
+    }
+    Adopt(std::allocator<T>().allocate(capacity), capacity);
+  }
+
+  /// Move the elements to block, a heap block of capacity, and free the old
+  /// one.
+  void
+  Adopt(T *block, size_type capacity) {
+    Relocate(data_, size_, block);
+    Release();
+    data_ = block;
+    capacity_ = capacity;
+  }
+
+  /// Move count elements from src to the uninitialized dst, destroying them.
+  static void
+  Relocate(T *src, size_type count, T *dst) {
+    if constexpr (std::is_nothrow_move_constructible_v<T> ||
+                  !std::is_copy_constructible_v<T>) {
+      std::uninitialized_move_n(src, count, dst);
+    } else {
+      std::uninitialized_copy_n(src, count, dst);
+    }
+    std::destroy_n(src, count);
+  }
+
+  /// Free the heap block, if any; the elements must be gone or moved.
+  void
+  Release() noexcept {
+    if (!is_inline()) {
+      std::allocator<T>().deallocate(data_, capacity_);
+      data_ = InlineData();
+      capacity_ = N;
+    }
+  }
+
+  /// Steal the heap block of other, or move its inline elements over.
+  void
+  TakeFrom(small_vector &other) {
+    if (other.is_inline()) {
+      std::uninitialized_move_n(other.data_, other.size_, data_);
+      size_ = other.size_;
+      other.clear();
+      return;
+    }
+    data_ = std::exchange(other.data_, other.InlineData());
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, N);
+  }
+
+  template <typename... Value>
+  void
+  Resize(size_type count, const Value &...value) {
+    if (count <= size_) {
+      std::destroy(data_ + count, data_ + size_);
+      size_ = count;
+      return;
+    }
+    if (count > capacity_) {
+      Reallocate(std::max(count, 2 * capacity_));
+    }
+    for (; size_ < count; ++size_) {
+      new (data_ + size_) T(value...);
+    }
+  }
+
+  [[gnu::always_inline]] void
+  AssertIndexInBounds(size_type index) const {
+    CheckIndex<kCheck>(index, size_, "small_vector");
+  }
+
+  T *data_ = InlineData();
+  size_type size_ = 0;
+  size_type capacity_ = N;
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+};
+
+} // namespace cdi::container
+
+namespace cdi {
+
+using container::small_vector;
+
+} // namespace cdi
+
+#endif // CDI_CONTAINER_SMALL_VECTOR_HH
@@ -11,274 +11,691 @@
 #define CDI_CONTAINER_TRIE_HH
 
 //===------------------------------------------------------------------------===
-// This file implements a concurrent safe trie.
-// I am considering RCU or COW version, but I'm not ready yet.
+// This file implements a concurrent safe trie, using lock coupling on per node
+// latches. For read mostly workloads, the RCU / COW version lives in
+// container/cow_trie.hh.
 //
 // A trie is a data structure for storing strings in a way which allows for fast
 // prefix queries.  The basic idea is to store the string "foo" as a path
-// through a tree, where each node is a single character.  For example, the
-// string "foo" would be stored as three nodes, one for each character.  The
-// string "bar" would share a node with "baz" for the first two characters.
+// through a tree, where each edge is labelled with characters.  Chains without
+// forks are compressed into one edge, so the string "foo" alone is a single
+// node labelled "foo".  The string "bar" would share a node "ba" with "baz",
+// which forks into "r" and "z".
 //
-// Classes: Trie, TrieNode
+// Classes: Trie<T>, TrieNode<T>, TrieSnapshot<T>, Trie<>
 //
-// TrieNode is a interface, representing a node in the trie.  It can be terminal
-// or internal nodes. Two types.
+// TrieNode<T> is a node in the trie, terminal or internal: it holds its value
+// inline, if any, so there is no node type to convert between and no virtual
+// dispatch. Children are kept in an AdaptiveChildren, the ART node layouts, so
+// a node pays for its fanout and not for a hash table.
 //
-// Trie provides most of our operations, containing:
+// Trie<T> provides most of our operations, containing:
 // - Insert
-// - Lookup
+// - Upsert / Update / CompareAndSwap, changing a value in place in one walk
+// - LongestPrefix / VisitPrefixes, the values on a key's path in one walk
+// - Lookup, and Visit / LookupRef that hand out the value without a copy;
+//   optimistic, without latching the path, in TrieReadMode::kOptimistic
+// - LookupBatch, many optimistic lookups interleaved to overlap cache misses,
+//   in container/trie_lookup_batch.hh
 // - Delete
+// - ScanPrefix / ScanRange, ordered scans streaming keys to a callback, in
+//   container/trie_scan.hh
+// - BulkLoad, building subtrees from a sorted batch on all cores, in
+//   container/trie_bulk_load.hh
+// - TopK, the best scored keys under a prefix, for ScoredTrie, in
+//   container/trie_top_k.hh
+// - VisitFuzzy / Fuzzy, the keys within an edit distance of a query, in
+//   container/trie_fuzzy.hh
+// - Snapshot, a point-in-time view for lookups and scans, writers go on, in
+//   container/trie_snapshot.hh
+//
+// Keys are std::string_views, nothing is copied on the way in; raw bytes and
+// integer or composite keys are encoded by container/trie_key.hh.
+//
+// Trie<> is the untyped flavour, every key may carry a value of its own type.
+// The type is checked on lookup.
 //
 //===------------------------------------------------------------------------===
 
 #include "constructor/maybe.hh"
-#include "container/unordered_map.hh"
+#include "container/adaptive_children.hh"
+#include "concurrency/epoch.hh"
+#include "container/visitor.hh"
+#include "memory/slab_arena.hh"
+#include "port/port.hh"
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <ostream>
+#include <set>
 #include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace cdi::container {
 
+template <typename T = void, typename Alloc = cdi::memory::HeapAllocator>
 class Trie;
-class TrieNodeGuard;
+template <typename T, typename Alloc> class TrieNodeGuard;
+template <typename T, typename Alloc> class TrieValueRef;
+template <typename T, typename Alloc> class TrieSnapshot;
+
+namespace detail {
+template <typename T, typename Alloc> class TrieScan;
+template <typename T, typename Alloc> class TrieBulkLoad;
+template <typename T, typename Alloc> class TrieFuzzy;
+template <typename T, typename Alloc> class TrieLookupBatch;
+template <typename T, typename Alloc> class TrieTopK;
+} // namespace detail
+
+/// How lookups synchronize with writers, see "Optimistic lock coupling" below.
+enum class TrieReadMode : std::uint8_t {
+  kPessimistic, // shared latches, hand over hand.
+  kOptimistic,  // version checks, the reader writes no shared memory.
+};
+
+/// A value ranked by its score, for Trie::TopK. Higher is better, and a
+/// score is never NaN.
+template <typename T> struct Scored {
+  double score;
+  T value;
+};
+
+template <typename T>
+auto operator==(const Scored<T> &lhs, const Scored<T> &rhs) -> bool {
+  return lhs.score == rhs.score && lhs.value == rhs.value;
+}
+
+template <typename T>
+auto operator!=(const Scored<T> &lhs, const Scored<T> &rhs) -> bool {
+  return !(lhs == rhs);
+}
+
+template <typename T>
+auto operator<<(std::ostream &out, const Scored<T> &scored) -> std::ostream & {
+  return out << scored.value << " (" << scored.score << ')';
+}
+
+/// A key found by Trie::Fuzzy, with its edit distance to the query.
+template <typename T> struct TrieFuzzyMatch {
+  std::string key;
+  std::size_t distance;
+  T value;
+};
+
+/// A trie whose nodes also know the best score below them, see Trie::TopK.
+template <typename T, typename Alloc = cdi::memory::HeapAllocator>
+using ScoredTrie = Trie<Scored<T>, Alloc>;
+
+namespace detail {
+
+template <typename T> struct IsScored : std::false_type {};
+template <typename T> struct IsScored<Scored<T>> : std::true_type {};
+
+/// An upper bound of the scores in a subtree. Raised on the way down by
+/// inserts, so readers may see it ahead of the key, never behind.
+class ScoreBound {
+public:
+  void Raise(double score) {
+    auto best = best_.load(std::memory_order_relaxed);
+    while (best < score &&
+           !best_.compare_exchange_weak(best, score,
+                                        std::memory_order_relaxed)) {
+    }
+  }
+
+  void Set(double score) { best_.store(score, std::memory_order_relaxed); }
+
+  [[nodiscard]] auto Get() const -> double {
+    return best_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<double> best_{-std::numeric_limits<double>::infinity()};
+};
 
+/// Unscored tries pay a byte of padding at most.
+struct NoScoreBound {};
+
+/// The open snapshots of a Trie, see TrieSnapshot. The clock only ticks for
+/// changes made while a snapshot is open, so writers touch nothing shared but
+/// the `open_` count otherwise, and that they only read.
+class SnapshotRegistry {
+public:
+  /// as of the latest change, what a snapshot never is.
+  constexpr static std::uint64_t kLatest =
+      std::numeric_limits<std::uint64_t>::max();
+
+  /// Register a snapshot.
+  /// \return the time it is taken at: it sees the changes stamped up to it.
+  auto Open() -> std::uint64_t {
+    std::lock_guard lock(latch_);
+    // a snapshot being taken is newer than every other.
+    newest_.store(kLatest);
+    open_.fetch_add(1);
+    auto asOf = clock_.load();
+    taken_.insert(asOf);
+    Publish();
+    return asOf;
+  }
+
+  /// \return whether it was the last one open.
+  auto Close(std::uint64_t asOf) -> bool {
+    std::lock_guard lock(latch_);
+    taken_.erase(taken_.find(asOf));
+    if (!taken_.empty()) {
+      Publish();
+    }
+    return open_.fetch_sub(1) == 1;
+  }
+
+  /// whether a change must keep the value it replaces.
+  [[nodiscard]] auto Recording() const -> bool { return open_.load() > 0; }
+
+  /// The time of a change. Only a change made while Recording() needs one.
+  auto Stamp() -> std::uint64_t { return clock_.fetch_add(1) + 1; }
+
+  /// [oldest, newest] covers the time of every open snapshot that may read
+  /// a replaced value; empty when none is open.
+  [[nodiscard]] auto Window() const -> std::pair<std::uint64_t, std::uint64_t> {
+    if (!Recording()) {
+      return {kLatest, 0};
+    }
+    return {oldest_.load(), newest_.load()};
+  }
+
+private:
+  void Publish() {
+    oldest_.store(*taken_.begin());
+    newest_.store(*taken_.rbegin());
+  }
+
+  std::atomic<std::uint64_t> clock_{0};
+  std::atomic<std::size_t> open_{0};
+  // the times only grow, so a stale oldest_ is still below every open one.
+  std::atomic<std::uint64_t> oldest_{0};
+  std::atomic<std::uint64_t> newest_{0};
+  std::mutex latch_;
+  std::multiset<std::uint64_t> taken_;
+};
+
+} // namespace detail
+
+template <typename T, typename Alloc = cdi::memory::HeapAllocator>
 class TrieNode {
-  friend class Trie;
-  friend class TrieNodeGuard;
+  friend class Trie<T, Alloc>;
+  friend class TrieNodeGuard<T, Alloc>;
+  friend class TrieValueRef<T, Alloc>;
+  friend class detail::TrieScan<T, Alloc>;
+  friend class detail::TrieBulkLoad<T, Alloc>;
+  friend class detail::TrieFuzzy<T, Alloc>;
+  friend class detail::TrieTopK<T, Alloc>;
+
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = std::unique_ptr<TrieNode, cdi::memory::AllocatorDelete<Alloc>>;
+  using Label = std::basic_string<char, std::char_traits<char>,
+                                  typename Alloc::template Stl<char>>;
+
+  /// A value the node had, for the snapshots taken before it was changed.
+  struct Version;
+  using VersionOwner =
+      std::unique_ptr<Version, cdi::memory::AllocatorDelete<Alloc>>;
+  struct Version {
+    Version(std::uint64_t changedAt,
+            cdi::constructor::Maybe<T> value,
+            VersionOwner older)
+        : changedAt(changedAt), value(std::move(value)),
+          older(std::move(older)) {}
+
+    std::uint64_t changedAt;
+    cdi::constructor::Maybe<T> value; // until changedAt.
+    VersionOwner older;
+  };
 
 public:
-  explicit TrieNode(char key) : key_(key) {}
-  TrieNode(TrieNode &&movedTNode) noexcept
-      : key_(movedTNode.key_), children_(std::move(movedTNode.children_)) {}
-  virtual ~TrieNode() = default;
-  virtual void Print(std::ostream &out, int depth = 0) const = 0;
+  TrieNode(char key, const Alloc &alloc)
+      : key_(key), prefix_(alloc.template ToStl<char>()) {}
+
+  void Print(std::ostream &out, int depth = 0) const;
 
-protected:
-  [[nodiscard("you must check the return value of me.")]] virtual auto
-  HasValue() const -> bool = 0;
+private:
+  [[nodiscard("you must check the return value of me.")]] inline auto
+  HasValue() const -> bool {
+    return value_.has_value();
+  }
+
+  /// The value a snapshot taken at asOf sees, nullptr if none: the one
+  /// replaced by the first change after asOf, or the current one.
+  [[nodiscard]] auto ValueAt(std::uint64_t asOf) const -> const T * {
+    const auto *visible = &value_;
+    for (const auto *version = history_.get();
+         version != nullptr && version->changedAt > asOf;
+         version = version->older.get()) {
+      visible = &version->value;
+    }
+    return visible->has_value() ? &**visible : nullptr;
+  }
 
   [[nodiscard]] inline auto HasChild(char key) const -> bool {
-    return children_.find(key) != children_.end();
+    return children_.Find(key) != nullptr;
   }
 
   [[nodiscard]] inline auto HasAnyChild() const -> bool {
-    return !children_.empty();
+    return !children_.Empty();
   }
 
   [[nodiscard]] auto GetChild(char key) const
       -> cdi::constructor::Maybe<std::reference_wrapper<TrieNode>> {
-    auto iter = children_.find(key);
-    if (iter == children_.end()) {
+    const auto *slot = children_.Find(key);
+    if (slot == nullptr) {
       return cdi::constructor::none;
     }
-    return *iter->second;
+    return **slot;
   }
 
   [[nodiscard]] auto GetChildGuardRead(char key) const
-      -> cdi::constructor::Maybe<TrieNodeGuard>;
+      -> cdi::constructor::Maybe<Guard>;
 
-  [[nodiscard]] auto GetChildGuardWrite(char key)
-      -> cdi::constructor::Maybe<TrieNodeGuard>;
+  /// The child latched exclusively. Only this node's children are read, so a
+  /// shared latch on this node is enough.
+  [[nodiscard]] auto GetChildGuardWrite(char key) const
+      -> cdi::constructor::Maybe<Guard>;
 
   [[nodiscard]] inline auto GetKey() const -> char { return key_; }
 
-  auto InsertKey(char key, std::unique_ptr<TrieNode> &&child)
+  /// Odd while a writer holds the node, and for good once it is unlinked.
+  [[nodiscard]] auto ReadVersion() const -> std::uint64_t {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  /// whether nothing changed since `version` was read.
+  [[nodiscard]] auto Validate(std::uint64_t version) const -> bool {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
+  [[nodiscard]] static auto IsLocked(std::uint64_t version) -> bool {
+    return (version & 1) != 0;
+  }
+
+  /// length of the common part of prefix_ and key[pos, ...).
+  [[nodiscard]] auto MatchPrefix(std::string_view key, std::size_t pos) const
+      -> std::size_t {
+    std::size_t matched = 0;
+    while (matched < prefix_.size() && pos + matched < key.size() &&
+           prefix_[matched] == key[pos + matched]) {
+      ++matched;
+    }
+    return matched;
+  }
+
+  auto InsertKey(char key, Owner &&child, const Alloc &alloc)
       -> cdi::constructor::Maybe<std::reference_wrapper<TrieNode>> {
-    auto iter = children_.find(key);
-    if (iter != children_.end()) {
+    auto *slot = children_.Insert(key, std::move(child), alloc);
+    if (slot == nullptr) {
       return cdi::constructor::none;
     }
-    children_.emplace(key, std::move(child));
-    return this->GetChild(key);
+    return **slot;
   }
 
-  [[nodiscard]] auto RemoveKey(char key) -> bool {
-    auto iter = children_.find(key);
-    if (iter == children_.end()) {
-      return false;
-    }
-    children_.erase(iter);
-    return true;
+  /// \param[out] erased if not nullptr, receives the child, see Trie::Retire.
+  [[nodiscard]] auto RemoveKey(char key,
+                               const Alloc &alloc,
+                               Owner *erased = nullptr) -> bool {
+    return children_.Erase(key, alloc, erased);
   }
 
   char key_;
-  unordered_map<char, std::unique_ptr<TrieNode>> children_;
-
-private:
+  std::conditional_t<detail::IsScored<T>::value,
+                     detail::ScoreBound,
+                     detail::NoScoreBound>
+      bound_; // best score in the subtree, Scored values only.
+  Label prefix_; // rest of the edge label after key_
+  cdi::constructor::Maybe<T> value_;
+  VersionOwner history_; // newest first, only while snapshots need it.
+  AdaptiveChildren<Owner, Alloc> children_;
   std::shared_mutex rwlatch_;
+  std::atomic<std::uint64_t> version_{0};
 };
 
 //===------------------------------------------------------------------------===
-// TODO: finer grained lock
+// Lock coupling (a.k.a. hand-over-hand latching)
+//
+// Every node carries its own latch. A thread never holds more than the latches
+// of a node and its parent while walking down, and latches are always taken
+// top-down, so there is no lock order inversion.
+//
+// Invariant: a node is only unlinked, or has its edge label changed, while both
+// its parent and the node itself are latched exclusively. So holding *any*
+// latch on a node pins it in memory, together with its label. A value is only
+// changed under the exclusive latch of its own node.
+//
+// Lookup path:
+//   shared lock the path to the node, hand over hand.
 // Insert path:
 //   shared lock the path to the node.
-//   exclusive lock the insertion node.
-//   insert the node.
-//   release all locks.
+//   exclusive lock the node whose children change (the parent latch pins it
+//   while we re-latch), or only the node that gets the value.
+//   exclusive lock the child that is split below it.
+// Update path (Update, CompareAndSwap):
+//   shared lock the path to the parent, exclusive lock the node. In
+//   kOptimistic mode only the node, after an optimistic descent.
 // Delete path:
-//   shared lock the path to the node.
-//   exclusive lock the deletion node.
-//   delete the node.
-//   release all locks.
-// Lookup path:
-//   shared lock the path to the node.
+//   shared lock the path to find the node.
+//   exclusive lock its grandparent and crab down exclusively, holding the
+//   last three latches. A removal changes at most the node, its parent, its
+//   grandparent's child slot, and the one child that gets merged upward.
+//
+// Optimistic lock coupling (Leis et al., "The ART of practical
+// synchronization", DaMoN 2016)
+//
+// Shared latches make every reader write the latch word of every node on its
+// path, so readers of a hot prefix bounce its cache line between cores. A node
+// also carries a version word, bumped to odd when an exclusive latch is taken
+// and back to even when it is released. In kOptimistic mode a lookup reads the
+// versions on its way down instead of latching, and checks after every read
+// of a node that its version did not move; if it did, the lookup starts over.
+// Only the node holding the value is latched, shared, and only once its
+// version is confirmed. So writers keep latching exactly as above.
+//
+// An unlinked node keeps an odd version for good (MarkObsolete), and is not
+// freed before every optimistic reader that may still look at it left its
+// EpochGuard (see concurrency/epoch.hh). Nor is an edge label rewritten in
+// place where it could move: a merge builds a new node.
 //===------------------------------------------------------------------------===
 
-/// This class is for higher concurrency, using finer grained lock.
-class TrieNodeGuard {
+/// RAII latch on a single TrieNode. Guards are movable so that they can be
+/// handed over while crabbing down the trie.
+template <typename T, typename Alloc> class TrieNodeGuard {
+  using Node = TrieNode<T, Alloc>;
+
 public:
-  TrieNodeGuard(TrieNode &node, bool readOnly = true)
-      : node_(node), readOnly_(readOnly) {
-    readOnly_ ? succeedGuard = node_.rwlatch_.try_lock_shared()
-              : succeedGuard = node_.rwlatch_.try_lock();
+  TrieNodeGuard() = default;
+
+  TrieNodeGuard(Node &node, bool readOnly = true)
+      : node_(&node), readOnly_(readOnly) {
+    if (readOnly_) {
+      node_->rwlatch_.lock_shared();
+    } else {
+      node_->rwlatch_.lock();
+      node_->version_.store(
+          node_->version_.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+      // optimistic readers must see the odd version before any change.
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    succeedGuard = true;
+  }
+
+  TrieNodeGuard(const TrieNodeGuard &) = delete;
+  auto operator=(const TrieNodeGuard &) -> TrieNodeGuard & = delete;
+
+  TrieNodeGuard(TrieNodeGuard &&other) noexcept
+      : node_(other.node_), readOnly_(other.readOnly_),
+        obsolete_(other.obsolete_), succeedGuard(other.succeedGuard) {
+    other.succeedGuard = false;
   }
 
-  ~TrieNodeGuard() {
-    if (succeedGuard) {
-      readOnly_ ? node_.rwlatch_.unlock_shared() : node_.rwlatch_.unlock();
+  auto operator=(TrieNodeGuard &&other) noexcept -> TrieNodeGuard & {
+    if (this != &other) {
+      Release();
+      node_ = other.node_;
+      readOnly_ = other.readOnly_;
+      obsolete_ = other.obsolete_;
+      succeedGuard = other.succeedGuard;
+      other.succeedGuard = false;
     }
+    return *this;
   }
 
+  ~TrieNodeGuard() { Release(); }
+
+  void Release() {
+    if (!succeedGuard) {
+      return;
+    }
+    if (readOnly_) {
+      node_->rwlatch_.unlock_shared();
+    } else {
+      if (!obsolete_) {
+        node_->version_.store(
+            node_->version_.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+      }
+      node_->rwlatch_.unlock();
+    }
+    succeedGuard = false;
+  }
+
+  /// The node is being unlinked: leave its version odd on release, so
+  /// optimistic readers still on it restart. Exclusive guards only.
+  void MarkObsolete() { obsolete_ = true; }
+
   [[nodiscard]] auto Succeed() const -> bool { return succeedGuard; }
 
   [[nodiscard]] auto GetNode() const
-      -> cdi::constructor::Maybe<std::reference_wrapper<TrieNode>> {
+      -> cdi::constructor::Maybe<std::reference_wrapper<Node>> {
     if (!succeedGuard) {
       return cdi::constructor::none;
     }
-    return node_;
+    return *node_;
   }
 
+  auto operator->() const -> Node * { return node_; }
+  auto operator*() const -> Node & { return *node_; }
+
 private:
-  TrieNode &node_;
+  Node *node_ = nullptr;
   bool readOnly_ = true;
+  bool obsolete_ = false;
   bool succeedGuard = false; // someones may not release the lock.
 };
 
-auto TrieNode::GetChildGuardRead(char key) const
-    -> cdi::constructor::Maybe<TrieNodeGuard> {
-  auto iter = children_.find(key);
-  if (iter == children_.end()) {
+template <typename T, typename Alloc>
+inline auto TrieNode<T, Alloc>::GetChildGuardRead(char key) const
+    -> cdi::constructor::Maybe<Guard> {
+  const auto *slot = children_.Find(key);
+  if (slot == nullptr) {
     return cdi::constructor::none;
   }
-  return TrieNodeGuard(*iter->second);
+  return Guard(**slot);
 }
 
-auto TrieNode::GetChildGuardWrite(char key)
-    -> cdi::constructor::Maybe<TrieNodeGuard> {
-  auto iter = children_.find(key);
-  if (iter == children_.end()) {
+template <typename T, typename Alloc>
+inline auto TrieNode<T, Alloc>::GetChildGuardWrite(char key) const
+    -> cdi::constructor::Maybe<Guard> {
+  const auto *slot = children_.Find(key);
+  if (slot == nullptr) {
     return cdi::constructor::none;
   }
-  return TrieNodeGuard(*iter->second, false);
+  return Guard(**slot, false);
 }
 
-//===------------------------------------------------------------------------===
-// Concrete TrieNode implementations
-//===------------------------------------------------------------------------===
-
-template <typename T> class ValueTrieNode : public TrieNode {
-  friend class Trie;
+template <typename T, typename Alloc>
+void TrieNode<T, Alloc>::Print(std::ostream &out, int depth) const {
+  out << std::string(depth, ' ') << key_ << prefix_;
+  if (value_) {
+    out << " : " << *value_;
+  }
+  out << '\n';
+  children_.ForEach([&out, depth](char, const auto &child) {
+    Guard childGuard(*child);
+    child->Print(out, depth + 1);
+  });
+}
 
+/// A value handed out by reference. The node stays latched in shared mode as
+/// long as the handle lives, so writers to that key wait: do not modify the
+/// trie from the thread holding it.
+template <typename T, typename Alloc = cdi::memory::HeapAllocator>
+class TrieValueRef {
 public:
-  explicit ValueTrieNode(char key, T value)
-      : TrieNode(key), value_(std::move(value)) {}
+  explicit TrieValueRef(TrieNodeGuard<T, Alloc> &&guard)
+      : guard_(std::move(guard)) {}
 
-  explicit ValueTrieNode(TrieNode &&movedTNode, T value)
-      : TrieNode(std::move(movedTNode)), value_(std::move(value)) {}
+  auto operator*() const -> const T & { return *guard_->value_; }
+  auto operator->() const -> const T * { return &*guard_->value_; }
 
 private:
-  [[nodiscard("you must check the return value of me.")]] inline auto
-  HasValue() const -> bool override {
-    return true;
-  }
-
-  [[nodiscard("you want my value, right? take it.")]] inline auto
-  GetValue() const -> T {
-    return value_;
-  }
-
-  void Print(std::ostream &out, int depth = 0) const override {
-    out << std::string(depth, ' ') << key_ << " : " << value_ << std::endl;
-    for (const auto &child : children_) {
-      child.second->Print(out, depth + 1);
-    }
-  }
-
-  T value_;
+  TrieNodeGuard<T, Alloc> guard_;
 };
 
-class NavigatorTrieNode : public TrieNode {
-  friend class Trie;
+//===------------------------------------------------------------------------===
+// Trie implementations
+//
+// The trie is path compressed (Patricia / radix tree): a node stores the whole
+// edge label leading to it, key_ plus prefix_, so a chain of one-child nodes
+// collapses into one. Labels are checked pessimistically on the way down, as
+// in ART. Every node but the root has a value or at least two children; Insert
+// splits an edge when a key diverges inside it, Remove merges a node that is
+// left with a single child into that child. Except while snapshots are open,
+// see below.
+//
+// Nodes come from Alloc, see memory/slab_arena.hh. With ArenaAllocator the
+// trie owns a SlabArena: removed nodes are recycled through its free lists, and
+// destroying or clearing the trie frees the slabs without visiting the nodes.
+//
+// With Scored values (ScoredTrie) every node also keeps the best score in its
+// subtree, an upper bound rather: Insert raises it along the path, Remove
+// recomputes it for the nodes it latched exclusively, and leaves the bounds
+// above those too high until a later removal passes by.
+//
+// Snapshots (multiversion concurrency control, only while one is open)
+//
+// A snapshot is a time on a clock that ticks for every change made while
+// snapshots are open. Such a change stamps itself, and pushes the value it
+// replaces onto the node's history, newest first; a snapshot reads the value
+// replaced by the first change after its time, or the current one. Changes
+// are made under the node's exclusive latch, so one made before a snapshot
+// was taken either ended before, or holds the latch a reader of the node
+// waits for: the reader sees it either way.
+//
+// Edges are never merged away under a version a snapshot may read: a removal
+// leaves the node and its history in place, so the path of every key a
+// snapshot sees stays there. Splits and merges of nodes without history keep
+// the keys and values where they are. History no open snapshot can read is
+// pruned by the next change to the node, and the nodes that got any are
+// listed by key; when the last snapshot is dropped they are pruned and
+// compacted as a Remove would have done.
+//===------------------------------------------------------------------------===
+template <typename T, typename Alloc> class Trie {
+  friend class TrieSnapshot<T, Alloc>;
+  friend class detail::TrieScan<T, Alloc>;
+  friend class detail::TrieBulkLoad<T, Alloc>;
+  friend class detail::TrieFuzzy<T, Alloc>;
+  friend class detail::TrieLookupBatch<T, Alloc>;
+  friend class detail::TrieTopK<T, Alloc>;
+
+  using Node = TrieNode<T, Alloc>;
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = typename Node::Owner;
 
 public:
-  explicit NavigatorTrieNode(char key) : TrieNode(key) {}
+  using value_type = T;
 
-  explicit NavigatorTrieNode(TrieNode &&movedTNode)
-      : TrieNode(std::move(movedTNode)) {}
+  explicit Trie(TrieReadMode mode = TrieReadMode::kPessimistic)
+      : alloc_(resource_, &retired_), root_(NewNode('\0')), mode_(mode) {}
+  ~Trie() { DestroyAll(); }
 
-private:
-  void Print(std::ostream &out, int depth = 0) const override {
-    out << std::string(depth, ' ') << key_ << std::endl;
-    for (const auto &child : children_) {
-      child.second->Print(out, depth + 1);
-    }
+  Trie(const Trie &) = delete;
+  auto operator=(const Trie &) -> Trie & = delete;
+
+  /// Drop every key. Like the destructor, it must not race with any other
+  /// operation.
+  void Clear() {
+    DestroyAll();
+    root_ = NewNode('\0');
   }
 
-  [[nodiscard("you must check the return value of me.")]] auto HasValue() const
-      -> bool override {
-    return false;
+  /// \return false if the key already has a value, which is kept.
+  auto Insert(std::string_view key, T value) -> bool {
+    return Emplace(key, std::move(value), KeepValue{});
   }
-};
 
-//===------------------------------------------------------------------------===
-// Trie implementations
-//===------------------------------------------------------------------------===
-class Trie {
-public:
-  Trie() : root_(std::make_unique<NavigatorTrieNode>('\0')) {}
-  ~Trie() = default;
+  /// Insert, or replace the value the key has, in one walk down.
+  /// \return true if the key had no value.
+  auto Upsert(std::string_view key, T value) -> bool {
+    return Emplace(key, std::move(value), [](T &current, T &&value) {
+      current = std::move(value);
+    });
+  }
 
-  template <typename T> auto Insert(const std::string &key, T &value) -> bool {
-    if (key.empty()) {
+  /// Insert, or `merge(T &current, T &&value)` into the value the key has,
+  /// in place and in one walk down, e.g. to add to a counter. merge runs
+  /// under the exclusive latch of the key's node: keep it short, and do not
+  /// touch the trie from it.
+  /// \return true if the key had no value.
+  template <typename Merge>
+  auto Upsert(std::string_view key, T value, Merge &&merge) -> bool {
+    return Emplace(key, std::move(value), merge);
+  }
+
+  /// Call `fn(T &value)` on the value of key in place, under the exclusive
+  /// latch of its node only; in kOptimistic mode the path is not latched at
+  /// all. As with merge above, fn must not touch the trie.
+  /// \return false if key has no value.
+  template <typename Fn> auto Update(std::string_view key, Fn &&fn) -> bool {
+    auto guard = LocateForWrite(key);
+    if (!guard || !(*guard)->HasValue()) {
       return false;
     }
+    Record(**guard, key);
+    fn(*(*guard)->value_);
+    auto raised = RaiseScore(**guard);
+    guard->Release();
+    RaisePath(key, raised);
+    return true;
+  }
 
-    std::scoped_lock<std::shared_mutex> lockInsert(rwlatch_);
-    auto *currentNode = &root_;
-    auto *nextNode = currentNode;
-    for (char keychar : key) {
-      // LESSON: use find() instead of operator[] to avoid segfault.
-      if (auto queryResult = currentNode->get()->children_.find(keychar);
-          queryResult != currentNode->get()->children_.end()) {
-        nextNode = &queryResult->second;
-      } else {
-        currentNode->get()->InsertKey(
-            keychar, std::make_unique<NavigatorTrieNode>(keychar));
-        nextNode = &currentNode->get()->children_[keychar];
-      }
-      currentNode = nextNode;
+  /// Replace the value of key by desired if it equals expected, atomically
+  /// with respect to every other operation on the key, as Update.
+  /// \return whether it was replaced.
+  auto CompareAndSwap(std::string_view key, const T &expected, T desired)
+      -> bool {
+    auto guard = LocateForWrite(key);
+    if (!guard || !(*guard)->HasValue() ||
+        !(*(*guard)->value_ == expected)) {
+      return false;
     }
+    Record(**guard, key);
+    *(*guard)->value_ = std::move(desired);
+    auto raised = RaiseScore(**guard);
+    guard->Release();
+    RaisePath(key, raised);
+    return true;
+  }
 
-    // already has value, return false.
-    if (currentNode->get()->HasValue()) {
+  // True if key is on the path of some key, and has no value afterwards.
+  // False if key not found.
+  auto Remove(std::string_view key) -> bool {
+    if (key.empty()) {
       return false;
     }
+    MaybeCollect();
 
-    // currentNode is some NavigatorTrieNode
-    *currentNode = std::make_unique<ValueTrieNode<T>>(std::move(**currentNode),
-                                                      std::move(value));
-
-    return true;
+    auto plan = PlanRemove(key);
+    if (!plan.onPath) {
+      return false;
+    }
+    if (!plan.hasValue) {
+      return true;
+    }
+    return RemoveLatched(key, plan.steps, false);
   }
 
-  // True if key doesn't have a value
-  // False if key not found.
-  auto Remove(const std::string &key) -> bool {
-    std::scoped_lock<std::shared_mutex> lockRemove(rwlatch_);
-    return Remove(key, root_, root_);
+  /// A point-in-time view for lookups and scans, while writers go on. Taking
+  /// one copies nothing: from then on a change keeps the value it replaces
+  /// for as long as an open snapshot may read it, and a removal leaves the
+  /// node in place. Both are cleaned up when the last snapshot is dropped.
+  /// A snapshot must not outlive the trie, nor be open across Clear().
+  auto Snapshot() -> TrieSnapshot<T, Alloc> {
+    return TrieSnapshot<T, Alloc>(*this, snapshots_.Open());
   }
 
   /// Lookup a key in the trie.
@@ -286,108 +703,1256 @@ public:
   /// \param[out] value The value to store the result, if value is nullptr, then
   /// this method is used to check whether the key exists.
   /// \return true if the key exists, false otherwise.
-  template <typename T>
   [[nodiscard("you must check whether the lookup succeed.")]] auto
-  Lookup(const std::string &key, T *value = nullptr) -> bool {
-    if (key.empty()) {
-      return false;
+  Lookup(std::string_view key, T *value = nullptr) const -> bool {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      if (mode_ == TrieReadMode::kOptimistic) {
+        auto found = Optimistic(key);
+        if (found && value != nullptr) {
+          *value = *found;
+        }
+        return found.has_value();
+      }
     }
+    if (value == nullptr) {
+      return Visit(key, [](const T &) {});
+    }
+    return Visit(key, [value](const T &found) { *value = found; });
+  }
 
-    auto queryResult = LookupMaybe<T>(key);
-    if (!queryResult) {
-      return false;
+  /// cdi-style api.
+  auto LookupMaybe(std::string_view key) const
+      -> cdi::constructor::Maybe<T> {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      if (mode_ == TrieReadMode::kOptimistic) {
+        return Optimistic(key);
+      }
     }
+    cdi::constructor::Maybe<T> result;
+    (void)Visit(key, [&result](const T &found) { result = found; });
+    return result;
+  }
 
-    if (value) {
-      *value = queryResult.value();
+  /// Call `visitor` with a reference to the value while its node is latched,
+  /// no copy is made. The reference must not escape the visitor.
+  /// \return true if the key has a value.
+  template <typename Visitor>
+  auto Visit(std::string_view key, Visitor &&visitor) const -> bool {
+    auto queryResult = Locate(key);
+    if (!queryResult || !(*queryResult)->HasValue()) {
+      return false;
     }
+    std::forward<Visitor>(visitor)(*(*queryResult)->value_);
     return true;
   }
 
-  /// cdi-style api.
-  template <typename T>
-  auto LookupMaybe(const std::string &key) -> cdi::constructor::Maybe<T> {
-    std::shared_lock<std::shared_mutex> readerlock(rwlatch_);
+  /// Like Visit, but the latch travels with the returned handle.
+  auto LookupRef(std::string_view key) const
+      -> cdi::constructor::Maybe<TrieValueRef<T, Alloc>> {
+    auto queryResult = Locate(key);
+    if (!queryResult || !(*queryResult)->HasValue()) {
+      return cdi::constructor::none;
+    }
+    return TrieValueRef<T, Alloc>(std::move(*queryResult));
+  }
 
-    // lockup the node
-    auto queryResult = TraverseDown(key);
-    if (!queryResult) {
-      return constructor::none;
+  /// Call `visitor(std::string_view prefix, const T &value)` for the longest
+  /// prefix of key that has a value, in one walk down. prefix is a view of
+  /// key. The node stays latched in shared mode for the call, as with Visit.
+  /// \return false if no prefix of key has a value.
+  template <typename Visitor>
+  auto VisitLongestPrefix(std::string_view key, Visitor &&visitor) const
+      -> bool {
+    std::size_t length = 0;
+    auto best = LocateLongestPrefix(key, length);
+    if (!best) {
+      return false;
     }
+    std::forward<Visitor>(visitor)(key.substr(0, length), *(*best)->value_);
+    return true;
+  }
+
+  /// Longest prefix of key that has a value, with a copy of the value.
+  auto LongestPrefix(std::string_view key) const
+      -> cdi::constructor::Maybe<std::pair<std::string_view, T>> {
+    cdi::constructor::Maybe<std::pair<std::string_view, T>> result;
+    (void)VisitLongestPrefix(
+        key, [&result](std::string_view prefix, const T &value) {
+          result.emplace(prefix, value);
+        });
+    return result;
+  }
 
-    // see if the node has value
-    auto *node = &queryResult->get();
-    if (node->HasValue()) {
-      return static_cast<ValueTrieNode<T> *>(node)->value_;
+  /// Call `visitor(std::string_view prefix, const T &value)` for every prefix
+  /// of key that has a value, shortest first, in one walk down; key itself
+  /// included. visitor returns void, or bool where false stops the walk. The
+  /// node of each prefix is latched in shared mode for its call.
+  /// \return the number of prefixes visited.
+  template <typename Visitor>
+  auto VisitPrefixes(std::string_view key, Visitor &&visitor) const
+      -> std::size_t {
+    std::size_t visited = 0;
+    Guard current(*root_);
+    std::size_t depth = 0;
+    while (depth < key.size()) {
+      auto child = current->GetChildGuardRead(key[depth]);
+      if (!child) {
+        break;
+      }
+      auto matched = (*child)->MatchPrefix(key, depth + 1);
+      if (matched < (*child)->prefix_.size()) {
+        break;
+      }
+      depth += 1 + matched;
+      current = std::move(*child);
+      if (current->HasValue()) {
+        ++visited;
+        if (!detail::CallVisitor(
+                visitor, key.substr(0, depth), *current->value_)) {
+          break;
+        }
+      }
     }
+    return visited;
+  }
+
+  /// Look up many keys at once: out[i] receives the value of keys[i], none if
+  /// it has none. Whatever the read mode, the lookups are optimistic, inside
+  /// a single EpochGuard, and advance in lockstep: a step of one descent
+  /// prefetches what its next step reads, then the batch moves on to the
+  /// next descent, so the cache misses of up to 16 keys overlap instead of
+  /// adding up (AMAC, Kocberber et al., VLDB 2015). A value that is not
+  /// trivially copyable is copied under the shared latch of its node.
+  /// \param first, last keys, anything a std::string_view converts from.
+  /// \param out random access, with room for every key.
+  /// \return the number of keys found.
+  template <typename KeyIter, typename OutIter>
+  auto LookupBatch(KeyIter first, KeyIter last, OutIter out) const
+      -> std::size_t {
+    return detail::TrieLookupBatch<T, Alloc>::Run(*this, first, last, out);
+  }
+
+  /// Insert a batch of keys, sorted or not, building new subtrees bottom-up
+  /// instead of inserting key by key. Subtrees of the root are built in
+  /// parallel, and so are the children of any large enough node below, so a
+  /// batch sharing a long prefix spreads over the cores as well. They are
+  /// stitched under the root while it is latched. Keys whose leading byte
+  /// already has a subtree are inserted one by one.
+  /// As with Insert, an existing value is kept, and the first of duplicate
+  /// keys in the batch wins.
+  /// \param threads at most this many threads build, 0 for one per core.
+  /// \return the number of keys added.
+  auto BulkLoad(std::vector<std::pair<std::string, T>> entries,
+                std::size_t threads = 0) -> std::size_t {
+    return detail::TrieBulkLoad<T, Alloc>::Load(
+        *this, std::move(entries), threads);
+  }
+
+  /// Stream every key starting with `prefix`, with its value, in
+  /// lexicographic (unsigned byte) order.
+  /// `visitor(std::string_view key, const T &value)` returns void, or bool
+  /// where false stops the scan. The key is a view of one buffer reused for
+  /// the whole scan, copy it to keep it. The path to the current key stays
+  /// latched in shared mode, so the visitor must not modify the trie.
+  /// \return the number of keys visited, at most `limit`.
+  template <typename Visitor>
+  auto ScanPrefix(std::string_view prefix,
+                  Visitor &&visitor,
+                  std::size_t limit = kNoLimit) const -> std::size_t {
+    return detail::TrieScan<T, Alloc>::Prefix(
+        *this, prefix, visitor, limit, detail::SnapshotRegistry::kLatest);
+  }
+
+  /// Like ScanPrefix, for the keys in [lo, hi).
+  template <typename Visitor>
+  auto ScanRange(std::string_view lo,
+                 std::string_view hi,
+                 Visitor &&visitor,
+                 std::size_t limit = kNoLimit) const -> std::size_t {
+    return detail::TrieScan<T, Alloc>::Range(
+        *this, lo, hi, visitor, limit, detail::SnapshotRegistry::kLatest);
+  }
+
+  /// The k best scored keys starting with `prefix`, best first, ties in key
+  /// order; for Scored values, see ScoredTrie. Every node knows an upper
+  /// bound of the scores below it, so the search goes best-first and stops
+  /// after k keys: it expands O(k * depth) nodes, however large the subtree.
+  /// Only the node being expanded is latched, in shared mode; an EpochGuard
+  /// keeps the queued ones alive. If one of them is unlinked meanwhile the
+  /// search starts over, and a search starved by writers scans the subtree.
+  /// `visitor(std::string_view key, const T &value)` returns void, or bool
+  /// where false stops. It is called on copies once the search is done, no
+  /// latch held.
+  /// \return the number of keys visited, at most k.
+  template <typename Visitor>
+  auto TopK(std::string_view prefix, std::size_t k, Visitor &&visitor) const
+      -> std::size_t {
+    static_assert(kScored, "TopK needs Scored values, see ScoredTrie");
+    return detail::TrieTopK<T, Alloc>::Run(*this, prefix, k, visitor);
+  }
 
-    return constructor::none;
+  /// Call `visitor(std::string_view key, std::size_t distance, const T
+  /// &value)` for every key within maxDistance edits of query (Levenshtein:
+  /// insert, delete or replace a byte), in key order. The walk carries one
+  /// row of the edit distance table per byte of the path, and leaves a
+  /// subtree as soon as no entry of the row is within the distance, so it
+  /// visits the neighbourhood of query rather than the trie. visitor returns
+  /// void, or bool where false stops; latches as in ScanPrefix.
+  /// \return the number of keys visited.
+  template <typename Visitor>
+  auto VisitFuzzy(std::string_view query,
+                  std::size_t maxDistance,
+                  Visitor &&visitor) const -> std::size_t {
+    return detail::TrieFuzzy<T, Alloc>::Visit(
+        *this, query, maxDistance, visitor);
+  }
+
+  /// The keys within maxDistance edits of query, closest first, ties in key
+  /// order, at most `best` of them. With a limit the distance tightens as
+  /// closer keys turn up, and the walk prunes accordingly.
+  auto Fuzzy(std::string_view query,
+             std::size_t maxDistance,
+             std::size_t best = kNoLimit) const
+      -> std::vector<TrieFuzzyMatch<T>> {
+    return detail::TrieFuzzy<T, Alloc>::Best(*this, query, maxDistance, best);
   }
 
   /// what can you expect from a function named `Print`...
   void Print(std::ostream &out) const {
-    std::shared_lock<std::shared_mutex> readerlock(rwlatch_);
+    Guard rootGuard(*root_);
     root_->Print(out);
   }
 
+  [[nodiscard]] auto GetReadMode() const -> TrieReadMode { return mode_; }
+
+  constexpr static std::size_t kNoLimit =
+      std::numeric_limits<std::size_t>::max();
+
 private:
-  // recursive remove
-  auto Remove(const std::string &key,
-              std::unique_ptr<TrieNode> &tnp,
-              std::unique_ptr<TrieNode> &tnc) -> bool {
-    // key empty, found & delete tn
+  /// an optimistic lookup starved by writers this often takes the latches.
+  constexpr static int kOptimisticRestarts = 16;
+  /// retired nodes are freed in batches, by the writer that fills one.
+  constexpr static std::size_t kCollectBatch = 64;
+  /// whether nodes keep a score bound, see TopK.
+  constexpr static bool kScored = detail::IsScored<T>::value;
+
+  /// a node of this key has versions, see Reclaim.
+  struct DirtyKey {
+    std::string key;
+    DirtyKey *next;
+  };
+
+  /// Call visitor on key's value as of asOf, with lock coupling.
+  template <typename Visitor>
+  auto VisitAt(std::string_view key, std::uint64_t asOf, Visitor &visitor)
+      const -> bool {
+    auto found = TraverseDown(key);
+    const T *value = found ? (*found)->ValueAt(asOf) : nullptr;
+    if (value == nullptr) {
+      return false;
+    }
+    visitor(*value);
+    return true;
+  }
+
+  /// What a removal looks like from a shared latched walk. Exclusive latches
+  /// are only taken when there is a value to remove.
+  struct RemovePlan {
+    bool onPath = false;   // key is a prefix of some key in the trie.
+    bool hasValue = false; // key itself has a value.
+    std::size_t steps = 0; // edges from the root down to key's node.
+  };
+
+  /// Account for `value` in the score bound of a node it is inserted under.
+  /// Called while the node's parent is latched, see Insert.
+  static void RaiseBound(Node &node, const T &value) {
+    if constexpr (kScored) {
+      node.bound_.Raise(value.score);
+    }
+  }
+
+  /// Recompute the score bound of a node the caller latches exclusively, or
+  /// has not published yet, from its value and its children.
+  static void ResetBound(Node &node) {
+    if constexpr (kScored) {
+      auto best = node.HasValue() ? node.value_->score
+                                  : -std::numeric_limits<double>::infinity();
+      node.children_.ForEach([&best](char, const Owner &child) {
+        best = std::max(best, child->bound_.Get());
+      });
+      node.bound_.Set(best);
+    }
+  }
+
+  /// Re-latch a shared guard exclusively. The caller must pin the node, i.e.
+  /// hold a latch on its parent, since it is unlatched for a moment.
+  static void Upgrade(Guard &guard) {
+    auto &node = *guard;
+    guard.Release();
+    guard = Guard(node, false);
+  }
+
+  /// Give key the value, or merge it into the one it has.
+  /// \return true if key had no value.
+  template <typename Merge>
+  auto Emplace(std::string_view key, T value, Merge &&merge) -> bool {
     if (key.empty()) {
-      if ((tnc->HasAnyChild())) {
-        tnc = std::make_unique<NavigatorTrieNode>(std::move(*tnc));
-      } else {
-        (void)tnp->RemoveKey(tnc->GetKey());
+      return false;
+    }
+    MaybeCollect();
+    cdi::constructor::Maybe<double> raised;
+    auto inserted = EmplaceLatched(key, std::move(value), merge, raised);
+    RaisePath(key, raised);
+    return inserted;
+  }
+
+  /// Emplace, up to a merge raising the score, which is left to the caller
+  /// since the path must be latched from the top again.
+  template <typename Merge>
+  auto EmplaceLatched(std::string_view key,
+                      T &&value,
+                      Merge &merge,
+                      cdi::constructor::Maybe<double> &raised) -> bool {
+    // crab down with shared latches as far as the path is fully matched.
+    // Score bounds are raised while the parent is latched, so a removal
+    // recomputing the parent's bound sees them.
+    Guard parent;
+    Guard current(*root_);
+    RaiseBound(*current, value);
+    std::size_t depth = 0;
+    while (true) {
+      auto child = current->GetChildGuardRead(key[depth]);
+      if (!child) {
+        break;
       }
-      return true;
+      RaiseBound(**child, value);
+      auto matched = (*child)->MatchPrefix(key, depth + 1);
+      auto next = depth + 1 + matched;
+      if (matched < (*child)->prefix_.size()) {
+        break;
+      }
+      if (next == key.size()) {
+        // the node exists, only its value changes. current pins it while we
+        // re-latch.
+        child->Release();
+        auto target = current->GetChildGuardWrite(key[depth]);
+        return Assign(**target, key, std::move(value), merge, raised);
+      }
+      parent = std::move(current);
+      current = std::move(*child);
+      depth = next;
     }
 
-    // find next tn
-    auto nextIter = tnc->children_.find(key[0]);
-    if (nextIter == tnc->children_.end()) {
-      return false;
+    // current is the node whose children change. parent pins it while we
+    // re-latch; the path below may have changed meanwhile, so keep walking
+    // with exclusive latches.
+    Upgrade(current);
+    parent.Release();
+
+    while (true) {
+      char keychar = key[depth];
+      auto *slot = current->children_.Find(keychar);
+      if (slot == nullptr) {
+        (void)current->InsertKey(
+            keychar, MakeLeaf(key, depth, std::move(value)), alloc_);
+        return true;
+      }
+
+      Guard child(**slot, false);
+      RaiseBound(*child, value);
+      auto matched = (*slot)->MatchPrefix(key, depth + 1);
+      auto next = depth + 1 + matched;
+      if (matched < (*slot)->prefix_.size()) {
+        Split(*slot, matched, key, depth, std::move(value));
+        return true;
+      }
+      if (next == key.size()) {
+        return Assign(*child, key, std::move(value), merge, raised);
+      }
+      current = std::move(child);
+      depth = next;
     }
-    auto &ntn = nextIter->second;
+  }
 
-    // remove next tn
-    if (!Remove(key.substr(1), tnc, ntn)) {
+  /// Set the value of key's node, which the caller latches exclusively, or
+  /// merge into the one it has.
+  /// \param[out] raised see RaiseScore.
+  /// \return true if it had no value.
+  template <typename Merge>
+  auto Assign(Node &node,
+              std::string_view key,
+              T &&value,
+              Merge &merge,
+              cdi::constructor::Maybe<double> &raised) -> bool {
+    if (!node.HasValue()) {
+      Record(node, key);
+      node.value_.emplace(std::move(value));
+      return true;
+    }
+    if constexpr (std::is_same_v<std::decay_t<Merge>, KeepValue>) {
       return false;
     }
+    Record(node, key);
+    merge(*node.value_, std::move(value));
+    raised = RaiseScore(node);
+    return false;
+  }
+
+  /// the merge of Insert, which leaves an existing value alone.
+  struct KeepValue {
+    void operator()(T & /*current*/, T && /*value*/) const {}
+  };
+
+  /// After a value changed in place under the exclusive latch of its node:
+  /// the score, if it went up past the node's bound. The bounds above, which
+  /// the change did not raise on its way down, are then up to RaisePath,
+  /// once every latch is released.
+  static auto RaiseScore(Node &node) -> cdi::constructor::Maybe<double> {
+    if constexpr (kScored) {
+      auto score = node.value_->score;
+      if (score > node.bound_.Get()) {
+        node.bound_.Raise(score);
+        return score;
+      }
+    }
+    return cdi::constructor::none;
+  }
 
-    // check if myself is orphan
-    // root node can not remove
-    if (!tnc->HasValue() && !tnc->HasAnyChild() && tnc != root_) {
-      (void)tnp->RemoveKey(tnc->GetKey());
+  /// Raise the bounds on key's path to score, each while the parent is
+  /// latched as in Insert. The caller holds no latch.
+  void RaisePath(std::string_view key,
+                 cdi::constructor::Maybe<double> score) const {
+    if constexpr (kScored) {
+      if (!score) {
+        return;
+      }
+      Guard current(*root_);
+      current->bound_.Raise(*score);
+      std::size_t depth = 0;
+      while (depth < key.size()) {
+        auto child = current->GetChildGuardRead(key[depth]);
+        if (!child) {
+          return;
+        }
+        (*child)->bound_.Raise(*score);
+        auto matched = (*child)->MatchPrefix(key, depth + 1);
+        if (matched < (*child)->prefix_.size()) {
+          return;
+        }
+        current = std::move(*child);
+        depth += 1 + matched;
+      }
     }
+  }
+
+  /// Before the value of key's node changes, under its exclusive latch, or
+  /// before the node is published: keep the value for the open snapshots,
+  /// and drop the versions none of them reads any more.
+  void Record(Node &node, std::string_view key) {
+    if (snapshots_.Recording()) {
+      auto changedAt = snapshots_.Stamp();
+      auto clean = !node.history_;
+      node.history_.reset(alloc_.template New<typename Node::Version>(
+          changedAt, node.value_, std::move(node.history_)));
+      if (clean) {
+        MarkDirty(key);
+      }
+    }
+    Prune(node);
+  }
+
+  /// Unlink the versions of a node latched exclusively that no open snapshot
+  /// reads. A snapshot reads the version of the first change after it, so a
+  /// version is needed only if a snapshot was taken between the change
+  /// before it and its own change.
+  void Prune(Node &node) const {
+    if (!node.history_) {
+      return;
+    }
+    auto [oldest, newest] = snapshots_.Window();
+    auto *link = &node.history_;
+    while (*link) {
+      auto &version = **link;
+      auto before = version.older ? version.older->changedAt : 0;
+      if (version.changedAt > oldest && before <= newest) {
+        link = &version.older;
+      } else {
+        *link = std::move(version.older); // frees version, not the rest.
+      }
+    }
+  }
+
+  /// Remember a key whose node got versions, for Reclaim.
+  void MarkDirty(std::string_view key) {
+    auto *dirty = new DirtyKey{std::string(key), dirty_.load()};
+    while (!dirty_.compare_exchange_weak(dirty->next, dirty)) {
+    }
+  }
+
+  /// Once the last snapshot is dropped: drop the versions of the dirty keys,
+  /// and the nodes removals left in place.
+  void Reclaim() {
+    MaybeCollect();
+    auto *dirty = dirty_.exchange(nullptr);
+    while (dirty != nullptr) {
+      auto plan = PlanRemove(dirty->key);
+      if (plan.onPath) {
+        (void)RemoveLatched(dirty->key, plan.steps, true);
+      }
+      delete std::exchange(dirty, dirty->next);
+    }
+  }
+
+  auto NewNode(char key) const -> Owner {
+    return Owner(alloc_.template New<Node>(key, alloc_));
+  }
+
+  /// leaf for key[depth, ...), one node however long the rest is.
+  auto MakeLeaf(std::string_view key, std::size_t depth, T &&value) -> Owner {
+    auto leaf = NewNode(key[depth]);
+    leaf->prefix_.assign(key, depth + 1, std::string::npos);
+    Record(*leaf, key);
+    leaf->value_.emplace(std::move(value));
+    ResetBound(*leaf);
+    return leaf;
+  }
+
+  /// key diverges from the edge label of `slot` after `matched` characters of
+  /// its prefix_. Put a new node at the divergence point above it. The caller
+  /// holds the parent of slot and slot itself exclusively.
+  void Split(Owner &slot,
+             std::size_t matched,
+             std::string_view key,
+             std::size_t depth,
+             T &&value) {
+    auto splitAt = depth + 1 + matched;
+    auto middle = NewNode(key[depth]);
+    middle->prefix_.assign(slot->prefix_, 0, matched);
+
+    auto tail = std::move(slot);
+    tail->key_ = tail->prefix_[matched];
+    tail->prefix_.erase(0, matched + 1);
+    (void)middle->InsertKey(tail->key_, std::move(tail), alloc_);
+    if (splitAt == key.size()) {
+      Record(*middle, key);
+      middle->value_.emplace(std::move(value));
+    } else {
+      (void)middle->InsertKey(
+          key[splitAt], MakeLeaf(key, splitAt, std::move(value)), alloc_);
+    }
+    ResetBound(*middle);
+    slot = std::move(middle);
+  }
+
+  /// Replace `slot` and its only child by one node carrying both edge labels,
+  /// the child's value and its children. The caller holds the parent of slot
+  /// and slot itself exclusively, the guard of slot is released here before
+  /// it dies.
+  void MergeWithChild(Owner &slot, Guard &slotGuard) const {
+    Owner *only = nullptr;
+    slot->children_.ForEach([&only](char, auto &child) { only = &child; });
+    Guard childGuard(**only, false);
+    auto &child = **only;
+
+    auto merged = NewNode(slot->key_);
+    merged->prefix_.reserve(slot->prefix_.size() + 1 + child.prefix_.size());
+    merged->prefix_.append(slot->prefix_);
+    merged->prefix_.push_back(child.key_);
+    merged->prefix_.append(child.prefix_);
+    if (child.HasValue()) {
+      merged->value_.emplace(std::move(*child.value_));
+      child.value_.reset();
+    }
+    // the merged node has the child's key, so it stays where MarkDirty put
+    // it.
+    merged->history_ = std::move(child.history_);
+    merged->children_ = std::move(child.children_);
+    if constexpr (kScored) {
+      merged->bound_.Set(child.bound_.Get());
+    }
+
+    auto old = std::exchange(slot, std::move(merged));
+    childGuard.MarkObsolete();
+    slotGuard.MarkObsolete();
+    childGuard.Release();
+    slotGuard.Release();
+    Retire(std::move(old)); // the child goes along, it is still owned by old.
+  }
+
+  /// Free an unlinked node once no optimistic reader can reach it.
+  void Retire(Owner &&node) const { alloc_.Retire(node.release()); }
+
+  void MaybeCollect() {
+    if (retired_.Pending() >= kCollectBatch) {
+      (void)retired_.Collect();
+    }
+  }
 
+  auto PlanRemove(std::string_view key) const -> RemovePlan {
+    RemovePlan plan;
+    Guard current(*root_);
+    std::size_t depth = 0;
+    while (depth < key.size()) {
+      auto child = current->GetChildGuardRead(key[depth]);
+      if (!child) {
+        return plan;
+      }
+      auto matched = (*child)->MatchPrefix(key, depth + 1);
+      depth += 1 + matched;
+      if (matched < (*child)->prefix_.size()) {
+        // ends inside an edge label, or leaves it.
+        plan.onPath = depth == key.size();
+        return plan;
+      }
+      current = std::move(*child);
+      ++plan.steps;
+    }
+    plan.onPath = true;
+    plan.hasValue = current->HasValue();
+    return plan;
+  }
+
+  /// Remove the value of key, `steps` edges down, see PlanRemove. With
+  /// `compact` there is no value to remove, only the node left behind by
+  /// removals while snapshots were open, see Reclaim.
+  auto RemoveLatched(std::string_view key, std::size_t steps, bool compact)
+      -> bool {
+    // latch the grandparent exclusively, that is as high as a merge reaches.
+    auto anchor = steps >= 2 ? steps - 2 : 0;
+    while (true) {
+      auto removed = RemoveAt(key, anchor, compact);
+      if (removed) {
+        return *removed;
+      }
+      // the path got shorter meanwhile, latch from higher up.
+      anchor = anchor > 0 ? anchor - 1 : 0;
+    }
+  }
+
+  /// Latch `anchor` edges down with shared latches, then the rest of the path
+  /// exclusively, and remove the value of key.
+  /// \return the result of Remove, none if the path changed so that the
+  /// anchor is no longer above the parent of key's node.
+  auto RemoveAt(std::string_view key, std::size_t anchor, bool compact)
+      -> cdi::constructor::Maybe<bool> {
+    Guard parent;
+    Guard current(*root_);
+    std::size_t depth = 0;
+    // follow one edge. on failure depth tells whether key ends inside the
+    // edge label (== key.size()) or leaves the trie.
+    auto descend = [&key, &depth](
+                       Guard &guard,
+                       bool readOnly) -> cdi::constructor::Maybe<Guard> {
+      auto child = readOnly ? guard->GetChildGuardRead(key[depth])
+                            : guard->GetChildGuardWrite(key[depth]);
+      if (child) {
+        auto matched = (*child)->MatchPrefix(key, depth + 1);
+        depth += 1 + matched;
+        if (matched < (*child)->prefix_.size()) {
+          if (depth != key.size()) {
+            depth = key.size() + 1;
+          }
+          return cdi::constructor::none;
+        }
+      }
+      return child;
+    };
+
+    for (std::size_t step = 0; step < anchor && depth < key.size(); ++step) {
+      auto child = descend(current, true);
+      if (!child) {
+        return depth == key.size();
+      }
+      parent = std::move(current);
+      current = std::move(*child);
+    }
+    if (depth == key.size()) {
+      return cdi::constructor::none;
+    }
+    Upgrade(current);
+    parent.Release();
+
+    // a removal changes key's node, its parent and its grandparent at most,
+    // so exclusive latches above those are handed over as we go.
+    Guard grandparent;
+    while (depth < key.size()) {
+      auto child = descend(current, false);
+      if (!child) {
+        return depth == key.size();
+      }
+      grandparent = std::move(parent);
+      parent = std::move(current);
+      current = std::move(*child);
+    }
+    if (anchor > 0 && !grandparent.Succeed()) {
+      // the path got shorter since it was planned, and a merge may reach
+      // the grandparent.
+      return cdi::constructor::none;
+    }
+
+    auto &tnc = *current;
+    if (compact) {
+      Prune(tnc);
+      if (tnc.history_) {
+        // a snapshot taken since still reads it, the next Reclaim will do.
+        MarkDirty(key);
+        return true;
+      }
+      if (tnc.HasValue()) {
+        return true;
+      }
+    } else {
+      if (!tnc.HasValue()) {
+        return true;
+      }
+      Record(tnc, key);
+      tnc.value_.reset();
+    }
+
+    // found, keep tn as a navigator if it still forks, or if a snapshot may
+    // still read its value. score bounds are recomputed for the latched
+    // nodes; those above stay as high as they were, which only costs TopK a
+    // detour.
+    auto &tnp = *parent;
+    if (tnc.children_.Size() > 1 || tnc.history_) {
+      ResetBound(tnc);
+    } else if (tnc.children_.Size() == 1) {
+      MergeWithChild(*tnp.children_.Find(tnc.GetKey()), current);
+    } else {
+      Owner dead;
+      (void)tnp.RemoveKey(tnc.GetKey(), alloc_, &dead);
+      current.MarkObsolete();
+      current.Release();
+      Retire(std::move(dead));
+
+      // the parent may be left with a single child. the root never merges,
+      // and a latched grandparent means the parent is not the root.
+      if (grandparent.Succeed() && !tnp.HasValue() && !tnp.history_ &&
+          tnp.children_.Size() == 1) {
+        MergeWithChild(*grandparent->children_.Find(tnp.GetKey()), parent);
+      }
+    }
+    if (parent.Succeed()) {
+      ResetBound(*parent);
+    }
+    if (grandparent.Succeed()) {
+      ResetBound(*grandparent);
+    }
     return true;
   }
 
-  // NOT LOCKED
-  auto TraverseDown(const std::string &key) const
-      -> cdi::constructor::Maybe<std::reference_wrapper<TrieNode>> {
-    auto *currentNode = root_.get();
-    for (char keychar : key) {
-      if (auto queryResult = currentNode->GetChild(keychar); queryResult) {
-        currentNode = &queryResult->get();
-        continue;
+  enum class ProbeResult : std::uint8_t {
+    kFound,
+    kAbsent,
+    kRestart,
+    kAdvanced, // not done yet, see Step.
+  };
+
+  /// State of one optimistic descent, latching nothing. `node` was reached
+  /// through key[0, depth) and read at `version`.
+  struct Descent {
+    std::string_view key;
+    Node *node = nullptr;
+    std::uint64_t version = 0;
+    std::size_t depth = 0;
+    Node *child = nullptr; // being entered, prefetched.
+    std::size_t index = 0; // in the batch.
+    int restarts = 0;
+  };
+
+  void Begin(Descent &descent) const {
+    descent.node = root_.get();
+    descent.version = descent.node->ReadVersion();
+    descent.depth = 0;
+    descent.child = nullptr;
+  }
+
+  /// Take half an edge: find the child and prefetch it, or enter the child
+  /// found last time and prefetch where its own search will look. So a batch
+  /// can switch to another descent while the memory arrives.
+  ///
+  /// Each read of a node is confirmed by its version afterwards, and a
+  /// child's version is read while its parent is known unchanged, so the
+  /// child was reached through a consistent path. Reads racing with a writer
+  /// may see garbage, which is never acted upon before the check. The caller
+  /// holds an EpochGuard.
+  auto Step(Descent &descent) const -> ProbeResult {
+    auto *node = descent.node;
+    if (descent.child == nullptr) {
+      if (Node::IsLocked(descent.version)) {
+        return ProbeResult::kRestart;
+      }
+      if (descent.depth == descent.key.size()) {
+        return ProbeResult::kFound;
+      }
+      const auto *slot = node->children_.Find(descent.key[descent.depth]);
+      descent.child = slot == nullptr ? nullptr : slot->get();
+      if (descent.child == nullptr) {
+        return node->Validate(descent.version) ? ProbeResult::kAbsent
+                                               : ProbeResult::kRestart;
+      }
+      CDI_PREFETCH(descent.child);
+      return ProbeResult::kAdvanced;
+    }
+
+    auto *child = std::exchange(descent.child, nullptr);
+    auto childVersion = child->ReadVersion();
+    if (Node::IsLocked(childVersion) || !node->Validate(descent.version)) {
+      return ProbeResult::kRestart;
+    }
+    auto matched = child->MatchPrefix(descent.key, descent.depth + 1);
+    auto whole = matched == child->prefix_.size();
+    if (!child->Validate(childVersion)) {
+      return ProbeResult::kRestart;
+    }
+    if (!whole) {
+      return ProbeResult::kAbsent;
+    }
+    descent.node = child;
+    descent.version = childVersion;
+    descent.depth += 1 + matched;
+    if (descent.depth < descent.key.size()) {
+      child->children_.Prefetch(descent.key[descent.depth]);
+    }
+    return ProbeResult::kAdvanced;
+  }
+
+  /// A whole descent, from the root.
+  auto Probe(Descent &descent) const -> ProbeResult {
+    Begin(descent);
+    auto probed = ProbeResult::kAdvanced;
+    while (probed == ProbeResult::kAdvanced) {
+      probed = Step(descent);
+    }
+    return probed;
+  }
+
+  /// Copy the value of a node found by a descent, if it has one. Trivially
+  /// copyable values are copied optimistically, a torn copy is thrown away;
+  /// others under a shared latch.
+  /// \return false if the node changed since the descent read it.
+  auto ReadValue(const Descent &descent,
+                 cdi::constructor::Maybe<T> &result) const -> bool {
+    auto &node = *descent.node;
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      auto value = node.value_;
+      if (!node.Validate(descent.version)) {
+        return false;
+      }
+      result = value;
+    } else {
+      Guard guard(node);
+      if (!node.Validate(descent.version)) {
+        return false;
+      }
+      result = node.value_;
+    }
+    return true;
+  }
+
+  /// Copy of key's value, read optimistically.
+  auto Optimistic(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    cdi::constructor::Maybe<T> result;
+    Descent descent{key};
+    for (; descent.restarts < kOptimisticRestarts; ++descent.restarts) {
+      cdi::concurrency::EpochGuard epoch;
+      auto probed = Probe(descent);
+      if (probed == ProbeResult::kAbsent ||
+          (probed == ProbeResult::kFound && ReadValue(descent, result))) {
+        return result;
+      }
+    }
+    return Latched(key);
+  }
+
+  /// Copy of key's value, read with lock coupling.
+  auto Latched(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    cdi::constructor::Maybe<T> result;
+    if (auto found = TraverseDown(key); found && (*found)->HasValue()) {
+      result = *(*found)->value_;
+    }
+    return result;
+  }
+
+  /// The node of the longest prefix of key with a value, latched in shared
+  /// mode, and the length of that prefix.
+  auto LocateLongestPrefix(std::string_view key, std::size_t &length) const
+      -> cdi::constructor::Maybe<Guard> {
+    if (mode_ == TrieReadMode::kOptimistic) {
+      Descent descent{key};
+      for (; descent.restarts < kOptimisticRestarts; ++descent.restarts) {
+        cdi::concurrency::EpochGuard epoch;
+        Begin(descent);
+        // every node passed is validated by the next step, which makes the
+        // HasValue() read on it stick; the last one is checked below.
+        Descent best;
+        auto probed = ProbeResult::kAdvanced;
+        while (probed == ProbeResult::kAdvanced) {
+          if (descent.child == nullptr && descent.depth > 0 &&
+              descent.node->HasValue()) {
+            best = descent;
+          }
+          probed = Step(descent);
+        }
+        if (probed == ProbeResult::kRestart ||
+            !descent.node->Validate(descent.version)) {
+          continue;
+        }
+        if (best.node == nullptr) {
+          return cdi::constructor::none;
+        }
+        Guard guard(*best.node);
+        if (best.node->Validate(best.version)) {
+          length = best.depth;
+          return guard;
+        }
+      }
+    }
+
+    // hand over hand, but the deepest node with a value so far stays latched
+    // until a deeper one is found. Latches are still taken top-down.
+    Guard best;
+    Guard current(*root_);
+    const Node *node = root_.get();
+    std::size_t depth = 0;
+    while (depth < key.size()) {
+      auto child = node->GetChildGuardRead(key[depth]);
+      if (!child) {
+        break;
+      }
+      auto matched = (*child)->MatchPrefix(key, depth + 1);
+      if (matched < (*child)->prefix_.size()) {
+        break;
       }
+      depth += 1 + matched;
+      node = &**child;
+      if (node->HasValue()) {
+        best = std::move(*child);
+        length = depth;
+        current.Release();
+      } else {
+        current = std::move(*child);
+      }
+    }
+    if (!best.Succeed()) {
       return cdi::constructor::none;
     }
-    return *currentNode;
+    return best;
   }
 
-  // TODO: TraverseDown with all read locks
-  // TODO: TraverseDown with read locks and one mutex
+  /// key's node latched in shared mode. In kOptimistic mode only that node is
+  /// latched, after an optimistic descent, and its version checked again
+  /// under the latch.
+  auto Locate(std::string_view key) const -> cdi::constructor::Maybe<Guard> {
+    if (mode_ == TrieReadMode::kOptimistic) {
+      Descent descent{key};
+      for (; descent.restarts < kOptimisticRestarts; ++descent.restarts) {
+        cdi::concurrency::EpochGuard epoch;
+        auto probed = Probe(descent);
+        if (probed == ProbeResult::kAbsent) {
+          return cdi::constructor::none;
+        }
+        if (probed == ProbeResult::kFound) {
+          // the latch pins the node once the version is confirmed.
+          Guard guard(*descent.node);
+          if (descent.node->Validate(descent.version)) {
+            return guard;
+          }
+        }
+      }
+    }
+    return TraverseDown(key);
+  }
 
-  mutable std::shared_mutex
-      rwlatch_; // TODO: alas, global lock is always a bad idea.
-  std::unique_ptr<TrieNode> root_;
+  /// key's node latched exclusively, none if key is empty or not on a node.
+  /// In kOptimistic mode only that node is latched, after an optimistic
+  /// descent; taking the latch bumps the version by one, so anything else
+  /// having moved it shows.
+  auto LocateForWrite(std::string_view key) const
+      -> cdi::constructor::Maybe<Guard> {
+    if (key.empty()) {
+      return cdi::constructor::none;
+    }
+    if (mode_ == TrieReadMode::kOptimistic) {
+      Descent descent{key};
+      for (; descent.restarts < kOptimisticRestarts; ++descent.restarts) {
+        cdi::concurrency::EpochGuard epoch;
+        auto probed = Probe(descent);
+        if (probed == ProbeResult::kAbsent) {
+          return cdi::constructor::none;
+        }
+        if (probed == ProbeResult::kFound) {
+          Guard guard(*descent.node, false);
+          if (descent.node->Validate(descent.version + 1)) {
+            return guard;
+          }
+        }
+      }
+    }
+    // shared latches down to the parent, which pins the node while it is
+    // latched exclusively.
+    Guard current(*root_);
+    std::size_t depth = 0;
+    while (true) {
+      const auto *slot = current->children_.Find(key[depth]);
+      if (slot == nullptr) {
+        return cdi::constructor::none;
+      }
+      auto matched = (*slot)->MatchPrefix(key, depth + 1);
+      if (matched < (*slot)->prefix_.size()) {
+        return cdi::constructor::none;
+      }
+      depth += 1 + matched;
+      if (depth == key.size()) {
+        return Guard(**slot, false);
+      }
+      current = Guard(**slot);
+    }
+  }
+
+  /// shared latch crabbing. the returned guard holds the node.
+  auto TraverseDown(std::string_view key) const
+      -> cdi::constructor::Maybe<Guard> {
+    Guard current(*root_);
+    std::size_t depth = 0;
+    while (depth < key.size()) {
+      auto child = current->GetChildGuardRead(key[depth]);
+      if (!child) {
+        return cdi::constructor::none;
+      }
+      auto matched = (*child)->MatchPrefix(key, depth + 1);
+      if (matched < (*child)->prefix_.size()) {
+        return cdi::constructor::none;
+      }
+      current = std::move(*child);
+      depth += 1 + matched;
+    }
+    return current;
+  }
+
+  /// With bulk release only the values are destroyed, if they need it at
+  /// all; the nodes go with the arena.
+  void DestroyAll() {
+    retired_.Drain();
+    for (auto *dirty = dirty_.exchange(nullptr); dirty != nullptr;) {
+      delete std::exchange(dirty, dirty->next);
+    }
+    if constexpr (Alloc::kBulkRelease) {
+      if constexpr (!std::is_trivially_destructible_v<T>) {
+        std::vector<Node *> stack{root_.get()};
+        while (!stack.empty()) {
+          auto *node = stack.back();
+          stack.pop_back();
+          node->value_.reset();
+          node->history_.reset();
+          node->children_.ForEach(
+              [&stack](char, Owner &child) { stack.push_back(child.get()); });
+        }
+      }
+      (void)root_.release();
+      resource_.Release();
+    } else {
+      root_.reset();
+    }
+  }
+
+  typename Alloc::Resource resource_;
+  cdi::concurrency::RetireList retired_;
+  Alloc alloc_;
+  Owner root_;
+  TrieReadMode mode_;
+  detail::SnapshotRegistry snapshots_;
+  std::atomic<DirtyKey *> dirty_{nullptr};
+};
+
+//===------------------------------------------------------------------------===
+// Untyped trie
+//===------------------------------------------------------------------------===
+
+namespace detail {
+
+/// A value of any type that still knows how to print itself.
+struct AnyTrieValue {
+  std::any value;
+  void (*print)(std::ostream &out, const std::any &value);
+};
+
+inline auto operator<<(std::ostream &out, const AnyTrieValue &value)
+    -> std::ostream & {
+  value.print(out, value.value);
+  return out;
+}
+
+} // namespace detail
+
+template <typename Alloc> class Trie<void, Alloc> {
+public:
+  explicit Trie(TrieReadMode mode = TrieReadMode::kPessimistic)
+      : trie_(mode) {}
+
+  template <typename T> auto Insert(std::string_view key, T &value) -> bool {
+    return trie_.Insert(key, Erase(std::move(value)));
+  }
+
+  // True if key is on the path of some key, and has no value afterwards.
+  // False if key not found.
+  auto Remove(std::string_view key) -> bool { return trie_.Remove(key); }
+
+  /// Lookup a key in the trie.
+  /// \param key The key to lookup.
+  /// \param[out] value The value to store the result, if value is nullptr, then
+  /// this method is used to check whether the key exists.
+  /// \return true if the key exists with a value of type T, false otherwise.
+  template <typename T>
+  [[nodiscard("you must check whether the lookup succeed.")]] auto
+  Lookup(std::string_view key, T *value = nullptr) const -> bool {
+    return Visit<T>(key, [value](const T &found) {
+      if (value) {
+        *value = found;
+      }
+    });
+  }
+
+  /// cdi-style api.
+  template <typename T>
+  auto LookupMaybe(std::string_view key) const
+      -> cdi::constructor::Maybe<T> {
+    cdi::constructor::Maybe<T> result;
+    (void)Visit<T>(key, [&result](const T &found) { result = found; });
+    return result;
+  }
+
+  /// \return true if the key has a value of type T.
+  template <typename T, typename Visitor>
+  auto Visit(std::string_view key, Visitor &&visitor) const -> bool {
+    bool typed = false;
+    (void)trie_.Visit(key, [&](const detail::AnyTrieValue &found) {
+      if (const auto *value = std::any_cast<T>(&found.value)) {
+        typed = true;
+        std::forward<Visitor>(visitor)(*value);
+      }
+    });
+    return typed;
+  }
+
+  /// Trie<T>::VisitPrefixes over the prefixes with a value of type T.
+  template <typename T, typename Visitor>
+  auto VisitPrefixes(std::string_view key, Visitor &&visitor) const
+      -> std::size_t {
+    std::size_t visited = 0;
+    (void)trie_.VisitPrefixes(key,
+                              Typed<T>(visitor, Erased::kNoLimit, visited));
+    return visited;
+  }
+
+  /// Longest prefix of key with a value of type T, with a copy of the value.
+  template <typename T>
+  auto LongestPrefix(std::string_view key) const
+      -> cdi::constructor::Maybe<std::pair<std::string_view, T>> {
+    cdi::constructor::Maybe<std::pair<std::string_view, T>> result;
+    (void)VisitPrefixes<T>(key, [&result](std::string_view prefix,
+                                          const T &value) {
+      result.emplace(prefix, value);
+    });
+    return result;
+  }
+
+  /// Trie<T>::LookupBatch, none for a value of another type.
+  template <typename T, typename KeyIter, typename OutIter>
+  auto LookupBatch(KeyIter first, KeyIter last, OutIter out) const
+      -> std::size_t {
+    std::vector<cdi::constructor::Maybe<detail::AnyTrieValue>> erased(
+        std::distance(first, last));
+    (void)trie_.LookupBatch(first, last, erased.begin());
+    std::size_t found = 0;
+    for (std::size_t i = 0; i < erased.size(); ++i) {
+      const auto *value =
+          erased[i] ? std::any_cast<T>(&erased[i]->value) : nullptr;
+      if (value != nullptr) {
+        out[i] = *value;
+        ++found;
+      } else {
+        out[i] = cdi::constructor::Maybe<T>();
+      }
+    }
+    return found;
+  }
+
+  /// Trie<T>::BulkLoad, every value of type T.
+  template <typename T>
+  auto BulkLoad(std::vector<std::pair<std::string, T>> entries,
+                std::size_t threads = 0) -> std::size_t {
+    std::vector<std::pair<std::string, detail::AnyTrieValue>> erased;
+    erased.reserve(entries.size());
+    for (auto &[key, value] : entries) {
+      erased.emplace_back(std::move(key), Erase(std::move(value)));
+    }
+    return trie_.BulkLoad(std::move(erased), threads);
+  }
+
+  /// Trie<T>::ScanPrefix over the keys with a value of type T.
+  template <typename T, typename Visitor>
+  auto ScanPrefix(std::string_view prefix,
+                  Visitor &&visitor,
+                  std::size_t limit = Erased::kNoLimit) const -> std::size_t {
+    std::size_t visited = 0;
+    (void)trie_.ScanPrefix(prefix, Typed<T>(visitor, limit, visited));
+    return visited;
+  }
+
+  /// Trie<T>::ScanRange over the keys with a value of type T.
+  template <typename T, typename Visitor>
+  auto ScanRange(std::string_view lo,
+                 std::string_view hi,
+                 Visitor &&visitor,
+                 std::size_t limit = Erased::kNoLimit) const -> std::size_t {
+    std::size_t visited = 0;
+    (void)trie_.ScanRange(lo, hi, Typed<T>(visitor, limit, visited));
+    return visited;
+  }
+
+  /// what can you expect from a function named `Print`...
+  void Print(std::ostream &out) const { trie_.Print(out); }
+
+private:
+  using Erased = Trie<detail::AnyTrieValue, Alloc>;
+
+  template <typename T> static auto Erase(T &&value) -> detail::AnyTrieValue {
+    using Value = std::decay_t<T>;
+    return {std::any(std::forward<T>(value)),
+            [](std::ostream &out, const std::any &erased) {
+              out << *std::any_cast<Value>(&erased);
+            }};
+  }
+
+  /// scan visitor skipping other types; the limit counts typed keys only.
+  template <typename T, typename Visitor>
+  static auto Typed(Visitor &visitor, std::size_t limit, std::size_t &visited) {
+    return [&visitor, limit, &visited](std::string_view key,
+                                       const detail::AnyTrieValue &found) {
+      const auto *value = std::any_cast<T>(&found.value);
+      if (value == nullptr) {
+        return visited < limit;
+      }
+      if (visited == limit) {
+        return false;
+      }
+      ++visited;
+      return detail::CallVisitor(visitor, key, *value);
+    };
+  }
+
+  Erased trie_;
 };
 
 } // namespace cdi::container
 
+// the read side features, kept out of the core above.
+#include "container/trie_bulk_load.hh"
+#include "container/trie_fuzzy.hh"
+#include "container/trie_lookup_batch.hh"
+#include "container/trie_scan.hh"
+#include "container/trie_snapshot.hh"
+#include "container/trie_top_k.hh"
+
 #endif // CDI_CONTAINER_TRIE_HH
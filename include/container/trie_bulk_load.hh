@@ -0,0 +1,260 @@
+//===--- trie_bulk_load.hh - Parallel bulk load of a Trie -------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_bulk_load.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Trie::BulkLoad builds the subtrees of a sorted batch bottom-up: each node is
+// made once, with its final label, and nothing is latched until the subtrees
+// are stitched under the root. A subtree of kParallelGrain keys or more is
+// built on a thread of its own while the thread budget lasts, at any depth, so
+// a batch where every key shares a leading '/' still spreads over the cores.
+//
+// Classes: detail::TrieBulkLoad
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_BULK_LOAD_HH
+#define CDI_CONTAINER_TRIE_BULK_LOAD_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cdi::container::detail {
+
+template <typename T, typename Alloc> class TrieBulkLoad {
+  using Trie = container::Trie<T, Alloc>;
+  using Node = TrieNode<T, Alloc>;
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = typename Node::Owner;
+  using Entries = std::vector<std::pair<std::string, T>>;
+
+public:
+  /// see Trie::BulkLoad.
+  static auto
+  Load(Trie &trie, Entries entries, std::size_t threads) -> std::size_t {
+    auto byKey = [](const auto &lhs, const auto &rhs) {
+      return lhs.first < rhs.first;
+    };
+    if (!std::is_sorted(entries.begin(), entries.end(), byKey)) {
+      std::stable_sort(entries.begin(), entries.end(), byKey);
+    }
+    entries.erase(std::unique(entries.begin(),
+                              entries.end(),
+                              [](const auto &lhs, const auto &rhs) {
+                                return lhs.first == rhs.first;
+                              }),
+                  entries.end());
+    auto begin = entries.begin();
+    while (begin != entries.end() && begin->first.empty()) {
+      ++begin;
+    }
+
+    if (threads == 0) {
+      threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    Budget budget{static_cast<std::ptrdiff_t>(threads) - 1};
+
+    // subtrees under bytes the root already has are merged key by key.
+    struct Group {
+      std::size_t begin;
+      std::size_t end;
+      bool stitch;
+      cdi::constructor::Maybe<Owner> subtree;
+    };
+    std::vector<Group> groups;
+    {
+      Guard rootGuard(*trie.root_);
+      for (auto iter = begin; iter != entries.end();) {
+        auto keychar = iter->first[0];
+        auto last = std::find_if(iter, entries.end(), [keychar](auto &entry) {
+          return entry.first[0] != keychar;
+        });
+        groups.push_back({static_cast<std::size_t>(iter - entries.begin()),
+                          static_cast<std::size_t>(last - entries.begin()),
+                          !trie.root_->HasChild(keychar),
+                          {}});
+        iter = last;
+      }
+    }
+    std::vector<std::future<Owner>> spawned;
+    for (auto &group : groups) {
+      if (group.stitch) {
+        group.subtree = BuildOrSpawn(
+            trie, entries, group.begin, group.end, 0, budget, spawned);
+      }
+    }
+    for (auto &subtree : spawned) {
+      auto built = subtree.get();
+      auto keychar = built->key_;
+      for (auto &group : groups) {
+        if (group.stitch && entries[group.begin].first[0] == keychar) {
+          group.subtree = std::move(built);
+          break;
+        }
+      }
+    }
+
+    std::size_t added = 0;
+    Entries rest;
+    {
+      Guard rootGuard(*trie.root_, false);
+      for (auto &group : groups) {
+        if (!group.stitch) {
+          continue;
+        }
+        auto subtree = std::move(*group.subtree);
+        auto keychar = subtree->key_;
+        if (trie.root_->HasChild(keychar) || trie.snapshots_.Recording()) {
+          // a concurrent Insert got there first, or a snapshot must not see
+          // the subtree: its values are stamped one by one.
+          std::string key;
+          Drain(*subtree, key, rest);
+          continue;
+        }
+        if constexpr (Trie::kScored) {
+          trie.root_->bound_.Raise(subtree->bound_.Get());
+        }
+        (void)trie.root_->InsertKey(keychar, std::move(subtree), trie.alloc_);
+        added += group.end - group.begin;
+      }
+    }
+    for (auto &group : groups) {
+      if (!group.stitch) {
+        for (auto index = group.begin; index < group.end; ++index) {
+          rest.push_back(std::move(entries[index]));
+        }
+      }
+    }
+    for (auto &[key, value] : rest) {
+      added += trie.Insert(key, std::move(value)) ? 1 : 0;
+    }
+    return added;
+  }
+
+private:
+  /// threads a bulk load may still start.
+  struct Budget {
+    auto TryTake() -> bool {
+      auto spare = spare_.load(std::memory_order_relaxed);
+      while (spare > 0) {
+        if (spare_.compare_exchange_weak(spare, spare - 1)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void Give() { spare_.fetch_add(1); }
+
+    std::atomic<std::ptrdiff_t> spare_;
+  };
+
+  /// below this many keys a subtree is built by the thread that reaches it.
+  constexpr static std::size_t kParallelGrain = 4096;
+
+  /// Build the subtree on a thread of its own when it is large and the
+  /// budget allows.
+  /// \return the subtree, or none after handing it to `spawned`.
+  static auto
+  BuildOrSpawn(Trie &trie,
+               Entries &entries,
+               std::size_t begin,
+               std::size_t end,
+               std::size_t depth,
+               Budget &budget,
+               std::vector<std::future<Owner>> &spawned)
+      -> cdi::constructor::Maybe<Owner> {
+    if (end - begin >= kParallelGrain && budget.TryTake()) {
+      spawned.push_back(
+          std::async(std::launch::async, [=, &trie, &entries, &budget]() {
+            auto subtree =
+                BuildSubtree(trie, entries, begin, end, depth, budget);
+            budget.Give();
+            return subtree;
+          }));
+      return cdi::constructor::none;
+    }
+    return BuildSubtree(trie, entries, begin, end, depth, budget);
+  }
+
+  /// Node for the sorted, distinct keys in entries[begin, end), which agree
+  /// on their first depth + 1 characters; its edge label starts at depth.
+  /// Nothing is shared yet, so no latch is taken.
+  static auto
+  BuildSubtree(Trie &trie,
+               Entries &entries,
+               std::size_t begin,
+               std::size_t end,
+               std::size_t depth,
+               Budget &budget) -> Owner {
+    // sorted, so the first and the last key bound the common prefix.
+    const auto &first = entries[begin].first;
+    const auto &last = entries[end - 1].first;
+    auto common = depth + 1;
+    while (common < first.size() && common < last.size() &&
+           first[common] == last[common]) {
+      ++common;
+    }
+
+    auto node = trie.NewNode(first[depth]);
+    node->prefix_.assign(first, depth + 1, common - depth - 1);
+    if (first.size() == common) {
+      node->value_.emplace(std::move(entries[begin].second));
+      ++begin;
+    }
+
+    std::vector<std::future<Owner>> spawned;
+    while (begin < end) {
+      auto keychar = entries[begin].first[common];
+      auto groupEnd = begin + 1;
+      while (groupEnd < end && entries[groupEnd].first[common] == keychar) {
+        ++groupEnd;
+      }
+      auto child = BuildOrSpawn(
+          trie, entries, begin, groupEnd, common, budget, spawned);
+      if (child) {
+        (void)node->InsertKey(keychar, std::move(*child), trie.alloc_);
+      }
+      begin = groupEnd;
+    }
+    for (auto &child : spawned) {
+      auto subtree = child.get();
+      auto keychar = subtree->key_;
+      (void)node->InsertKey(keychar, std::move(subtree), trie.alloc_);
+    }
+    Trie::ResetBound(*node);
+    return node;
+  }
+
+  /// Move the values below an unpublished `node` out, with their keys.
+  /// `key` is the key above node.
+  static void
+  Drain(Node &node, std::string &key, Entries &out) {
+    auto depth = key.size();
+    key.push_back(node.key_);
+    key.append(node.prefix_);
+    if (node.HasValue()) {
+      out.emplace_back(key, std::move(*node.value_));
+    }
+    node.children_.ForEach(
+        [&key, &out](char, Owner &child) { Drain(*child, key, out); });
+    key.resize(depth);
+  }
+};
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_TRIE_BULK_LOAD_HH
@@ -0,0 +1,174 @@
+//===--- trie_fuzzy.hh - Bounded edit-distance search of Trie ---*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_fuzzy.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// The walk behind Trie::VisitFuzzy and Trie::Fuzzy. It carries one row of the
+// Levenshtein table per byte of the path and leaves a subtree, even in the
+// middle of a compressed edge, once no entry of the row is within the bound.
+// Fuzzy keeps the best keys in a heap and tightens the bound as closer keys
+// turn up. Latching is the same as for the scans.
+//
+// Classes: detail::TrieFuzzy
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_FUZZY_HH
+#define CDI_CONTAINER_TRIE_FUZZY_HH
+
+#include "container/trie.hh"
+#include "container/visitor.hh"
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cdi::container::detail {
+
+template <typename T, typename Alloc> class TrieFuzzy {
+  using Trie = container::Trie<T, Alloc>;
+  using Node = TrieNode<T, Alloc>;
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = typename Node::Owner;
+  using Matches = std::vector<TrieFuzzyMatch<T>>;
+
+public:
+  /// see Trie::VisitFuzzy.
+  template <typename Visitor>
+  static auto
+  Visit(const Trie &trie,
+        std::string_view query,
+        std::size_t maxDistance,
+        Visitor &visitor) -> std::size_t {
+    std::size_t visited = 0;
+    auto report = [&visitor, &visited](std::string_view key,
+                                       std::size_t distance,
+                                       const T &value) {
+      ++visited;
+      return CallVisitor(visitor, key, distance, value);
+    };
+    State state(query, maxDistance);
+    Guard rootGuard(*trie.root_);
+    (void)Walk(*trie.root_, state, report);
+    return visited;
+  }
+
+  /// see Trie::Fuzzy.
+  static auto
+  Best(const Trie &trie,
+       std::string_view query,
+       std::size_t maxDistance,
+       std::size_t best) -> Matches {
+    Matches found;
+    if (best == 0) {
+      return found;
+    }
+    // a max-heap on (distance, key). Keys come in order, so a later key
+    // never beats an earlier one at the same distance.
+    auto worse = [](const auto &lhs, const auto &rhs) {
+      return lhs.distance < rhs.distance ||
+             (lhs.distance == rhs.distance && lhs.key.compare(rhs.key) < 0);
+    };
+    State state(query, maxDistance);
+    auto keep = [&](std::string_view key,
+                    std::size_t distance,
+                    const T &value) {
+      if (found.size() == best) {
+        std::pop_heap(found.begin(), found.end(), worse);
+        found.pop_back();
+      }
+      found.push_back({std::string(key), distance, value});
+      std::push_heap(found.begin(), found.end(), worse);
+      if (found.size() < best) {
+        return true;
+      }
+      if (found.front().distance == 0) {
+        return false;
+      }
+      state.bound = found.front().distance - 1;
+      return true;
+    };
+    Guard rootGuard(*trie.root_);
+    (void)Walk(*trie.root_, state, keep);
+    std::sort_heap(found.begin(), found.end(), worse);
+    return found;
+  }
+
+private:
+  /// The edit distance table of a fuzzy walk, one row per byte of the key.
+  struct State {
+    State(std::string_view query, std::size_t bound)
+        : query(query), bound(bound), rows(query.size() + 1) {
+      for (std::size_t j = 0; j <= query.size(); ++j) {
+        rows[j] = j;
+      }
+    }
+
+    /// Append the row for one more key byte.
+    /// \return the least entry of the new row.
+    auto Push(char keychar) -> std::size_t {
+      auto width = query.size() + 1;
+      auto prev = rows.size() - width;
+      rows.resize(rows.size() + width);
+      auto *above = rows.data() + prev;
+      auto *row = above + width;
+      row[0] = above[0] + 1;
+      auto least = row[0];
+      for (std::size_t j = 1; j < width; ++j) {
+        row[j] = std::min({above[j] + 1,
+                           row[j - 1] + 1,
+                           above[j - 1] + (query[j - 1] == keychar ? 0 : 1)});
+        least = std::min(least, row[j]);
+      }
+      return least;
+    }
+
+    /// distance of the key so far to the whole query.
+    [[nodiscard]] auto Distance() const -> std::size_t { return rows.back(); }
+
+    std::string_view query;
+    std::size_t bound;
+    std::string key;
+    std::vector<std::size_t> rows;
+  };
+
+  /// Preorder walk below `node`, latched by the caller, whose key and rows
+  /// are in state. `found(key, distance, value)` returns false to stop.
+  /// \return false once the walk is over.
+  template <typename Found>
+  static auto
+  Walk(const Node &node, State &state, Found &found) -> bool {
+    if (node.HasValue() && state.Distance() <= state.bound &&
+        !found(std::string_view(state.key), state.Distance(), *node.value_)) {
+      return false;
+    }
+    return node.children_.ForEach([&](char keychar, const Owner &child) {
+      auto depth = state.key.size();
+      auto reachable = true;
+      // the label is pruned byte by byte, a long edge may end early.
+      for (std::size_t i = 0; reachable && i <= child->prefix_.size(); ++i) {
+        auto byte = i == 0 ? keychar : child->prefix_[i - 1];
+        state.key.push_back(byte);
+        reachable = state.Push(byte) <= state.bound;
+      }
+      auto more = true;
+      if (reachable) {
+        Guard childGuard(*child);
+        more = Walk(*child, state, found);
+      }
+      state.rows.resize((depth + 1) * (state.query.size() + 1));
+      state.key.resize(depth);
+      return more;
+    });
+  }
+};
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_TRIE_FUZZY_HH
@@ -0,0 +1,241 @@
+//===--- trie_key.hh - Binary comparable keys -------------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_key.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Keys for the tries, which compare bytes as unsigned, like std::string.
+//
+// AsKey views raw bytes, e.g. a network buffer, as a key without copying.
+//
+// KeyEncoder builds a key from typed fields, in a buffer of its own on the
+// stack, so that comparing encoded keys byte by byte orders them like the
+// tuples of their fields, and ordered scans over a trie come out in field
+// order:
+//   unsigned   big endian.
+//   signed     big endian, sign bit flipped.
+//   double     big endian, sign bit flipped for positives, every bit for
+//              negatives, so -0.0 sorts just before 0.0 and NaNs at the ends.
+//   string     0x00 escaped as 0x00 0xff, then a 0x00 0x01 terminator, so a
+//              string sorts before its extensions whatever follows it.
+// KeyDecoder reads the fields back, in the same order.
+//
+// Classes: KeyEncoder, KeyDecoder
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_KEY_HH
+#define CDI_CONTAINER_TRIE_KEY_HH
+
+#include "constructor/maybe.hh"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace cdi::container {
+
+/// `size` raw bytes as a key, no copy.
+template <typename Byte>
+auto
+AsKey(const Byte *data, std::size_t size) -> std::string_view {
+  static_assert(sizeof(Byte) == 1, "a key is a sequence of bytes");
+  return {reinterpret_cast<const char *>(data), size};
+}
+
+namespace detail {
+
+constexpr static char kKeyEscape = '\x00';
+constexpr static char kKeyEscaped = '\xff';
+constexpr static char kKeyTerminator = '\x01'; // after a kKeyEscape.
+
+/// unsigned of the same width, with signed values shifted to sort unsigned.
+template <typename T>
+auto
+KeyBits(T value) {
+  if constexpr (std::is_floating_point_v<T>) {
+    static_assert(sizeof(T) == 8 || sizeof(T) == 4);
+    using Bits =
+        std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    constexpr Bits kSign = Bits(1) << (sizeof(Bits) * 8 - 1);
+    return (bits & kSign) != 0 ? static_cast<Bits>(~bits) : bits ^ kSign;
+  } else {
+    using Bits = std::make_unsigned_t<T>;
+    auto bits = static_cast<Bits>(value);
+    if constexpr (std::is_signed_v<T>) {
+      bits ^= Bits(1) << (sizeof(Bits) * 8 - 1);
+    }
+    return bits;
+  }
+}
+
+template <typename T, typename Bits>
+auto
+FromKeyBits(Bits bits) -> T {
+  constexpr Bits kSign = Bits(1) << (sizeof(Bits) * 8 - 1);
+  if constexpr (std::is_floating_point_v<T>) {
+    bits = (bits & kSign) != 0 ? bits ^ kSign : static_cast<Bits>(~bits);
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  } else {
+    if constexpr (std::is_signed_v<T>) {
+      bits ^= kSign;
+    }
+    return static_cast<T>(bits);
+  }
+}
+
+} // namespace detail
+
+/// Encoded key of at most Capacity bytes, no allocation. Appending past the
+/// capacity throws std::length_error.
+template <std::size_t Capacity = 64>
+class KeyEncoder {
+public:
+  /// an integral or floating point field.
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic_v<T> &&
+                                        !std::is_same_v<T, bool>>>
+  auto
+  Append(T value) -> KeyEncoder & {
+    auto bits = detail::KeyBits(value);
+    Reserve(sizeof(bits));
+    for (auto shift = sizeof(bits) * 8; shift > 0; shift -= 8) {
+      buffer_[size_++] = static_cast<char>((bits >> (shift - 8)) & 0xff);
+    }
+    return *this;
+  }
+
+  /// a string field. Use AppendRaw for the last field to skip the escaping.
+  auto
+  Append(std::string_view value) -> KeyEncoder & {
+    for (auto byte : value) {
+      if (byte == detail::kKeyEscape) {
+        Reserve(2);
+        buffer_[size_++] = detail::kKeyEscape;
+        buffer_[size_++] = detail::kKeyEscaped;
+      } else {
+        Reserve(1);
+        buffer_[size_++] = byte;
+      }
+    }
+    Reserve(2);
+    buffer_[size_++] = detail::kKeyEscape;
+    buffer_[size_++] = detail::kKeyTerminator;
+    return *this;
+  }
+
+  /// bytes as they are; only prefix order is kept past them.
+  auto
+  AppendRaw(std::string_view bytes) -> KeyEncoder & {
+    Reserve(bytes.size());
+    std::memcpy(buffer_ + size_, bytes.data(), bytes.size());
+    size_ += bytes.size();
+    return *this;
+  }
+
+  void
+  Clear() {
+    size_ = 0;
+  }
+
+  /// valid until the encoder is modified or dies.
+  [[nodiscard]] auto
+  View() const -> std::string_view {
+    return {buffer_, size_};
+  }
+
+  operator std::string_view() const { return View(); }
+
+  [[nodiscard]] auto
+  Size() const -> std::size_t {
+    return size_;
+  }
+
+private:
+  void
+  Reserve(std::size_t bytes) const {
+    if (Capacity - size_ < bytes) {
+      throw std::length_error("KeyEncoder: key longer than its capacity");
+    }
+  }
+
+  char buffer_[Capacity];
+  std::size_t size_ = 0;
+};
+
+/// Reads the fields of a KeyEncoder key back, front to back. A read that does
+/// not fit the rest of the key returns none and consumes nothing.
+class KeyDecoder {
+public:
+  explicit KeyDecoder(std::string_view key) : rest_(key) {}
+
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic_v<T> &&
+                                        !std::is_same_v<T, bool>>>
+  auto
+  Read() -> cdi::constructor::Maybe<T> {
+    using Bits = decltype(detail::KeyBits(T()));
+    if (rest_.size() < sizeof(Bits)) {
+      return cdi::constructor::none;
+    }
+    Bits bits = 0;
+    for (std::size_t i = 0; i < sizeof(Bits); ++i) {
+      bits = static_cast<Bits>(bits << 8) |
+             static_cast<std::uint8_t>(rest_[i]);
+    }
+    rest_.remove_prefix(sizeof(Bits));
+    return detail::FromKeyBits<T>(bits);
+  }
+
+  auto
+  ReadString() -> cdi::constructor::Maybe<std::string> {
+    std::string value;
+    for (std::size_t pos = 0; pos < rest_.size(); ++pos) {
+      if (rest_[pos] != detail::kKeyEscape) {
+        value.push_back(rest_[pos]);
+        continue;
+      }
+      if (++pos == rest_.size()) {
+        break;
+      }
+      if (rest_[pos] == detail::kKeyTerminator) {
+        rest_.remove_prefix(pos + 1);
+        return value;
+      }
+      if (rest_[pos] != detail::kKeyEscaped) {
+        break;
+      }
+      value.push_back(detail::kKeyEscape);
+    }
+    return cdi::constructor::none;
+  }
+
+  /// what is left, e.g. an AppendRaw field.
+  [[nodiscard]] auto
+  Rest() const -> std::string_view {
+    return rest_;
+  }
+
+  [[nodiscard]] auto
+  Done() const -> bool {
+    return rest_.empty();
+  }
+
+private:
+  std::string_view rest_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_TRIE_KEY_HH
@@ -0,0 +1,104 @@
+//===--- trie_lookup_batch.hh - Interleaved Trie lookups --------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_lookup_batch.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Trie::LookupBatch keeps kLanes optimistic descents in flight and takes half
+// an edge of each in turn (Trie::Step): one step prefetches the node or the
+// child layout line that the next step of the same descent reads, so by the
+// time the batch comes back to it the memory has arrived. A finished lane is
+// refilled with the next key, and the busy lanes are kept in front.
+//
+// Classes: detail::TrieLookupBatch
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_LOOKUP_BATCH_HH
+#define CDI_CONTAINER_TRIE_LOOKUP_BATCH_HH
+
+#include "concurrency/epoch.hh"
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace cdi::container::detail {
+
+template <typename T, typename Alloc> class TrieLookupBatch {
+  using Trie = container::Trie<T, Alloc>;
+  using Descent = typename Trie::Descent;
+  using ProbeResult = typename Trie::ProbeResult;
+
+public:
+  /// see Trie::LookupBatch.
+  template <typename KeyIter, typename OutIter>
+  static auto
+  Run(const Trie &trie, KeyIter first, KeyIter last, OutIter out)
+      -> std::size_t {
+    auto count = static_cast<std::size_t>(std::distance(first, last));
+    std::size_t next = 0;
+    std::size_t found = 0;
+    std::array<Descent, kLanes> lanes;
+    std::size_t busy = 0;
+    auto load = [&](Descent &lane) {
+      lane.key = std::string_view(first[next]);
+      lane.index = next++;
+      lane.restarts = 0;
+      trie.Begin(lane);
+    };
+
+    cdi::concurrency::EpochGuard epoch;
+    for (; busy < lanes.size() && next < count; ++busy) {
+      load(lanes[busy]);
+    }
+    while (busy > 0) {
+      for (std::size_t lane = 0; lane < busy;) {
+        auto &descent = lanes[lane];
+        auto probed = trie.Step(descent);
+        if (probed == ProbeResult::kAdvanced) {
+          ++lane;
+          continue;
+        }
+        cdi::constructor::Maybe<T> result;
+        if (probed == ProbeResult::kFound &&
+            !trie.ReadValue(descent, result)) {
+          probed = ProbeResult::kRestart;
+        }
+        if (probed == ProbeResult::kRestart) {
+          if (++descent.restarts < Trie::kOptimisticRestarts) {
+            trie.Begin(descent);
+            ++lane;
+            continue;
+          }
+          result = trie.Latched(descent.key);
+        }
+        found += result.has_value() ? 1 : 0;
+        out[descent.index] = std::move(result);
+        if (next < count) {
+          load(descent);
+          ++lane;
+        } else {
+          // keep the busy lanes in front.
+          std::swap(descent, lanes[--busy]);
+        }
+      }
+    }
+    return found;
+  }
+
+private:
+  /// descents a batch keeps in flight.
+  constexpr static std::size_t kLanes = 16;
+};
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_TRIE_LOOKUP_BATCH_HH
@@ -0,0 +1,155 @@
+//===--- trie_scan.hh - Ordered prefix and range scans of Trie -*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_scan.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// The walks behind Trie::ScanPrefix and Trie::ScanRange, and those of a
+// TrieSnapshot. Children are kept in key order, so a preorder walk visits the
+// keys in lexicographic (unsigned byte) order. The walk latches the path to the
+// current key in shared mode and builds the key in one buffer, pushing and
+// popping edge labels, so a scan does not allocate per key.
+//
+// Classes: detail::TrieScan
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_SCAN_HH
+#define CDI_CONTAINER_TRIE_SCAN_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include "container/visitor.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace cdi::container::detail {
+
+template <typename T, typename Alloc> class TrieScan {
+  using Trie = container::Trie<T, Alloc>;
+  using Node = TrieNode<T, Alloc>;
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = typename Node::Owner;
+
+public:
+  /// see Trie::ScanPrefix, with the values as of asOf.
+  template <typename Visitor>
+  static auto
+  Prefix(const Trie &trie,
+         std::string_view prefix,
+         Visitor &visitor,
+         std::size_t limit,
+         std::uint64_t asOf) -> std::size_t {
+    State state(limit, asOf);
+    Guard current(*trie.root_);
+    std::size_t depth = 0;
+    while (depth < prefix.size()) {
+      auto child = current->GetChildGuardRead(prefix[depth]);
+      if (!child) {
+        return 0;
+      }
+      // the prefix may end inside the edge label.
+      auto matched = (*child)->MatchPrefix(prefix, depth + 1);
+      depth += 1 + matched;
+      if (matched < (*child)->prefix_.size() && depth < prefix.size()) {
+        return 0;
+      }
+      state.key.push_back((*child)->key_);
+      state.key.append((*child)->prefix_);
+      current = std::move(*child);
+    }
+    (void)Walk(*current, true, state, visitor);
+    return state.visited;
+  }
+
+  /// see Trie::ScanRange, with the values as of asOf.
+  template <typename Visitor>
+  static auto
+  Range(const Trie &trie,
+        std::string_view lo,
+        std::string_view hi,
+        Visitor &visitor,
+        std::size_t limit,
+        std::uint64_t asOf) -> std::size_t {
+    State state(limit, asOf);
+    state.lo = lo;
+    state.hi = hi;
+    Guard rootGuard(*trie.root_);
+    (void)Walk(*trie.root_, lo.empty(), state, visitor);
+    return state.visited;
+  }
+
+private:
+  struct State {
+    State(std::size_t limit, std::uint64_t asOf)
+        : remaining(limit), asOf(asOf) {}
+
+    std::string key; // of the node being visited, reused for the whole scan.
+    std::string_view lo;
+    cdi::constructor::Maybe<std::string_view> hi;
+    std::size_t remaining;
+    std::size_t visited = 0;
+    std::uint64_t asOf; // the values seen, see TrieNode::ValueAt.
+  };
+
+  /// Preorder walk below `node`, which the caller latches and whose key is
+  /// in state.key. Preorder is key order, so the first key past hi ends the
+  /// scan. `aboveLo` tells that every key below `node` is >= lo, otherwise
+  /// node's key is a prefix of lo.
+  /// \return false once the scan is over.
+  template <typename Visitor>
+  static auto
+  Walk(const Node &node, bool aboveLo, State &state, Visitor &visitor)
+      -> bool {
+    if (state.hi && std::string_view(state.key).compare(*state.hi) >= 0) {
+      return false;
+    }
+    const auto *value = node.ValueAt(state.asOf);
+    if (value != nullptr &&
+        (aboveLo || state.key.size() >= state.lo.size())) {
+      if (state.remaining == 0) {
+        return false;
+      }
+      --state.remaining;
+      ++state.visited;
+      if (!CallVisitor(visitor, std::string_view(state.key), *value)) {
+        return false;
+      }
+    }
+    return node.children_.ForEach([&](char keychar, const Owner &child) {
+      auto depth = state.key.size();
+      state.key.push_back(keychar);
+      state.key.append(child->prefix_);
+      auto childAboveLo = aboveLo;
+      auto below = true;
+      if (!aboveLo) {
+        // only the new label can differ from lo.
+        auto label = std::string_view(state.key).substr(depth);
+        auto bound = state.lo.substr(std::min(depth, state.lo.size()),
+                                     label.size());
+        auto order = label.substr(0, bound.size()).compare(bound);
+        below = order >= 0;
+        childAboveLo = order > 0 || bound.empty();
+      }
+      auto more = true;
+      if (below) {
+        Guard childGuard(*child);
+        more = Walk(*child, childAboveLo, state, visitor);
+      }
+      state.key.resize(depth);
+      return more;
+    });
+  }
+};
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_TRIE_SCAN_HH
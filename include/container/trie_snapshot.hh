@@ -0,0 +1,118 @@
+//===--- trie_snapshot.hh - Point-in-time views of a Trie -------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_snapshot.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// The handle returned by Trie::Snapshot. The versions it reads are kept by the
+// writers of the trie, see "Snapshots" in container/trie.hh; the handle only
+// carries the time it was taken at, reads through the trie as of that time,
+// and tells the trie when the last one is dropped.
+//
+// Classes: TrieSnapshot<T>
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_SNAPSHOT_HH
+#define CDI_CONTAINER_TRIE_SNAPSHOT_HH
+
+#include "constructor/maybe.hh"
+#include "container/trie.hh"
+#include "container/trie_scan.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace cdi::container {
+
+/// The keys and values of a Trie as of the moment Trie::Snapshot() was
+/// called, whatever writers did since. Reads latch like the trie's own
+/// pessimistic ones, also in kOptimistic mode, and see the same values
+/// however long the handle is kept; dropping the last one frees what the
+/// writers kept for it.
+template <typename T, typename Alloc> class TrieSnapshot {
+public:
+  TrieSnapshot(TrieSnapshot &&other) noexcept
+      : trie_(std::exchange(other.trie_, nullptr)), asOf_(other.asOf_) {}
+
+  auto operator=(TrieSnapshot &&other) noexcept -> TrieSnapshot & {
+    if (this != &other) {
+      Close();
+      trie_ = std::exchange(other.trie_, nullptr);
+      asOf_ = other.asOf_;
+    }
+    return *this;
+  }
+
+  TrieSnapshot(const TrieSnapshot &) = delete;
+  auto operator=(const TrieSnapshot &) -> TrieSnapshot & = delete;
+
+  ~TrieSnapshot() { Close(); }
+
+  /// see Trie::Lookup.
+  [[nodiscard("you must check whether the lookup succeed.")]] auto
+  Lookup(std::string_view key, T *value = nullptr) const -> bool {
+    if (value == nullptr) {
+      return Visit(key, [](const T &) {});
+    }
+    return Visit(key, [value](const T &found) { *value = found; });
+  }
+
+  auto LookupMaybe(std::string_view key) const -> cdi::constructor::Maybe<T> {
+    cdi::constructor::Maybe<T> result;
+    (void)Visit(key, [&result](const T &found) { result = found; });
+    return result;
+  }
+
+  /// see Trie::Visit.
+  template <typename Visitor>
+  auto Visit(std::string_view key, Visitor &&visitor) const -> bool {
+    return trie_->VisitAt(key, asOf_, visitor);
+  }
+
+  /// see Trie::ScanPrefix.
+  template <typename Visitor>
+  auto ScanPrefix(std::string_view prefix,
+                  Visitor &&visitor,
+                  std::size_t limit = Trie<T, Alloc>::kNoLimit) const
+      -> std::size_t {
+    return detail::TrieScan<T, Alloc>::Prefix(
+        *trie_, prefix, visitor, limit, asOf_);
+  }
+
+  /// see Trie::ScanRange.
+  template <typename Visitor>
+  auto ScanRange(std::string_view lo,
+                 std::string_view hi,
+                 Visitor &&visitor,
+                 std::size_t limit = Trie<T, Alloc>::kNoLimit) const
+      -> std::size_t {
+    return detail::TrieScan<T, Alloc>::Range(
+        *trie_, lo, hi, visitor, limit, asOf_);
+  }
+
+private:
+  friend class Trie<T, Alloc>;
+
+  TrieSnapshot(Trie<T, Alloc> &trie, std::uint64_t asOf)
+      : trie_(&trie), asOf_(asOf) {}
+
+  void Close() {
+    if (trie_ != nullptr && trie_->snapshots_.Close(asOf_)) {
+      trie_->Reclaim();
+    }
+    trie_ = nullptr;
+  }
+
+  Trie<T, Alloc> *trie_;
+  std::uint64_t asOf_;
+};
+
+} // namespace cdi::container
+
+#endif // CDI_CONTAINER_TRIE_SNAPSHOT_HH
@@ -0,0 +1,195 @@
+//===--- trie_top_k.hh - Best-first top-k over a ScoredTrie -----*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/trie_top_k.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Trie::TopK over Scored values. Every node of a ScoredTrie keeps an upper
+// bound of the scores below it, so the search pops the best candidate from a
+// priority queue, expands it when it is a node and reports it when it is a
+// value; after k values no candidate left can beat them. Bounds left too high
+// by a removal only cost a detour.
+//
+// Classes: detail::TrieTopK
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_CONTAINER_TRIE_TOP_K_HH
+#define CDI_CONTAINER_TRIE_TOP_K_HH
+
+#include "concurrency/epoch.hh"
+#include "container/trie.hh"
+#include "container/visitor.hh"
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cdi::container::detail {
+
+template <typename T, typename Alloc> class TrieTopK {
+  using Trie = container::Trie<T, Alloc>;
+  using Node = TrieNode<T, Alloc>;
+  using Guard = TrieNodeGuard<T, Alloc>;
+  using Owner = typename Node::Owner;
+  using Entries = std::vector<std::pair<std::string, T>>;
+
+public:
+  /// see Trie::TopK.
+  template <typename Visitor>
+  static auto
+  Run(const Trie &trie,
+      std::string_view prefix,
+      std::size_t k,
+      Visitor &visitor) -> std::size_t {
+    Entries best;
+    for (int restarts = 0; k > 0 && !BestFirst(trie, prefix, k, best);
+         ++restarts) {
+      if (restarts == Trie::kOptimisticRestarts) {
+        ScanBest(trie, prefix, k, best);
+        break;
+      }
+    }
+    std::size_t visited = 0;
+    for (const auto &[key, value] : best) {
+      ++visited;
+      if (!CallVisitor(visitor, std::string_view(key), value)) {
+        break;
+      }
+    }
+    return visited;
+  }
+
+private:
+  /// A node to expand, or a value to report, in the queue.
+  struct Candidate {
+    double score; // bound of the node's subtree, or the value's score.
+    std::string key;
+    Node *node;
+    bool value;
+  };
+
+  /// Queue order: lower score first, then higher key. A node's keys are
+  /// never below its own key, so equal scores come out in key order.
+  struct Worse {
+    auto operator()(const Candidate &lhs, const Candidate &rhs) const
+        -> bool {
+      if (lhs.score != rhs.score) {
+        return lhs.score < rhs.score;
+      }
+      return lhs.key.compare(rhs.key) > 0;
+    }
+  };
+
+  using CandidateQueue =
+      std::priority_queue<Candidate, std::vector<Candidate>, Worse>;
+
+  /// Queue the value and the children of `node`, latched by the caller.
+  static void
+  Expand(Node &node, const std::string &key, CandidateQueue &queue) {
+    if (node.HasValue()) {
+      queue.push({node.value_->score, key, &node, true});
+    }
+    // the parent's latch keeps the children's labels in place.
+    node.children_.ForEach([&key, &queue](char keychar, const Owner &child) {
+      auto bound = child->bound_.Get();
+      if (bound != -std::numeric_limits<double>::infinity()) {
+        std::string childKey = key;
+        childKey.push_back(keychar);
+        childKey.append(child->prefix_);
+        queue.push({bound, std::move(childKey), child.get(), false});
+      }
+    });
+  }
+
+  /// One best-first search into `best`.
+  /// \return false if a queued node was unlinked, the search must restart.
+  static auto
+  BestFirst(const Trie &trie,
+            std::string_view prefix,
+            std::size_t k,
+            Entries &best) -> bool {
+    best.clear();
+    CandidateQueue queue;
+    cdi::concurrency::EpochGuard epoch;
+    {
+      std::string key;
+      Guard current(*trie.root_);
+      std::size_t depth = 0;
+      while (depth < prefix.size()) {
+        auto child = current->GetChildGuardRead(prefix[depth]);
+        if (!child) {
+          return true;
+        }
+        // the prefix may end inside the edge label.
+        auto matched = (*child)->MatchPrefix(prefix, depth + 1);
+        depth += 1 + matched;
+        if (matched < (*child)->prefix_.size() && depth < prefix.size()) {
+          return true;
+        }
+        key.push_back((*child)->key_);
+        key.append((*child)->prefix_);
+        current = std::move(*child);
+      }
+      Expand(*current, key, queue);
+    }
+
+    // a node's key never changes while it is linked: splits and merges above
+    // it move labels between its ancestors only. Under a shared latch an odd
+    // version means unlinked.
+    while (!queue.empty() && best.size() < k) {
+      auto candidate = queue.top();
+      queue.pop();
+      Guard guard(*candidate.node);
+      if (Node::IsLocked(candidate.node->ReadVersion())) {
+        return false;
+      }
+      if (!candidate.value) {
+        Expand(*candidate.node, candidate.key, queue);
+      } else if (candidate.node->HasValue()) {
+        best.emplace_back(std::move(candidate.key),
+                          *candidate.node->value_);
+      }
+    }
+    // scores may have changed since they were queued.
+    std::stable_sort(best.begin(), best.end(), [](auto &lhs, auto &rhs) {
+      return lhs.second.score > rhs.second.score;
+    });
+    return true;
+  }
+
+  /// TopK the slow way, a latched scan of the whole subtree.
+  static void
+  ScanBest(const Trie &trie,
+           std::string_view prefix,
+           std::size_t k,
+           Entries &best) {
+    best.clear();
+    (void)trie.ScanPrefix(prefix,
+                          [&best](std::string_view key, const T &value) {
+                            best.emplace_back(std::string(key), value);
+                          });
+    auto size = std::min(k, best.size());
+    std::partial_sort(best.begin(),
+                      best.begin() + size,
+                      best.end(),
+                      [](auto &lhs, auto &rhs) {
+                        return lhs.second.score > rhs.second.score ||
+                               (lhs.second.score == rhs.second.score &&
+                                lhs.first.compare(rhs.first) < 0);
+                      });
+    best.resize(size);
+  }
+};
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_TRIE_TOP_K_HH
@@ -7,13 +7,29 @@
 //
 //===------------------------------------------===
 
+//===------------------------------------------------------------------------===
+// The hash map of cdi is open addressing, see container/flat_hash_map.hh: no
+// allocation per value, no pointer chased per probe. Mind that unlike with
+// std::unordered_map, an insertion may move every value.
+//===------------------------------------------------------------------------===
+
 #ifndef CDI_CONTAINER_UNORDERED_MAP_HH
 #define CDI_CONTAINER_UNORDERED_MAP_HH
 
-#include <unordered_map>
+#include "container/flat_hash_map.hh"
+#include <functional>
+#include <memory>
+#include <utility>
 
 namespace cdi::container {
-using std::unordered_map;
+
+template <typename K,
+          typename V,
+          typename Hash = std::hash<K>,
+          typename Eq = std::equal_to<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>>
+using unordered_map = flat_hash_map<K, V, Hash, Eq, Allocator>;
+
 } // namespace cdi::container
 
 #endif // CDI_CONTAINER_UNORDERED_MAP_HH
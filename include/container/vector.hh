@@ -13,18 +13,22 @@
 // vector.back(), it segfaults and nobody know what happened.
 //
 // Here I let it crush, and print stack trace so that we know what happened.
+//
+// How much that costs is up to kCheck, see container/bounds_check.hh: nothing
+// in release builds by default, one branch not taken in checked ones.
 //===------------------------------------------------------------------------===
 
 #ifndef CDI_CONTAINER_VECTOR_HH
 #define CDI_CONTAINER_VECTOR_HH
 
-// #include "common/logger.hh"
+#include "container/bounds_check.hh"
 #include <vector>
 
 namespace cdi {
 namespace container {
 
-template <typename Tp> class vector : public std::vector<Tp> {
+template <typename Tp, BoundsCheck kCheck = kDefaultBoundsCheck>
+class vector : public std::vector<Tp> {
   using original = std::vector<Tp, std::allocator<Tp>>;
   using original::original;
   using size_type = typename original::size_type;
@@ -32,15 +36,16 @@ template <typename Tp> class vector : public std::vector<Tp> {
   using reference = typename original::reference;
 
 public:
-  inline auto get(typename original::size_type _nn) ->
-      typename original::reference {
+  [[gnu::always_inline]] inline auto get(typename original::size_type _nn)
+      -> typename original::reference {
 
     AssertIndexInBounds(_nn);
 
     return original::operator[](_nn);
   }
 
-  inline auto get(typename original::size_type _nn) const ->
+  [[gnu::always_inline]] inline auto
+  get(typename original::size_type _nn) const ->
       typename original::const_reference {
 
     AssertIndexInBounds(_nn);
@@ -48,11 +53,12 @@ public:
     return original::operator[](_nn);
   }
 
-  auto operator[](typename original::size_type _nn) ->
-      typename original::reference {
+  [[gnu::always_inline]] auto operator[](typename original::size_type _nn)
+      -> typename original::reference {
     return get(_nn);
   }
-  auto operator[](typename original::size_type _nn) const ->
+  [[gnu::always_inline]] auto
+  operator[](typename original::size_type _nn) const ->
       typename original::const_reference {
     return get(_nn);
   }
@@ -61,21 +67,20 @@ public:
 
   auto front() const -> typename original::const_reference { return get(0); }
 
+  // on an empty vector, size() - 1 wraps around and fails the check.
   auto back() -> typename original::reference {
-    // CHECK(!original::empty());
     return get(original::size() - 1);
   }
 
   auto back() const -> typename original::const_reference {
-    // CHECK(original::empty());
     return get(original::size() - 1);
   }
 
 private:
-  void AssertIndexInBounds(size_type index) {
-    if (index >= original::size()) {
-      // LOG(FATAL) << "vector index out of bound: " << index
-      //            << " >= " << this->size();
+  // unchecked, not even size() is called: nothing is left of it at -O0.
+  [[gnu::always_inline]] void AssertIndexInBounds(size_type index) const {
+    if constexpr (kCheck != BoundsCheck::kUnchecked) {
+      CheckIndex<kCheck>(index, original::size(), "vector");
     }
   }
 };
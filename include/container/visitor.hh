@@ -0,0 +1,35 @@
+//===--- visitor.hh - Visitors that may stop a walk -------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/container/visitor.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#ifndef CDI_CONTAINER_VISITOR_HH
+#define CDI_CONTAINER_VISITOR_HH
+
+#include <type_traits>
+#include <utility>
+
+namespace cdi::container::detail {
+
+/// Call the visitor of a walk over a container. It returns void, or bool
+/// where false stops the walk.
+/// \return false if the visitor stopped the walk.
+template <typename Visitor, typename... Args>
+auto
+CallVisitor(Visitor &visitor, Args &&...args) -> bool {
+  if constexpr (std::is_void_v<std::invoke_result_t<Visitor &, Args...>>) {
+    visitor(std::forward<Args>(args)...);
+    return true;
+  } else {
+    return static_cast<bool>(visitor(std::forward<Args>(args)...));
+  }
+}
+
+} // namespace cdi::container::detail
+
+#endif // CDI_CONTAINER_VISITOR_HH
@@ -10,12 +10,23 @@
 #ifndef CDI_DEBUGGING_TRACER_HH
 #define CDI_DEBUGGING_TRACER_HH
 
-#include "container/vector.hh"
+#include "container/small_vector.hh"
+#include <cstddef>
 
 namespace cdi::debugging {
 
 using StackFrame = void *;
 
+/// deepest stack GetStackFrame unwinds.
+constexpr std::size_t kMaxStackFrames = 64;
+
+/// frames held inline, up to the deepest stack: tracing never allocates,
+/// which matters on the error paths that trace. The bounds check is pinned
+/// rather than left to CDI_BOUNDS_CHECK, so every translation unit sees the
+/// same return type for GetStackFrame.
+using StackFrames =
+    small_vector<StackFrame, kMaxStackFrames, container::BoundsCheck::kChecked>;
+
 struct UnwindOptions {
   int maxDepth;
   int skipFrames;
@@ -23,7 +34,7 @@ struct UnwindOptions {
 
 [[nodiscard("you may want to know how many stack traces to print. please check "
             "that.")]] [[maybe_unused]] extern auto
-GetStackFrame(UnwindOptions opt) noexcept -> vector<StackFrame>;
+GetStackFrame(UnwindOptions opt) noexcept -> StackFrames;
 
 } // namespace cdi::debugging
 
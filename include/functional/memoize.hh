@@ -11,9 +11,10 @@
 #ifndef CDI_FUNCTIONAL_MEMOIZE_HH
 #define CDI_FUNCTIONAL_MEMOIZE_HH
 
+#include "container/unordered_map.hh"
 #include <cstdint>
 #include <functional>
-#include <unordered_map>
+#include <tuple>
 
 namespace std {
 namespace {
@@ -77,7 +78,8 @@ template <typename Ret, typename... Args, class BaseFunc>
 // infer Ret, Args...
 struct Memoize<Ret(Args...), BaseFunc> {
   BaseFunc func_;
-  mutable std::unordered_map<std::tuple<std::decay_t<Args>...>, Ret> cache;
+  mutable cdi::container::unordered_map<std::tuple<std::decay_t<Args>...>, Ret>
+      cache;
 
   template <typename U>
   Memoize(U &&func) : func_(std::forward<U>(func)) {} // NOLINT
@@ -0,0 +1,60 @@
+//===--- mapped_file.hh - Read only memory mapped file ----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/memory/mapped_file.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#ifndef CDI_MEMORY_MAPPED_FILE_HH
+#define CDI_MEMORY_MAPPED_FILE_HH
+
+#include "constructor/maybe.hh"
+#include <cstddef>
+#include <string>
+
+namespace cdi::memory {
+
+/// A whole file mapped read only and shared, so processes mapping the same
+/// file share its pages in the page cache. The mapping is page aligned.
+class MappedFile {
+public:
+  /// \return none if the file cannot be opened or mapped.
+  static auto
+  Open(const std::string &path) -> cdi::constructor::Maybe<MappedFile>;
+
+  MappedFile(const MappedFile &) = delete;
+  auto
+  operator=(const MappedFile &) -> MappedFile & = delete;
+
+  MappedFile(MappedFile &&other) noexcept;
+  auto
+  operator=(MappedFile &&other) noexcept -> MappedFile &;
+
+  ~MappedFile();
+
+  [[nodiscard]] auto
+  Data() const -> const void * {
+    return data_;
+  }
+
+  [[nodiscard]] auto
+  Size() const -> std::size_t {
+    return size_;
+  }
+
+private:
+  MappedFile(const void *data, std::size_t size) : data_(data), size_(size) {}
+
+  void
+  Unmap();
+
+  const void *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace cdi::memory
+
+#endif // CDI_MEMORY_MAPPED_FILE_HH
@@ -0,0 +1,378 @@
+//===--- slab_arena.hh - Size classed slab arena ----------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/memory/slab_arena.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// An arena for node based containers.
+//
+// Small objects are carved out of 64KiB slabs, one size class per slab. Freed
+// objects go to the free list of their class and are handed out again before
+// the slab cursor moves, so a container that removes and inserts keeps its
+// footprint. Slabs are aligned to their size, and a header at the start of
+// every slab names the arena and the class: freeing needs only the pointer.
+//
+// Release() gives every slab back at once, without visiting the objects. That
+// is what makes tearing down a large container O(slabs) instead of O(nodes),
+// as long as the objects own nothing outside the arena.
+//
+// Allocation policies for containers live here too:
+//   HeapAllocator   plain new / delete.
+//   ArenaAllocator  a SlabArena owned by the container.
+// Given a RetireList, Retire() on them defers the delete until no optimistic
+// reader can still see the object; without one it deletes right away.
+//
+// Classes: SlabArena, ArenaStlAllocator, HeapAllocator, ArenaAllocator
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_MEMORY_SLAB_ARENA_HH
+#define CDI_MEMORY_SLAB_ARENA_HH
+
+#include "concurrency/epoch.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cdi::memory {
+
+class SlabArena {
+  constexpr static std::size_t kCacheLineSize = 64;
+  constexpr static std::size_t kHeaderSize = 64;
+
+  constexpr static std::size_t kClassSizes[] = {
+      16,  32,  48,  64,  80,   96,   112,  128,  160,  192,
+      224, 256, 320, 384, 448,  512,  640,  768,  896,  1024,
+      1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096};
+  constexpr static std::size_t kNumClasses = std::size(kClassSizes);
+  /// class of blocks holding a single object above kMaxSmallSize.
+  constexpr static std::uint32_t kLargeClass = kNumClasses;
+
+public:
+  constexpr static std::size_t kSlabSize = 64 * 1024;
+  constexpr static std::size_t kMaxSmallSize = 4096;
+  constexpr static std::size_t kAlignment = 16;
+
+  SlabArena() = default;
+  ~SlabArena() { Release(); }
+
+  SlabArena(const SlabArena &) = delete;
+  auto
+  operator=(const SlabArena &) -> SlabArena & = delete;
+
+  /// \return storage for `size` bytes, aligned to kAlignment.
+  auto
+  Allocate(std::size_t size) -> void * {
+    if (size > kMaxSmallSize) {
+      return AllocateLarge(size);
+    }
+    auto &sizeClass = classes_[ClassOf(size)];
+    std::scoped_lock<std::mutex> lock(sizeClass.latch);
+    if (sizeClass.freeList != nullptr) {
+      return std::exchange(sizeClass.freeList, sizeClass.freeList->next);
+    }
+    auto blockSize = kClassSizes[&sizeClass - classes_];
+    if (sizeClass.cursor + blockSize > sizeClass.end) {
+      auto *slab = NewBlock(kSlabSize, &sizeClass - classes_);
+      slab->next = std::exchange(sizeClass.slabs, slab);
+      sizeClass.cursor = reinterpret_cast<char *>(slab) + kHeaderSize;
+      sizeClass.end = reinterpret_cast<char *>(slab) + kSlabSize;
+    }
+    return std::exchange(sizeClass.cursor, sizeClass.cursor + blockSize);
+  }
+
+  /// Give `object` back to the arena it came from.
+  static void
+  Deallocate(void *object) noexcept {
+    if (object == nullptr) {
+      return;
+    }
+    auto *header = reinterpret_cast<BlockHeader *>(
+        reinterpret_cast<std::uintptr_t>(object) & ~(kSlabSize - 1));
+    auto *arena = header->arena;
+    if (header->sizeClass == kLargeClass) {
+      arena->DeallocateLarge(header);
+      return;
+    }
+    auto &sizeClass = arena->classes_[header->sizeClass];
+    std::scoped_lock<std::mutex> lock(sizeClass.latch);
+    sizeClass.freeList =
+        new (object) FreeBlock{std::exchange(sizeClass.freeList, nullptr)};
+  }
+
+  /// Free every slab, whatever is still allocated in it. No destructor runs.
+  /// Must not race with any other call.
+  void
+  Release() noexcept {
+    for (auto &sizeClass : classes_) {
+      FreeChain(sizeClass.slabs);
+      sizeClass.slabs = nullptr;
+      sizeClass.freeList = nullptr;
+      sizeClass.cursor = nullptr;
+      sizeClass.end = nullptr;
+    }
+    FreeChain(large_);
+    large_ = nullptr;
+  }
+
+  /// bytes taken from the system, headers and free blocks included.
+  [[nodiscard]] auto
+  BytesReserved() const -> std::size_t {
+    return reserved_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct BlockHeader {
+    SlabArena *arena;
+    std::uint32_t sizeClass;
+    std::size_t bytes;
+    BlockHeader *prev; // large blocks only
+    BlockHeader *next;
+  };
+  static_assert(sizeof(BlockHeader) <= kHeaderSize);
+
+  struct alignas(kCacheLineSize) SizeClass {
+    std::mutex latch;
+    FreeBlock *freeList = nullptr;
+    char *cursor = nullptr;
+    char *end = nullptr;
+    BlockHeader *slabs = nullptr;
+  };
+
+  static auto
+  ClassOf(std::size_t size) -> std::size_t {
+    return std::lower_bound(kClassSizes, kClassSizes + kNumClasses, size) -
+           kClassSizes;
+  }
+
+  auto
+  NewBlock(std::size_t bytes, std::size_t sizeClass) -> BlockHeader * {
+    auto *memory = ::operator new(bytes, std::align_val_t{kSlabSize});
+    reserved_.fetch_add(bytes, std::memory_order_relaxed);
+    return new (memory) BlockHeader{
+        this, static_cast<std::uint32_t>(sizeClass), bytes, nullptr, nullptr};
+  }
+
+  auto
+  AllocateLarge(std::size_t size) -> void * {
+    auto bytes = (kHeaderSize + size + kSlabSize - 1) & ~(kSlabSize - 1);
+    auto *block = NewBlock(bytes, kLargeClass);
+    std::scoped_lock<std::mutex> lock(largeLatch_);
+    block->next = large_;
+    if (large_ != nullptr) {
+      large_->prev = block;
+    }
+    large_ = block;
+    return reinterpret_cast<char *>(block) + kHeaderSize;
+  }
+
+  void
+  DeallocateLarge(BlockHeader *block) noexcept {
+    {
+      std::scoped_lock<std::mutex> lock(largeLatch_);
+      (block->prev != nullptr ? block->prev->next : large_) = block->next;
+      if (block->next != nullptr) {
+        block->next->prev = block->prev;
+      }
+    }
+    reserved_.fetch_sub(block->bytes, std::memory_order_relaxed);
+    ::operator delete(block, std::align_val_t{kSlabSize});
+  }
+
+  void
+  FreeChain(BlockHeader *block) noexcept {
+    while (block != nullptr) {
+      reserved_.fetch_sub(block->bytes, std::memory_order_relaxed);
+      ::operator delete(std::exchange(block, block->next),
+                        std::align_val_t{kSlabSize});
+    }
+  }
+
+  SizeClass classes_[kNumClasses];
+  std::mutex largeLatch_;
+  BlockHeader *large_ = nullptr;
+  std::atomic<std::size_t> reserved_{0};
+};
+
+/// std allocator interface over a SlabArena, e.g. for the strings of nodes.
+template <typename T>
+class ArenaStlAllocator {
+  template <typename U>
+  friend class ArenaStlAllocator;
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  explicit ArenaStlAllocator(SlabArena &arena) noexcept : arena_(&arena) {}
+
+  template <typename U>
+  ArenaStlAllocator(const ArenaStlAllocator<U> &other) noexcept
+      : arena_(other.arena_) {}
+
+  auto
+  allocate(std::size_t count) -> T * {
+    return static_cast<T *>(arena_->Allocate(count * sizeof(T)));
+  }
+
+  void
+  deallocate(T *object, std::size_t /*count*/) noexcept {
+    SlabArena::Deallocate(object);
+  }
+
+  template <typename U>
+  auto
+  operator==(const ArenaStlAllocator<U> &other) const -> bool {
+    return arena_ == other.arena_;
+  }
+
+  template <typename U>
+  auto
+  operator!=(const ArenaStlAllocator<U> &other) const -> bool {
+    return arena_ != other.arena_;
+  }
+
+private:
+  SlabArena *arena_;
+};
+
+/// Every object on its own, from the global heap.
+class HeapAllocator {
+public:
+  /// what the container owns on behalf of the allocator.
+  struct Resource {
+    void
+    Release() noexcept {}
+  };
+
+  /// whether Resource::Release() frees every object.
+  constexpr static bool kBulkRelease = false;
+
+  template <typename T>
+  using Stl = std::allocator<T>;
+
+  HeapAllocator() = default;
+  explicit HeapAllocator(Resource & /*resource*/,
+                         cdi::concurrency::RetireList *retired = nullptr)
+      : retired_(retired) {}
+
+  template <typename T, typename... Args>
+  auto
+  New(Args &&...args) const -> T * {
+    return new T(std::forward<Args>(args)...);
+  }
+
+  template <typename T>
+  static void
+  Delete(T *object) {
+    delete object;
+  }
+
+  template <typename T>
+  void
+  Retire(T *object) const {
+    if (retired_ == nullptr) {
+      Delete(object);
+      return;
+    }
+    retired_->Retire(object,
+                     [](void *erased) { Delete(static_cast<T *>(erased)); });
+  }
+
+  template <typename T>
+  auto
+  ToStl() const -> Stl<T> {
+    return {};
+  }
+
+private:
+  cdi::concurrency::RetireList *retired_ = nullptr;
+};
+
+/// Objects from a SlabArena owned by the container.
+class ArenaAllocator {
+public:
+  using Resource = SlabArena;
+
+  constexpr static bool kBulkRelease = true;
+
+  template <typename T>
+  using Stl = ArenaStlAllocator<T>;
+
+  explicit ArenaAllocator(SlabArena &arena,
+                          cdi::concurrency::RetireList *retired = nullptr)
+      : arena_(&arena), retired_(retired) {}
+
+  template <typename T, typename... Args>
+  auto
+  New(Args &&...args) const -> T * {
+    static_assert(alignof(T) <= SlabArena::kAlignment);
+    auto *memory = arena_->Allocate(sizeof(T));
+    try {
+      return new (memory) T(std::forward<Args>(args)...);
+    } catch (...) {
+      SlabArena::Deallocate(memory);
+      throw;
+    }
+  }
+
+  template <typename T>
+  static void
+  Delete(T *object) {
+    if (object != nullptr) {
+      object->~T();
+      SlabArena::Deallocate(object);
+    }
+  }
+
+  template <typename T>
+  void
+  Retire(T *object) const {
+    if (retired_ == nullptr) {
+      Delete(object);
+      return;
+    }
+    retired_->Retire(object,
+                     [](void *erased) { Delete(static_cast<T *>(erased)); });
+  }
+
+  template <typename T>
+  auto
+  ToStl() const -> Stl<T> {
+    return Stl<T>(*arena_);
+  }
+
+private:
+  SlabArena *arena_;
+  cdi::concurrency::RetireList *retired_;
+};
+
+/// unique_ptr deleter for objects made by Alloc::New.
+template <typename Alloc>
+struct AllocatorDelete {
+  template <typename T>
+  void
+  operator()(T *object) const {
+    Alloc::Delete(object);
+  }
+};
+
+} // namespace cdi::memory
+
+#endif // CDI_MEMORY_SLAB_ARENA_HH
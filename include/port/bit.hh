@@ -0,0 +1,83 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: include/port/bit.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+//===------------------------------------------------------------------------===
+// bit counts and scans of SIMD match masks and bitmap words, by compiler
+// builtins where there are some.
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_PORT_BIT_HH
+#define CDI_PORT_BIT_HH
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cdi::port {
+
+/// index of the lowest set bit of a non-zero mask.
+inline auto
+LowestBit(std::uint32_t mask) -> std::size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_ctz(mask));
+#else
+  std::size_t bit = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+/// index of the lowest set bit of a non-zero word.
+inline auto
+LowestBit(std::uint64_t word) -> std::size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_ctzll(word));
+#else
+  std::size_t bit = 0;
+  while ((word & 1) == 0) {
+    word >>= 1;
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+/// number of set bits of mask.
+inline auto
+PopCount(std::uint32_t mask) -> std::size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_popcount(mask));
+#else
+  std::size_t count = 0;
+  for (; mask != 0; mask &= mask - 1) {
+    ++count;
+  }
+  return count;
+#endif
+}
+
+/// number of set bits of word.
+inline auto
+PopCount(std::uint64_t word) -> std::size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_popcountll(word));
+#else
+  std::size_t count = 0;
+  for (; word != 0; word &= word - 1) {
+    ++count;
+  }
+  return count;
+#endif
+}
+
+} // namespace cdi::port
+
+#endif // CDI_PORT_BIT_HH
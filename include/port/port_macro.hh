@@ -32,4 +32,75 @@
     #endif // __GNUC__ >= 4
 #endif // defined(_WIN32) || defined(__CYGWIN__)
 
+//===------------------------------------------------------------------------===
+// simd
+//===------------------------------------------------------------------------===
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CDI_HAVE_SSE2 1
+#else
+    #define CDI_HAVE_SSE2 0
+#endif
+
+// SSSE3 brings pshufb, a byte shuffle looking up 16 bytes in a table at once.
+#if defined(__SSSE3__) || defined(__AVX__)
+    #define CDI_HAVE_SSSE3 1
+#else
+    #define CDI_HAVE_SSSE3 0
+#endif
+
+// read prefetch into every cache level, a no-op where unsupported.
+#if defined(__GNUC__) || defined(__clang__)
+    #define CDI_PREFETCH(address) __builtin_prefetch((address), 0, 3)
+#elif CDI_HAVE_SSE2
+    #include <xmmintrin.h>
+    #define CDI_PREFETCH(address) \
+        _mm_prefetch(reinterpret_cast<const char *>(address), _MM_HINT_T0)
+#else
+    #define CDI_PREFETCH(address) ((void)(address))
+#endif
+
+//===------------------------------------------------------------------------===
+// branches
+//===------------------------------------------------------------------------===
+
+// tell the compiler which way a branch goes, to lay the other one out of line.
+#if defined(__GNUC__) || defined(__clang__)
+    #define CDI_LIKELY(condition) __builtin_expect(!!(condition), 1)
+    #define CDI_UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#else
+    #define CDI_LIKELY(condition) (condition)
+    #define CDI_UNLIKELY(condition) (condition)
+#endif
+
+// stop the program on the spot, in a single instruction where possible.
+#if defined(__GNUC__) || defined(__clang__)
+    #define CDI_TRAP() __builtin_trap()
+#elif defined(_MSC_VER)
+    #include <intrin.h>
+    #define CDI_TRAP() __fastfail(7) // FAST_FAIL_FATAL_APP_EXIT
+#else
+    #include <cstdlib>
+    #define CDI_TRAP() std::abort()
+#endif
+
+//===------------------------------------------------------------------------===
+// sanitizers
+//===------------------------------------------------------------------------===
+
+// 1 when built with ThreadSanitizer. Version validated (seqlock style) readers
+// race with writers by design and throw away what they read when the version
+// moved; TSan cannot tell, so tests running them concurrently skip under it.
+#if defined(__SANITIZE_THREAD__)
+    #define CDI_THREAD_SANITIZER 1
+#elif defined(__has_feature)
+    #if __has_feature(thread_sanitizer)
+        #define CDI_THREAD_SANITIZER 1
+    #endif
+#endif
+#ifndef CDI_THREAD_SANITIZER
+    #define CDI_THREAD_SANITIZER 0
+#endif
+
 #endif // CDI_PORT_PORT_MACRO_HH
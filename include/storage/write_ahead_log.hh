@@ -0,0 +1,170 @@
+//===--- write_ahead_log.hh - Group committed redo log ----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: include/storage/write_ahead_log.hh
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+//===------------------------------------------------------------------------===
+// Durability for containers that live in memory, see container/durable_trie.hh:
+// an append only redo log, and checkpoints that let the log be cut short.
+//
+// Records are opaque payloads numbered by a log sequence number (LSN), framed
+// as
+//   u32 crc32c of the rest | u32 payload size | u64 lsn | payload
+// in the byte order of the machine that wrote them. A crash may tear the last
+// records of a file; reading stops at the first frame that does not check
+// out, which was never acknowledged.
+//
+// Group commit: Append only copies a record into a buffer, Commit waits until
+// it is on disk. The first committer that finds no write in progress leads:
+// it writes everything buffered so far with one write and one fdatasync, and
+// wakes the others. Records appended while a sync runs go with the next one,
+// so under load the cost of a sync is shared by all of them.
+//
+// The log is a series of segment files named after their first LSN. Rotate
+// starts a new segment, Truncate deletes the ones a checkpoint made obsolete.
+// A checkpoint is a file of records in the same framing, written aside and
+// renamed into place, so a directory holds one complete checkpoint or none.
+//
+// I/O errors throw std::system_error, a damaged checkpoint std::runtime_error.
+// After a failed write the log refuses every further Append and Commit.
+//
+// Classes: WriteAheadLog, CheckpointWriter
+//===------------------------------------------------------------------------===
+
+#ifndef CDI_STORAGE_WRITE_AHEAD_LOG_HH
+#define CDI_STORAGE_WRITE_AHEAD_LOG_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace cdi::storage {
+
+/// Log sequence number, 1 for the first record ever, 0 for none.
+using Lsn = std::uint64_t;
+
+class WriteAheadLog {
+public:
+  /// Append to a new segment in dir, which must exist, numbering records from
+  /// `next` on: the LSN after the last one Replay found.
+  /// \param sync whether Commit waits for fdatasync, or for write(2) only. A
+  /// crash of the process loses nothing either way, one of the machine may.
+  WriteAheadLog(std::string dir, Lsn next, bool sync = true);
+
+  /// Writes out what is still buffered.
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  auto
+  operator=(const WriteAheadLog &) -> WriteAheadLog & = delete;
+
+  /// Call visitor(lsn, payload) for every intact record of the segments in
+  /// dir numbered after `after`, in order.
+  /// \return the last LSN found, `after` if there is none.
+  static auto
+  Replay(const std::string &dir,
+         Lsn after,
+         const std::function<void(Lsn, std::string_view)> &visitor) -> Lsn;
+
+  /// Buffer a record, it is not durable before Commit.
+  /// \return its LSN.
+  auto
+  Append(std::string_view payload) -> Lsn;
+
+  /// Block until every record up to lsn is durable.
+  void
+  Commit(Lsn lsn);
+
+  /// the LSN of the last record appended, 0 if none.
+  [[nodiscard]] auto
+  Last() const -> Lsn;
+
+  /// Write out what is buffered and start a new segment.
+  /// \return the last LSN in the older segments.
+  auto
+  Rotate() -> Lsn;
+
+  /// Delete the segments holding no record after upTo, but the current one.
+  void
+  Truncate(Lsn upTo);
+
+  /// fdatasync calls so far: group commit makes them fewer than commits.
+  [[nodiscard]] auto
+  Syncs() const -> std::uint64_t {
+    return syncs_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /// Write out what is buffered, as the only writer. Called and returns with
+  /// latch_ held by lock, which is released meanwhile.
+  void
+  Flush(std::unique_lock<std::mutex> &lock);
+
+  void
+  ThrowIfFailed() const;
+
+  std::string dir_;
+  bool sync_;
+  mutable std::mutex latch_;
+  std::condition_variable flushed_;
+  std::string buffer_; // framed records not written yet.
+  std::string spare_;  // the buffer of the last write, for reuse.
+  Lsn next_;           // handed out by the next Append.
+  Lsn durable_;        // every record up to it is written.
+  bool flushing_ = false;
+  std::error_code failure_;
+  int fd_ = -1;
+  std::vector<Lsn> segments_; // first LSNs, oldest first; the last is open.
+  std::atomic<std::uint64_t> syncs_{0};
+};
+
+/// Writes the checkpoint of a directory, the state after some LSN as a set
+/// of records. Nothing replaces the current checkpoint before Finish.
+class CheckpointWriter {
+public:
+  CheckpointWriter(std::string dir, Lsn lsn);
+
+  /// Abandons the checkpoint unless it is finished.
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  auto
+  operator=(const CheckpointWriter &) -> CheckpointWriter & = delete;
+
+  void
+  Add(std::string_view payload);
+
+  /// Make the checkpoint durable, and the one of the directory.
+  void
+  Finish();
+
+  /// Call visitor(payload) for every record of dir's checkpoint.
+  /// \return the LSN it was taken after, 0 if there is none.
+  static auto
+  Load(const std::string &dir,
+       const std::function<void(std::string_view)> &visitor) -> Lsn;
+
+private:
+  void
+  Write();
+
+  std::string dir_;
+  Lsn lsn_;
+  std::string buffer_;
+  int fd_ = -1;
+};
+
+} // namespace cdi::storage
+
+#endif // CDI_STORAGE_WRITE_AHEAD_LOG_HH
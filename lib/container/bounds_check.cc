@@ -0,0 +1,38 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: lib/container/bounds_check.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/bounds_check.hh"
+#include "debugging/tracer.hh"
+#include <cstdio>
+#include <cstdlib>
+
+namespace cdi::container::detail {
+
+// stdio rather than streams: nothing here allocates, as the failure may be
+// in the middle of an allocator or a broken heap.
+void
+ReportOutOfBounds(const char *container,
+                  std::size_t index,
+                  std::size_t size) noexcept {
+  std::fprintf(stderr,
+               "%s index out of bounds: %zu >= %zu\n",
+               container,
+               index,
+               size);
+  debugging::UnwindOptions opt{};
+  opt.maxDepth = static_cast<int>(debugging::kMaxStackFrames);
+  opt.skipFrames = 1;
+  for (auto *frame : debugging::GetStackFrame(opt)) {
+    std::fprintf(stderr, "  at %p\n", frame);
+  }
+  std::fflush(stderr);
+  std::abort();
+}
+
+} // namespace cdi::container::detail
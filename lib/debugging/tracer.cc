@@ -45,25 +45,26 @@ findFirstEligibleFrame(UnwindOptions opt, int backtraceResult) -> int {
   return opt.skipFrames + 1;
 }
 
-static const int kStackLength = 64;
+static const int kStackLength = kMaxStackFrames;
 
 [[gnu::always_inline]] inline static auto
 AdjustUnwindOpt(UnwindOptions opt, int backtraceResult) -> UnwindOptions {
   opt.skipFrames = findFirstEligibleFrame(opt, backtraceResult);
   auto maxDepthAfterSkip = opt.maxDepth - opt.skipFrames;
-  auto nonNegDepth = std::max(0, maxDepthAfterSkip);
+  // frames past what backtrace() filled in are garbage, never report them.
+  auto framesAfterSkip = backtraceResult - opt.skipFrames;
+  auto nonNegDepth = std::max(0, std::min(maxDepthAfterSkip, framesAfterSkip));
   auto cutoffDepth = std::min(nonNegDepth, kStackLength);
   opt.maxDepth = cutoffDepth;
   return opt;
 }
 
 [[gnu::always_inline]] inline static auto
-UnwindWithoutRecursion(UnwindOptions opt) -> vector<StackFrame> {
+UnwindWithoutRecursion(UnwindOptions opt) -> StackFrames {
   array<void *, kStackLength> stack;
   int size = backtrace(stack.data(), kStackLength);
   opt = AdjustUnwindOpt(opt, size);
-  vector<StackFrame> result;
-  result.reserve(opt.maxDepth);
+  StackFrames result;
   for (int i = 0; i < opt.maxDepth; i++) {
     result.push_back(stack[opt.skipFrames + i]);
   }
@@ -76,7 +77,7 @@ namespace cdi::debugging {
 using namespace detail;
 
 [[maybe_unused]] auto
-GetStackFrame(UnwindOptions opt) noexcept -> vector<StackFrame> {
+GetStackFrame(UnwindOptions opt) noexcept -> StackFrames {
   if (NoTrace()) {
     return {};
   }
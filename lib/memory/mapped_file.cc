@@ -0,0 +1,70 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: lib/memory/mapped_file.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "memory/mapped_file.hh"
+#include "control/finally.hh"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace cdi::memory {
+
+auto
+MappedFile::Open(const std::string &path)
+    -> cdi::constructor::Maybe<MappedFile> {
+  auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return cdi::constructor::none;
+  }
+  // the mapping keeps the file alive.
+  auto closeFd = cdi::control::finally([fd]() { ::close(fd); });
+
+  struct stat status {};
+  if (::fstat(fd, &status) != 0) {
+    return cdi::constructor::none;
+  }
+  auto size = static_cast<std::size_t>(status.st_size);
+  if (size == 0) {
+    return MappedFile(nullptr, 0);
+  }
+  auto *data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    return cdi::constructor::none;
+  }
+  return MappedFile(data, size);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+auto
+MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile & {
+  if (this != &other) {
+    Unmap();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() { Unmap(); }
+
+void
+MappedFile::Unmap() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<void *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+} // namespace cdi::memory
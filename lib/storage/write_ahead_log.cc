@@ -0,0 +1,431 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: lib/storage/write_ahead_log.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "storage/write_ahead_log.hh"
+#include "control/finally.hh"
+#include "memory/mapped_file.hh"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+namespace cdi::storage {
+
+namespace {
+
+/// crc, payload size and lsn.
+constexpr std::size_t kFrameHeader = 16;
+constexpr char kSegmentPrefix[] = "wal.";
+constexpr char kCheckpointName[] = "checkpoint";
+constexpr char kCheckpointTemp[] = "checkpoint.tmp";
+/// the payload of the first record of a checkpoint.
+constexpr std::string_view kCheckpointMagic = "cdi checkpoint 1";
+/// a checkpoint is written out in chunks of this many bytes.
+constexpr std::size_t kCheckpointChunk = std::size_t{1} << 20;
+
+[[noreturn]] void
+ThrowErrno(const std::string &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+auto
+Crc32cTable() -> const std::array<std::uint32_t, 256> & {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t byte = 0; byte < table.size(); ++byte) {
+      auto crc = byte;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ ((crc & 1) != 0 ? 0x82f63b78U : 0);
+      }
+      table[byte] = crc;
+    }
+    return table;
+  }();
+  return table;
+}
+
+/// CRC-32C (Castagnoli), a byte at a time.
+auto
+Crc32c(const char *data, std::size_t size) -> std::uint32_t {
+  const auto &table = Crc32cTable();
+  std::uint32_t crc = ~0U;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ static_cast<std::uint8_t>(data[i])) & 0xff] ^
+          (crc >> 8);
+  }
+  return ~crc;
+}
+
+void
+AppendFrame(std::string &out, Lsn lsn, std::string_view payload) {
+  if (payload.size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error("WriteAheadLog: record larger than 4GiB");
+  }
+  auto start = out.size();
+  auto size = static_cast<std::uint32_t>(payload.size());
+  out.resize(start + kFrameHeader);
+  std::memcpy(&out[start + 4], &size, sizeof(size));
+  std::memcpy(&out[start + 8], &lsn, sizeof(lsn));
+  out.append(payload);
+  auto crc = Crc32c(&out[start + 4], out.size() - start - 4);
+  std::memcpy(&out[start], &crc, sizeof(crc));
+}
+
+/// Call visitor(lsn, payload) for the frames of bytes up to the first one
+/// that does not check out.
+/// \return whether every byte belongs to a good frame.
+template <typename Visitor>
+auto
+ReadFrames(std::string_view bytes, Visitor &&visitor) -> bool {
+  std::size_t pos = 0;
+  while (bytes.size() - pos >= kFrameHeader) {
+    std::uint32_t crc = 0;
+    std::uint32_t size = 0;
+    Lsn lsn = 0;
+    std::memcpy(&crc, bytes.data() + pos, sizeof(crc));
+    std::memcpy(&size, bytes.data() + pos + 4, sizeof(size));
+    std::memcpy(&lsn, bytes.data() + pos + 8, sizeof(lsn));
+    if (bytes.size() - pos - kFrameHeader < size ||
+        Crc32c(bytes.data() + pos + 4, kFrameHeader - 4 + size) != crc) {
+      return false;
+    }
+    visitor(lsn, bytes.substr(pos + kFrameHeader, size));
+    pos += kFrameHeader + size;
+  }
+  return pos == bytes.size();
+}
+
+auto
+Map(const std::string &path) -> cdi::constructor::Maybe<memory::MappedFile> {
+  auto file = memory::MappedFile::Open(path);
+  if (!file && errno != ENOENT) {
+    ThrowErrno("cannot read " + path);
+  }
+  return file;
+}
+
+auto
+Bytes(const memory::MappedFile &file) -> std::string_view {
+  return {static_cast<const char *>(file.Data()), file.Size()};
+}
+
+void
+WriteAll(int fd, std::string_view bytes, const std::string &what) {
+  while (!bytes.empty()) {
+    auto written = ::write(fd, bytes.data(), bytes.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ThrowErrno("cannot write " + what);
+    }
+    bytes.remove_prefix(static_cast<std::size_t>(written));
+  }
+}
+
+/// make the creation, removal or renaming of files in dir durable.
+void
+SyncDirectory(const std::string &dir) {
+  auto fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    ThrowErrno("cannot open " + dir);
+  }
+  auto closeFd = cdi::control::finally([fd]() { ::close(fd); });
+  if (::fsync(fd) != 0) {
+    ThrowErrno("cannot sync " + dir);
+  }
+}
+
+auto
+SegmentPath(const std::string &dir, Lsn first) -> std::string {
+  char name[sizeof(kSegmentPrefix) + 16];
+  std::snprintf(name, sizeof(name), "%s%016" PRIx64, kSegmentPrefix, first);
+  return dir + '/' + name;
+}
+
+/// the segments in dir by first LSN, oldest first.
+auto
+ListSegments(const std::string &dir) -> std::vector<Lsn> {
+  std::vector<Lsn> segments;
+  std::error_code error;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, error)) {
+    auto name = entry.path().filename().string();
+    if (name.size() != sizeof(kSegmentPrefix) - 1 + 16 ||
+        name.compare(0, sizeof(kSegmentPrefix) - 1, kSegmentPrefix) != 0) {
+      continue;
+    }
+    segments.push_back(
+        std::stoull(name.substr(sizeof(kSegmentPrefix) - 1), nullptr, 16));
+  }
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+/// a new, empty segment, replacing a torn one of the same name.
+auto
+CreateSegment(const std::string &dir, Lsn first, bool sync) -> int {
+  auto path = SegmentPath(dir, first);
+  auto fd = ::open(path.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                   0644);
+  if (fd < 0) {
+    ThrowErrno("cannot create " + path);
+  }
+  if (sync) {
+    SyncDirectory(dir);
+  }
+  return fd;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(std::string dir, Lsn next, bool sync)
+    : dir_(std::move(dir)), sync_(sync), next_(std::max<Lsn>(next, 1)),
+      durable_(next_ - 1) {
+  for (auto first : ListSegments(dir_)) {
+    if (first != next_) {
+      segments_.push_back(first);
+    }
+  }
+  fd_ = CreateSegment(dir_, next_, sync_);
+  segments_.push_back(next_);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  try {
+    Commit(Last());
+  } catch (const std::exception &) {
+    // the records were never acknowledged.
+  }
+  ::close(fd_);
+}
+
+auto
+WriteAheadLog::Replay(
+    const std::string &dir,
+    Lsn after,
+    const std::function<void(Lsn, std::string_view)> &visitor) -> Lsn {
+  auto last = after;
+  for (auto first : ListSegments(dir)) {
+    auto file = Map(SegmentPath(dir, first));
+    if (!file) {
+      continue;
+    }
+    // a torn tail ends its segment, not the log: the next run started a new
+    // segment after the last good record.
+    (void)ReadFrames(Bytes(*file), [&](Lsn lsn, std::string_view payload) {
+      if (lsn > last) {
+        last = lsn;
+        visitor(lsn, payload);
+      }
+    });
+  }
+  return last;
+}
+
+auto
+WriteAheadLog::Append(std::string_view payload) -> Lsn {
+  std::lock_guard lock(latch_);
+  ThrowIfFailed();
+  auto lsn = next_++;
+  AppendFrame(buffer_, lsn, payload);
+  return lsn;
+}
+
+void
+WriteAheadLog::Commit(Lsn lsn) {
+  std::unique_lock lock(latch_);
+  lsn = std::min(lsn, next_ - 1);
+  while (durable_ < lsn) {
+    ThrowIfFailed();
+    if (flushing_) {
+      flushed_.wait(lock);
+    } else {
+      Flush(lock);
+    }
+  }
+}
+
+auto
+WriteAheadLog::Last() const -> Lsn {
+  std::lock_guard lock(latch_);
+  return next_ - 1;
+}
+
+auto
+WriteAheadLog::Rotate() -> Lsn {
+  std::unique_lock lock(latch_);
+  while (flushing_) {
+    flushed_.wait(lock);
+  }
+  ThrowIfFailed();
+  Flush(lock);
+  auto last = durable_;
+  if (segments_.back() == last + 1) {
+    return last; // the current segment is still empty.
+  }
+  // appends wait for an open(2), commits find the log written.
+  auto fd = CreateSegment(dir_, last + 1, sync_);
+  ::close(std::exchange(fd_, fd));
+  segments_.push_back(last + 1);
+  return last;
+}
+
+void
+WriteAheadLog::Truncate(Lsn upTo) {
+  std::vector<Lsn> obsolete;
+  {
+    std::lock_guard lock(latch_);
+    // a segment ends where the next one starts.
+    std::size_t keep = 0;
+    while (keep + 1 < segments_.size() && segments_[keep + 1] <= upTo + 1) {
+      ++keep;
+    }
+    obsolete.assign(segments_.begin(), segments_.begin() + keep);
+    segments_.erase(segments_.begin(), segments_.begin() + keep);
+  }
+  for (auto first : obsolete) {
+    auto path = SegmentPath(dir_, first);
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+      ThrowErrno("cannot remove " + path);
+    }
+  }
+}
+
+void
+WriteAheadLog::Flush(std::unique_lock<std::mutex> &lock) {
+  if (buffer_.empty()) {
+    return;
+  }
+  flushing_ = true;
+  auto batch = std::exchange(buffer_, std::move(spare_));
+  buffer_.clear();
+  auto upTo = next_ - 1;
+  lock.unlock();
+
+  std::error_code failure;
+  try {
+    WriteAll(fd_, batch, dir_);
+    if (sync_) {
+      if (::fdatasync(fd_) != 0) {
+        ThrowErrno("cannot sync " + dir_);
+      }
+      syncs_.fetch_add(1, std::memory_order_relaxed);
+    }
+  } catch (const std::system_error &error) {
+    failure = error.code();
+  }
+
+  lock.lock();
+  flushing_ = false;
+  if (failure) {
+    failure_ = failure;
+  } else {
+    durable_ = upTo;
+  }
+  batch.clear();
+  spare_ = std::move(batch);
+  flushed_.notify_all();
+  ThrowIfFailed();
+}
+
+void
+WriteAheadLog::ThrowIfFailed() const {
+  if (failure_) {
+    throw std::system_error(failure_, "WriteAheadLog: an earlier write failed");
+  }
+}
+
+CheckpointWriter::CheckpointWriter(std::string dir, Lsn lsn)
+    : dir_(std::move(dir)), lsn_(lsn) {
+  auto path = dir_ + '/' + kCheckpointTemp;
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    ThrowErrno("cannot create " + path);
+  }
+  AppendFrame(buffer_, lsn_, kCheckpointMagic);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    ::unlink((dir_ + '/' + kCheckpointTemp).c_str());
+  }
+}
+
+void
+CheckpointWriter::Add(std::string_view payload) {
+  AppendFrame(buffer_, lsn_, payload);
+  if (buffer_.size() >= kCheckpointChunk) {
+    Write();
+  }
+}
+
+void
+CheckpointWriter::Finish() {
+  Write();
+  if (::fsync(fd_) != 0) {
+    ThrowErrno("cannot sync the checkpoint of " + dir_);
+  }
+  ::close(std::exchange(fd_, -1));
+  auto temp = dir_ + '/' + kCheckpointTemp;
+  auto path = dir_ + '/' + kCheckpointName;
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    ThrowErrno("cannot rename " + temp);
+  }
+  SyncDirectory(dir_);
+}
+
+auto
+CheckpointWriter::Load(const std::string &dir,
+                       const std::function<void(std::string_view)> &visitor)
+    -> Lsn {
+  auto path = dir + '/' + kCheckpointName;
+  auto file = Map(path);
+  if (!file) {
+    return 0;
+  }
+  Lsn lsn = 0;
+  auto header = true;
+  auto damaged = [&path]() {
+    return std::runtime_error("CheckpointWriter: damaged checkpoint " + path);
+  };
+  auto complete =
+      ReadFrames(Bytes(*file), [&](Lsn at, std::string_view payload) {
+        if (!header) {
+          visitor(payload);
+          return;
+        }
+        if (payload != kCheckpointMagic) {
+          throw damaged();
+        }
+        lsn = at;
+        header = false;
+      });
+  if (!complete || header) {
+    throw damaged();
+  }
+  return lsn;
+}
+
+void
+CheckpointWriter::Write() {
+  WriteAll(fd_, buffer_, "the checkpoint of " + dir_);
+  buffer_.clear();
+}
+
+} // namespace cdi::storage
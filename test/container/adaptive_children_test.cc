@@ -0,0 +1,108 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: test/container/adaptive_children_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/adaptive_children.hh"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace cdi::container;
+
+using Children = AdaptiveChildren<std::unique_ptr<int>>;
+
+static auto
+Keys(const Children &children) -> std::vector<unsigned char> {
+  std::vector<unsigned char> keys;
+  children.ForEach([&keys](char key, const std::unique_ptr<int> &child) {
+    EXPECT_EQ(*child, static_cast<unsigned char>(key));
+    keys.push_back(static_cast<unsigned char>(key));
+  });
+  return keys;
+}
+
+// NOLINTNEXTLINE
+TEST(AdaptiveChildrenTest, GrowThroughAllKinds) {
+  Children children;
+  EXPECT_EQ(children.Kind(), AdaptiveKind::kEmpty);
+  EXPECT_EQ(children.MemoryUsage(), 0U);
+
+  // insert in a scrambled order, both halves of the signed char range.
+  for (int step = 0; step < 256; ++step) {
+    auto byte = (step * 167 + 13) % 256;
+    auto key = static_cast<char>(byte);
+    EXPECT_NE(children.Insert(key, std::make_unique<int>(byte)), nullptr);
+    EXPECT_EQ(children.Insert(key, std::make_unique<int>(byte)), nullptr);
+    auto size = static_cast<std::size_t>(step + 1);
+    EXPECT_EQ(children.Size(), size);
+    if (size <= 4) {
+      EXPECT_EQ(children.Kind(), AdaptiveKind::kNode4);
+    } else if (size <= 16) {
+      EXPECT_EQ(children.Kind(), AdaptiveKind::kNode16);
+    } else if (size <= 48) {
+      EXPECT_EQ(children.Kind(), AdaptiveKind::kNode48);
+    } else {
+      EXPECT_EQ(children.Kind(), AdaptiveKind::kNode256);
+    }
+    auto keys = Keys(children);
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ(keys.size(), size);
+  }
+
+  for (int byte = 0; byte < 256; ++byte) {
+    auto *slot = children.Find(static_cast<char>(byte));
+    ASSERT_NE(slot, nullptr);
+    EXPECT_EQ(**slot, byte);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(AdaptiveChildrenTest, ShrinkBackToEmpty) {
+  Children children;
+  for (int byte = 0; byte < 256; ++byte) {
+    children.Insert(static_cast<char>(byte), std::make_unique<int>(byte));
+  }
+  for (int byte = 255; byte >= 0; --byte) {
+    EXPECT_TRUE(children.Erase(static_cast<char>(byte)));
+    EXPECT_FALSE(children.Erase(static_cast<char>(byte)));
+    EXPECT_EQ(children.Find(static_cast<char>(byte)), nullptr);
+    EXPECT_EQ(children.Size(), static_cast<std::size_t>(byte));
+    auto keys = Keys(children);
+    EXPECT_EQ(keys.size(), static_cast<std::size_t>(byte));
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+  }
+  EXPECT_EQ(children.Kind(), AdaptiveKind::kEmpty);
+  EXPECT_TRUE(children.Empty());
+}
+
+// NOLINTNEXTLINE
+TEST(AdaptiveChildrenTest, SmallFanoutIsSmall) {
+  Children children;
+  children.Insert('a', std::make_unique<int>('a'));
+  EXPECT_EQ(sizeof(Children), sizeof(void *));
+  EXPECT_LE(children.MemoryUsage(), 48U);
+
+  Children moved(std::move(children));
+  EXPECT_TRUE(children.Empty());
+  EXPECT_EQ(**moved.Find('a'), 'a');
+}
+
+// NOLINTNEXTLINE
+TEST(AdaptiveChildrenTest, ForEachStopsEarly) {
+  Children children;
+  for (int byte = 0; byte < 10; ++byte) {
+    children.Insert(static_cast<char>(byte), std::make_unique<int>(byte));
+  }
+  int visited = 0;
+  EXPECT_FALSE(children.ForEach([&visited](char key, std::unique_ptr<int> &) {
+    ++visited;
+    return key < 3;
+  }));
+  EXPECT_EQ(visited, 4);
+}
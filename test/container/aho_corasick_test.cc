@@ -0,0 +1,111 @@
+//===--- aho_corasick_test.cc - Test AhoCorasick ----------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/aho_corasick_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/aho_corasick.hh"
+
+#include "gtest/gtest.h"
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+/// (offset, length, value) of every match.
+using Matches = std::vector<std::tuple<std::size_t, std::size_t, int>>;
+
+auto
+ScanAll(const AhoCorasick<int> &automaton, std::string_view text) -> Matches {
+  Matches found;
+  auto count = automaton.Scan(
+      text, [&found, text](std::string_view match, const int &value) {
+        found.emplace_back(match.data() - text.data(), match.size(), value);
+      });
+  EXPECT_EQ(count, found.size());
+  return found;
+}
+
+/// what Scan reports, by probing every prefix of every suffix of text.
+auto
+BruteForce(const Trie<int> &trie, std::string_view text) -> Matches {
+  Matches found;
+  for (std::size_t end = 1; end <= text.size(); ++end) {
+    for (std::size_t begin = 0; begin < end; ++begin) {
+      if (auto value = trie.LookupMaybe(text.substr(begin, end - begin))) {
+        found.emplace_back(begin, end - begin, *value);
+      }
+    }
+  }
+  return found;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(AhoCorasickTest, Textbook) {
+  Trie<int> trie;
+  int id = 0;
+  for (const char *key : {"he", "she", "his", "hers"}) {
+    EXPECT_TRUE(trie.Insert(key, id++));
+  }
+  auto automaton = AhoCorasick<int>::Compile(trie);
+  EXPECT_EQ(automaton.Size(), 4U);
+  EXPECT_EQ(ScanAll(automaton, "ushers"),
+            (Matches{{1, 3, 1}, {2, 2, 0}, {2, 4, 3}}));
+  EXPECT_EQ(ScanAll(automaton, "ahishers"),
+            (Matches{{1, 3, 2}, {3, 3, 1}, {4, 2, 0}, {4, 4, 3}}));
+  EXPECT_EQ(ScanAll(automaton, "xyz"), Matches{});
+  EXPECT_EQ(ScanAll(automaton, ""), Matches{});
+  EXPECT_TRUE(automaton.Contains("a shell"));
+  EXPECT_FALSE(automaton.Contains("sh h e"));
+
+  // a visitor returning false stops the scan.
+  EXPECT_EQ(automaton.Scan("she hers",
+                           [](std::string_view, const int &) { return false; }),
+            1U);
+
+  auto empty = AhoCorasick<int>::Compile(Trie<int>());
+  EXPECT_EQ(empty.StateCount(), 1U);
+  EXPECT_FALSE(empty.Contains("anything"));
+}
+
+// NOLINTNEXTLINE
+TEST(AhoCorasickTest, MatchesBruteForce) {
+  std::mt19937 random(16);
+  // few and many first bytes (SSE2 compares or the table; SSSE3 nibble
+  // lookups either way, with bytes over 0x7f), few and many states (dense
+  // rows only, and sparse ones behind them).
+  for (auto [alphabet, keys] : {std::pair<int, int>{3, 20},
+                                std::pair<int, int>{4, 2000},
+                                std::pair<int, int>{256, 50},
+                                std::pair<int, int>{256, 3000}}) {
+    auto randomBytes = [&random, alphabet = alphabet](std::size_t length) {
+      std::string bytes(length, '\0');
+      for (auto &byte : bytes) {
+        byte = static_cast<char>(alphabet == 256 ? random() % 256
+                                                 : 'a' + random() % alphabet);
+      }
+      return bytes;
+    };
+    Trie<int> trie;
+    for (int i = 0; i < keys; ++i) {
+      (void)trie.Insert(randomBytes(1 + random() % 6), i);
+    }
+    auto automaton = AhoCorasick<int>::Compile(trie);
+    for (int round = 0; round < 50; ++round) {
+      auto text = randomBytes(random() % 200);
+      EXPECT_EQ(ScanAll(automaton, text), BruteForce(trie, text))
+          << alphabet << " " << keys;
+    }
+  }
+}
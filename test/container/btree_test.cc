@@ -0,0 +1,189 @@
+//===--- btree_test.cc - Test btree_set and btree_map -----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/btree_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/set.hh"
+
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+/// counts the live instances, to catch values leaked or destroyed twice.
+struct Counted {
+  explicit Counted(int value) : value(value) { ++live; }
+  Counted(const Counted &other) : value(other.value) { ++live; }
+  Counted(Counted &&other) noexcept : value(other.value) { ++live; }
+  auto
+  operator=(const Counted &) -> Counted & = default;
+  ~Counted() { --live; }
+
+  int value;
+  static inline int live = 0;
+};
+
+template <typename K, typename Make>
+void
+MatchStdSet(Make &&make) {
+  std::mt19937 random(42);
+  for (int range : {10, 300, 20000}) {
+    set<K> tree;
+    std::set<K> expected;
+    for (int i = 0; i < 60000; ++i) {
+      auto key = make(static_cast<int>(random() % range));
+      switch (random() % 6) {
+      case 0:
+      case 1:
+        EXPECT_EQ(tree.insert(key).second, expected.insert(key).second);
+        break;
+      case 2:
+        EXPECT_EQ(tree.erase(key), expected.erase(key));
+        break;
+      case 3: {
+        auto bound = tree.lower_bound(key);
+        auto wanted = expected.lower_bound(key);
+        ASSERT_EQ(bound == tree.end(), wanted == expected.end());
+        if (bound != tree.end()) {
+          EXPECT_EQ(*bound, *wanted);
+        }
+        break;
+      }
+      case 4: {
+        auto bound = tree.upper_bound(key);
+        auto wanted = expected.upper_bound(key);
+        ASSERT_EQ(bound == tree.end(), wanted == expected.end());
+        if (bound != tree.end()) {
+          EXPECT_EQ(*bound, *wanted);
+        }
+        break;
+      }
+      default:
+        EXPECT_EQ(tree.contains(key), expected.count(key) == 1);
+      }
+      ASSERT_EQ(tree.size(), expected.size());
+    }
+    EXPECT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin()));
+    EXPECT_TRUE(std::equal(tree.rbegin(), tree.rend(), expected.rbegin()));
+  }
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, MatchesStdSet) {
+  MatchStdSet<int>([](int key) { return key - 5000; });
+  MatchStdSet<unsigned>([](int key) { return 0x7ffffff0U + key; });
+  MatchStdSet<double>([](int key) { return key / 4.0; });
+  MatchStdSet<std::int64_t>([](int key) { return std::int64_t{key} << 40; });
+  MatchStdSet<std::string>([](int key) { return std::to_string(key); });
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, MatchesStdMap) {
+  {
+    std::mt19937 random(7);
+    btree_map<std::string, Counted> map;
+    std::map<std::string, int> expected;
+    for (int i = 0; i < 40000; ++i) {
+      auto key = std::to_string(random() % 3000);
+      switch (random() % 4) {
+      case 0:
+        EXPECT_EQ(map.try_emplace(key, i).second,
+                  expected.try_emplace(key, i).second);
+        break;
+      case 1:
+        EXPECT_EQ(map.insert_or_assign(key, Counted(i)).second,
+                  expected.insert_or_assign(key, i).second);
+        break;
+      case 2:
+        EXPECT_EQ(map.erase(key), expected.erase(key));
+        break;
+      default: {
+        auto found = map.find(key);
+        auto wanted = expected.find(key);
+        ASSERT_EQ(found == map.end(), wanted == expected.end());
+        if (found != map.end()) {
+          EXPECT_EQ(found->second.value, wanted->second);
+        }
+      }
+      }
+      ASSERT_EQ(map.size(), expected.size());
+      ASSERT_EQ(Counted::live, static_cast<int>(expected.size()));
+    }
+    auto wanted = expected.begin();
+    for (const auto &[key, value] : map) {
+      EXPECT_EQ(key, wanted->first);
+      EXPECT_EQ(value.value, wanted->second);
+      ++wanted;
+    }
+    auto copy = map;
+    EXPECT_EQ(Counted::live, 2 * static_cast<int>(expected.size()));
+    // erase every other value, the iterator from erase walking on.
+    bool drop = true;
+    for (auto iter = copy.begin(); iter != copy.end(); drop = !drop) {
+      iter = drop ? copy.erase(iter) : std::next(iter);
+    }
+    EXPECT_EQ(copy.size(), expected.size() / 2);
+    EXPECT_EQ(std::next(map.begin())->first, copy.begin()->first);
+  }
+  EXPECT_EQ(Counted::live, 0);
+
+  btree_map<int, std::unique_ptr<int>> owners;
+  owners[3] = std::make_unique<int>(3);
+  owners.emplace(1, std::make_unique<int>(1));
+  EXPECT_EQ(*owners.at(1), 1);
+  EXPECT_EQ(owners[2], nullptr);
+  EXPECT_THROW((void)owners.at(4), std::out_of_range);
+  EXPECT_EQ(owners.begin()->first, 1);
+  EXPECT_EQ(std::prev(owners.end())->first, 3);
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, NodesFillAndEmpty) {
+  constexpr static int kKeys = 100000;
+  set<int> ascending;
+  set<int> shuffled;
+  std::vector<int> keys(kKeys);
+  for (int i = 0; i < kKeys; ++i) {
+    keys[i] = i;
+    EXPECT_TRUE(ascending.insert(i).second);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  shuffled.insert(keys.begin(), keys.end());
+  EXPECT_EQ(ascending, shuffled);
+  // appending fills the nodes: what is left is their headers.
+  EXPECT_LE(ascending.bytes_used(), kKeys * sizeof(int) * 5 / 4);
+  EXPECT_LT(ascending.bytes_used(), shuffled.bytes_used());
+  EXPECT_LE(ascending.height(), 4U);
+
+  auto first = shuffled.lower_bound(100);
+  auto last = shuffled.lower_bound(kKeys - 100);
+  auto after = shuffled.erase(first, last);
+  EXPECT_EQ(*after, kKeys - 100);
+  EXPECT_EQ(shuffled.size(), 200U);
+  EXPECT_EQ(*std::prev(after), 99);
+  for (auto key : keys) {
+    (void)shuffled.erase(key);
+  }
+  EXPECT_TRUE(shuffled.empty());
+  EXPECT_EQ(shuffled.begin(), shuffled.end());
+  EXPECT_EQ(shuffled.height(), 1U);
+  auto none = ascending.erase(ascending.begin(), ascending.end());
+  EXPECT_EQ(none, ascending.end());
+  EXPECT_EQ(ascending.bytes_used(), 0U);
+  EXPECT_EQ(ascending.find(1), ascending.end());
+}
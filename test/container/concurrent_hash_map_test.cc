@@ -0,0 +1,101 @@
+//===--- concurrent_hash_map_test.cc - Test concurrent_hash_map -*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/concurrent_hash_map_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/concurrent_hash_map.hh"
+
+#include "gtest/gtest.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(ConcurrentHashMapTest, SingleThreaded) {
+  concurrent_hash_map<std::string, int> map(3);
+  EXPECT_EQ(map.ShardCount(), 4U);
+  EXPECT_TRUE(map.insert("a", 1));
+  EXPECT_FALSE(map.insert("a", 2));
+  EXPECT_FALSE(map.insert_or_assign("a", 3));
+  EXPECT_TRUE(map.insert_or_assign("b", 4));
+  EXPECT_EQ(map.find("a").value_or(-1), 3);
+  EXPECT_FALSE(map.find("c").has_value());
+  EXPECT_TRUE(map.update("b", [](int &value) { ++value; }));
+  EXPECT_FALSE(map.update("c", [](int &value) { ++value; }));
+  EXPECT_TRUE(map.visit("b", [](const int &value) { EXPECT_EQ(value, 5); }));
+  EXPECT_FALSE(map.erase_if("b", [](const int &value) { return value < 5; }));
+  EXPECT_TRUE(map.erase_if("b", [](const int &value) { return value == 5; }));
+  EXPECT_FALSE(map.contains("b"));
+  EXPECT_FALSE(map.erase("b"));
+
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(map.insert(std::to_string(i), i));
+  }
+  EXPECT_EQ(map.size(), 1001U);
+  EXPECT_EQ(map.erase_if([](const std::string &, int value) {
+    return value % 2 == 0;
+  }),
+            500U);
+  std::map<std::string, int> left;
+  map.for_each([&left](const std::string &key, int value) {
+    left.emplace(key, value);
+  });
+  EXPECT_EQ(left.size(), 501U);
+  EXPECT_EQ(left["a"], 3);
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+// NOLINTNEXTLINE
+TEST(ConcurrentHashMapTest, ConcurrentWritersAndReaders) {
+  constexpr static int kThreads = 4;
+  constexpr static int kKeys = 20000;
+  concurrent_hash_map<int, int> map(8);
+  std::atomic<bool> done{false};
+  std::thread reader([&map, &done]() {
+    // a key is inserted with its own value, and only ever bumped by whole
+    // multiples of kKeys.
+    while (!done.load()) {
+      for (int key = 0; key < kThreads * kKeys; key += 97) {
+        if (auto value = map.find(key)) {
+          EXPECT_EQ(*value % kKeys, key % kKeys);
+        }
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    writers.emplace_back([&map, thread]() {
+      for (int i = 0; i < kKeys; ++i) {
+        auto key = thread * kKeys + i;
+        EXPECT_TRUE(map.insert(key, i));
+      }
+      for (int i = 0; i < kKeys; ++i) {
+        auto key = thread * kKeys + i;
+        EXPECT_TRUE(map.update(key, [](int &value) { value += kKeys; }));
+        if (i % 2 == 0) {
+          EXPECT_TRUE(map.erase(key));
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(map.size(), static_cast<std::size_t>(kThreads * kKeys / 2));
+  map.for_each([](int key, int value) {
+    EXPECT_EQ(key % 2, 1);
+    EXPECT_EQ(value, key % kKeys + kKeys);
+  });
+}
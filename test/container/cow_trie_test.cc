@@ -0,0 +1,117 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: test/container/cow_trie_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/cow_trie.hh"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(CowTrieTest, InsertLookupRemove) {
+  CowTrie<int> trie;
+  EXPECT_TRUE(trie.Insert("foo", 1));
+  EXPECT_FALSE(trie.Insert("foo", 2));
+  EXPECT_TRUE(trie.Insert("foobar", 3));
+  EXPECT_TRUE(trie.Insert("bar", 4));
+  EXPECT_FALSE(trie.Insert("", 5));
+
+  EXPECT_EQ(trie.LookupMaybe("foo").value_or(0), 1);
+  EXPECT_EQ(trie.LookupMaybe("foobar").value_or(0), 3);
+  EXPECT_EQ(trie.LookupMaybe("bar").value_or(0), 4);
+  EXPECT_FALSE(trie.LookupMaybe("foob"));
+  EXPECT_FALSE(trie.LookupMaybe("baz"));
+
+  EXPECT_TRUE(trie.Remove("foo"));
+  EXPECT_FALSE(trie.Remove("foo"));
+  EXPECT_FALSE(trie.LookupMaybe("foo"));
+  EXPECT_EQ(trie.LookupMaybe("foobar").value_or(0), 3);
+  EXPECT_TRUE(trie.Remove("foobar"));
+  EXPECT_FALSE(trie.Remove("fo"));
+  EXPECT_TRUE(trie.Insert("foo", 6));
+  EXPECT_EQ(trie.LookupMaybe("foo").value_or(0), 6);
+}
+
+// NOLINTNEXTLINE
+TEST(CowTrieTest, VisitDoesNotCopy) {
+  CowTrie<std::vector<int>> trie;
+  EXPECT_TRUE(trie.Insert("big", std::vector<int>(1024, 7)));
+  const std::vector<int> *seen = nullptr;
+  EXPECT_TRUE(trie.Visit("big", [&](const std::vector<int> &value) {
+    seen = &value;
+    EXPECT_EQ(value.size(), 1024U);
+  }));
+  const std::vector<int> *again = nullptr;
+  EXPECT_TRUE(trie.Visit(
+      "big", [&](const std::vector<int> &value) { again = &value; }));
+  EXPECT_EQ(seen, again);
+  EXPECT_FALSE(trie.Visit("bi", [](const std::vector<int> &) {}));
+}
+
+// NOLINTNEXTLINE
+TEST(CowTrieTest, ReclaimOldVersions) {
+  CowTrie<int> trie;
+  for (int index = 0; index < 100; ++index) {
+    EXPECT_TRUE(trie.Insert("key" + std::to_string(index), index));
+  }
+  trie.Collect();
+  EXPECT_EQ(trie.PendingReclaim(), 0U);
+
+  {
+    // a reader in flight holds every version replaced after it pinned.
+    cdi::concurrency::EpochGuard reader;
+    EXPECT_TRUE(trie.Remove("key1"));
+    trie.Collect();
+    EXPECT_GT(trie.PendingReclaim(), 0U);
+  }
+  trie.Collect();
+  EXPECT_EQ(trie.PendingReclaim(), 0U);
+}
+
+// NOLINTNEXTLINE
+TEST(CowTrieTest, ReadersRaceWriters) {
+  constexpr static int kReaders = 6;
+  constexpr static int kKeys = 3000;
+  CowTrie<std::string> trie;
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> readers;
+  for (int reader = 0; reader < kReaders; ++reader) {
+    readers.emplace_back([&]() {
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int index = 0; index < kKeys; index += 97) {
+          auto key = std::to_string(index);
+          auto value = trie.LookupMaybe(key);
+          if (value) {
+            EXPECT_EQ(*value, key);
+          }
+        }
+      }
+    });
+  }
+
+  for (int index = 0; index < kKeys; ++index) {
+    EXPECT_TRUE(trie.Insert(std::to_string(index), std::to_string(index)));
+  }
+  for (int index = 0; index < kKeys; index += 2) {
+    EXPECT_TRUE(trie.Remove(std::to_string(index)));
+  }
+  done.store(true);
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  for (int index = 0; index < kKeys; ++index) {
+    EXPECT_EQ(trie.LookupMaybe(std::to_string(index)).has_value(),
+              index % 2 == 1);
+  }
+}
@@ -0,0 +1,172 @@
+//===--- durable_trie_test.cc - Test DurableTrie ----------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/durable_trie_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/durable_trie.hh"
+
+#include "gtest/gtest.h"
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+auto
+FreshDir(const std::string &name) -> std::string {
+  auto dir = testing::TempDir() + "durable_trie_test." + name;
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+template <typename Trie>
+auto
+Contents(const Trie &trie) -> std::map<std::string, int> {
+  std::map<std::string, int> contents;
+  (void)trie.ScanPrefix("", [&contents](std::string_view key, int value) {
+    contents.emplace(key, value);
+  });
+  return contents;
+}
+
+auto
+SegmentCount(const std::string &dir) -> std::size_t {
+  std::size_t segments = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    segments += entry.path().filename().string().rfind("wal.", 0) == 0;
+  }
+  return segments;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(DurableTrieTest, RecoversFromLog) {
+  auto dir = FreshDir("log");
+  std::map<std::string, int> expected;
+  cdi::storage::Lsn last = 0;
+  {
+    DurableTrie<int> trie(dir, {false});
+    std::mt19937 random(42);
+    for (int i = 0; i < 2000; ++i) {
+      auto key = std::to_string(random() % 500);
+      switch (random() % 4) {
+      case 0:
+        EXPECT_EQ(trie.Insert(key, i), expected.emplace(key, i).second);
+        break;
+      case 1:
+        EXPECT_EQ(trie.Upsert(key, i), expected.count(key) == 0);
+        expected[key] = i;
+        break;
+      case 2:
+        EXPECT_EQ(trie.Update(key, [](int &value) { value = -value; }),
+                  expected.count(key) == 1);
+        if (expected.count(key) == 1) {
+          expected[key] = -expected[key];
+        }
+        break;
+      default:
+        EXPECT_EQ(trie.Remove(key), expected.erase(key) == 1);
+      }
+    }
+    EXPECT_FALSE(trie.Remove("no such key"));
+    EXPECT_EQ(Contents(trie.Get()), expected);
+    last = trie.LastLsn();
+  }
+  DurableTrie<int> recovered(dir, {false});
+  EXPECT_EQ(Contents(recovered.Get()), expected);
+  EXPECT_EQ(recovered.LastLsn(), last);
+}
+
+// NOLINTNEXTLINE
+TEST(DurableTrieTest, RecoversFromCheckpointAndTail) {
+  auto dir = FreshDir("checkpoint");
+  {
+    DurableTrie<int> trie(dir, {false});
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(trie.Insert("key/" + std::to_string(i), i));
+    }
+    EXPECT_EQ(trie.Checkpoint(), 1000U);
+    EXPECT_EQ(SegmentCount(dir), 1U);
+    for (int i = 0; i < 1000; i += 2) {
+      EXPECT_TRUE(trie.Remove("key/" + std::to_string(i)));
+    }
+    EXPECT_FALSE(trie.Upsert("key/1", -1));
+    EXPECT_TRUE(trie.Insert("tail", 7));
+  }
+  {
+    DurableTrie<int> trie(dir, {false});
+    auto contents = Contents(trie.Get());
+    EXPECT_EQ(contents.size(), 501U);
+    EXPECT_EQ(contents["key/1"], -1);
+    EXPECT_EQ(contents["key/999"], 999);
+    EXPECT_EQ(contents.count("key/0"), 0U);
+    EXPECT_EQ(contents["tail"], 7);
+    EXPECT_EQ(trie.LastLsn(), 1502U);
+    // a checkpoint with nothing new is not written.
+    EXPECT_EQ(trie.Checkpoint(), 1502U);
+    EXPECT_EQ(trie.Checkpoint(), 1502U);
+  }
+  // nothing left in the log to replay.
+  EXPECT_EQ(cdi::storage::WriteAheadLog::Replay(
+                dir, 1502, [](cdi::storage::Lsn, std::string_view) {
+                  FAIL();
+                }),
+            1502U);
+  DurableTrie<int> trie(dir, {false});
+  EXPECT_EQ(Contents(trie.Get()).size(), 501U);
+}
+
+// NOLINTNEXTLINE
+TEST(DurableTrieTest, CheckpointsWhileWriting) {
+  constexpr static int kThreads = 4;
+  constexpr static int kKeys = 3000;
+  auto dir = FreshDir("background");
+  {
+    DurableTrie<int> trie(dir, {false, std::chrono::milliseconds(1)});
+    std::vector<std::thread> writers;
+    for (int thread = 0; thread < kThreads; ++thread) {
+      writers.emplace_back([&trie, thread]() {
+        for (int i = 0; i < kKeys; ++i) {
+          auto key = std::to_string(thread) + "/" + std::to_string(i);
+          EXPECT_TRUE(trie.Insert(key, i));
+          if (i % 3 == 0) {
+            EXPECT_FALSE(trie.Upsert(key, -i));
+          }
+        }
+        for (int i = 0; i < kKeys; i += 2) {
+          EXPECT_TRUE(
+              trie.Remove(std::to_string(thread) + "/" + std::to_string(i)));
+        }
+      });
+    }
+    std::thread checkpointer([&trie]() {
+      for (int i = 0; i < 20; ++i) {
+        (void)trie.Checkpoint();
+      }
+    });
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    checkpointer.join();
+  }
+  DurableTrie<int> trie(dir);
+  auto contents = Contents(trie.Get());
+  EXPECT_EQ(contents.size(), static_cast<std::size_t>(kThreads * kKeys / 2));
+  for (auto &[key, value] : contents) {
+    auto i = std::stoi(key.substr(key.find('/') + 1));
+    EXPECT_EQ(i % 2, 1);
+    EXPECT_EQ(value, i % 3 == 0 ? -i : i);
+  }
+}
@@ -0,0 +1,189 @@
+//===--- flat_hash_map_test.cc - Test flat_hash_map -------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/flat_hash_map_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/unordered_map.hh"
+
+#include "gtest/gtest.h"
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+template <typename Map>
+auto
+Sorted(const Map &map) -> std::map<typename Map::key_type,
+                                   typename Map::mapped_type> {
+  return {map.begin(), map.end()};
+}
+
+struct StringHash {
+  using is_transparent = void;
+
+  auto
+  operator()(std::string_view key) const -> std::size_t {
+    return std::hash<std::string_view>()(key);
+  }
+};
+
+/// counts the live instances, to catch values leaked or destroyed twice.
+struct Counted {
+  explicit Counted(int value) : value(value) { ++live; }
+  Counted(const Counted &other) : value(other.value) { ++live; }
+  Counted(Counted &&other) noexcept : value(other.value) { ++live; }
+  auto
+  operator=(const Counted &) -> Counted & = default;
+  ~Counted() { --live; }
+
+  int value;
+  static inline int live = 0;
+};
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapTest, MatchesStdUnorderedMap) {
+  std::mt19937 random(42);
+  for (int range : {8, 100, 5000}) {
+    unordered_map<int, int> map;
+    std::unordered_map<int, int> expected;
+    for (int i = 0; i < 50000; ++i) {
+      auto key = static_cast<int>(random() % range);
+      switch (random() % 5) {
+      case 0:
+        EXPECT_EQ(map.insert({key, i}).second,
+                  expected.insert({key, i}).second);
+        break;
+      case 1:
+        map[key] = i;
+        expected[key] = i;
+        break;
+      case 2:
+      case 3:
+        EXPECT_EQ(map.erase(key), expected.erase(key));
+        break;
+      default: {
+        auto found = map.find(key);
+        auto wanted = expected.find(key);
+        ASSERT_EQ(found == map.end(), wanted == expected.end());
+        if (found != map.end()) {
+          EXPECT_EQ(found->second, wanted->second);
+        }
+      }
+      }
+      ASSERT_EQ(map.size(), expected.size());
+    }
+    EXPECT_EQ(Sorted(map), Sorted(expected));
+    EXPECT_LE(map.load_factor(), map.max_load_factor());
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapTest, TombstonesDoNotGrowTheTable) {
+  unordered_map<int, int> map;
+  map.reserve(1000);
+  auto capacity = map.bucket_count();
+  // a sliding window of keys: every insert a fresh key, every erase leaves
+  // a slot that probes may have passed.
+  for (int i = 0; i < 200000; ++i) {
+    map[i] = i;
+    if (i >= 500) {
+      EXPECT_EQ(map.erase(i - 500), 1U);
+    }
+  }
+  EXPECT_EQ(map.size(), 500U);
+  EXPECT_EQ(map.bucket_count(), capacity);
+  for (int i = 200000 - 500; i < 200000; ++i) {
+    EXPECT_EQ(map.at(i), i);
+  }
+  EXPECT_FALSE(map.contains(0));
+  EXPECT_THROW((void)map.at(0), std::out_of_range);
+}
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapTest, HeterogeneousLookup) {
+  flat_hash_map<std::string, int, StringHash, std::equal_to<>> map;
+  map.try_emplace("apple", 1);
+  map.try_emplace(std::string(100, 'x'), 2);
+  std::string_view apple = "apple";
+  EXPECT_EQ(map.find(apple)->second, 1);
+  EXPECT_TRUE(map.contains(std::string_view(std::string(100, 'x'))));
+  EXPECT_EQ(map.count("pear"), 0U);
+  EXPECT_EQ(map.erase(apple), 1U);
+  EXPECT_EQ(map.size(), 1U);
+  // erase by iterator still picks the iterator overload.
+  map.erase(map.begin());
+  EXPECT_TRUE(map.empty());
+}
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapTest, ValuesAreConstructedAndDestroyedOnce) {
+  {
+    unordered_map<int, Counted> map;
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(map.try_emplace(i, i).second);
+      EXPECT_FALSE(map.try_emplace(i, -1).second);
+    }
+    EXPECT_EQ(Counted::live, 1000);
+    for (int i = 0; i < 1000; i += 2) {
+      EXPECT_EQ(map.erase(i), 1U);
+    }
+    EXPECT_EQ(Counted::live, 500);
+    auto copy = map;
+    EXPECT_EQ(Counted::live, 1000);
+    EXPECT_EQ(copy.at(1).value, 1);
+    auto moved = std::move(copy);
+    EXPECT_EQ(Counted::live, 1000);
+    moved.clear();
+    EXPECT_EQ(Counted::live, 500);
+    for (auto iter = map.begin(); iter != map.end();) {
+      iter = iter->second.value % 4 == 1 ? map.erase(iter) : std::next(iter);
+    }
+    EXPECT_EQ(map.size(), 250U);
+    EXPECT_EQ(Counted::live, 250);
+  }
+  EXPECT_EQ(Counted::live, 0);
+
+  unordered_map<std::string, std::unique_ptr<int>> owners;
+  owners.insert_or_assign("a", std::make_unique<int>(1));
+  owners.insert_or_assign("a", std::make_unique<int>(2));
+  owners.emplace("b", std::make_unique<int>(3));
+  EXPECT_EQ(*owners["a"], 2);
+  EXPECT_EQ(*owners.at("b"), 3);
+  EXPECT_EQ(owners["c"], nullptr);
+  EXPECT_EQ(owners.size(), 3U);
+}
+
+// NOLINTNEXTLINE
+TEST(FlatHashMapTest, CopyCompareAndRehash) {
+  unordered_map<std::string, int> map{{"one", 1}, {"two", 2}, {"three", 3}};
+  auto copy = map;
+  EXPECT_EQ(copy, map);
+  copy["two"] = 22;
+  EXPECT_NE(copy, map);
+  map.rehash(1000);
+  EXPECT_GE(map.bucket_count(), 1000U);
+  EXPECT_EQ(map.at("three"), 3);
+  map.rehash(0);
+  EXPECT_LT(map.bucket_count(), 1000U);
+  EXPECT_EQ(Sorted(map),
+            (std::map<std::string, int>{{"one", 1}, {"three", 3}, {"two", 2}}));
+  map.clear();
+  map.rehash(0);
+  EXPECT_EQ(map.bucket_count(), 0U);
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_EQ(map.find("one"), map.end());
+}
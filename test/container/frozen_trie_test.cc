@@ -0,0 +1,126 @@
+//===--- frozen_trie_test.cc - Test FrozenTrie ------------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/frozen_trie_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/frozen_trie.hh"
+#include "memory/mapped_file.hh"
+
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+/// an image copied into 8 byte aligned memory.
+auto
+Aligned(const std::string &image) -> std::vector<std::uint64_t> {
+  std::vector<std::uint64_t> words((image.size() + 7) / 8);
+  std::memcpy(words.data(), image.data(), image.size());
+  return words;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(FrozenTrieTest, MatchesTrie) {
+  Trie<int> trie;
+  std::map<std::string, int> expected;
+  std::mt19937 random(5);
+  auto randomKey = [&random]() {
+    std::string key(1 + random() % 12, 'a');
+    for (auto &keychar : key) {
+      // the whole byte range, the order is unsigned.
+      keychar = static_cast<char>(random() % 4 == 0 ? random() % 256
+                                                    : 'a' + random() % 4);
+    }
+    return key;
+  };
+  for (int i = 0; i < 20000; ++i) {
+    auto key = randomKey();
+    if (trie.Insert(key, i)) {
+      expected.emplace(key, i);
+    }
+  }
+
+  std::stringstream out;
+  FrozenTrie<int>::Freeze(trie, out);
+  auto image = out.str();
+  auto words = Aligned(image);
+  auto frozen = FrozenTrie<int>::View(words.data(), image.size());
+  ASSERT_TRUE(frozen.has_value());
+  EXPECT_EQ(frozen->Size(), expected.size());
+
+  for (auto &[key, value] : expected) {
+    EXPECT_EQ(frozen->LookupMaybe(key).value_or(-1), value);
+  }
+  for (int i = 0; i < 20000; ++i) {
+    auto key = randomKey();
+    auto found = expected.find(key);
+    EXPECT_EQ(frozen->LookupMaybe(key).value_or(-1),
+              found == expected.end() ? -1 : found->second);
+    // a strict prefix of a key is no key.
+    EXPECT_EQ(frozen->Find(key.substr(0, key.size() / 2)) != nullptr,
+              expected.count(key.substr(0, key.size() / 2)) == 1);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(FrozenTrieTest, MappedFile) {
+  Trie<double> trie;
+  EXPECT_TRUE(trie.Insert("pi", 3.14));
+  EXPECT_TRUE(trie.Insert("e", 2.71));
+  EXPECT_TRUE(trie.Insert("phi", 1.61));
+  auto path = testing::TempDir() + "frozen_trie_test.louds";
+  {
+    std::ofstream file(path, std::ios::binary);
+    FrozenTrie<double>::Freeze(trie, file);
+  }
+
+  auto file = cdi::memory::MappedFile::Open(path);
+  ASSERT_TRUE(file.has_value());
+  auto frozen = FrozenTrie<double>::View(file->Data(), file->Size());
+  ASSERT_TRUE(frozen.has_value());
+  // the value is read in place, from the mapping.
+  const auto *pi = frozen->Find("pi");
+  ASSERT_NE(pi, nullptr);
+  EXPECT_EQ(*pi, 3.14);
+  EXPECT_GE(reinterpret_cast<const char *>(pi),
+            static_cast<const char *>(file->Data()));
+  EXPECT_EQ(frozen->LookupMaybe("phi").value_or(0), 1.61);
+  EXPECT_EQ(frozen->Find("p"), nullptr);
+  EXPECT_EQ(frozen->Find("pie"), nullptr);
+  std::remove(path.c_str());
+
+  EXPECT_FALSE(cdi::memory::MappedFile::Open(path).has_value());
+}
+
+// NOLINTNEXTLINE
+TEST(FrozenTrieTest, RejectsOtherImages) {
+  std::stringstream out;
+  FrozenTrie<int>::Freeze(std::vector<std::pair<std::string, int>>{}, out);
+  auto image = out.str();
+  auto words = Aligned(image);
+  auto empty = FrozenTrie<int>::View(words.data(), image.size());
+  ASSERT_TRUE(empty.has_value());
+  EXPECT_EQ(empty->Size(), 0U);
+  EXPECT_EQ(empty->Find("a"), nullptr);
+
+  // another value type, a truncated image, garbage.
+  EXPECT_FALSE(FrozenTrie<double>::View(words.data(), image.size()));
+  EXPECT_FALSE(FrozenTrie<int>::View(words.data(), image.size() - 8));
+  words[0] = 0;
+  EXPECT_FALSE(FrozenTrie<int>::View(words.data(), image.size()));
+}
@@ -0,0 +1,159 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: test/container/sharded_trie_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/sharded_trie.hh"
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cdi::container;
+
+namespace {
+
+auto
+RandomKey(std::mt19937 &random) -> std::string {
+  std::string key(1 + random() % 6, 'a');
+  for (auto &keychar : key) {
+    keychar = static_cast<char>("abz\x01\xff"[random() % 5]);
+  }
+  return key;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(ShardedTrieTest, MatchesOrderedMap) {
+  for (auto sharding : {TrieSharding::kLeadingByte, TrieSharding::kHash}) {
+    ShardedTrie<int> trie(5, sharding);
+    EXPECT_EQ(trie.ShardCount(), 5U);
+    std::map<std::string, int> expected;
+    std::mt19937 random(1);
+    for (int round = 0; round < 5000; ++round) {
+      auto key = RandomKey(random);
+      if (random() % 3 == 0) {
+        trie.Remove(key);
+        expected.erase(key);
+      } else {
+        EXPECT_EQ(trie.Insert(key, round), expected.emplace(key, round).second);
+      }
+    }
+    for (auto &[key, value] : expected) {
+      EXPECT_EQ(trie.LookupMaybe(key).value_or(-1), value);
+    }
+
+    // scans come out in key order across shards.
+    for (std::string prefix : {"", "a", "z", "\xff", "ab"}) {
+      std::vector<std::pair<std::string, int>> scanned;
+      (void)trie.ScanPrefix(prefix, [&scanned](std::string_view key, int v) {
+        scanned.emplace_back(key, v);
+      });
+      std::vector<std::pair<std::string, int>> want;
+      for (auto &entry : expected) {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0) {
+          want.push_back(entry);
+        }
+      }
+      EXPECT_EQ(scanned, want) << prefix;
+    }
+    for (auto [lo, hi] : std::vector<std::pair<std::string, std::string>>{
+             {"", "\xff\xff"}, {"a", "b"}, {"ab", "z"}, {"b", "za"},
+             {"z", "z"}, {"\x01", "a"}}) {
+      std::vector<std::string> scanned;
+      auto visited = trie.ScanRange(
+          lo, hi, [&scanned](std::string_view key, int) {
+            scanned.emplace_back(key);
+            return scanned.size() < 50;
+          });
+      std::vector<std::string> want;
+      for (auto &entry : expected) {
+        if (entry.first.compare(lo) >= 0 && entry.first < hi &&
+            want.size() < 50) {
+          want.push_back(entry.first);
+        }
+      }
+      EXPECT_EQ(scanned, want) << lo << " " << hi;
+      EXPECT_EQ(visited, want.size());
+    }
+    EXPECT_EQ(trie.ScanPrefix("", [](std::string_view, int) {}, 7), 7U);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(ShardedTrieTest, LongestPrefixAndBulkLoad) {
+  for (auto sharding : {TrieSharding::kLeadingByte, TrieSharding::kHash}) {
+    ShardedTrie<std::string> routes(4, sharding, TrieReadMode::kOptimistic);
+    EXPECT_EQ(routes.BulkLoad({{"/", "root"},
+                               {"/api", "api"},
+                               {"/api/v1", "v1"},
+                               {"images/", "images"},
+                               {"/api", "duplicate"}}),
+              4U);
+    auto found = routes.LongestPrefix("/api/v1/users");
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->first, "/api/v1");
+    EXPECT_EQ(found->second, "v1");
+    EXPECT_EQ(routes.LongestPrefix("/static")->second, "root");
+    EXPECT_EQ(routes.LongestPrefix("images/a.png")->second, "images");
+    EXPECT_FALSE(routes.LongestPrefix("video").has_value());
+    EXPECT_EQ(routes.LookupMaybe("/api").value_or(""), "api");
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(ShardedTrieTest, ConcurrentWriters) {
+  constexpr static int kThreads = 4;
+  constexpr static int kKeys = 5000;
+  ShardedTrie<int> trie(8, TrieSharding::kHash);
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&trie, thread]() {
+      for (int i = 0; i < kKeys; ++i) {
+        EXPECT_TRUE(
+            trie.Insert(std::to_string(i) + "/" + std::to_string(thread), i));
+      }
+      for (int i = 0; i < kKeys; i += 2) {
+        EXPECT_TRUE(
+            trie.Remove(std::to_string(i) + "/" + std::to_string(thread)));
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  EXPECT_EQ(trie.ScanPrefix("", [](std::string_view, int value) {
+    EXPECT_EQ(value % 2, 1);
+  }),
+            static_cast<std::size_t>(kThreads * kKeys / 2));
+}
+
+// NOLINTNEXTLINE
+TEST(ShardedTrieTest, TopKMergesShards) {
+  for (auto sharding : {TrieSharding::kLeadingByte, TrieSharding::kHash}) {
+    ShardedTrie<Scored<int>> trie(4, sharding);
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(trie.Insert(std::to_string(i), {i % 100 * 1.0, i}));
+    }
+    auto topK = [&trie](std::string_view prefix) {
+      std::vector<int> found;
+      (void)trie.TopK(prefix,
+                      4,
+                      [&found](std::string_view, const Scored<int> &value) {
+                        found.push_back(value.value);
+                      });
+      return found;
+    };
+    // ties in key order: "199" < "299" < ... < "99".
+    EXPECT_EQ(topK(""), (std::vector<int>{199, 299, 399, 499}));
+    EXPECT_EQ(topK("9"), (std::vector<int>{99, 999, 98, 998}));
+    EXPECT_EQ(topK("x"), std::vector<int>{});
+  }
+}
@@ -0,0 +1,112 @@
+//===--- small_vector_test.cc - Test small_vector ---------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/small_vector_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/small_vector.hh"
+
+#include "gtest/gtest.h"
+#include <memory>
+#include <string>
+
+using namespace cdi::container;
+
+namespace {
+
+/// counts the live instances, to catch values leaked or destroyed twice.
+struct Counted {
+  explicit Counted(int value) : value(value) { ++live; }
+  Counted(const Counted &other) : value(other.value) { ++live; }
+  Counted(Counted &&other) noexcept : value(other.value) { ++live; }
+  auto
+  operator=(const Counted &) -> Counted & = default;
+  ~Counted() { --live; }
+
+  int value;
+  static inline int live = 0;
+};
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(SmallVectorTest, SpillsToHeap) {
+  small_vector<std::string, 4> strings{"a", "b", "c"};
+  EXPECT_TRUE(strings.is_inline());
+  EXPECT_EQ(strings.capacity(), 4U);
+  strings.push_back("d");
+  EXPECT_TRUE(strings.is_inline());
+  // the pushed value is an element of the vector it grows.
+  strings.push_back(strings.front());
+  EXPECT_FALSE(strings.is_inline());
+  EXPECT_EQ(strings.capacity(), 8U);
+  EXPECT_EQ(strings, (small_vector<std::string, 4>{"a", "b", "c", "d", "a"}));
+  EXPECT_EQ(strings.back(), "a");
+
+  strings.insert(strings.begin() + 1, "x");
+  strings.erase(strings.begin() + 3, strings.end() - 1);
+  EXPECT_EQ(strings, (small_vector<std::string, 4>{"a", "x", "b", "a"}));
+  strings.shrink_to_fit();
+  EXPECT_TRUE(strings.is_inline());
+  EXPECT_EQ(strings.get(1), "x");
+  EXPECT_THROW((void)strings.at(4), std::out_of_range);
+
+  strings.resize(6, "y");
+  EXPECT_EQ(strings[5], "y");
+  strings.resize(1);
+  strings.pop_back();
+  EXPECT_TRUE(strings.empty());
+
+  small_vector<std::unique_ptr<int>, 2> owners;
+  for (int i = 0; i < 5; ++i) {
+    owners.emplace_back(std::make_unique<int>(i));
+  }
+  EXPECT_EQ(*owners[4], 4);
+}
+
+// NOLINTNEXTLINE
+TEST(SmallVectorTest, CopyAndMove) {
+  {
+    small_vector<Counted, 3> few;
+    small_vector<Counted, 3> many;
+    for (int i = 0; i < 2; ++i) {
+      few.emplace_back(i);
+    }
+    for (int i = 0; i < 10; ++i) {
+      many.emplace_back(i);
+    }
+    EXPECT_EQ(Counted::live, 12);
+
+    auto fewCopy = few;
+    auto manyCopy = many;
+    EXPECT_EQ(Counted::live, 24);
+    EXPECT_FALSE(manyCopy.is_inline());
+
+    // a heap block changes hands, inline elements are moved one by one.
+    auto *block = many.data();
+    auto manyMoved = std::move(many);
+    EXPECT_EQ(manyMoved.data(), block);
+    EXPECT_TRUE(many.is_inline());
+    auto fewMoved = std::move(few);
+    EXPECT_TRUE(fewMoved.is_inline());
+    EXPECT_EQ(fewMoved.size(), 2U);
+    EXPECT_EQ(Counted::live, 24);
+
+    fewMoved.swap(manyMoved);
+    EXPECT_EQ(fewMoved.size(), 10U);
+    EXPECT_EQ(manyMoved.size(), 2U);
+    fewCopy = fewMoved;
+    EXPECT_EQ(fewCopy.size(), 10U);
+    manyCopy = std::move(manyMoved);
+    EXPECT_EQ(manyCopy.size(), 2U);
+    EXPECT_TRUE(manyCopy.is_inline());
+    EXPECT_EQ(Counted::live, 22);
+    fewCopy.clear();
+    EXPECT_EQ(Counted::live, 12);
+  }
+  EXPECT_EQ(Counted::live, 0);
+}
@@ -0,0 +1,117 @@
+//===------------------------------------------===
+// cdi 2023
+//
+// Identification: test/container/trie_key_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+//===------------------------------------------===
+
+#include "container/trie_key.hh"
+#include "container/trie.hh"
+#include <cmath>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(TrieKeyTest, OrderMatchesFields) {
+  using Fields = std::tuple<std::int32_t, std::string, double, std::uint16_t>;
+  std::mt19937 random(3);
+  std::vector<std::int32_t> ints = {std::numeric_limits<std::int32_t>::min(),
+                                    -70000, -1, 0, 1, 255, 256,
+                                    std::numeric_limits<std::int32_t>::max()};
+  std::vector<std::string> strings = {
+      "", std::string(1, '\0'), std::string("a\0", 2), "a", "ab", "b",
+      std::string("a\0b", 3), "\xff"};
+  std::vector<double> doubles = {-std::numeric_limits<double>::infinity(),
+                                 -2.5, -0.0, 0.0, 1e-300, 3.0, 1e300};
+  std::vector<Fields> fields;
+  for (int i = 0; i < 2000; ++i) {
+    fields.emplace_back(ints[random() % ints.size()],
+                        strings[random() % strings.size()],
+                        doubles[random() % doubles.size()],
+                        static_cast<std::uint16_t>(random()));
+  }
+  auto encode = [](const Fields &field) {
+    KeyEncoder<> encoder;
+    encoder.Append(std::get<0>(field))
+        .Append(std::get<1>(field))
+        .Append(std::get<2>(field))
+        .Append(std::get<3>(field));
+    return std::string(encoder.View());
+  };
+  for (std::size_t i = 1; i < fields.size(); ++i) {
+    const auto &lhs = fields[i - 1];
+    const auto &rhs = fields[i];
+    // -0.0 == 0.0 as a double, but not as a key.
+    if (std::get<2>(lhs) == 0.0 && std::get<2>(rhs) == 0.0) {
+      continue;
+    }
+    auto order = encode(lhs).compare(encode(rhs));
+    EXPECT_EQ(order < 0, lhs < rhs);
+    EXPECT_EQ(order == 0, lhs == rhs);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieKeyTest, DecodeRoundTrips) {
+  KeyEncoder<32> encoder;
+  encoder.Append(std::int64_t{-42})
+      .Append(std::string_view("x\0y", 3))
+      .Append(0.5F)
+      .Append(std::uint8_t{7})
+      .AppendRaw("tail");
+  KeyDecoder decoder(encoder);
+  EXPECT_EQ(decoder.Read<std::int64_t>().value_or(0), -42);
+  EXPECT_EQ(decoder.ReadString().value_or(""), std::string("x\0y", 3));
+  EXPECT_EQ(decoder.Read<float>().value_or(0), 0.5F);
+  EXPECT_EQ(decoder.Read<std::uint8_t>().value_or(0), 7);
+  EXPECT_EQ(decoder.Rest(), "tail");
+  EXPECT_FALSE(decoder.Read<std::uint64_t>().has_value());
+  EXPECT_FALSE(decoder.ReadString().has_value());
+  EXPECT_EQ(decoder.Rest(), "tail");
+
+  EXPECT_THROW(encoder.AppendRaw(std::string(32, 'z')), std::length_error);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieKeyTest, IndexesEncodedKeys) {
+  Trie<std::int64_t> trie;
+  for (std::int64_t id = -500; id < 500; id += 7) {
+    KeyEncoder<16> key;
+    key.Append(std::string_view("user")).Append(id);
+    EXPECT_TRUE(trie.Insert(key, id));
+  }
+
+  // a scan over the encoded ids comes out in numeric order.
+  KeyEncoder<16> lo;
+  lo.Append(std::string_view("user")).Append(std::int64_t{-100});
+  KeyEncoder<16> hi;
+  hi.Append(std::string_view("user")).Append(std::int64_t{100});
+  std::vector<std::int64_t> ids;
+  (void)trie.ScanRange(lo, hi, [&ids](std::string_view key, std::int64_t id) {
+    KeyDecoder decoder(key);
+    EXPECT_EQ(decoder.ReadString().value_or(""), "user");
+    EXPECT_EQ(decoder.Read<std::int64_t>().value_or(0), id);
+    ids.push_back(id);
+  });
+  ASSERT_FALSE(ids.empty());
+  EXPECT_EQ(ids.front(), -94);
+  EXPECT_EQ(ids.back(), 95);
+  EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+
+  // raw bytes straight from a buffer.
+  const std::uint8_t packet[] = {0x00, 0x80, 0xff, 0x01};
+  EXPECT_TRUE(trie.Insert(AsKey(packet, sizeof(packet)), 1));
+  EXPECT_EQ(trie.LookupMaybe(AsKey(packet, sizeof(packet))).value_or(0), 1);
+  EXPECT_FALSE(trie.Lookup(AsKey(packet, 3)));
+  EXPECT_TRUE(trie.Remove(AsKey(packet, sizeof(packet))));
+  EXPECT_FALSE(trie.Lookup(AsKey(packet, sizeof(packet))));
+}
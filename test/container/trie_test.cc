@@ -8,8 +8,17 @@
 //===------------------------------------------===
 
 #include "container/trie.hh"
+#include "port/port.hh"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace cdi::container;
 
@@ -59,3 +68,1243 @@ TEST(TrieTest, Lookup) {
   EXPECT_FALSE(trie.Lookup<int>("fooba"));
   EXPECT_FALSE(trie.Lookup<int>("foobaz"));
 }
+
+// NOLINTNEXTLINE
+TEST(TrieTest, RemovePrunesOrphans) {
+  Trie trie;
+  int value = 1;
+  EXPECT_TRUE(trie.Insert<int>("foo", value));
+  EXPECT_TRUE(trie.Insert<int>("foobar", value));
+  EXPECT_TRUE(trie.Remove("foobar"));
+  EXPECT_FALSE(trie.Remove("foob"));
+  EXPECT_TRUE(trie.Lookup<int>("foo"));
+  EXPECT_TRUE(trie.Remove("foo"));
+  EXPECT_FALSE(trie.Remove("f"));
+  EXPECT_FALSE(trie.Remove(""));
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ConcurrentDisjointWriters) {
+  constexpr static int kThreads = 8;
+  constexpr static int kKeysPerThread = 2000;
+  Trie trie;
+  auto keyOf = [](int thread, int index) {
+    return std::string(1, static_cast<char>('a' + thread)) + "/" +
+           std::to_string(index);
+  };
+
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&, thread]() {
+      for (int index = 0; index < kKeysPerThread; ++index) {
+        int value = index;
+        EXPECT_TRUE(trie.Insert<int>(keyOf(thread, index), value));
+      }
+      for (int index = 0; index < kKeysPerThread; index += 2) {
+        EXPECT_TRUE(trie.Remove(keyOf(thread, index)));
+      }
+    });
+  }
+  // readers race with the writers on the same paths.
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&, thread]() {
+      for (int index = 0; index < kKeysPerThread; ++index) {
+        auto result = trie.LookupMaybe<int>(keyOf(thread, index));
+        if (result) {
+          EXPECT_EQ(*result, index);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (int thread = 0; thread < kThreads; ++thread) {
+    for (int index = 0; index < kKeysPerThread; ++index) {
+      EXPECT_EQ(trie.LookupMaybe<int>(keyOf(thread, index)).has_value(),
+                index % 2 == 1);
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ConcurrentSharedPaths) {
+  constexpr static int kThreads = 8;
+  constexpr static int kRounds = 500;
+  Trie trie;
+  // all threads fight over the same chain, inserting and pruning it.
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&, thread]() {
+      auto mine = "shared/path/" + std::to_string(thread);
+      for (int round = 0; round < kRounds; ++round) {
+        int value = round;
+        EXPECT_TRUE(trie.Insert<int>(mine, value));
+        EXPECT_EQ(trie.LookupMaybe<int>(mine).value_or(-1), round);
+        EXPECT_TRUE(trie.Remove(mine));
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  EXPECT_FALSE(trie.Remove("shared"));
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, WideFanout) {
+  Trie trie;
+  // every byte value under one node, including '\0' and the negative chars.
+  for (int byte = 0; byte < 256; ++byte) {
+    std::string key = {'x', static_cast<char>(byte)};
+    int value = byte;
+    EXPECT_TRUE(trie.Insert<int>(key, value));
+  }
+  for (int byte = 0; byte < 256; ++byte) {
+    std::string key = {'x', static_cast<char>(byte)};
+    EXPECT_EQ(trie.LookupMaybe<int>(key).value_or(-1), byte);
+  }
+  for (int byte = 0; byte < 256; byte += 2) {
+    EXPECT_TRUE(trie.Remove(std::string{'x', static_cast<char>(byte)}));
+  }
+  for (int byte = 0; byte < 256; ++byte) {
+    std::string key = {'x', static_cast<char>(byte)};
+    EXPECT_EQ(trie.LookupMaybe<int>(key).has_value(), byte % 2 == 1);
+  }
+}
+
+static auto
+CountNodes(const Trie<> &trie) -> std::size_t {
+  std::stringstream out;
+  trie.Print(out);
+  std::size_t lines = 0;
+  for (std::string line; std::getline(out, line);) {
+    ++lines;
+  }
+  return lines;
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, PathCompression) {
+  Trie trie;
+  int value = 1;
+  EXPECT_TRUE(trie.Insert<int>("/api/v1/users/list", value));
+  EXPECT_EQ(CountNodes(trie), 2U);
+  EXPECT_TRUE(trie.Insert<int>("/api/v1/users/get", value));
+  EXPECT_TRUE(trie.Insert<int>("/api/v2/items", value));
+  // root, "/api/v", "1/users/", "list", "get", "2/items"
+  EXPECT_EQ(CountNodes(trie), 6U);
+  EXPECT_FALSE(trie.Lookup<int>("/api/v1/users/"));
+  EXPECT_FALSE(trie.Lookup<int>("/api/v1/users/lis"));
+  EXPECT_FALSE(trie.Lookup<int>("/api/v1/users/lists"));
+
+  // splitting in the middle of a label, with a value on the split node.
+  EXPECT_TRUE(trie.Insert<int>("/api/v1/us", value));
+  EXPECT_EQ(CountNodes(trie), 7U);
+  EXPECT_TRUE(trie.Lookup<int>("/api/v1/us"));
+
+  // merges keep it compressed.
+  EXPECT_TRUE(trie.Remove("/api/v1/us"));
+  EXPECT_EQ(CountNodes(trie), 6U);
+  EXPECT_TRUE(trie.Remove("/api/v1/users/get"));
+  EXPECT_EQ(CountNodes(trie), 4U);
+  EXPECT_TRUE(trie.Remove("/api/v2/items"));
+  EXPECT_EQ(CountNodes(trie), 2U);
+  EXPECT_TRUE(trie.Lookup<int>("/api/v1/users/list"));
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, MatchesOrderedMap) {
+  Trie trie;
+  std::map<std::string, int> expected;
+  std::mt19937 random(42);
+  // a tiny alphabet forces lots of splits and merges.
+  auto randomKey = [&random]() {
+    std::string key(1 + random() % 8, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 3);
+    }
+    return key;
+  };
+
+  for (int round = 0; round < 20000; ++round) {
+    auto key = randomKey();
+    if (random() % 3 == 0) {
+      trie.Remove(key);
+      expected.erase(key);
+    } else {
+      int value = round;
+      EXPECT_EQ(trie.Insert<int>(key, value),
+                expected.emplace(key, round).second);
+    }
+    auto probe = randomKey();
+    auto found = expected.find(probe);
+    EXPECT_EQ(trie.LookupMaybe<int>(probe).value_or(-1),
+              found == expected.end() ? -1 : found->second);
+  }
+  for (auto &[key, value] : expected) {
+    EXPECT_EQ(trie.LookupMaybe<int>(key).value_or(-1), value);
+  }
+  for (auto &[key, value] : expected) {
+    EXPECT_TRUE(trie.Remove(key));
+  }
+  EXPECT_EQ(CountNodes(trie), 1U);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ConcurrentSplitsAndMerges) {
+  constexpr static int kThreads = 6;
+  constexpr static int kRounds = 3000;
+  Trie trie;
+  // threads own disjoint keys that share prefixes, so their splits and merges
+  // hit the same nodes.
+  std::vector<std::map<std::string, int>> owned(kThreads);
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&, thread]() {
+      std::mt19937 random(thread);
+      auto &mine = owned[thread];
+      for (int round = 0; round < kRounds; ++round) {
+        std::string key(1 + random() % 6, 'a');
+        for (auto &keychar : key) {
+          keychar = static_cast<char>('a' + random() % 3);
+        }
+        key.push_back(static_cast<char>('0' + thread));
+        if (random() % 3 == 0) {
+          EXPECT_EQ(trie.LookupMaybe<int>(key).has_value(),
+                    mine.erase(key) == 1);
+          trie.Remove(key);
+        } else {
+          int value = round;
+          EXPECT_EQ(trie.Insert<int>(key, value),
+                    mine.emplace(key, round).second);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (auto &mine : owned) {
+    for (auto &[key, value] : mine) {
+      EXPECT_EQ(trie.LookupMaybe<int>(key).value_or(-1), value);
+      EXPECT_TRUE(trie.Remove(key));
+    }
+  }
+  EXPECT_EQ(CountNodes(trie), 1U);
+}
+
+namespace {
+
+/// counts the copies made of it.
+struct CopyCounter {
+  explicit CopyCounter(int *copies) : copies_(copies) {}
+  CopyCounter(const CopyCounter &other) : copies_(other.copies_) {
+    ++*copies_;
+  }
+  CopyCounter(CopyCounter &&other) noexcept = default;
+  auto operator=(const CopyCounter &other) -> CopyCounter & {
+    copies_ = other.copies_;
+    ++*copies_;
+    return *this;
+  }
+  auto operator=(CopyCounter &&other) noexcept -> CopyCounter & = default;
+
+  int *copies_;
+};
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieTest, TypedValuesInPlace) {
+  int copies = 0;
+  Trie<CopyCounter> trie;
+  EXPECT_TRUE(trie.Insert("foobar", CopyCounter(&copies)));
+  // a value on an existing navigator, and on a split point.
+  EXPECT_TRUE(trie.Insert("foo", CopyCounter(&copies)));
+  EXPECT_TRUE(trie.Insert("fo", CopyCounter(&copies)));
+  EXPECT_FALSE(trie.Insert("foo", CopyCounter(&copies)));
+
+  int visits = 0;
+  EXPECT_TRUE(trie.Visit("foo", [&visits](const CopyCounter &) { ++visits; }));
+  EXPECT_FALSE(trie.Visit("f", [&visits](const CopyCounter &) { ++visits; }));
+  EXPECT_EQ(visits, 1);
+  {
+    auto ref = trie.LookupRef("foobar");
+    ASSERT_TRUE(ref.has_value());
+    EXPECT_EQ((*ref)->copies_, &copies);
+  }
+  EXPECT_FALSE(trie.LookupRef("foob").has_value());
+  EXPECT_EQ(copies, 0);
+
+  EXPECT_TRUE(trie.Remove("foo"));
+  EXPECT_FALSE(trie.Visit("foo", [](const CopyCounter &) {}));
+  EXPECT_TRUE(trie.Visit("foobar", [](const CopyCounter &) {}));
+  EXPECT_EQ(copies, 0);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, UntypedChecksType) {
+  Trie trie;
+  int number = 42;
+  std::string text = "text";
+  EXPECT_TRUE(trie.Insert<int>("number", number));
+  EXPECT_TRUE(trie.Insert<std::string>("text", text));
+  EXPECT_EQ(trie.LookupMaybe<int>("number").value_or(-1), 42);
+  EXPECT_FALSE(trie.LookupMaybe<std::string>("number").has_value());
+  EXPECT_EQ(trie.LookupMaybe<std::string>("text").value_or(""), "text");
+  EXPECT_FALSE(trie.Lookup<int>("text"));
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ArenaMatchesOrderedMap) {
+  Trie<std::string, cdi::memory::ArenaAllocator> trie;
+  std::map<std::string, std::string> expected;
+  std::mt19937 random(7);
+  auto randomKey = [&random]() {
+    // long labels, so that they do not fit the small string buffer.
+    std::string key(1 + random() % 40, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 2);
+    }
+    return key;
+  };
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int round = 0; round < 5000; ++round) {
+      auto key = randomKey();
+      if (random() % 3 == 0) {
+        trie.Remove(key);
+        expected.erase(key);
+      } else {
+        EXPECT_EQ(trie.Insert(key, key + "!"),
+                  expected.emplace(key, key + "!").second);
+      }
+    }
+    for (auto &[key, value] : expected) {
+      EXPECT_EQ(trie.LookupMaybe(key).value_or(""), value);
+    }
+    trie.Clear();
+    expected.clear();
+    EXPECT_FALSE(trie.LookupMaybe(randomKey()).has_value());
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ScanPrefix) {
+  Trie<int> trie;
+  for (auto key : {"app", "apple", "apply", "apt", "banana", "ap\xff", "b"}) {
+    EXPECT_TRUE(trie.Insert(key, static_cast<int>(std::string(key).size())));
+  }
+  std::vector<std::string> keys;
+  auto collect = [&keys](std::string_view key, int) { keys.emplace_back(key); };
+
+  EXPECT_EQ(trie.ScanPrefix("ap", collect), 5U);
+  EXPECT_EQ(keys, (std::vector<std::string>{"app", "apple", "apply", "apt",
+                                            "ap\xff"}));
+  keys.clear();
+  // ends inside the "le" / "ly" labels.
+  EXPECT_EQ(trie.ScanPrefix("appl", collect), 2U);
+  EXPECT_EQ(keys, (std::vector<std::string>{"apple", "apply"}));
+  keys.clear();
+  EXPECT_EQ(trie.ScanPrefix("apx", collect), 0U);
+  EXPECT_EQ(trie.ScanPrefix("applesauce", collect), 0U);
+  EXPECT_EQ(trie.ScanPrefix("", collect, 3), 3U);
+  EXPECT_EQ(keys, (std::vector<std::string>{"app", "apple", "apply"}));
+  keys.clear();
+
+  // a visitor returning false stops the scan.
+  EXPECT_EQ(trie.ScanPrefix("", [&keys](std::string_view key, int) {
+    keys.emplace_back(key);
+    return key != "apt";
+  }), 4U);
+  EXPECT_EQ(keys.back(), "apt");
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ScanMatchesOrderedMap) {
+  Trie<int> trie;
+  std::map<std::string, int> expected;
+  std::mt19937 random(3);
+  auto randomKey = [&random]() {
+    std::string key(random() % 6, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 3);
+    }
+    return key;
+  };
+  for (int round = 0; round < 2000; ++round) {
+    auto key = randomKey();
+    if (!key.empty() && trie.Insert(key, round)) {
+      expected.emplace(key, round);
+    }
+  }
+
+  for (int round = 0; round < 500; ++round) {
+    auto lo = randomKey();
+    auto hi = randomKey();
+    std::size_t limit = random() % 2 == 0 ? Trie<int>::kNoLimit : random() % 20;
+    std::vector<std::pair<std::string, int>> want;
+    for (auto iter = expected.lower_bound(lo);
+         iter != expected.end() && iter->first < hi && want.size() < limit;
+         ++iter) {
+      want.emplace_back(*iter);
+    }
+    std::vector<std::pair<std::string, int>> got;
+    auto count = trie.ScanRange(
+        lo, hi, [&got](std::string_view key, int value) {
+          got.emplace_back(key, value);
+        }, limit);
+    EXPECT_EQ(count, got.size());
+    EXPECT_EQ(got, want) << "[" << lo << ", " << hi << ")";
+
+    want.clear();
+    got.clear();
+    for (auto iter = expected.lower_bound(lo);
+         iter != expected.end() && iter->first.compare(0, lo.size(), lo) == 0;
+         ++iter) {
+      want.emplace_back(*iter);
+    }
+    (void)trie.ScanPrefix(lo, [&got](std::string_view key, int value) {
+      got.emplace_back(key, value);
+    });
+    EXPECT_EQ(got, want) << lo;
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, UntypedScanFiltersType) {
+  Trie trie;
+  int number = 1;
+  std::string text = "text";
+  EXPECT_TRUE(trie.Insert<int>("a1", number));
+  EXPECT_TRUE(trie.Insert<std::string>("a2", text));
+  EXPECT_TRUE(trie.Insert<int>("a3", number));
+  std::vector<std::string> keys;
+  EXPECT_EQ(trie.ScanPrefix<int>("a", [&keys](std::string_view key, int) {
+    keys.emplace_back(key);
+  }), 2U);
+  EXPECT_EQ(keys, (std::vector<std::string>{"a1", "a3"}));
+  EXPECT_EQ(trie.ScanRange<int>("a2", "b", [](std::string_view, int) {}), 1U);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, BulkLoadMatchesInsert) {
+  std::mt19937 random(11);
+  std::vector<std::pair<std::string, int>> entries;
+  for (int i = 0; i < 30000; ++i) {
+    // a shared leading byte, so the partitioning has to go deeper.
+    entries.emplace_back("/" + std::to_string(random() % 20000), i);
+  }
+  entries.emplace_back("", -1);
+
+  Trie<int> trie;
+  EXPECT_TRUE(trie.Insert("/1", -2));
+  EXPECT_TRUE(trie.Insert("x", -3));
+  std::map<std::string, int> expected{{"/1", -2}, {"x", -3}};
+  for (auto &[key, value] : entries) {
+    if (!key.empty()) {
+      expected.emplace(key, value);
+    }
+  }
+
+  auto added = trie.BulkLoad(entries, 4);
+  EXPECT_EQ(added, expected.size() - 2);
+  std::vector<std::pair<std::string, int>> got;
+  (void)trie.ScanPrefix("", [&got](std::string_view key, int value) {
+    got.emplace_back(key, value);
+  });
+  EXPECT_EQ(got, (std::vector<std::pair<std::string, int>>(expected.begin(),
+                                                            expected.end())));
+
+  // the loaded trie splits and merges like any other.
+  Trie<int> empty;
+  std::map<std::string, int> loaded(entries.begin(), entries.end() - 1);
+  EXPECT_EQ(empty.BulkLoad(entries), loaded.size());
+  for (auto &[key, value] : loaded) {
+    EXPECT_EQ(empty.LookupMaybe(key).value_or(-1), value);
+    EXPECT_TRUE(empty.Remove(key));
+  }
+  EXPECT_EQ(empty.ScanPrefix("", [](std::string_view, int) {}), 0U);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, UntypedBulkLoad) {
+  Trie trie;
+  EXPECT_EQ(trie.BulkLoad<int>({{"b", 2}, {"a", 1}, {"a", 3}}), 2U);
+  EXPECT_EQ(trie.LookupMaybe<int>("a").value_or(-1), 1);
+  EXPECT_EQ(trie.LookupMaybe<int>("b").value_or(-1), 2);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, OptimisticMatchesOrderedMap) {
+  Trie<int, cdi::memory::ArenaAllocator> ints(TrieReadMode::kOptimistic);
+  Trie<std::string> strings(TrieReadMode::kOptimistic);
+  std::map<std::string, int> expected;
+  std::mt19937 random(11);
+  auto randomKey = [&random]() {
+    std::string key(1 + random() % 8, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 3);
+    }
+    return key;
+  };
+
+  for (int round = 0; round < 20000; ++round) {
+    auto key = randomKey();
+    if (random() % 3 == 0) {
+      ints.Remove(key);
+      strings.Remove(key);
+      expected.erase(key);
+    } else {
+      auto added = expected.emplace(key, round).second;
+      EXPECT_EQ(ints.Insert(key, round), added);
+      EXPECT_EQ(strings.Insert(key, std::to_string(round)), added);
+    }
+    auto probe = randomKey();
+    auto found = expected.find(probe);
+    auto want = found == expected.end() ? -1 : found->second;
+    EXPECT_EQ(ints.LookupMaybe(probe).value_or(-1), want);
+    EXPECT_EQ(strings.LookupMaybe(probe).value_or("-1"), std::to_string(want));
+  }
+  for (auto &[key, value] : expected) {
+    int found = -1;
+    EXPECT_TRUE(ints.Lookup(key, &found));
+    EXPECT_EQ(found, value);
+    auto ref = strings.LookupRef(key);
+    ASSERT_TRUE(ref.has_value());
+    EXPECT_EQ(**ref, std::to_string(value));
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, OptimisticReadersRaceWriters) {
+#if CDI_THREAD_SANITIZER
+  GTEST_SKIP() << "optimistic readers race with writers by design";
+#endif
+  constexpr static int kWriters = 3;
+  constexpr static int kReaders = 3;
+  constexpr static int kRounds = 20000;
+  Trie<int> ints(TrieReadMode::kOptimistic);
+  Trie<std::string> strings(TrieReadMode::kOptimistic);
+  // stable keys are never removed, while the writers split and merge the
+  // edges around them.
+  std::vector<std::string> stable;
+  for (int index = 0; index < 64; ++index) {
+    std::string key(1 + index % 5, 'a');
+    for (std::size_t pos = 0; pos < key.size(); ++pos) {
+      key[pos] = static_cast<char>('a' + (index >> pos) % 3);
+    }
+    key.push_back('.');
+    key.append(std::to_string(index));
+    stable.push_back(key);
+    EXPECT_TRUE(ints.Insert(key, index));
+    EXPECT_TRUE(strings.Insert(key, key));
+  }
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kWriters; ++thread) {
+    threads.emplace_back([&, thread]() {
+      std::mt19937 random(thread);
+      for (int round = 0; round < kRounds; ++round) {
+        std::string key(1 + random() % 6, 'a');
+        for (auto &keychar : key) {
+          keychar = static_cast<char>('a' + random() % 3);
+        }
+        if (random() % 2 == 0) {
+          ints.Remove(key);
+          strings.Remove(key);
+        } else {
+          ints.Insert(key, -1);
+          strings.Insert(key, key);
+        }
+      }
+    });
+  }
+  for (int thread = 0; thread < kReaders; ++thread) {
+    threads.emplace_back([&, thread]() {
+      std::mt19937 random(100 + thread);
+      while (!done.load()) {
+        auto index = random() % stable.size();
+        const auto &key = stable[index];
+        EXPECT_EQ(ints.LookupMaybe(key).value_or(-2),
+                  static_cast<int>(index));
+        EXPECT_TRUE(strings.Visit(
+            key, [&key](const std::string &found) { EXPECT_EQ(found, key); }));
+        // a churned key is there or not, but never with a foreign value.
+        auto churned = key.substr(0, key.find('.'));
+        EXPECT_EQ(ints.LookupMaybe(churned).value_or(-1), -1);
+        strings.Visit(churned, [&churned](const std::string &found) {
+          EXPECT_EQ(found, churned);
+        });
+        auto route = ints.LongestPrefix(key + "/x");
+        EXPECT_EQ(route.has_value() ? route->second : -2,
+                  static_cast<int>(index));
+        std::string batch[] = {key, churned};
+        cdi::constructor::Maybe<int> out[2];
+        (void)ints.LookupBatch(std::begin(batch), std::end(batch), out);
+        EXPECT_EQ(out[0].value_or(-2), static_cast<int>(index));
+        EXPECT_EQ(out[1].value_or(-1), -1);
+      }
+    });
+  }
+  for (int thread = 0; thread < kWriters; ++thread) {
+    threads[thread].join();
+  }
+  done.store(true);
+  for (int thread = kWriters; thread < kWriters + kReaders; ++thread) {
+    threads[thread].join();
+  }
+  for (std::size_t index = 0; index < stable.size(); ++index) {
+    EXPECT_EQ(ints.LookupMaybe(stable[index]).value_or(-2),
+              static_cast<int>(index));
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, LookupBatchMatchesLookup) {
+  for (auto mode : {TrieReadMode::kPessimistic, TrieReadMode::kOptimistic}) {
+    Trie<int> ints(mode);
+    Trie<std::string, cdi::memory::ArenaAllocator> strings(mode);
+    std::mt19937 random(5);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; ++i) {
+      std::string key(1 + random() % 10, 'a');
+      for (auto &keychar : key) {
+        keychar = static_cast<char>('a' + random() % 4);
+      }
+      keys.push_back(key);
+      if (random() % 2 == 0) {
+        (void)ints.Insert(key, i);
+        (void)strings.Insert(key, key);
+      }
+    }
+    keys.emplace_back("");
+
+    std::vector<cdi::constructor::Maybe<int>> intsOut(keys.size());
+    auto found = ints.LookupBatch(keys.begin(), keys.end(), intsOut.begin());
+    std::vector<cdi::constructor::Maybe<std::string>> stringsOut(keys.size());
+    EXPECT_EQ(strings.LookupBatch(keys.data(),
+                                  keys.data() + keys.size(),
+                                  stringsOut.data()),
+              found);
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      auto want = ints.LookupMaybe(keys[i]);
+      expected += want.has_value() ? 1 : 0;
+      EXPECT_EQ(intsOut[i].value_or(-1), want.value_or(-1));
+      EXPECT_EQ(stringsOut[i].value_or("-"),
+                strings.LookupMaybe(keys[i]).value_or("-"));
+    }
+    EXPECT_EQ(found, expected);
+  }
+
+  Trie trie;
+  int one = 1;
+  std::string two = "2";
+  (void)trie.Insert("one", one);
+  (void)trie.Insert("two", two);
+  std::vector<std::string_view> keys = {"one", "two", "three"};
+  std::vector<cdi::constructor::Maybe<int>> out(keys.size());
+  EXPECT_EQ(trie.LookupBatch<int>(keys.begin(), keys.end(), out.begin()), 1U);
+  EXPECT_EQ(out[0].value_or(-1), 1);
+  EXPECT_FALSE(out[1].has_value());
+  EXPECT_FALSE(out[2].has_value());
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, LongestPrefixMatch) {
+  for (auto mode : {TrieReadMode::kPessimistic, TrieReadMode::kOptimistic}) {
+    Trie<std::string> routes(mode);
+    for (const char *route : {"/", "/api", "/api/v1", "/api/v1/users",
+                              "/static/", "/apiary"}) {
+      EXPECT_TRUE(routes.Insert(route, std::string("handler ") + route));
+    }
+    auto longest = [&routes](std::string_view path) -> std::string {
+      auto found = routes.LongestPrefix(path);
+      return found ? std::string(found->first) : "-";
+    };
+    EXPECT_EQ(longest("/api/v1/users/42"), "/api/v1/users");
+    EXPECT_EQ(longest("/api/v1/user"), "/api/v1");
+    EXPECT_EQ(longest("/api/v2"), "/api");
+    EXPECT_EQ(longest("/apiar"), "/api");
+    EXPECT_EQ(longest("/static/app.js"), "/static/");
+    EXPECT_EQ(longest("/static"), "/");
+    EXPECT_EQ(longest("/"), "/");
+    EXPECT_EQ(longest("api"), "-");
+    EXPECT_EQ(longest(""), "-");
+    EXPECT_TRUE(routes.VisitLongestPrefix(
+        "/apiary/bees", [](std::string_view prefix, const std::string &value) {
+          EXPECT_EQ(prefix, "/apiary");
+          EXPECT_EQ(value, "handler /apiary");
+        }));
+
+    std::vector<std::string> prefixes;
+    EXPECT_EQ(routes.VisitPrefixes("/api/v1/users",
+                                   [&prefixes](std::string_view prefix,
+                                               const std::string &) {
+                                     prefixes.emplace_back(prefix);
+                                   }),
+              4U);
+    EXPECT_EQ(prefixes, (std::vector<std::string>{
+                            "/", "/api", "/api/v1", "/api/v1/users"}));
+    prefixes.clear();
+    EXPECT_EQ(routes.VisitPrefixes("/api/v1/users",
+                                   [&prefixes](std::string_view prefix,
+                                               const std::string &) {
+                                     prefixes.emplace_back(prefix);
+                                     return prefixes.size() < 2;
+                                   }),
+              2U);
+  }
+
+  // against probing every prefix, shortest to longest.
+  Trie<int> trie(TrieReadMode::kOptimistic);
+  std::mt19937 random(9);
+  auto randomKey = [&random]() {
+    std::string key(random() % 9, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 3);
+    }
+    return key;
+  };
+  for (int i = 0; i < 300; ++i) {
+    (void)trie.Insert(randomKey(), i);
+  }
+  for (int i = 0; i < 2000; ++i) {
+    auto key = randomKey();
+    int want = -1;
+    std::size_t wantLength = 0;
+    std::size_t count = 0;
+    for (std::size_t length = 1; length <= key.size(); ++length) {
+      if (auto found = trie.LookupMaybe(key.substr(0, length))) {
+        want = *found;
+        wantLength = length;
+        ++count;
+      }
+    }
+    auto found = trie.LongestPrefix(key);
+    EXPECT_EQ(found ? found->second : -1, want);
+    EXPECT_EQ(found ? found->first.size() : 0, wantLength);
+    EXPECT_EQ(trie.VisitPrefixes(key, [](std::string_view, int) {}), count);
+  }
+
+  Trie untyped;
+  int one = 1;
+  std::string two = "2";
+  (void)untyped.Insert("a", one);
+  (void)untyped.Insert("ab", two);
+  auto typed = untyped.LongestPrefix<int>("abc");
+  ASSERT_TRUE(typed.has_value());
+  EXPECT_EQ(typed->first, "a");
+  EXPECT_EQ(typed->second, 1);
+}
+
+namespace {
+
+using Ranked = std::vector<std::pair<std::string, double>>;
+
+/// the k best of the keys starting with prefix, as TopK orders them.
+auto
+BruteTopK(const std::map<std::string, double> &keys,
+          const std::string &prefix,
+          std::size_t k) -> Ranked {
+  Ranked all;
+  for (auto &[key, score] : keys) {
+    if (key.compare(0, prefix.size(), prefix) == 0) {
+      all.emplace_back(key, score);
+    }
+  }
+  std::stable_sort(all.begin(), all.end(), [](auto &lhs, auto &rhs) {
+    return lhs.second > rhs.second;
+  });
+  all.resize(std::min(k, all.size()));
+  return all;
+}
+
+auto
+TopKOf(const ScoredTrie<int> &trie, const std::string &prefix, std::size_t k)
+    -> Ranked {
+  Ranked found;
+  (void)trie.TopK(prefix,
+                  k,
+                  [&found](std::string_view key, const Scored<int> &value) {
+                    found.emplace_back(std::string(key), value.score);
+                  });
+  return found;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieTest, TopKMatchesBruteForce) {
+  ScoredTrie<int> trie;
+  std::map<std::string, double> expected;
+  std::mt19937 random(15);
+  auto randomKey = [&random]() {
+    std::string key(1 + random() % 7, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 4);
+    }
+    return key;
+  };
+  auto check = [&]() {
+    for (auto prefix : {"", "a", "ab", "abc", "d", "dddd", "x"}) {
+      for (std::size_t k : {1, 3, 10, 1000}) {
+        EXPECT_EQ(TopKOf(trie, prefix, k), BruteTopK(expected, prefix, k))
+            << prefix << " " << k;
+      }
+    }
+  };
+
+  std::vector<std::pair<std::string, Scored<int>>> batch;
+  for (int i = 0; i < 500; ++i) {
+    auto key = randomKey();
+    // few distinct scores, so ties are exercised.
+    double score = static_cast<double>(random() % 50);
+    batch.push_back({key, {score, i}});
+    expected.emplace(key, score);
+  }
+  (void)trie.BulkLoad(batch);
+  check();
+
+  for (int round = 0; round < 3000; ++round) {
+    auto key = randomKey();
+    if (random() % 2 == 0) {
+      double score = static_cast<double>(random() % 50);
+      EXPECT_EQ(trie.Insert(key, {score, round}),
+                expected.emplace(key, score).second);
+    } else {
+      (void)trie.Remove(key);
+      expected.erase(key);
+    }
+    if (round % 300 == 0) {
+      check();
+    }
+  }
+  check();
+
+  // the visitor can stop early.
+  std::size_t seen = 0;
+  EXPECT_EQ(trie.TopK("",
+                      10,
+                      [&seen](std::string_view, const Scored<int> &) {
+                        return ++seen < 4;
+                      }),
+            4U);
+  EXPECT_EQ(trie.TopK("", 0, [](std::string_view, const Scored<int> &) {}),
+            0U);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, TopKRacesWriters) {
+  // the "s" keys never change and outscore the churning "t" keys below them.
+  ScoredTrie<int> trie;
+  std::map<std::string, double> stable;
+  for (int i = 0; i < 64; ++i) {
+    auto key = "s" + std::to_string(i * 7919 % 1000);
+    stable.emplace(key, 1000.0 + i);
+    EXPECT_TRUE(trie.Insert(key, {1000.0 + i, i}));
+  }
+  auto want = BruteTopK(stable, "s", 10);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> writers;
+  for (int id = 0; id < 2; ++id) {
+    writers.emplace_back([&trie, &done, id]() {
+      std::mt19937 random(id);
+      while (!done.load()) {
+        // "s" paths are split and merged as well.
+        auto key = std::string(random() % 2 == 0 ? "s" : "t") +
+                   std::to_string(random() % 2000);
+        if (random() % 2 == 0) {
+          (void)trie.Insert(key, {static_cast<double>(random() % 1000), 0});
+        } else if (key[0] == 't' || key.size() > 4) {
+          (void)trie.Remove(key);
+        }
+      }
+    });
+  }
+  for (int round = 0; round < 2000; ++round) {
+    EXPECT_EQ(TopKOf(trie, "s", 10), want);
+    auto any = TopKOf(trie, "", 10);
+    EXPECT_EQ(any, want);
+  }
+  done.store(true);
+  for (auto &writer : writers) {
+    writer.join();
+  }
+}
+
+namespace {
+
+auto
+Levenshtein(const std::string &lhs, const std::string &rhs) -> std::size_t {
+  std::vector<std::size_t> row(rhs.size() + 1);
+  for (std::size_t j = 0; j <= rhs.size(); ++j) {
+    row[j] = j;
+  }
+  for (std::size_t i = 1; i <= lhs.size(); ++i) {
+    auto diagonal = row[0];
+    row[0] = i;
+    for (std::size_t j = 1; j <= rhs.size(); ++j) {
+      auto above = row[j];
+      row[j] = std::min({row[j] + 1,
+                         row[j - 1] + 1,
+                         diagonal + (lhs[i - 1] == rhs[j - 1] ? 0 : 1)});
+      diagonal = above;
+    }
+  }
+  return row[rhs.size()];
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieTest, FuzzyMatchesBruteForce) {
+  Trie<int> trie;
+  std::map<std::string, int> expected;
+  std::mt19937 random(17);
+  auto randomKey = [&random]() {
+    std::string key(1 + random() % 8, 'a');
+    for (auto &keychar : key) {
+      keychar = static_cast<char>('a' + random() % 4);
+    }
+    return key;
+  };
+  for (int i = 0; i < 2000; ++i) {
+    auto key = randomKey();
+    if (trie.Insert(key, i)) {
+      expected.emplace(key, i);
+    }
+  }
+
+  for (int round = 0; round < 200; ++round) {
+    auto query = round == 0 ? std::string() : randomKey();
+    for (std::size_t maxDistance : {0, 1, 2, 3}) {
+      // (distance, key), which is also the order of Fuzzy.
+      std::vector<std::pair<std::size_t, std::string>> want;
+      for (auto &[key, value] : expected) {
+        auto distance = Levenshtein(key, query);
+        if (distance <= maxDistance) {
+          want.emplace_back(distance, key);
+        }
+      }
+
+      std::vector<std::string> visited;
+      EXPECT_EQ(trie.VisitFuzzy(query,
+                                maxDistance,
+                                [&](std::string_view key,
+                                    std::size_t distance,
+                                    int value) {
+                                  EXPECT_EQ(distance,
+                                            Levenshtein(std::string(key),
+                                                        query));
+                                  EXPECT_EQ(value,
+                                            expected.at(std::string(key)));
+                                  visited.emplace_back(key);
+                                }),
+                want.size());
+      std::vector<std::string> wantKeys;
+      for (auto &[distance, key] : want) {
+        wantKeys.push_back(key);
+      }
+      std::sort(wantKeys.begin(), wantKeys.end());
+      EXPECT_EQ(visited, wantKeys);
+
+      std::sort(want.begin(), want.end());
+      for (std::size_t best : {1, 5, 1000}) {
+        auto found = trie.Fuzzy(query, maxDistance, best);
+        ASSERT_EQ(found.size(), std::min(best, want.size()));
+        for (std::size_t i = 0; i < found.size(); ++i) {
+          EXPECT_EQ(found[i].distance, want[i].first);
+          EXPECT_EQ(found[i].key, want[i].second);
+          EXPECT_EQ(found[i].value, expected.at(found[i].key));
+        }
+      }
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, UpsertUpdateCompareAndSwap) {
+  for (auto mode : {TrieReadMode::kPessimistic, TrieReadMode::kOptimistic}) {
+    Trie<int> trie(mode);
+    EXPECT_TRUE(trie.Upsert("counter", 1));
+    EXPECT_FALSE(trie.Upsert("counter", 5));
+    EXPECT_EQ(trie.LookupMaybe("counter").value_or(0), 5);
+
+    auto add = [](int &current, int &&value) { current += value; };
+    EXPECT_FALSE(trie.Upsert("counter", 2, add));
+    EXPECT_EQ(trie.LookupMaybe("counter").value_or(0), 7);
+    // "count" splits the edge, then gets its value merged in place.
+    EXPECT_TRUE(trie.Upsert("count", 3, add));
+    EXPECT_FALSE(trie.Upsert("count", 3, add));
+    EXPECT_EQ(trie.LookupMaybe("count").value_or(0), 6);
+    EXPECT_FALSE(trie.Upsert("", 1));
+
+    EXPECT_TRUE(trie.Update("counter", [](int &value) { value *= 10; }));
+    EXPECT_EQ(trie.LookupMaybe("counter").value_or(0), 70);
+    EXPECT_FALSE(trie.Update("cou", [](int &) { ADD_FAILURE(); }));
+    EXPECT_FALSE(trie.Update("counters", [](int &) { ADD_FAILURE(); }));
+    EXPECT_FALSE(trie.Update("", [](int &) { ADD_FAILURE(); }));
+
+    EXPECT_FALSE(trie.CompareAndSwap("counter", 69, 0));
+    EXPECT_TRUE(trie.CompareAndSwap("counter", 70, 71));
+    EXPECT_EQ(trie.LookupMaybe("counter").value_or(0), 71);
+    EXPECT_FALSE(trie.CompareAndSwap("missing", 0, 1));
+
+    // a key on the path only gets a value, without a new node.
+    EXPECT_TRUE(trie.Insert("counted", 1));
+    EXPECT_TRUE(trie.Remove("count"));
+    EXPECT_FALSE(trie.Update("count", [](int &) { ADD_FAILURE(); }));
+    EXPECT_TRUE(trie.Upsert("count", 9));
+    EXPECT_EQ(trie.LookupMaybe("count").value_or(0), 9);
+  }
+
+  // changes in place keep TopK right, up and down.
+  ScoredTrie<int> scored;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(scored.Insert("k" + std::to_string(i), {1.0 * i, i}));
+  }
+  auto best = [&scored](std::string_view prefix) {
+    int found = -1;
+    (void)scored.TopK(prefix, 1, [&found](std::string_view,
+                                          const Scored<int> &value) {
+      found = value.value;
+    });
+    return found;
+  };
+  EXPECT_EQ(best("k"), 99);
+  EXPECT_TRUE(scored.Update("k5", [](Scored<int> &value) {
+    value.score = 1000;
+  }));
+  EXPECT_EQ(best("k"), 5);
+  EXPECT_EQ(best("k5"), 5);
+  EXPECT_FALSE(scored.Upsert("k7", {1, 0}, [](auto &current, auto &&) {
+    current.score += 2000;
+  }));
+  EXPECT_EQ(best(""), 7);
+  EXPECT_TRUE(scored.CompareAndSwap("k7", *scored.LookupMaybe("k7"), {0, 7}));
+  EXPECT_FALSE(scored.Upsert("k5", {-1, 5}));
+  EXPECT_EQ(best("k"), 99);
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, ConcurrentCounters) {
+  constexpr static int kThreads = 4;
+  constexpr static int kRounds = 20000;
+  constexpr static std::size_t kKeys = 64;
+#if CDI_THREAD_SANITIZER
+  // optimistic descents race with writers by design.
+  for (auto mode : {TrieReadMode::kPessimistic}) {
+#else
+  for (auto mode : {TrieReadMode::kPessimistic, TrieReadMode::kOptimistic}) {
+#endif
+    Trie<long> trie(mode);
+    std::vector<std::thread> workers;
+    for (int id = 0; id < kThreads; ++id) {
+      workers.emplace_back([&trie, id]() {
+        std::mt19937 random(id);
+        for (int round = 0; round < kRounds; ++round) {
+          auto key = "/path/" + std::to_string(random() % kKeys);
+          if (round % 2 == 0) {
+            (void)trie.Upsert(key, 1, [](long &current, long &&value) {
+              current += value;
+            });
+          } else if (!trie.Update(key, [](long &value) { ++value; })) {
+            (void)trie.Upsert(key, 1, [](long &current, long &&value) {
+              current += value;
+            });
+          }
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    long total = 0;
+    EXPECT_EQ(trie.ScanPrefix("/path/",
+                              [&total](std::string_view, long value) {
+                                total += value;
+                              }),
+              kKeys);
+    EXPECT_EQ(total, kThreads * kRounds);
+  }
+}
+
+namespace {
+
+auto
+Contents(const Trie<int> &trie) -> std::map<std::string, int> {
+  std::map<std::string, int> contents;
+  (void)trie.ScanPrefix("", [&contents](std::string_view key, int value) {
+    contents.emplace(key, value);
+  });
+  return contents;
+}
+
+auto
+Contents(const TrieSnapshot<int, cdi::memory::HeapAllocator> &snapshot)
+    -> std::map<std::string, int> {
+  std::map<std::string, int> contents;
+  (void)snapshot.ScanPrefix("",
+                            [&contents](std::string_view key, int value) {
+                              contents.emplace(key, value);
+                            });
+  return contents;
+}
+
+/// the shape of the trie, which a compacted one shares with a fresh one.
+auto
+Shape(const Trie<int> &trie) -> std::string {
+  std::ostringstream out;
+  trie.Print(out);
+  return out.str();
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(TrieTest, SnapshotIsFrozen) {
+  Trie<int> trie;
+  for (const auto &[key, value] : std::map<std::string, int>{
+           {"a", 1}, {"ab", 2}, {"abc", 3}, {"b", 4}, {"bcd", 5}}) {
+    EXPECT_TRUE(trie.Insert(key, value));
+  }
+  auto before = Contents(trie);
+  auto snapshot = trie.Snapshot();
+
+  // a new leaf, a split, replaced and updated values, a removed leaf, a
+  // removal that would merge, a removed fork and a bulk load.
+  EXPECT_TRUE(trie.Insert("abd", 6));
+  EXPECT_TRUE(trie.Insert("bc", 7));
+  EXPECT_FALSE(trie.Upsert("a", 10));
+  EXPECT_TRUE(trie.Update("ab", [](int &value) { value += 20; }));
+  EXPECT_TRUE(trie.CompareAndSwap("b", 4, 40));
+  EXPECT_TRUE(trie.Remove("abc"));
+  EXPECT_TRUE(trie.Remove("bcd"));
+  EXPECT_TRUE(trie.Remove("a"));
+  EXPECT_EQ(trie.BulkLoad({{"x", 8}, {"y", 9}}), 2U);
+  auto after = Contents(trie);
+  EXPECT_EQ(after, (std::map<std::string, int>{
+                       {"ab", 22}, {"abd", 6}, {"b", 40}, {"bc", 7},
+                       {"x", 8}, {"y", 9}}));
+
+  EXPECT_EQ(Contents(snapshot), before);
+  for (const auto &[key, value] : before) {
+    EXPECT_EQ(snapshot.LookupMaybe(key), value) << key;
+  }
+  EXPECT_FALSE(snapshot.Lookup("abd"));
+  EXPECT_FALSE(snapshot.Lookup("x"));
+  int value = 0;
+  EXPECT_TRUE(snapshot.Lookup("abc", &value));
+  EXPECT_EQ(value, 3);
+  EXPECT_EQ(snapshot.ScanRange("ab", "b", [](std::string_view, int) {}), 2U);
+
+  // a later snapshot sees the changes, the earlier one still does not.
+  auto later = trie.Snapshot();
+  EXPECT_TRUE(trie.Remove("ab"));
+  EXPECT_TRUE(trie.Insert("a", 11));
+  EXPECT_EQ(Contents(later), after);
+  EXPECT_EQ(Contents(snapshot), before);
+
+  // moved handles stay open, dropping the last one compacts the trie.
+  auto moved = std::move(snapshot);
+  EXPECT_EQ(Contents(moved), before);
+  {
+    auto dropped = std::move(later);
+  }
+  EXPECT_EQ(Contents(moved), before);
+  moved = trie.Snapshot();
+  EXPECT_EQ(Contents(moved), Contents(trie));
+  {
+    auto dropped = std::move(moved);
+  }
+
+  Trie<int> fresh;
+  for (const auto &[key, value] : Contents(trie)) {
+    EXPECT_TRUE(fresh.Insert(key, value));
+  }
+  EXPECT_EQ(Shape(trie), Shape(fresh));
+}
+
+// NOLINTNEXTLINE
+TEST(TrieTest, SnapshotRacesWriters) {
+  constexpr static int kKeys = 200;
+  constexpr static int kReaders = 2;
+  constexpr static int kSnapshots = 200;
+  auto counter = [](int index) {
+    auto key = std::to_string(index);
+    return "k" + std::string(3 - key.size(), '0') + key;
+  };
+  auto churned = [](int index) {
+    auto key = std::to_string(index);
+    return "z" + std::string(8 - key.size(), '0') + key;
+  };
+  Trie<int> trie;
+  for (int i = 0; i < kKeys; ++i) {
+    EXPECT_TRUE(trie.Insert(counter(i), 0));
+  }
+  EXPECT_TRUE(trie.Insert(churned(0), 0));
+
+  // one writer bumps the counters in key order, generation by generation,
+  // so a consistent view never sees them go up along the keys. Another
+  // inserts the next churned key before it removes the last one.
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]() {
+    for (int generation = 1; !done.load(); ++generation) {
+      for (int i = 0; i < kKeys; ++i) {
+        (void)trie.Upsert(counter(i), generation);
+      }
+    }
+  });
+  threads.emplace_back([&]() {
+    for (int i = 1; !done.load(); ++i) {
+      (void)trie.Insert(churned(i), i);
+      (void)trie.Remove(churned(i - 1));
+    }
+  });
+  std::atomic<int> readersDone{0};
+  for (int id = 0; id < kReaders; ++id) {
+    threads.emplace_back([&]() {
+      for (int round = 0; round < kSnapshots; ++round) {
+        auto snapshot = trie.Snapshot();
+        std::vector<int> generations;
+        (void)snapshot.ScanPrefix("k", [&](std::string_view, int value) {
+          generations.push_back(value);
+        });
+        ASSERT_EQ(generations.size(), static_cast<std::size_t>(kKeys));
+        EXPECT_TRUE(std::is_sorted(generations.rbegin(), generations.rend()));
+        EXPECT_LE(generations.front() - generations.back(), 1);
+        EXPECT_EQ(snapshot.LookupMaybe(counter(kKeys / 2)),
+                  generations[kKeys / 2]);
+
+        std::vector<int> alive;
+        (void)snapshot.ScanPrefix("z", [&](std::string_view, int value) {
+          alive.push_back(value);
+        });
+        ASSERT_TRUE(alive.size() == 1 || alive.size() == 2) << alive.size();
+        EXPECT_EQ(alive.back() - alive.front() + 1,
+                  static_cast<int>(alive.size()));
+      }
+      readersDone.fetch_add(1);
+    });
+  }
+  while (readersDone.load() < kReaders) {
+    std::this_thread::yield();
+  }
+  done.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  Trie<int> fresh;
+  for (const auto &[key, value] : Contents(trie)) {
+    EXPECT_TRUE(fresh.Insert(key, value));
+  }
+  EXPECT_EQ(Shape(trie), Shape(fresh));
+}
@@ -0,0 +1,43 @@
+//===--- vector_test.cc - Test vector bounds checks -------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/container/vector_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "container/small_vector.hh"
+#include "container/vector.hh"
+
+#include "gtest/gtest.h"
+
+using namespace cdi::container;
+
+// NOLINTNEXTLINE
+TEST(VectorTest, CheckedReportsAndAborts) {
+  vector<int, BoundsCheck::kChecked> values{1, 2, 3};
+  EXPECT_EQ(values[2], 3);
+  EXPECT_EQ(values.back(), 3);
+  EXPECT_DEATH((void)values[3], "vector index out of bounds: 3 >= 3");
+  const vector<int, BoundsCheck::kChecked> empty;
+  EXPECT_DEATH((void)empty.front(), "vector index out of bounds: 0 >= 0");
+  // back() of an empty vector asks for index -1.
+  EXPECT_DEATH((void)empty.back(), "out of bounds: 18446744073709551615|"
+                                   "out of bounds: 4294967295");
+
+  small_vector<int, 2, BoundsCheck::kChecked> few{1};
+  EXPECT_DEATH((void)few.get(1), "small_vector index out of bounds: 1 >= 1");
+  few.pop_back();
+  EXPECT_DEATH(few.pop_back(), "small_vector index out of bounds");
+}
+
+// NOLINTNEXTLINE
+TEST(VectorTest, HardenedTraps) {
+  vector<int, BoundsCheck::kHardened> values{1, 2, 3};
+  EXPECT_EQ(values.get(0), 1);
+  EXPECT_DEATH((void)values[7], "");
+  small_vector<int, 2, BoundsCheck::kHardened> few;
+  EXPECT_DEATH((void)few.back(), "");
+}
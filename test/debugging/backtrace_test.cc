@@ -17,7 +17,21 @@ TEST(BacktraceTest, backtraceTest) {
   using namespace cdi::debugging;
   constexpr static int kMaxDepth = 10;
   auto frames = GetStackFrame({.maxDepth = kMaxDepth, .skipFrames = 0});
+  EXPECT_LE(frames.size(), static_cast<std::size_t>(kMaxDepth));
+  EXPECT_TRUE(frames.is_inline());
   for (auto &frame : frames) {
     std::cout << frame << std::endl;
   }
 }
+
+// NOLINTNEXTLINE
+TEST(BacktraceTest, NoFramesPastTheStack) {
+  using namespace cdi::debugging;
+  // asking for more than the stack holds must not pad with unfilled slots.
+  auto frames = GetStackFrame({.maxDepth = kMaxStackFrames, .skipFrames = 0});
+  EXPECT_GT(frames.size(), 0U);
+  EXPECT_LT(frames.size(), kMaxStackFrames);
+  for (auto &frame : frames) {
+    EXPECT_NE(frame, nullptr);
+  }
+}
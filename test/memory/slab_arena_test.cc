@@ -0,0 +1,106 @@
+//===--- slab_arena_test.cc - Test SlabArena --------------------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/memory/slab_arena_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "memory/slab_arena.hh"
+
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using cdi::memory::SlabArena;
+
+// NOLINTNEXTLINE
+TEST(SlabArenaTest, ReusesFreedBlocks) {
+  SlabArena arena;
+  std::vector<void *> blocks;
+  for (int i = 0; i < 1000; ++i) {
+    auto *block = arena.Allocate(40);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(block) % SlabArena::kAlignment,
+              0U);
+    std::memset(block, 0xab, 40);
+    blocks.push_back(block);
+  }
+  std::set<void *> distinct(blocks.begin(), blocks.end());
+  EXPECT_EQ(distinct.size(), blocks.size());
+
+  auto reserved = arena.BytesReserved();
+  for (auto *block : blocks) {
+    SlabArena::Deallocate(block);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(distinct.count(arena.Allocate(33)), 1U);
+  }
+  EXPECT_EQ(arena.BytesReserved(), reserved);
+}
+
+// NOLINTNEXTLINE
+TEST(SlabArenaTest, LargeBlocks) {
+  SlabArena arena;
+  auto *large = static_cast<char *>(arena.Allocate(3 * SlabArena::kSlabSize));
+  std::memset(large, 0xcd, 3 * SlabArena::kSlabSize);
+  EXPECT_GE(arena.BytesReserved(), 3 * SlabArena::kSlabSize);
+  SlabArena::Deallocate(large);
+  EXPECT_EQ(arena.BytesReserved(), 0U);
+
+  (void)arena.Allocate(SlabArena::kMaxSmallSize + 1);
+  (void)arena.Allocate(8);
+  arena.Release();
+  EXPECT_EQ(arena.BytesReserved(), 0U);
+}
+
+// NOLINTNEXTLINE
+TEST(SlabArenaTest, StlAllocator) {
+  SlabArena arena;
+  using ArenaString =
+      std::basic_string<char,
+                        std::char_traits<char>,
+                        cdi::memory::ArenaStlAllocator<char>>;
+  ArenaString text{cdi::memory::ArenaStlAllocator<char>(arena)};
+  text.assign(100, 'x');
+  EXPECT_GT(arena.BytesReserved(), 0U);
+  auto copy = text + "y";
+  EXPECT_EQ(copy.size(), 101U);
+  EXPECT_TRUE(copy.get_allocator() == text.get_allocator());
+}
+
+// NOLINTNEXTLINE
+TEST(SlabArenaTest, ConcurrentAllocateAndFree) {
+  SlabArena arena;
+  constexpr static int kThreads = 4;
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    workers.emplace_back([&arena, thread]() {
+      std::vector<void *> mine;
+      for (int round = 0; round < 20000; ++round) {
+        auto size = static_cast<std::size_t>(16 + (round * 7 + thread) % 500);
+        auto *block = static_cast<char *>(arena.Allocate(size));
+        block[0] = static_cast<char>(thread);
+        block[size - 1] = static_cast<char>(thread);
+        mine.push_back(block);
+        if (round % 3 == 0) {
+          SlabArena::Deallocate(mine[mine.size() / 2]);
+          mine[mine.size() / 2] = mine.back();
+          mine.pop_back();
+        }
+      }
+      for (auto *block : mine) {
+        EXPECT_EQ(static_cast<char *>(block)[0], static_cast<char>(thread));
+        SlabArena::Deallocate(block);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
@@ -0,0 +1,201 @@
+//===--- write_ahead_log_test.cc - Test WriteAheadLog -----------*- C++ -*-===//
+// cdi 2023
+//
+// Identification: test/storage/write_ahead_log_test.cc
+//
+// Author: Ji Wang <jiwangcdi@gmail.com>
+//
+// SPDX-License-Identifier: MIT
+//===----------------------------------------------------------------------===//
+
+#include "storage/write_ahead_log.hh"
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace cdi::storage;
+
+namespace {
+
+/// an empty directory of its own for the test.
+auto
+FreshDir(const std::string &name) -> std::string {
+  auto dir = testing::TempDir() + "write_ahead_log_test." + name;
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+auto
+ReplayAll(const std::string &dir, Lsn after = 0)
+    -> std::vector<std::pair<Lsn, std::string>> {
+  std::vector<std::pair<Lsn, std::string>> records;
+  (void)WriteAheadLog::Replay(
+      dir, after, [&records](Lsn lsn, std::string_view payload) {
+        records.emplace_back(lsn, payload);
+      });
+  return records;
+}
+
+auto
+Segments(const std::string &dir) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    auto name = entry.path().filename().string();
+    if (name.rfind("wal.", 0) == 0) {
+      names.push_back(entry.path().string());
+    }
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+} // namespace
+
+// NOLINTNEXTLINE
+TEST(WriteAheadLogTest, ReplaysInOrder) {
+  auto dir = FreshDir("replay");
+  {
+    WriteAheadLog log(dir, 1);
+    EXPECT_EQ(log.Last(), 0U);
+    EXPECT_EQ(log.Append("one"), 1U);
+    EXPECT_EQ(log.Append(""), 2U);
+    log.Commit(log.Append(std::string(100000, 'x')));
+    EXPECT_EQ(log.Last(), 3U);
+  }
+  auto records = ReplayAll(dir);
+  ASSERT_EQ(records.size(), 3U);
+  EXPECT_EQ(records[0], std::make_pair(Lsn{1}, std::string("one")));
+  EXPECT_EQ(records[1], std::make_pair(Lsn{2}, std::string()));
+  EXPECT_EQ(records[2].second.size(), 100000U);
+  EXPECT_EQ(ReplayAll(dir, 2).size(), 1U);
+
+  // a restart goes on numbering after the last record.
+  auto last = WriteAheadLog::Replay(dir, 0, [](Lsn, std::string_view) {});
+  EXPECT_EQ(last, 3U);
+  {
+    WriteAheadLog log(dir, last + 1);
+    EXPECT_EQ(log.Append("four"), 4U);
+  }
+  EXPECT_EQ(ReplayAll(dir).back(), std::make_pair(Lsn{4}, std::string("four")));
+}
+
+// NOLINTNEXTLINE
+TEST(WriteAheadLogTest, StopsAtTornTail) {
+  auto dir = FreshDir("torn");
+  {
+    WriteAheadLog log(dir, 1, false);
+    for (int i = 1; i <= 10; ++i) {
+      log.Commit(log.Append("record " + std::to_string(i)));
+    }
+  }
+  auto segments = Segments(dir);
+  ASSERT_EQ(segments.size(), 1U);
+  std::filesystem::resize_file(segments[0],
+                               std::filesystem::file_size(segments[0]) - 3);
+
+  auto last = WriteAheadLog::Replay(dir, 0, [](Lsn, std::string_view) {});
+  EXPECT_EQ(last, 9U);
+  {
+    WriteAheadLog log(dir, last + 1, false);
+    EXPECT_EQ(log.Append("again"), 10U);
+  }
+  auto records = ReplayAll(dir);
+  ASSERT_EQ(records.size(), 10U);
+  EXPECT_EQ(records[8].second, "record 9");
+  EXPECT_EQ(records[9].second, "again");
+}
+
+// NOLINTNEXTLINE
+TEST(WriteAheadLogTest, GroupCommit) {
+  constexpr static std::size_t kThreads = 8;
+  constexpr static std::size_t kRecords = 200;
+  auto dir = FreshDir("group");
+  WriteAheadLog log(dir, 1);
+  std::vector<std::thread> writers;
+  for (std::size_t thread = 0; thread < kThreads; ++thread) {
+    writers.emplace_back([&log]() {
+      for (std::size_t i = 0; i < kRecords; ++i) {
+        log.Commit(log.Append(std::string(64, 'r')));
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  std::cout << kThreads * kRecords << " commits, " << log.Syncs() << " syncs"
+            << std::endl;
+  EXPECT_LT(log.Syncs(), kThreads * kRecords);
+  EXPECT_GT(log.Syncs(), 0U);
+  auto records = ReplayAll(dir);
+  ASSERT_EQ(records.size(), kThreads * kRecords);
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(records[i].first, i + 1);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(WriteAheadLogTest, RotateAndTruncate) {
+  auto dir = FreshDir("rotate");
+  WriteAheadLog log(dir, 1, false);
+  for (int i = 0; i < 5; ++i) {
+    (void)log.Append("old");
+  }
+  EXPECT_EQ(log.Rotate(), 5U);
+  EXPECT_EQ(log.Rotate(), 5U); // nothing since, no empty segment.
+  for (int i = 0; i < 5; ++i) {
+    (void)log.Append("new");
+  }
+  log.Commit(log.Last());
+  EXPECT_EQ(Segments(dir).size(), 2U);
+
+  log.Truncate(4); // record 5 is still needed.
+  EXPECT_EQ(Segments(dir).size(), 2U);
+  log.Truncate(5);
+  EXPECT_EQ(Segments(dir).size(), 1U);
+  auto records = ReplayAll(dir);
+  ASSERT_EQ(records.size(), 5U);
+  EXPECT_EQ(records.front(), std::make_pair(Lsn{6}, std::string("new")));
+  log.Truncate(10); // never the current segment.
+  EXPECT_EQ(Segments(dir).size(), 1U);
+}
+
+// NOLINTNEXTLINE
+TEST(WriteAheadLogTest, Checkpoint) {
+  auto dir = FreshDir("checkpoint");
+  EXPECT_EQ(CheckpointWriter::Load(dir, [](std::string_view) { FAIL(); }),
+            0U);
+  {
+    CheckpointWriter writer(dir, 42);
+    for (int i = 0; i < 100000; ++i) {
+      writer.Add(std::to_string(i));
+    }
+    writer.Finish();
+  }
+  {
+    // abandoned: the finished one stays.
+    CheckpointWriter writer(dir, 50);
+    writer.Add("lost");
+  }
+  int next = 0;
+  EXPECT_EQ(CheckpointWriter::Load(dir,
+                                   [&next](std::string_view payload) {
+                                     EXPECT_EQ(payload, std::to_string(next));
+                                     ++next;
+                                   }),
+            42U);
+  EXPECT_EQ(next, 100000);
+
+  auto path = dir + "/checkpoint";
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  EXPECT_THROW(
+      (void)CheckpointWriter::Load(dir, [](std::string_view) {}),
+      std::runtime_error);
+}